@@ -0,0 +1,82 @@
+#include <cmc/arena.h>
+#include <cmc/buff.h>
+#include <cmc/packets.h>
+
+#include "bench.h"
+
+#define ITERATIONS 200000
+#define PROPERTIES 8
+#define METADATA_ENTRIES 16
+
+static cmc_buff *entity_properties_payload(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 1);
+  cmc_buff_pack_int(buff, PROPERTIES);
+  for (int i = 0; i < PROPERTIES; i++) {
+    cmc_buff_pack_string(buff, "generic.movementSpeed");
+    cmc_buff_pack_double(buff, 0.1);
+    cmc_buff_pack_varint(buff, 3);
+    for (int j = 0; j < 3; j++) {
+      cmc_buff_pack_double(buff, j);
+      cmc_buff_pack_byte(buff, 0);
+    }
+  }
+  return buff;
+}
+
+static cmc_buff *spawn_mob_payload(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 1);
+  cmc_buff_pack_byte(buff, 50);
+  for (int i = 0; i < 3; i++)
+    cmc_buff_pack_int(buff, i);
+  for (int i = 0; i < 3; i++)
+    cmc_buff_pack_byte(buff, i);
+  for (int i = 0; i < 3; i++)
+    cmc_buff_pack_short(buff, i);
+  for (int i = 0; i < METADATA_ENTRIES; i++) {
+    int type = i % 2 ? ENTITY_METADATA_ENTRY_TYPE_STRING
+                     : ENTITY_METADATA_ENTRY_TYPE_INT;
+    cmc_buff_pack_char(buff, type << 5 | i);
+    if (type == ENTITY_METADATA_ENTRY_TYPE_STRING)
+      cmc_buff_pack_string(buff, "Steve");
+    else
+      cmc_buff_pack_int(buff, i);
+  }
+  cmc_buff_pack_byte(buff, 127);
+  return buff;
+}
+
+#define BENCH_DECODE(packet_name, payload)                                     \
+  do {                                                                         \
+    cmc_buff *buff = payload();                                                \
+    cmc_arena *arena = cmc_arena_init(0);                                      \
+                                                                               \
+    uint64_t start = bench_now_ns();                                           \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      buff->position = 0;                                                      \
+      packet_name##_packet packet = unpack_##packet_name##_packet(buff);       \
+      BENCH_KEEP(&packet);                                                     \
+      cmc_free_##packet_name##_packet(&packet, &buff->err);                    \
+    }                                                                          \
+    bench_report("malloc " #packet_name, start, bench_now_ns(), ITERATIONS);   \
+                                                                               \
+    buff->arena = arena;                                                       \
+    start = bench_now_ns();                                                    \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      buff->position = 0;                                                      \
+      packet_name##_packet packet = unpack_##packet_name##_packet(buff);       \
+      BENCH_KEEP(&packet);                                                     \
+      cmc_arena_reset(arena);                                                  \
+    }                                                                          \
+    bench_report("arena " #packet_name, start, bench_now_ns(), ITERATIONS);    \
+                                                                               \
+    cmc_arena_free(arena);                                                     \
+    cmc_buff_free(buff);                                                       \
+  } while (0)
+
+int main() {
+  BENCH_DECODE(S2C_play_entity_properties, entity_properties_payload);
+  BENCH_DECODE(S2C_play_spawn_mob, spawn_mob_payload);
+  return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// keeps the compiler from optimizing a benchmarked value away
+#define BENCH_KEEP(value) __asm__ volatile("" : : "r"(value) : "memory")
+
+static inline void bench_report(const char *name, uint64_t start_ns,
+                                uint64_t end_ns, uint64_t ops) {
+  printf("%-40s %10.2f ns/op\n", name, (double)(end_ns - start_ns) / ops);
+}
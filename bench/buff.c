@@ -0,0 +1,121 @@
+#include <cmc/buff.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define ITERATIONS 1000000
+#define VALUES_PER_BUFF 1024
+
+// the unpack path before borrowed views, a malloced copy per read
+#define COPY_READ(type, buff)                                                  \
+  ({                                                                           \
+    void *data = cmc_buff_unpack(buff, sizeof(type));                          \
+    type result;                                                               \
+    memcpy(&result, data, sizeof(type));                                       \
+    free(data);                                                                \
+    result;                                                                    \
+  })
+
+#define BENCH_TYPE(name, type)                                                 \
+  do {                                                                         \
+    cmc_buff *buff = cmc_buff_init(47);                                        \
+    for (int i = 0; i < VALUES_PER_BUFF; ++i)                                  \
+      cmc_buff_write_##name(buff, (type)i);                                    \
+                                                                               \
+    uint64_t start = bench_now_ns();                                           \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      if (i % VALUES_PER_BUFF == 0)                                            \
+        buff->position = 0;                                                    \
+      type v = cmc_buff_read_##name(buff);                                     \
+      BENCH_KEEP(v);                                                           \
+    }                                                                          \
+    bench_report("cmc_buff_read_" #name, start, bench_now_ns(), ITERATIONS);   \
+                                                                               \
+    start = bench_now_ns();                                                    \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      if (i % VALUES_PER_BUFF == 0)                                            \
+        buff->position = 0;                                                    \
+      type v = cmc_buff_unpack_##name(buff);                                   \
+      BENCH_KEEP(v);                                                           \
+    }                                                                          \
+    bench_report("cmc_buff_unpack_" #name, start, bench_now_ns(),              \
+                 ITERATIONS);                                                  \
+                                                                               \
+    start = bench_now_ns();                                                    \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      if (i % VALUES_PER_BUFF == 0)                                            \
+        buff->position = 0;                                                    \
+      type v = COPY_READ(type, buff);                                          \
+      BENCH_KEEP(v);                                                           \
+    }                                                                          \
+    bench_report("malloced copy " #name, start, bench_now_ns(), ITERATIONS);   \
+                                                                               \
+    start = bench_now_ns();                                                    \
+    for (int i = 0; i < ITERATIONS; ++i) {                                     \
+      if (i % VALUES_PER_BUFF == 0)                                            \
+        buff->length = 0;                                                      \
+      cmc_buff_write_##name(buff, (type)i);                                    \
+    }                                                                          \
+    bench_report("cmc_buff_write_" #name, start, bench_now_ns(), ITERATIONS);  \
+    cmc_buff_free(buff);                                                       \
+  } while (0)
+
+static void bench_string(const char *name, const char *str) {
+  cmc_buff *buff = cmc_buff_init(47);
+  for (int i = 0; i < VALUES_PER_BUFF; ++i)
+    cmc_buff_pack_string(buff, str);
+  char title[64];
+
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < ITERATIONS; ++i) {
+    if (i % VALUES_PER_BUFF == 0)
+      buff->position = 0;
+    char *str = cmc_buff_unpack_string(buff);
+    BENCH_KEEP(str);
+    cmc_string_free(str);
+  }
+  snprintf(title, sizeof(title), "cmc_buff_unpack_string %s", name);
+  bench_report(title, start, bench_now_ns(), ITERATIONS);
+
+  start = bench_now_ns();
+  for (int i = 0; i < ITERATIONS; ++i) {
+    if (i % VALUES_PER_BUFF == 0)
+      buff->position = 0;
+    cmc_string_view str = cmc_buff_unpack_string_view(buff);
+    BENCH_KEEP(str.data);
+  }
+  snprintf(title, sizeof(title), "cmc_buff_unpack_string_view %s", name);
+  bench_report(title, start, bench_now_ns(), ITERATIONS);
+  cmc_buff_free(buff);
+}
+
+static void bench_strings(void) {
+  bench_string("chat",
+               "{\"text\":\"<Steve> has anyone seen my diamond pickaxe\"}");
+  bench_string("utf8 chat", "{\"text\":\"<J\xc3\xbcrgen> gr\xc3\xbc\xc3\x9f "
+                            "dich \xe2\x9c\x8c \xf0\x9f\x98\x80\"}");
+
+  // a status response sized string
+  static char status[4096];
+  memset(status, 'x', sizeof(status) - 1);
+  memcpy(status, "{\"description\":\"", 16);
+  bench_string("4k status", status);
+}
+
+int main() {
+  BENCH_TYPE(char, char);
+  BENCH_TYPE(byte, uint8_t);
+  BENCH_TYPE(short, int16_t);
+  BENCH_TYPE(ushort, uint16_t);
+  BENCH_TYPE(int, int32_t);
+  BENCH_TYPE(uint, uint32_t);
+  BENCH_TYPE(long, int64_t);
+  BENCH_TYPE(ulong, uint64_t);
+  BENCH_TYPE(float, float);
+  BENCH_TYPE(double, double);
+  bench_strings();
+  return 0;
+}
@@ -0,0 +1,320 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+Inflates and deflates the chunk packets of a real session through cmc_conn.
+Build once with and once without CMC_USE_LIBDEFLATE to compare the two.
+Usage: compress_bench [capture.pcapng]
+
+The capture is a 1.20.4 (765) session, so chunk traffic is
+chunk_data_and_update_light (play 0x25). It contains no 1.8 map_chunk_bulk.
+*/
+
+#define CHUNK_DATA_765 0x25
+#define MC_PORT 25565
+#define ROUNDS 5
+// below the default unix socket buffer, so a batch never blocks the writer
+#define BATCH_BYTES (64 * 1024)
+
+typedef struct {
+  uint16_t port; // client side port, one stream per connection
+  uint32_t seq;
+  const uint8_t *data;
+  size_t length;
+} segment;
+
+typedef struct {
+  uint8_t **frames; // length prefixed, as they were on the wire
+  size_t *lengths;
+  cmc_buff **bodies; // the same packets decompressed
+  size_t count;
+  size_t capacity;
+  size_t wire_bytes;
+  size_t body_bytes;
+} chunk_set;
+
+static uint8_t *read_file(const char *path, size_t *length) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  *length = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = malloc(*length);
+  if (fread(data, 1, *length, f) != *length) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  return data;
+}
+
+static uint32_t be16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+static uint32_t be32(const uint8_t *p) { return be16(p) << 16 | be16(p + 2); }
+
+// server to client tcp payloads of every ethernet/ipv4 packet in the capture
+static segment *parse_pcapng(const uint8_t *data, size_t length,
+                             size_t *count) {
+  segment *segments = NULL;
+  size_t capacity = 0;
+  *count = 0;
+  for (size_t off = 0; off + 12 <= length;) {
+    uint32_t type, block_length;
+    memcpy(&type, data + off, 4);
+    memcpy(&block_length, data + off + 4, 4);
+    if (block_length < 12 || off + block_length > length)
+      break;
+    // enhanced packet block, the interface is assumed to be ethernet
+    if (type == 6) {
+      uint32_t captured;
+      memcpy(&captured, data + off + 20, 4);
+      const uint8_t *eth = data + off + 28;
+      const uint8_t *ip = eth + 14;
+      if (captured > 14 + 20 && be16(eth + 12) == 0x0800 && ip[9] == 6) {
+        size_t ip_length = be16(ip + 2);
+        const uint8_t *tcp = ip + (ip[0] & 0xF) * 4;
+        size_t header = ip - eth + (tcp - ip) + (tcp[12] >> 4) * 4;
+        if (be16(tcp) == MC_PORT && ip_length + 14 > header &&
+            ip_length + 14 <= captured) {
+          if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            segments = realloc(segments, capacity * sizeof(segment));
+          }
+          segments[(*count)++] =
+              (segment){.port = be16(tcp + 2),
+                        .seq = be32(tcp + 4),
+                        .data = eth + header,
+                        .length = ip_length + 14 - header};
+        }
+      }
+    }
+    off += block_length;
+  }
+  return segments;
+}
+
+static int compare_segments(const void *a, const void *b) {
+  const segment *x = a, *y = b;
+  if (x->port != y->port)
+    return x->port - y->port;
+  int32_t diff = x->seq - y->seq;
+  return (diff > 0) - (diff < 0);
+}
+
+static bool read_varint(const uint8_t *data, size_t length, size_t *pos,
+                        uint32_t *value) {
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (*pos >= length)
+      return false;
+    uint8_t byte = data[(*pos)++];
+    *value |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+/*
+Decodes one reassembled stream through a cmc_conn and keeps the chunk
+packets. Compression starts with the login set_compression packet.
+*/
+static void collect_chunks(const uint8_t *stream, size_t length,
+                           chunk_set *set) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  bool compressed = false;
+
+  uint32_t frame_length;
+  for (size_t start = 0, pos = 0;
+       read_varint(stream, length, &pos, &frame_length) &&
+       pos + frame_length <= length;
+       start = pos) {
+    const uint8_t *frame = stream + pos;
+    pos += frame_length;
+    if (!compressed) {
+      // login set_compression, nothing before it is interesting
+      if (frame_length > 0 && frame[0] == 0x03) {
+        compressed = true;
+        conn.compression_threshold = 0;
+      }
+      continue;
+    }
+
+    write(sv[1], stream + start, pos - start);
+    cmc_buff *body = cmc_conn_recive_packet(&conn);
+    if (!body)
+      break;
+    if (body->length == 0 || body->data[0] != CHUNK_DATA_765) {
+      cmc_buff_free(body);
+      continue;
+    }
+    if (set->count == set->capacity) {
+      set->capacity = set->capacity ? set->capacity * 2 : 256;
+      set->frames = realloc(set->frames, set->capacity * sizeof(uint8_t *));
+      set->lengths = realloc(set->lengths, set->capacity * sizeof(size_t));
+      set->bodies = realloc(set->bodies, set->capacity * sizeof(cmc_buff *));
+    }
+    set->frames[set->count] = malloc(pos - start);
+    memcpy(set->frames[set->count], stream + start, pos - start);
+    set->lengths[set->count] = pos - start;
+    set->bodies[set->count] = body;
+    set->count++;
+    set->wire_bytes += pos - start;
+    set->body_bytes += body->length;
+  }
+  cmc_conn_close(&conn);
+  close(sv[1]);
+}
+
+static bool load_chunks(const char *path, chunk_set *set) {
+  size_t length;
+  uint8_t *data = read_file(path, &length);
+  if (!data)
+    return false;
+  size_t count;
+  segment *segments = parse_pcapng(data, length, &count);
+  qsort(segments, count, sizeof(segment), compare_segments);
+
+  uint8_t *stream = malloc(length);
+  for (size_t i = 0; i < count;) {
+    // concatenates one connection, dropping retransmitted bytes
+    size_t stream_length = 0;
+    uint32_t base = segments[i].seq;
+    uint16_t port = segments[i].port;
+    for (; i < count && segments[i].port == port; i++) {
+      size_t offset = segments[i].seq - base;
+      if (offset > stream_length)
+        break; // lost segment, the rest of the stream can't be framed
+      if (offset + segments[i].length <= stream_length)
+        continue;
+      size_t skip = stream_length - offset;
+      memcpy(stream + stream_length, segments[i].data + skip,
+             segments[i].length - skip);
+      stream_length += segments[i].length - skip;
+    }
+    while (i < count && segments[i].port == port)
+      i++;
+    collect_chunks(stream, stream_length, set);
+  }
+  free(stream);
+  free(segments);
+  free(data);
+  return set->count > 0;
+}
+
+static void report(const char *name, uint64_t ns, size_t packets,
+                   size_t bytes) {
+  bench_report(name, 0, ns, packets);
+  printf("%-40s %10.2f MB/s decompressed\n", "", bytes / (ns / 1e9) / 1e6);
+}
+
+/*
+With filtered set the connection only wants MARKER_ID, which ends every batch
+uncompressed, so the chunk packets are dropped after peeking at their id.
+*/
+#define MARKER_ID 0x7F
+
+static void bench_inflate(const chunk_set *set, bool filtered) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  conn.compression_threshold = 0;
+  if (filtered)
+    cmc_conn_want_packet(&conn, MARKER_ID);
+  const uint8_t marker[] = {2, 0, MARKER_ID};
+
+  uint64_t total = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    for (size_t i = 0; i < set->count;) {
+      size_t batch_start = i, batch_bytes = 0;
+      for (; i < set->count && batch_bytes < BATCH_BYTES; i++) {
+        write(sv[1], set->frames[i], set->lengths[i]);
+        batch_bytes += set->lengths[i];
+      }
+      if (filtered)
+        write(sv[1], marker, sizeof(marker));
+      // only the decoding is timed, not the writes feeding it
+      uint64_t start = bench_now_ns();
+      size_t packets = filtered ? 1 : i - batch_start;
+      for (size_t j = 0; j < packets; j++) {
+        cmc_buff *buff = cmc_conn_recive_packet(&conn);
+        BENCH_KEEP(buff);
+        cmc_buff_free(buff);
+      }
+      total += bench_now_ns() - start;
+    }
+  }
+  report(filtered ? "skip unwanted chunk_data" : "inflate chunk_data", total,
+         ROUNDS * set->count, ROUNDS * set->body_bytes);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+}
+
+static void bench_deflate(const chunk_set *set) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  pid_t reader = fork();
+  if (reader == 0) {
+    close(sv[1]);
+    uint8_t bytes[64 * 1024];
+    while (read(sv[0], bytes, sizeof(bytes)) > 0)
+      ;
+    _exit(0);
+  }
+  close(sv[0]);
+
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[1];
+  conn.state = CMC_CONN_STATE_PLAY;
+  conn.compression_threshold = 256;
+
+  uint64_t start = bench_now_ns();
+  for (int round = 0; round < ROUNDS; round++)
+    for (size_t i = 0; i < set->count; i++)
+      cmc_conn_send_packet(&conn, set->bodies[i]);
+  uint64_t end = bench_now_ns();
+  report("deflate chunk_data", end - start, ROUNDS * set->count,
+         ROUNDS * set->body_bytes);
+
+  cmc_conn_close(&conn);
+  waitpid(reader, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+  const char *path = argc > 1 ? argv[1] : CMC_BENCH_CAPTURE;
+  chunk_set set = {};
+  if (!load_chunks(path, &set)) {
+    printf("no chunk packets found in %s\n", path);
+    return 1;
+  }
+  printf("%zu chunk_data packets, %zu bytes on the wire, %zu inflated\n",
+         set.count, set.wire_bytes, set.body_bytes);
+
+  bench_inflate(&set, false);
+  bench_inflate(&set, true);
+  bench_deflate(&set);
+
+  for (size_t i = 0; i < set.count; i++) {
+    free(set.frames[i]);
+    cmc_buff_free(set.bodies[i]);
+  }
+  free(set.frames);
+  free(set.lengths);
+  free(set.bodies);
+  return 0;
+}
@@ -0,0 +1,183 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define PACKETS 200000
+
+// roughly a player_position_and_look packet
+static cmc_buff *movement_packet(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x06);
+  for (int i = 0; i < 3; i++)
+    cmc_buff_pack_double(buff, i * 1.5);
+  cmc_buff_pack_float(buff, 90.0f);
+  cmc_buff_pack_float(buff, 0.0f);
+  cmc_buff_pack_bool(buff, true);
+  return buff;
+}
+
+// a chat message above the compression threshold used below
+static cmc_buff *chat_packet(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x02);
+  cmc_buff_pack_string(
+      buff, "{\"extra\":[{\"color\":\"gold\",\"text\":\"[Server] \"},{\"text\":"
+            "\"Welcome to the server, please read the rules before you start "
+            "building. Griefing, hacking and spamming the chat will get you "
+            "banned without a warning.\"}],\"text\":\"\"}");
+  cmc_buff_pack_byte(buff, 0);
+  return buff;
+}
+
+static void bench_send(const char *name, size_t cork_bytes) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  pid_t reader = fork();
+  if (reader == 0) {
+    close(sv[1]);
+    uint8_t bytes[64 * 1024];
+    while (read(sv[0], bytes, sizeof(bytes)) > 0)
+      ;
+    _exit(0);
+  }
+  close(sv[0]);
+
+  cmc_conn conn = cmc_conn_init(47);
+  conn.sockfd = sv[1];
+  conn.state = CMC_CONN_STATE_PLAY;
+  if (cork_bytes)
+    cmc_conn_cork(&conn, cork_bytes, 0);
+  cmc_buff *buff = movement_packet();
+
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < PACKETS; i++)
+    cmc_conn_send_packet(&conn, buff);
+  cmc_conn_flush(&conn);
+  uint64_t end = bench_now_ns();
+  bench_report(name, start, end, PACKETS);
+
+  cmc_buff_free(buff);
+  cmc_conn_close(&conn);
+  waitpid(reader, NULL, 0);
+}
+
+/*
+With latency_stats every received packet is also timed through the stages
+of cmc_conn_stage, the difference is what the clock reads cost.
+*/
+static void bench_compressed(bool latency_stats) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  // large enough to hold every frame, so sending never waits for the reader
+  int size = 16 * 1024 * 1024;
+  setsockopt(sv[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  setsockopt(sv[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  cmc_conn writer = cmc_conn_init(47);
+  writer.sockfd = sv[1];
+  writer.state = CMC_CONN_STATE_PLAY;
+  writer.compression_threshold = 64;
+  cmc_conn reader = cmc_conn_init(47);
+  reader.sockfd = sv[0];
+  reader.state = CMC_CONN_STATE_PLAY;
+  reader.compression_threshold = 64;
+  if (latency_stats)
+    cmc_conn_enable_latency_stats(&reader);
+  cmc_buff *buff = chat_packet();
+
+  for (int round = 0; round < 5; round++) {
+    enum { BATCH = 2000 };
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < BATCH; i++)
+      cmc_conn_send_packet(&writer, buff);
+    uint64_t sent = bench_now_ns();
+    for (int i = 0; i < BATCH; i++) {
+      cmc_buff *packet = cmc_conn_recive_packet(&reader);
+      BENCH_KEEP(packet);
+      cmc_buff_free(packet);
+    }
+    uint64_t received = bench_now_ns();
+    if (round == 4 && latency_stats) {
+      bench_report("recive compressed chat, latency stats", sent, received,
+                   BATCH);
+    } else if (round == 4) {
+      bench_report("send compressed chat", start, sent, BATCH);
+      bench_report("recive compressed chat", sent, received, BATCH);
+    }
+  }
+  if (latency_stats) {
+    const cmc_histogram *inflate =
+        &cmc_conn_get_latency(&reader)->stages[CMC_CONN_STAGE_INFLATE];
+    printf("  inflate p50 %llu ns, p99 %llu ns, max %llu ns\n",
+           (unsigned long long)cmc_histogram_percentile(inflate, 50),
+           (unsigned long long)cmc_histogram_percentile(inflate, 99),
+           (unsigned long long)cmc_histogram_max(inflate));
+  }
+
+  cmc_buff_free(buff);
+  cmc_conn_close(&writer);
+  cmc_conn_close(&reader);
+}
+
+/*
+Sends and receives 8 KB packets over a socketpair on one thread, so the rate
+is what a single core gets through including the cipher on both ends.
+*/
+static void bench_throughput(const char *name, bool encrypted) {
+  enum { PACKET_BYTES = 8 * 1024, BATCH = 8, TOTAL_MB = 256 };
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn writer = cmc_conn_init(47);
+  writer.sockfd = sv[1];
+  writer.state = CMC_CONN_STATE_PLAY;
+  cmc_conn reader = cmc_conn_init(47);
+  reader.sockfd = sv[0];
+  reader.state = CMC_CONN_STATE_PLAY;
+  if (encrypted) {
+    const uint8_t secret[CMC_CONN_SHARED_SECRET_LENGTH] = {0x5A};
+    cmc_conn_enable_encryption(&writer, secret);
+    cmc_conn_enable_encryption(&reader, secret);
+  }
+
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x21);
+  while (buff->length - buff->position < PACKET_BYTES)
+    cmc_buff_pack_long(buff, buff->length * 0x9E3779B97F4A7C15);
+
+  size_t packets = (size_t)TOTAL_MB * 1024 * 1024 / PACKET_BYTES;
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < packets; i += BATCH) {
+    for (int j = 0; j < BATCH; j++)
+      cmc_conn_send_packet(&writer, buff);
+    for (int j = 0; j < BATCH; j++) {
+      cmc_buff *packet = cmc_conn_recive_packet(&reader);
+      BENCH_KEEP(packet);
+      cmc_buff_free(packet);
+    }
+  }
+  uint64_t end = bench_now_ns();
+  printf("%-40s %10.2f MB/s\n", name, TOTAL_MB / ((end - start) / 1e9));
+
+  cmc_buff_free(buff);
+  cmc_conn_close(&writer);
+  cmc_conn_close(&reader);
+}
+
+int main() {
+  bench_send("send movement uncorked", 0);
+  bench_send("send movement corked 1k", 1024);
+  bench_send("send movement corked 16k", 16 * 1024);
+  bench_compressed(false);
+  bench_compressed(true);
+  bench_throughput("send and recive plain", false);
+  bench_throughput("send and recive aes-128-cfb8", true);
+  return 0;
+}
@@ -0,0 +1,180 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/loop.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+/*
+Many connections against a local stand-in server that echoes every packet
+back. The server always runs the epoll backend in its own process, the
+clients run each backend in turn. Usage: loop_bench [connections] [rounds]
+*/
+
+#define DEFAULT_CONNS 10000
+#define DEFAULT_ROUNDS 20
+#define PACKET_INTS 8
+
+static cmc_buff *packet;
+
+static void server_on_packet(cmc_loop *loop, cmc_conn *conn, cmc_buff *buff) {
+  (void)loop;
+  cmc_conn_send_packet(conn, buff);
+  cmc_buff_free(buff);
+}
+
+static void server_on_close(cmc_loop *loop, cmc_conn *conn) {
+  (void)loop;
+  cmc_conn_close(conn);
+}
+
+static void run_server(int listener, int conns) {
+  cmc_loop *loop = cmc_loop_init_with_backend(
+      (cmc_loop_callbacks){.on_packet = server_on_packet,
+                           .on_close = server_on_close},
+      CMC_LOOP_BACKEND_EPOLL);
+  cmc_conn *clients = calloc(conns, sizeof(cmc_conn));
+  int accepted = 0;
+  while (true) {
+    int fd;
+    while (accepted < conns && (fd = accept(listener, NULL, NULL)) != -1) {
+      clients[accepted] = cmc_conn_init(47);
+      clients[accepted].sockfd = fd;
+      clients[accepted].state = CMC_CONN_STATE_PLAY;
+      cmc_loop_add(loop, &clients[accepted++]);
+    }
+    cmc_loop_run_once(loop, accepted < conns ? 1 : -1);
+  }
+}
+
+typedef struct {
+  int connected;
+  int closed;
+  long echoed;
+} client_stats;
+
+static void client_on_connect(cmc_loop *loop, cmc_conn *conn) {
+  client_stats *stats = cmc_loop_get_callbacks(loop)->user_data;
+  stats->connected++;
+  (void)conn;
+}
+
+static void client_on_packet(cmc_loop *loop, cmc_conn *conn, cmc_buff *buff) {
+  client_stats *stats = cmc_loop_get_callbacks(loop)->user_data;
+  cmc_buff_free(buff);
+  stats->echoed++;
+  intptr_t *rounds_left = (intptr_t *)&conn->user_data;
+  if (--*rounds_left > 0)
+    cmc_conn_send_packet(conn, packet);
+}
+
+static void client_on_close(cmc_loop *loop, cmc_conn *conn) {
+  client_stats *stats = cmc_loop_get_callbacks(loop)->user_data;
+  stats->closed++;
+  (void)conn;
+}
+
+static void bench_backend(cmc_loop_backend backend,
+                          const struct sockaddr_in *addr, int conns,
+                          int rounds) {
+  client_stats stats = {};
+  cmc_loop *loop = cmc_loop_init_with_backend(
+      (cmc_loop_callbacks){.on_packet = client_on_packet,
+                           .on_close = client_on_close,
+                           .on_connect = client_on_connect,
+                           .user_data = &stats},
+      backend);
+  if (!loop) {
+    printf("%s is not available\n", cmc_loop_backend_string(backend));
+    return;
+  }
+  cmc_conn *clients = calloc(conns, sizeof(cmc_conn));
+
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < conns; i++) {
+    clients[i] = cmc_conn_init(47);
+    clients[i].state = CMC_CONN_STATE_PLAY;
+    clients[i].user_data = (void *)(intptr_t)rounds;
+    cmc_loop_connect(loop, &clients[i], (const struct sockaddr *)addr,
+                     sizeof(*addr));
+  }
+  while (stats.connected + stats.closed < conns)
+    cmc_loop_run_once(loop, 100);
+  uint64_t connected = bench_now_ns();
+
+  for (int i = 0; i < conns; i++)
+    if (clients[i].loop)
+      cmc_conn_send_packet(&clients[i], packet);
+  long expected = (long)stats.connected * rounds;
+  while (stats.echoed < expected && cmc_loop_conn_count(loop) > 0)
+    cmc_loop_run_once(loop, 100);
+  uint64_t end = bench_now_ns();
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s connect", cmc_loop_backend_string(backend));
+  bench_report(name, start, connected, conns);
+  snprintf(name, sizeof(name), "%s echo round trip",
+           cmc_loop_backend_string(backend));
+  bench_report(name, connected, end, stats.echoed ? stats.echoed : 1);
+  printf("%-40s %10d of %d connected, %ld echoed\n", "", stats.connected,
+         conns, stats.echoed);
+
+  for (int i = 0; i < conns; i++) {
+    cmc_loop_remove(loop, &clients[i]);
+    cmc_conn_close(&clients[i]);
+  }
+  cmc_loop_free(loop);
+  free(clients);
+}
+
+int main(int argc, char **argv) {
+  int conns = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNS;
+  int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+
+  // one descriptor per connection on each side
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < (rlim_t)conns + 16) {
+    conns = limit.rlim_cur - 16;
+    printf("limited to %d connections by RLIMIT_NOFILE\n", conns);
+  }
+
+  packet = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(packet, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(packet, 0x04);
+  for (int i = 0; i < PACKET_INTS; i++)
+    cmc_buff_pack_int(packet, i);
+
+  cmc_loop_backend backends[] = {CMC_LOOP_BACKEND_EPOLL,
+                                 CMC_LOOP_BACKEND_IO_URING};
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    bind(listener, (struct sockaddr *)&addr, addr_len);
+    listen(listener, SOMAXCONN);
+    getsockname(listener, (struct sockaddr *)&addr, &addr_len);
+
+    pid_t server = fork();
+    if (server == 0)
+      run_server(listener, conns);
+    close(listener);
+    bench_backend(backends[i], &addr, conns, rounds);
+    kill(server, SIGKILL);
+    waitpid(server, NULL, 0);
+  }
+  cmc_buff_free(packet);
+  return 0;
+}
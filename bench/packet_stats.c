@@ -0,0 +1,43 @@
+#include <cmc/buff.h>
+#include <cmc/packet_stats.h>
+#include <cmc/packets.h>
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+/*
+What the cmc_packet_stats hooks add to the generated unpack functions, off
+and on. The keep alive is about the cheapest packet there is to decode, so
+the hooks weigh the most on it. Afterwards the table of the run is printed.
+*/
+
+#define PACKETS 1000000
+
+static void bench_unpack(const char *name, cmc_buff *buff) {
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < PACKETS; i++) {
+    buff->position = 0;
+    cmc_buff_unpack_varint(buff);
+    S2C_play_keep_alive_packet packet = unpack_S2C_play_keep_alive_packet(buff);
+    BENCH_KEEP(packet.keep_alive_id_long);
+  }
+  uint64_t end = bench_now_ns();
+  bench_report(name, start, end, PACKETS);
+}
+
+int main() {
+  cmc_buff *buff = cmc_buff_init(765);
+  cmc_buff_pack_varint(buff, 0x24);
+  cmc_buff_pack_long(buff, 0x1234567890);
+
+  for (int round = 0; round < 3; round++) {
+    cmc_packet_stats_enable(false);
+    bench_unpack("unpack keep alive, stats off", buff);
+    cmc_packet_stats_enable(true);
+    bench_unpack("unpack keep alive, stats on", buff);
+  }
+  cmc_packet_stats_dump(stdout);
+  cmc_buff_free(buff);
+  return 0;
+}
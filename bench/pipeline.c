@@ -0,0 +1,190 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/loop.h>
+#include <cmc/pipeline.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+Compressed chunk sized packets on many connections, decoded by a plain
+cmc_loop and by a cmc_pipeline with different numbers of workers. A forked
+writer feeds the connections while they are read, so its cost is part of
+every run. The workers only help with more than one free core.
+Usage: pipeline_bench [connections] [packets per connection]
+*/
+
+#define DEFAULT_CONNS 64
+#define DEFAULT_PACKETS 100
+#define CHUNK_ID 0x25
+#define CHUNK_BYTES (16 * 1024)
+
+static size_t total_packets;
+static size_t delivered;
+
+// stands in for the generated unpack functions, touches every byte
+static uint64_t parse(cmc_buff *packet) {
+  uint64_t sum = 0;
+  for (size_t i = packet->position; i < packet->length; i++)
+    sum = sum * 31 + packet->data[i];
+  return sum;
+}
+
+static void *decode(cmc_buff *packet, cmc_conn_state state, void *user_data) {
+  (void)state;
+  (void)user_data;
+  BENCH_KEEP(parse(packet));
+  return NULL;
+}
+
+static void pipeline_on_packet(cmc_pipeline *pipeline, cmc_conn *conn,
+                               cmc_buff *packet, void *decoded) {
+  (void)pipeline;
+  (void)conn;
+  (void)decoded;
+  delivered++;
+  cmc_buff_free(packet);
+}
+
+static void loop_on_packet(cmc_loop *loop, cmc_conn *conn, cmc_buff *packet) {
+  (void)loop;
+  (void)conn;
+  BENCH_KEEP(parse(packet));
+  delivered++;
+  cmc_buff_free(packet);
+}
+
+// a chunk packet compressed like a server would send it, with its frame
+static cmc_buff *make_frame(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  conn.compression_threshold = 256;
+
+  // palette indices, long runs with some noise, like real sections
+  cmc_buff *packet = cmc_buff_init(765);
+  cmc_buff_reserve_headroom(packet, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(packet, CHUNK_ID);
+  srand(1);
+  for (int i = 0; i < CHUNK_BYTES; i++) {
+    uint8_t byte = i / 512 + (rand() % 8 == 0 ? rand() % 4 : 0);
+    cmc_buff_pack(packet, &byte, 1);
+  }
+  cmc_conn_send_packet(&conn, packet);
+  cmc_buff_free(packet);
+
+  cmc_buff *frame = cmc_buff_init(765);
+  uint8_t bytes[64 * 1024];
+  shutdown(sv[0], SHUT_WR);
+  ssize_t n;
+  while ((n = read(sv[1], bytes, sizeof(bytes))) > 0)
+    cmc_buff_pack(frame, bytes, n);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+  return frame;
+}
+
+static pid_t start_writer(const int *peers, int conns, int packets,
+                          const cmc_buff *frame) {
+  pid_t writer = fork();
+  if (writer == 0) {
+    for (int i = 0; i < packets; i++)
+      for (int c = 0; c < conns; c++)
+        write(peers[c], frame->data, frame->length);
+    _exit(0);
+  }
+  return writer;
+}
+
+/*
+With workers at -1 a plain cmc_loop decodes everything, else a pipeline with
+that many workers.
+*/
+static void run(int workers, int conns, int packets, const cmc_buff *frame) {
+  cmc_loop *loop = NULL;
+  cmc_pipeline *pipeline = NULL;
+  if (workers < 0)
+    loop = cmc_loop_init_with_backend(
+        (cmc_loop_callbacks){.on_packet = loop_on_packet},
+        CMC_LOOP_BACKEND_EPOLL);
+  else
+    pipeline = cmc_pipeline_init((cmc_pipeline_callbacks){
+                                     .decode = decode,
+                                     .on_packet = pipeline_on_packet},
+                                 workers, CMC_LOOP_BACKEND_EPOLL);
+
+  cmc_conn *clients = calloc(conns, sizeof(cmc_conn));
+  int *peers = calloc(conns, sizeof(int));
+  for (int c = 0; c < conns; c++) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    clients[c] = cmc_conn_init(765);
+    clients[c].sockfd = sv[0];
+    clients[c].state = CMC_CONN_STATE_PLAY;
+    clients[c].compression_threshold = 256;
+    peers[c] = sv[1];
+    if (loop)
+      cmc_loop_add(loop, &clients[c]);
+    else
+      cmc_pipeline_add(pipeline, &clients[c]);
+  }
+
+  total_packets = (size_t)conns * packets;
+  delivered = 0;
+  uint64_t start = bench_now_ns();
+  pid_t writer = start_writer(peers, conns, packets, frame);
+  while (delivered < total_packets) {
+    if (loop)
+      cmc_loop_run_once(loop, 100);
+    else
+      cmc_pipeline_run_once(pipeline, 100);
+  }
+  uint64_t end = bench_now_ns();
+  waitpid(writer, NULL, 0);
+
+  char name[64];
+  if (loop)
+    snprintf(name, sizeof(name), "cmc_loop, decode inline");
+  else
+    snprintf(name, sizeof(name), "cmc_pipeline, %d workers", workers);
+  bench_report(name, start, end, total_packets);
+  printf("%-40s %10.2f MB/s decompressed\n", "",
+         (double)total_packets * CHUNK_BYTES / ((end - start) / 1e9) / 1e6);
+
+  for (int c = 0; c < conns; c++) {
+    if (loop)
+      cmc_loop_remove(loop, &clients[c]);
+    else
+      cmc_pipeline_remove(pipeline, &clients[c]);
+    cmc_conn_close(&clients[c]);
+    close(peers[c]);
+  }
+  cmc_loop_free(loop);
+  cmc_pipeline_free(pipeline);
+  free(clients);
+  free(peers);
+}
+
+int main(int argc, char **argv) {
+  int conns = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNS;
+  int packets = argc > 2 ? atoi(argv[2]) : DEFAULT_PACKETS;
+  cmc_buff *frame = make_frame();
+  printf("%d connections, %d packets each, %zu bytes on the wire for %d\n",
+         conns, packets, frame->length, CHUNK_BYTES);
+  printf("%ld cores online\n", sysconf(_SC_NPROCESSORS_ONLN));
+
+  run(-1, conns, packets, frame);
+  const int workers[] = {0, 1, 2, 4};
+  for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); i++)
+    run(workers[i], conns, packets, frame);
+  cmc_buff_free(frame);
+  return 0;
+}
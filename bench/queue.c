@@ -0,0 +1,169 @@
+#include <cmc/queue.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+/*
+Producers hand pointers to one consumer through cmc_spsc_queue,
+cmc_mpsc_queue and, for comparison, a ring behind a pthread mutex like
+applications wrap around their own queues. Reports the time per item from
+the first push to the last pop. Threads that find the queue full or empty
+yield, on a machine with fewer cores than threads that is most of the time.
+Usage: queue_bench [items per producer]
+*/
+
+#define DEFAULT_ITEMS 1000000
+#define CAPACITY 1024
+#define MAX_PRODUCERS 4
+
+typedef enum { KIND_SPSC, KIND_MPSC, KIND_MUTEX } queue_kind;
+
+typedef struct {
+  pthread_mutex_t lock;
+  void *slots[CAPACITY];
+  size_t head;
+  size_t tail;
+} mutex_queue;
+
+static bool mutex_push(mutex_queue *queue, void *value) {
+  pthread_mutex_lock(&queue->lock);
+  bool room = queue->tail - queue->head < CAPACITY;
+  if (room)
+    queue->slots[queue->tail++ % CAPACITY] = value;
+  pthread_mutex_unlock(&queue->lock);
+  return room;
+}
+
+static void *mutex_pop(mutex_queue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  void *value = NULL;
+  if (queue->head != queue->tail)
+    value = queue->slots[queue->head++ % CAPACITY];
+  pthread_mutex_unlock(&queue->lock);
+  return value;
+}
+
+typedef struct {
+  queue_kind kind;
+  cmc_spsc_queue *spsc;
+  cmc_mpsc_queue *mpsc;
+  mutex_queue *mutex;
+  size_t items;
+} bench_queue;
+
+static bool push(bench_queue *queue, void *value) {
+  switch (queue->kind) {
+  case KIND_SPSC:
+    return cmc_spsc_queue_push(queue->spsc, value);
+  case KIND_MPSC:
+    return cmc_mpsc_queue_push(queue->mpsc, value);
+  case KIND_MUTEX:
+    return mutex_push(queue->mutex, value);
+  }
+  return false;
+}
+
+static void *pop(bench_queue *queue) {
+  switch (queue->kind) {
+  case KIND_SPSC:
+    return cmc_spsc_queue_pop(queue->spsc);
+  case KIND_MPSC:
+    return cmc_mpsc_queue_pop(queue->mpsc);
+  case KIND_MUTEX:
+    return mutex_pop(queue->mutex);
+  }
+  return NULL;
+}
+
+static void *produce(void *arg) {
+  bench_queue *queue = arg;
+  for (size_t i = 1; i <= queue->items; i++)
+    while (!push(queue, (void *)(uintptr_t)i))
+      sched_yield();
+  return NULL;
+}
+
+static void run(queue_kind kind, int producers, size_t items) {
+  bench_queue queue = {.kind = kind, .items = items};
+  if (kind == KIND_SPSC)
+    queue.spsc = cmc_spsc_queue_init(CAPACITY);
+  else if (kind == KIND_MPSC)
+    queue.mpsc = cmc_mpsc_queue_init(CAPACITY);
+  else {
+    queue.mutex = calloc(1, sizeof(mutex_queue));
+    pthread_mutex_init(&queue.mutex->lock, NULL);
+  }
+
+  pthread_t threads[MAX_PRODUCERS];
+  uint64_t start = bench_now_ns();
+  for (int i = 0; i < producers; i++)
+    pthread_create(&threads[i], NULL, produce, &queue);
+  uint64_t sum = 0;
+  for (size_t received = 0; received < producers * items;) {
+    void *value = pop(&queue);
+    if (!value) {
+      sched_yield();
+      continue;
+    }
+    sum += (uintptr_t)value;
+    received++;
+  }
+  uint64_t end = bench_now_ns();
+  BENCH_KEEP(sum);
+  for (int i = 0; i < producers; i++)
+    pthread_join(threads[i], NULL);
+
+  const char *names[] = {"cmc_spsc_queue", "cmc_mpsc_queue", "mutex ring"};
+  char name[64];
+  snprintf(name, sizeof(name), "%s, %d producer%s", names[kind], producers,
+           producers > 1 ? "s" : "");
+  bench_report(name, start, end, producers * items);
+
+  cmc_spsc_queue_free(queue.spsc);
+  cmc_mpsc_queue_free(queue.mpsc);
+  if (queue.mutex) {
+    pthread_mutex_destroy(&queue.mutex->lock);
+    free(queue.mutex);
+  }
+}
+
+// push and pop on one thread, the cost without any contention
+static void run_uncontended(size_t items) {
+  cmc_spsc_queue *spsc = cmc_spsc_queue_init(CAPACITY);
+  cmc_mpsc_queue *mpsc = cmc_mpsc_queue_init(CAPACITY);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 1; i <= items; i++) {
+    cmc_spsc_queue_push(spsc, (void *)(uintptr_t)i);
+    BENCH_KEEP(cmc_spsc_queue_pop(spsc));
+  }
+  uint64_t mid = bench_now_ns();
+  for (size_t i = 1; i <= items; i++) {
+    cmc_mpsc_queue_push(mpsc, (void *)(uintptr_t)i);
+    BENCH_KEEP(cmc_mpsc_queue_pop(mpsc));
+  }
+  uint64_t end = bench_now_ns();
+  bench_report("cmc_spsc_queue push+pop, one thread", start, mid, items);
+  bench_report("cmc_mpsc_queue push+pop, one thread", mid, end, items);
+  cmc_spsc_queue_free(spsc);
+  cmc_mpsc_queue_free(mpsc);
+}
+
+int main(int argc, char **argv) {
+  size_t items = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_ITEMS;
+  printf("%zu items per producer, %ld cores online\n", items,
+         sysconf(_SC_NPROCESSORS_ONLN));
+  run_uncontended(items);
+  run(KIND_SPSC, 1, items);
+  run(KIND_MUTEX, 1, items);
+  for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+    run(KIND_MPSC, producers, items);
+    run(KIND_MUTEX, producers, items);
+  }
+  return 0;
+}
@@ -0,0 +1,203 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/loop.h>
+#include <cmc/scheduler.h>
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+/*
+Many connections with a handler that does some work for every packet, run by
+a thread per connection blocking in cmc_conn_recive_packet and by a
+cmc_scheduler with different numbers of workers. A forked writer feeds the
+connections while they are read, so its cost is part of every run. More
+workers only help with more than one free core, the thread per connection
+numbers show what a thousand threads cost on top.
+Usage: scheduler_bench [connections] [packets per connection]
+*/
+
+#define DEFAULT_CONNS 1000
+#define DEFAULT_PACKETS 100
+#define PACKET_INTS 64
+// rounds over the packet per handler call, roughly a few microseconds
+#define WORK_ROUNDS 16
+#define THREAD_STACK (64 * 1024)
+
+static _Atomic size_t handled;
+
+// stands in for game logic, touches every byte a few times
+static void handle(cmc_buff *packet) {
+  uint64_t sum = 0;
+  for (int round = 0; round < WORK_ROUNDS; round++)
+    for (size_t i = packet->position; i < packet->length; i++)
+      sum = sum * 31 + packet->data[i] + round;
+  BENCH_KEEP(sum);
+  atomic_fetch_add_explicit(&handled, 1, memory_order_relaxed);
+  cmc_buff_free(packet);
+}
+
+static void scheduler_on_packet(cmc_scheduler *scheduler, cmc_conn *conn,
+                                cmc_buff *packet) {
+  (void)scheduler;
+  (void)conn;
+  handle(packet);
+}
+
+typedef struct {
+  cmc_conn *conn;
+  int packets;
+} reader;
+
+static void *read_conn(void *arg) {
+  reader *r = arg;
+  for (int i = 0; i < r->packets; i++) {
+    cmc_buff *packet = cmc_conn_recive_packet(r->conn);
+    if (!packet)
+      break;
+    handle(packet);
+  }
+  return NULL;
+}
+
+static cmc_buff *make_frame(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+
+  cmc_buff *packet = cmc_buff_init(765);
+  cmc_buff_reserve_headroom(packet, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(packet, 0x42);
+  for (int i = 0; i < PACKET_INTS; i++)
+    cmc_buff_pack_int(packet, i);
+  cmc_conn_send_packet(&conn, packet);
+  cmc_buff_free(packet);
+
+  cmc_buff *frame = cmc_buff_init(765);
+  uint8_t bytes[4096];
+  shutdown(sv[0], SHUT_WR);
+  ssize_t n;
+  while ((n = read(sv[1], bytes, sizeof(bytes))) > 0)
+    cmc_buff_pack(frame, bytes, n);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+  return frame;
+}
+
+static pid_t start_writer(const int *peers, int conns, int packets,
+                          const cmc_buff *frame) {
+  pid_t writer = fork();
+  if (writer == 0) {
+    for (int i = 0; i < packets; i++)
+      for (int c = 0; c < conns; c++)
+        write(peers[c], frame->data, frame->length);
+    _exit(0);
+  }
+  return writer;
+}
+
+// With workers at -1 every connection gets its own thread.
+static void run(int workers, int conns, int packets, const cmc_buff *frame) {
+  cmc_scheduler *scheduler = NULL;
+  if (workers >= 0)
+    scheduler = cmc_scheduler_init(
+        (cmc_scheduler_callbacks){.on_packet = scheduler_on_packet}, workers,
+        CMC_LOOP_BACKEND_EPOLL);
+
+  cmc_conn *clients = calloc(conns, sizeof(cmc_conn));
+  int *peers = calloc(conns, sizeof(int));
+  for (int c = 0; c < conns; c++) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    clients[c] = cmc_conn_init(765);
+    clients[c].sockfd = sv[0];
+    clients[c].state = CMC_CONN_STATE_PLAY;
+    peers[c] = sv[1];
+    if (scheduler)
+      cmc_scheduler_add(scheduler, &clients[c]);
+  }
+
+  size_t total_packets = (size_t)conns * packets;
+  atomic_store(&handled, 0);
+  pthread_t *threads = NULL;
+  reader *readers = NULL;
+  uint64_t start = bench_now_ns();
+  if (!scheduler) {
+    threads = calloc(conns, sizeof(pthread_t));
+    readers = calloc(conns, sizeof(reader));
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    for (int c = 0; c < conns; c++) {
+      readers[c] = (reader){.conn = &clients[c], .packets = packets};
+      pthread_create(&threads[c], &attr, read_conn, &readers[c]);
+    }
+    pthread_attr_destroy(&attr);
+  }
+  pid_t writer = start_writer(peers, conns, packets, frame);
+  if (scheduler)
+    while (atomic_load(&handled) < total_packets)
+      cmc_scheduler_run_once(scheduler, 100);
+  else
+    for (int c = 0; c < conns; c++)
+      pthread_join(threads[c], NULL);
+  uint64_t end = bench_now_ns();
+  waitpid(writer, NULL, 0);
+
+  char name[64];
+  if (scheduler) {
+    cmc_scheduler_stats stats = cmc_scheduler_get_stats(scheduler);
+    snprintf(name, sizeof(name), "cmc_scheduler, %d workers", workers);
+    bench_report(name, start, end, total_packets);
+    printf("%-40s %10llu steals\n", "", (unsigned long long)stats.steals);
+  } else {
+    snprintf(name, sizeof(name), "thread per connection");
+    bench_report(name, start, end, total_packets);
+  }
+
+  for (int c = 0; c < conns; c++) {
+    if (scheduler)
+      cmc_scheduler_remove(scheduler, &clients[c]);
+    cmc_conn_close(&clients[c]);
+    close(peers[c]);
+  }
+  cmc_scheduler_free(scheduler);
+  free(threads);
+  free(readers);
+  free(clients);
+  free(peers);
+}
+
+int main(int argc, char **argv) {
+  int conns = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNS;
+  int packets = argc > 2 ? atoi(argv[2]) : DEFAULT_PACKETS;
+
+  // two descriptors per connection
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < (rlim_t)conns * 2 + 16) {
+    conns = (limit.rlim_cur - 16) / 2;
+    printf("limited to %d connections by RLIMIT_NOFILE\n", conns);
+  }
+
+  cmc_buff *frame = make_frame();
+  printf("%d connections, %d packets each, %ld cores online\n", conns,
+         packets, sysconf(_SC_NPROCESSORS_ONLN));
+  run(-1, conns, packets, frame);
+  const int workers[] = {0, 1, 2, 4};
+  for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); i++)
+    run(workers[i], conns, packets, frame);
+  cmc_buff_free(frame);
+  return 0;
+}
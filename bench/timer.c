@@ -0,0 +1,182 @@
+#include <cmc/timer.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+/*
+The cost per timer of the cmc_timer_wheel operations with many timers armed,
+next to an indexed binary heap, which is what a timer per connection usually
+ends up as. Delays are spread over a minute like keep alive and read
+timeouts. Re-arming an armed timer is what a read timeout does on every
+packet if it isn't noted lazily like cmc_loop_set_read_timeout does.
+Usage: timer_bench [timers]
+*/
+
+#define DEFAULT_TIMERS 100000
+#define MAX_DELAY_MS 60000
+
+typedef struct {
+  cmc_timer timer;
+  size_t heap_index; // position in the heap, SIZE_MAX when not in it
+  uint64_t heap_expires;
+} bench_timer;
+
+static size_t fired;
+
+static void on_timer(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  (void)wheel;
+  (void)timer;
+  fired++;
+}
+
+typedef struct {
+  bench_timer **items;
+  size_t count;
+} heap;
+
+static void heap_set(heap *h, size_t i, bench_timer *t) {
+  h->items[i] = t;
+  t->heap_index = i;
+}
+
+static void heap_up(heap *h, size_t i) {
+  bench_timer *t = h->items[i];
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (h->items[parent]->heap_expires <= t->heap_expires)
+      break;
+    heap_set(h, i, h->items[parent]);
+    i = parent;
+  }
+  heap_set(h, i, t);
+}
+
+static void heap_down(heap *h, size_t i) {
+  bench_timer *t = h->items[i];
+  while (true) {
+    size_t child = 2 * i + 1;
+    if (child >= h->count)
+      break;
+    if (child + 1 < h->count &&
+        h->items[child + 1]->heap_expires < h->items[child]->heap_expires)
+      child++;
+    if (t->heap_expires <= h->items[child]->heap_expires)
+      break;
+    heap_set(h, i, h->items[child]);
+    i = child;
+  }
+  heap_set(h, i, t);
+}
+
+static void heap_remove(heap *h, bench_timer *t) {
+  size_t i = t->heap_index;
+  bench_timer *last = h->items[--h->count];
+  t->heap_index = SIZE_MAX;
+  if (last == t)
+    return;
+  heap_set(h, i, last);
+  heap_up(h, i);
+  heap_down(h, last->heap_index);
+}
+
+static void heap_arm(heap *h, bench_timer *t, uint64_t expires) {
+  if (t->heap_index != SIZE_MAX)
+    heap_remove(h, t);
+  t->heap_expires = expires;
+  heap_set(h, h->count++, t);
+  heap_up(h, t->heap_index);
+}
+
+static size_t heap_advance(heap *h, uint64_t now) {
+  size_t count = 0;
+  while (h->count > 0 && h->items[0]->heap_expires <= now) {
+    heap_remove(h, h->items[0]);
+    count++;
+  }
+  return count;
+}
+
+static void bench_wheel(bench_timer *timers, const uint32_t *delays,
+                        size_t count) {
+  cmc_timer_wheel *wheel = cmc_timer_wheel_init(0);
+  for (size_t i = 0; i < count; i++)
+    cmc_timer_init(&timers[i].timer, on_timer, NULL);
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < count; i++)
+    cmc_timer_arm(wheel, &timers[i].timer, delays[i], 0);
+  uint64_t armed = bench_now_ns();
+  // the same timers to other delays
+  for (size_t i = 0; i < count; i++)
+    cmc_timer_arm(wheel, &timers[i].timer, delays[count - 1 - i], 0);
+  uint64_t moved = bench_now_ns();
+  for (size_t i = 0; i < count; i++)
+    cmc_timer_cancel(wheel, &timers[i].timer);
+  uint64_t cancelled = bench_now_ns();
+  bench_report("cmc_timer_wheel arm", start, armed, count);
+  bench_report("cmc_timer_wheel re-arm an armed timer", armed, moved, count);
+  bench_report("cmc_timer_wheel cancel", moved, cancelled, count);
+
+  // a tick every millisecond, like a loop that is always busy
+  for (size_t i = 0; i < count; i++)
+    cmc_timer_arm(wheel, &timers[i].timer, delays[i], 0);
+  fired = 0;
+  start = bench_now_ns();
+  for (uint64_t now = 1; now <= MAX_DELAY_MS; now++)
+    cmc_timer_wheel_advance(wheel, now);
+  uint64_t end = bench_now_ns();
+  bench_report("cmc_timer_wheel advance, per timer fired", start, end, count);
+  if (fired != count)
+    printf("fired %zu of %zu timers\n", fired, count);
+  cmc_timer_wheel_free(wheel);
+}
+
+static void bench_heap(bench_timer *timers, const uint32_t *delays,
+                       size_t count) {
+  heap h = {.items = malloc(count * sizeof(bench_timer *))};
+  for (size_t i = 0; i < count; i++)
+    timers[i].heap_index = SIZE_MAX;
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < count; i++)
+    heap_arm(&h, &timers[i], delays[i]);
+  uint64_t armed = bench_now_ns();
+  for (size_t i = 0; i < count; i++)
+    heap_arm(&h, &timers[i], delays[count - 1 - i]);
+  uint64_t moved = bench_now_ns();
+  for (size_t i = 0; i < count; i++)
+    heap_remove(&h, &timers[i]);
+  uint64_t cancelled = bench_now_ns();
+  bench_report("binary heap arm", start, armed, count);
+  bench_report("binary heap re-arm an armed timer", armed, moved, count);
+  bench_report("binary heap cancel", moved, cancelled, count);
+
+  for (size_t i = 0; i < count; i++)
+    heap_arm(&h, &timers[i], delays[i]);
+  size_t expired = 0;
+  start = bench_now_ns();
+  for (uint64_t now = 1; now <= MAX_DELAY_MS; now++)
+    expired += heap_advance(&h, now);
+  uint64_t end = bench_now_ns();
+  bench_report("binary heap advance, per timer fired", start, end, count);
+  BENCH_KEEP(expired);
+  free(h.items);
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_TIMERS;
+  printf("%zu timers, delays up to %d ms\n", count, MAX_DELAY_MS);
+  bench_timer *timers = calloc(count, sizeof(bench_timer));
+  uint32_t *delays = malloc(count * sizeof(uint32_t));
+  srand(1);
+  for (size_t i = 0; i < count; i++)
+    delays[i] = 1 + rand() % MAX_DELAY_MS;
+
+  bench_wheel(timers, delays, count);
+  bench_heap(timers, delays, count);
+  free(timers);
+  free(delays);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <cmc/buff.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define COUNT 4096
+#define ROUNDS 500
+
+// the varint loop from before the fast codec, one malloced byte per read
+static int32_t loop_unpack_varint(cmc_buff *buff) {
+  int32_t number = 0;
+  for (int i = 0; i < 5; i++) {
+    uint8_t *data = cmc_buff_unpack(buff, 1);
+    uint8_t b = *data;
+    free(data);
+    number |= (b & 0x7F) << (7 * i);
+    if (!(b & 0x80))
+      break;
+  }
+  return number;
+}
+
+// and the matching encoder, one cmc_buff_pack per byte
+static void loop_pack_varint(cmc_buff *buff, int n) {
+  unsigned int number = (unsigned int)n;
+  for (int i = 0; i < 5; i++) {
+    uint8_t b = number & 0x7F;
+    number >>= 7;
+    b |= number > 0 ? 0x80 : 0;
+    cmc_buff_pack(buff, &b, 1);
+    if (number == 0)
+      break;
+  }
+}
+
+static void bench_values(const char *name, const int32_t *values) {
+  printf("%s\n", name);
+  cmc_buff *buff = cmc_buff_init(47);
+  const uint64_t ops = (uint64_t)COUNT * ROUNDS;
+
+  uint64_t start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->length = 0;
+    for (int i = 0; i < COUNT; i++)
+      loop_pack_varint(buff, values[i]);
+  }
+  bench_report("  old pack loop", start, bench_now_ns(), ops);
+
+  start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->length = 0;
+    for (int i = 0; i < COUNT; i++)
+      cmc_buff_pack_varint(buff, values[i]);
+  }
+  bench_report("  cmc_buff_pack_varint", start, bench_now_ns(), ops);
+
+  start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->length = 0;
+    cmc_buff_pack_varint_array(buff, values, COUNT);
+  }
+  bench_report("  cmc_buff_pack_varint_array", start, bench_now_ns(), ops);
+
+  start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->position = 0;
+    for (int i = 0; i < COUNT; i++)
+      BENCH_KEEP(loop_unpack_varint(buff));
+  }
+  bench_report("  old unpack loop", start, bench_now_ns(), ops);
+
+  start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->position = 0;
+    for (int i = 0; i < COUNT; i++)
+      BENCH_KEEP(cmc_buff_unpack_varint(buff));
+  }
+  bench_report("  cmc_buff_unpack_varint", start, bench_now_ns(), ops);
+
+  int32_t *decoded = malloc(COUNT * sizeof(int32_t));
+  start = bench_now_ns();
+  for (int r = 0; r < ROUNDS; r++) {
+    buff->position = 0;
+    cmc_buff_unpack_varint_array(buff, decoded, COUNT);
+    BENCH_KEEP(decoded[COUNT - 1]);
+  }
+  bench_report("  cmc_buff_unpack_varint_array", start, bench_now_ns(), ops);
+
+  free(decoded);
+  cmc_buff_free(buff);
+}
+
+int main() {
+  int32_t *values = malloc(COUNT * sizeof(int32_t));
+  srand(1);
+
+  for (int i = 0; i < COUNT; i++)
+    values[i] = rand() % 128;
+  bench_values("1 byte varints", values);
+
+  for (int i = 0; i < COUNT; i++)
+    values[i] = 128 + rand() % (16384 - 128);
+  bench_values("2 byte varints", values);
+
+  for (int i = 0; i < COUNT; i++)
+    values[i] = rand() % (1 << (7 * (1 + i % 4)));
+  bench_values("mixed 1-4 byte varints", values);
+
+  for (int i = 0; i < COUNT; i++)
+    values[i] = -1 - rand();
+  bench_values("negative (5 byte) varints", values);
+
+  free(values);
+  return 0;
+}
@@ -4,27 +4,28 @@ from pprint import pprint
 import glob
 
 type_map = {
-#  TYPE  |code tpye               |method type      |is heap |default value
-    "b": ["int8_t ",              "char",            False,  "0",                       False],
-    "B": ["uint8_t ",             "byte",            False,  "0",                       False],
-    "h": ["int16_t ",             "short",           False,  "0",                       False],
-    "H": ["uint16_t ",            "ushort",          False,  "0",                       False],
-    "i": ["int32_t ",             "int",             False,  "0",                       False],
-    "I": ["uint32_t ",            "uint",            False,  "0",                       False],
-    "l": ["int64_t ",             "long",            False,  "0",                       False],
-    "L": ["uint64_t ",            "ulong",           False,  "0",                       False],
-    "f": ["float ",               "float",           False,  "0",                       False],
-    "d": ["double ",              "double",          False,  "0",                       False],
-    "?": ["bool ",                "bool",            False,  "false",                   False],
-    "v": ["int32_t ",             "varint",          False,  "0",                       False],
-    "s": ["char *",               "string",          True,   "NULL",                    False],
-    "p": ["cmc_block_pos ",       "position",        False,  "{.x=0,.y=0,.z=0}",        False],
-    "n": ["cmc_nbt *",            "nbt",             True,   "NULL",                    True ],
-    "a": ["cmc_buff *",           "buff",            True,   "NULL",                    False],
-    "S": ["cmc_slot *",           "slot",            True,   "NULL",                    True ],
-    "m": ["cmc_entity_metadata ", "entity_metadata", True,   "{.size=0,.entries=NULL}", True ],
-    "u": ["cmc_uuid ",             "uuid",           False,  "{.lower=0,.upper=0}",     False],
-    "A": ["cmc_array ",            None,             True,   "{.data=NULL,.size=0}",    False],
+#  TYPE  |code tpye               |method type      |is heap |default value              |free err |max size |in arena
+    "b": ["int8_t ",              "char",            False,  "0",                       False,    1,        False],
+    "B": ["uint8_t ",             "byte",            False,  "0",                       False,    1,        False],
+    "h": ["int16_t ",             "short",           False,  "0",                       False,    2,        False],
+    "H": ["uint16_t ",            "ushort",          False,  "0",                       False,    2,        False],
+    "i": ["int32_t ",             "int",             False,  "0",                       False,    4,        False],
+    "I": ["uint32_t ",            "uint",            False,  "0",                       False,    4,        False],
+    "l": ["int64_t ",             "long",            False,  "0",                       False,    8,        False],
+    "L": ["uint64_t ",            "ulong",           False,  "0",                       False,    8,        False],
+    "f": ["float ",               "float",           False,  "0",                       False,    4,        False],
+    "d": ["double ",              "double",          False,  "0",                       False,    8,        False],
+    "?": ["bool ",                "bool",            False,  "false",                   False,    1,        False],
+    "v": ["int32_t ",             "varint",          False,  "0",                       False,    5,        False],
+    "s": ["char *",               "string",          True,   "NULL",                    False,    None,     True ],
+    "t": ["cmc_string_view ",     "string_view",     False,  "{.data=NULL,.length=0}",  False,    None,     False],
+    "p": ["cmc_block_pos ",       "position",        False,  "{.x=0,.y=0,.z=0}",        False,    8,        False],
+    "n": ["cmc_nbt *",            "nbt",             True,   "NULL",                    True,     None,     False],
+    "a": ["cmc_buff *",           "buff",            True,   "NULL",                    False,    None,     False],
+    "S": ["cmc_slot *",           "slot",            True,   "NULL",                    True,     None,     True ],
+    "m": ["cmc_entity_metadata ", "entity_metadata", True,   "{.size=0,.entries=NULL}", True,     None,     True ],
+    "u": ["cmc_uuid ",             "uuid",           False,  "{.lower=0,.upper=0}",     False,    16,       False],
+    "A": ["cmc_array ",            None,             True,   "{.data=NULL,.size=0}",    False,    None,     True ],
 }
 
 replacement_paths = ["src/*.c", "include/cmc/*.h"]
@@ -91,7 +92,12 @@ def replace_code_segments(replacement_code, tag):
     raise ValueError(f"didnt find tag {tag}")
 
 
-def type_def_content(token, packet_name, wrap_name):
+def is_varint_array(array_exp):
+    # arrays of a single varint go through the bulk varint functions
+    syms = careful_split(array_exp)
+    return len(syms) == 1 and syms[0][0] == "v"
+
+def type_def_content(token, packet_name, wrap_name, in_arena=False):
     typedefs = []
     members = []
     for sym in careful_split(token):
@@ -103,6 +109,8 @@ def type_def_content(token, packet_name, wrap_name):
             members.append(f"{type_map[exp_type][0]} {name};")
         else:
             members.append(f"{type_map[exp_type][0]} {exp_data};")
+    if in_arena:
+        members.append("bool in_arena;")
 
     typedefs.append(f"""
         typedef struct {{
@@ -113,10 +121,14 @@ def type_def_content(token, packet_name, wrap_name):
     return "\n".join(typedefs)
 
 
+def uses_arena(inp):
+    # the packet remembers if it was unpacked into buff->arena, its free method needs to know
+    return not inp["is_empty"] and any(type_map[sym[0]][6] for sym in careful_split(inp["type_def_content_str"]))
+
 def type_def(inp):
     if inp["is_empty"]:
         return ""
-    return type_def_content(inp["type_def_content_str"], inp["name"], f"{inp['name']}_packet")
+    return type_def_content(inp["type_def_content_str"], inp["name"], f"{inp['name']}_packet", uses_arena(inp))
 
 def unpack_method_content(to_unpack_to, exp, deepness, packet_name):
     def handle_value(sym):
@@ -128,9 +140,21 @@ def unpack_method_content(to_unpack_to, exp, deepness, packet_name):
     def handle_array(sym):
         name, array_exp, key = split_array_exp(sym)
         i = chr(deepness)
-        return f"""
+        # every element takes at least a byte, a bigger count is the peer lying
+        alloc = f"""
+            CMC_ERRB_IF({to_unpack_to}{key} < 0 || (size_t){to_unpack_to}{key} > cmc_buff_remaining(buff), CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
             {to_unpack_to}{name}.size = {to_unpack_to}{key};
-            {to_unpack_to}{name}.data = CMC_ERRB_ABLE(cmc_malloc({to_unpack_to}{name}.size * sizeof({packet_name}_{name}), &buff->err), goto err;);
+            {to_unpack_to}{name}.data = CMC_ERRB_ABLE(cmc_buff_malloc(buff, {to_unpack_to}{name}.size * sizeof({packet_name}_{name})), goto err;);
+        """
+        if is_varint_array(array_exp):
+            return alloc + f"CMC_ERRB_ABLE(cmc_buff_unpack_varint_array(buff, {to_unpack_to}{name}.data, {to_unpack_to}{name}.size), goto err;);"
+        if any(type_map[elem[0]][2] for elem in careful_split(array_exp)):
+            # the free method looks at every element when one of them fails
+            alloc += f"""
+                if ({to_unpack_to}{name}.data)
+                    memset({to_unpack_to}{name}.data, 0, {to_unpack_to}{name}.size * sizeof({packet_name}_{name}));
+            """
+        return alloc + f"""
             for (size_t {i} = 0; {i} < {to_unpack_to}{name}.size; ++{i}) {{
                 {packet_name}_{name} *p_{name} = &(({packet_name}_{name} *){to_unpack_to}{name}.data)[{i}];
                 {unpack_method_content(f'p_{name}->', array_exp, deepness + 1, packet_name)}
@@ -150,6 +174,8 @@ def unpack_method(inp):
         f"""
         {inp['name']}_packet unpack_{inp['name']}_packet(cmc_buff *buff) {{
             {inp['name']}_packet packet = {{}};
+            {"packet.in_arena = buff->arena != NULL;" if uses_arena(inp) else ""}
+            uint64_t stats_start = cmc_packet_stats_start();
             switch(buff->protocol_version) {{
         """,
         *(
@@ -167,6 +193,7 @@ def unpack_method(inp):
             }}
             CMC_ERRB_ABLE(,goto err);
             if(buff->position != buff->length) CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+            cmc_packet_stats_decoded(CMC_{inp['name'].upper()}_NAME_ID, stats_start);
             return packet;
             err:
                 cmc_free_{inp['name']}_packet(&packet, &buff->err);
@@ -183,6 +210,8 @@ def send_method_content(data, to_send, deepness, packet_name):
     def handle_array(symbol):
         name, array_exp, _ = split_array_exp(symbol)
         i = chr(deepness)
+        if is_varint_array(array_exp):
+            return f"cmc_buff_pack_varint_array(buff, {to_send}{name}.data, {to_send}{name}.size);"
         return f"""
             for (size_t {i} = 0; {i} < {to_send}{name}.size; ++{i}) {{
                 {packet_name}_{name} *p_{name} =  &(({packet_name}_{name} *){to_send}{name}.data)[{i}];
@@ -196,12 +225,39 @@ def send_method_content(data, to_send, deepness, packet_name):
     )
 
 
+def packet_max_size(inp):
+    # upper bound of the encoded size if every field has a fixed max size
+    sizes = []
+    for data in inp["packet_data"].values():
+        size = max(1, (int(data["packet_id"], 16).bit_length() + 6) // 7)
+        for field in data.get("content", []):
+            if type_map[field[0]][5] is None:
+                return None
+            size += type_map[field[0]][5]
+        sizes.append(size)
+    return max(sizes)
+
+def packet_max_size_define(exps):
+    return "".join(
+        f"CMC_{exp['name'].upper()}_MAX_SIZE = {packet_max_size(exp)},"
+        for exp in exps
+        if packet_max_size(exp) is not None
+    )
+
 def send_method(inp):
     second_param = "" if inp["is_empty"] else f", {inp['name']}_packet *packet"
+    buff_init = (
+        f"cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM + CMC_{inp['name'].upper()}_MAX_SIZE)"
+        if packet_max_size(inp) is not None
+        else "cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM)"
+    )
     return "".join((
         f"""
         cmc_err cmc_send_{inp['name']}_packet(cmc_conn *conn{second_param}) {{
-            cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+            uint64_t stats_start = cmc_packet_stats_start();
+            cmc_buff *buff = {buff_init};
+            CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+            if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM)) return send_failed(conn, buff);
             switch(conn->protocol_version) {{
         """,
         *(
@@ -219,9 +275,10 @@ def send_method(inp):
         ),
         f"""
             default:
-                cmc_buff_free(buff);
-                CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+                CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION, return send_failed(conn, buff););
             }}
+            if (buff->err.err) return send_failed(conn, buff);
+            cmc_packet_stats_encoded(CMC_{inp['name'].upper()}_NAME_ID, stats_start);
             cmc_conn_send_packet(conn, buff);
             cmc_buff_free(buff);
             return CMC_ERR_NO;
@@ -242,7 +299,7 @@ def packet_ids(mc_packet_exps):
 
     return code
 
-def free_method_content(exp, tofree, deepness, packet_name):
+def free_method_content(exp, tofree, deepness, packet_name, in_arena=None):
     def handle_value(sym):
         exp_type = sym[0]
         exp_data = sym[1:]
@@ -269,18 +326,58 @@ def free_method_content(exp, tofree, deepness, packet_name):
         handle_array(sym) if (sym[0] == "A") else handle_value(sym)
         for sym in careful_split(exp)
         if type_map[sym[0]][2] # is_heap(exp_type)
+        and in_arena in (None, type_map[sym[0]][6])
+    )
+
+def free_in_arena_content(exp, tofree, deepness, packet_name, arena_only=False):
+    # what an arena backed field still holds outside the arena, like the nbt of a slot
+    def handle_value(sym):
+        exp_type = sym[0]
+        exp_data = sym[1:]
+        if not type_map[exp_type][6]:
+            return free_method_content(sym, tofree, deepness, packet_name)
+        if exp_type in "Sm":
+            return f"cmc_{type_map[exp_type][1]}_free_in_arena({tofree}->{exp_data}, err);"
+        return ""
+
+    def handle_array(sym):
+        name, array_exp, _ = split_array_exp(sym)
+        i = chr(deepness)
+        loop_body = free_in_arena_content(array_exp, f"p_{name}", deepness + 1, packet_name)
+        return f"""
+            for (size_t {i} = 0; {i} < {tofree}->{name}.size; ++{i}) {{
+                {packet_name}_{name} *p_{name} = &(({packet_name}_{name} *){tofree}->{name}.data)[{i}];
+                {loop_body}
+            }}
+        """ if loop_body else ""
+
+    return "".join(
+        handle_array(sym) if (sym[0] == "A") else handle_value(sym)
+        for sym in careful_split(exp)
+        if type_map[sym[0]][2] # is_heap(exp_type)
+        and (not arena_only or type_map[sym[0]][6])
     )
 
 def free_method(inp):
     if inp["is_empty"]:
         return ""
 
+    if not inp["is_heap"]:
+        content = "(void)packet;"
+    elif not uses_arena(inp):
+        content = free_method_content(inp['type_def_content_str'], 'packet', ord('i'), inp['name'])
+    else:
+        # arena memory goes with cmc_arena_reset, anything else is freed either way
+        in_arena = free_in_arena_content(inp['type_def_content_str'], 'packet', ord('i'), inp['name'], True)
+        content = f"""
+            {free_method_content(inp['type_def_content_str'], 'packet', ord('i'), inp['name'], False)}
+            if (!packet->in_arena) {{
+                {free_method_content(inp['type_def_content_str'], 'packet', ord('i'), inp['name'], True)}
+            }}{f" else {{ {in_arena} }}" if in_arena else ""}
+        """
     return f"""
     void cmc_free_{inp['name']}_packet({inp['name']}_packet *packet, cmc_err_extra *err) {{
-        {
-            free_method_content(inp['type_def_content_str'], 'packet', ord('i'), inp['name'])
-            if inp['is_heap'] else '(void)packet;'
-        }
+        {content}
         (void)err;
     }}
     """
@@ -353,6 +450,8 @@ def main():
 
     replace_code_segments(packet_name_id_define(mc_packet_exps), "packet_name_id_define")
 
+    replace_code_segments(packet_max_size_define(mc_packet_exps), "packet_max_size_define")
+
     # packet unpack methods
     replace_code_segments(
         "".join(unpack_method(mc_packet_exp) for mc_packet_exp in mc_packet_exps),
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cmc/err.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+A bump allocator for decoded packets. Set buff->arena before calling an
+unpack function and every string, array, slot and metadata entry of the
+packet is carved out of the arena instead of being malloced one by one.
+cmc_arena_reset then drops all of them at once.
+
+Packets with arena backed fields get an in_arena flag set by the unpack
+function, and their cmc_free_* function only frees the rest of a flagged
+packet: buffers inside packets (cmc_buff fields) and the nbt of slots are
+still malloced and still need freeing. The free helpers for single fields
+(cmc_string_free, cmc_slot_free, cmc_entity_metadata_free) know nothing about
+arenas and must not be called on arena memory, cmc_slot_free_in_arena and
+cmc_entity_metadata_free_in_arena free only what is outside of it.
+
+An arena is not thread safe.
+*/
+typedef struct cmc_arena cmc_arena;
+
+#define CMC_ARENA_DEFAULT_BLOCK_SIZE (16 * 1024)
+
+/*
+block_size is the size of the first block, 0 means
+CMC_ARENA_DEFAULT_BLOCK_SIZE. May return null if malloc failed.
+*/
+cmc_arena *cmc_arena_init(size_t block_size);
+
+void cmc_arena_free(cmc_arena *arena);
+
+/*
+Frees everything allocated from the arena. If the arena had to grow it keeps
+a single block big enough for all of it, so the next round does not grow.
+*/
+void cmc_arena_reset(cmc_arena *arena);
+
+void *cmc_arena_alloc(cmc_arena *arena, size_t n, cmc_err_extra *err);
+
+/*
+Grows the most recent allocation in place when there is room, otherwise
+copies old_n bytes into a new allocation.
+*/
+void *cmc_arena_realloc(cmc_arena *arena, void *p, size_t old_n, size_t n,
+                        cmc_err_extra *err);
+
+bool cmc_arena_owns(const cmc_arena *arena, const void *p);
+
+// total bytes handed out since the last reset
+size_t cmc_arena_used(const cmc_arena *arena);
@@ -4,9 +4,12 @@
 #include <cmc/nbt_types.h>
 #include <cmc/protocol.h>
 
+#include <endian.h>
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 typedef struct {
   uint8_t *data;
@@ -15,19 +18,87 @@ typedef struct {
   size_t capacity;
   cmc_protocol_version protocol_version;
   cmc_err_extra err;
+  struct cmc_buff_pool *pool; // where cmc_buff_free puts it, may be null
+  struct cmc_arena *arena;    // where unpacked packets allocate, may be null
 } cmc_buff;
 
 /*
 May return null if malloc failed.
 */
 cmc_buff *cmc_buff_init(cmc_protocol_version protocol_version);
+
+/*
+Same as cmc_buff_init but allocates room for capacity bytes up front.
+May return null if malloc failed.
+*/
+cmc_buff *cmc_buff_init_with_capacity(cmc_protocol_version protocol_version,
+                                      size_t capacity);
 void cmc_buff_print_info(cmc_buff *buff);
 void cmc_buff_free(cmc_buff *buff);
 cmc_buff *cmc_buff_combine(cmc_buff *buff, cmc_buff *tmp);
 
 cmc_err cmc_buff_pack(cmc_buff *buff, const void *data, size_t data_size);
+
+/*
+Allocations for unpacked data, served from buff->arena if set and by malloc
+otherwise. Free malloced results with free, arena ones go with the arena. A
+size of 0 returns null without raising an error, so empty arrays decode fine.
+*/
+void *cmc_buff_malloc(cmc_buff *buff, size_t n);
+void *cmc_buff_realloc(cmc_buff *buff, void *p, size_t old_n, size_t n);
+
+/*
+Makes sure at least additional bytes can be packed without growing the
+buffer again.
+*/
+cmc_err cmc_buff_reserve(cmc_buff *buff, size_t additional);
+
+/*
+How buffers grow when they run out of room. The first allocation is at least
+min_capacity bytes, after that the capacity is multiplied by growth_factor
+until the data fits. A growth_factor of 1 grows to exactly the needed size.
+The policy is global and should be set before any buffers are used.
+*/
+typedef struct {
+  size_t min_capacity;
+  size_t growth_factor;
+} cmc_buff_growth_policy;
+
+#define CMC_BUFF_DEFAULT_GROWTH_POLICY                                         \
+  (cmc_buff_growth_policy) { .min_capacity = 64, .growth_factor = 2 }
+
+void cmc_buff_set_growth_policy(cmc_buff_growth_policy policy);
+cmc_buff_growth_policy cmc_buff_get_growth_policy(void);
+
+/*
+Leaves n bytes of room at the front of an empty buffer so a header can be
+written in front of the data later without moving it. The room counts as
+already read, so buff->position points at the first data byte.
+*/
+cmc_err cmc_buff_reserve_headroom(cmc_buff *buff, size_t n);
+
+/*
+Returns a malloced copy of the next n bytes, prefer cmc_buff_view if you dont
+need to keep the data around.
+May return null if malloc failed or there are not enough bytes left.
+*/
 void *cmc_buff_unpack(cmc_buff *buff, size_t n);
 
+/*
+Returns a pointer to the next n bytes and advances the position past them.
+The bytes are borrowed from buff->data, nothing is copied. The pointer is only
+valid until the buffer is packed into or freed.
+May return null if there are not enough bytes left.
+*/
+const uint8_t *cmc_buff_view(cmc_buff *buff, size_t n);
+
+/*
+Same as cmc_buff_view but doesnt advance the position.
+*/
+const uint8_t *cmc_buff_peek(cmc_buff *buff, size_t n);
+
+size_t cmc_buff_remaining(const cmc_buff *buff);
+
 #define NUM_PACK_AND_UNPACK_FUNC_FACTORY_H(name, type)                         \
   type cmc_buff_unpack_##name(cmc_buff *buff);                                 \
   cmc_err cmc_buff_pack_##name(cmc_buff *buff, type data);
@@ -45,13 +116,84 @@ NUM_PACK_AND_UNPACK_FUNC_FACTORY_H(double, double);
 
 #undef NUM_PACK_AND_UNPACK_FUNC_FACTORY_H
 
+/*
+Inline big endian number readers and writers, the cmc_buff_unpack_* and
+cmc_buff_pack_* number functions above are built on these.
+They check the bounds once and never allocate, except for the writers when the
+buffer has to grow. On error buff->err is set and the readers return 0.
+*/
+#define be8toh(x) (x)
+#define htobe8(x) (x)
+
+#define NUM_READ_AND_WRITE_FUNC_FACTORY_H(name, type, bits)                    \
+  static inline type cmc_buff_read_##name(cmc_buff *buff) {                    \
+    if (sizeof(type) > buff->length - buff->position) {                        \
+      buff->err = (cmc_err_extra){                                             \
+          .file = __FILE__, .line = __LINE__, .err = CMC_ERR_BUFF_OVERFLOW};   \
+      return 0;                                                                \
+    }                                                                          \
+    uint##bits##_t raw;                                                        \
+    memcpy(&raw, buff->data + buff->position, sizeof(raw));                    \
+    buff->position += sizeof(raw);                                             \
+    raw = be##bits##toh(raw);                                                  \
+    type result;                                                               \
+    memcpy(&result, &raw, sizeof(result));                                     \
+    return result;                                                             \
+  }                                                                            \
+                                                                               \
+  static inline cmc_err cmc_buff_write_##name(cmc_buff *buff, type value) {    \
+    uint##bits##_t raw;                                                        \
+    memcpy(&raw, &value, sizeof(raw));                                         \
+    raw = htobe##bits(raw);                                                    \
+    if (sizeof(raw) > buff->capacity - buff->length)                           \
+      return cmc_buff_pack(buff, &raw, sizeof(raw));                           \
+    memcpy(buff->data + buff->length, &raw, sizeof(raw));                      \
+    buff->length += sizeof(raw);                                               \
+    return CMC_ERR_NO;                                                         \
+  }
+
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(char, char, 8);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(byte, uint8_t, 8);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(short, int16_t, 16);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(ushort, uint16_t, 16);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(int, int32_t, 32);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(uint, uint32_t, 32);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(long, int64_t, 64);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(ulong, uint64_t, 64);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(float, float, 32);
+NUM_READ_AND_WRITE_FUNC_FACTORY_H(double, double, 64);
+
+#undef NUM_READ_AND_WRITE_FUNC_FACTORY_H
+#undef be8toh
+#undef htobe8
+
 // booleans
 cmc_err cmc_buff_pack_bool(cmc_buff *buff, bool value);
 bool cmc_buff_unpack_bool(cmc_buff *buff);
 
 // varints
+#define CMC_VARINT_MAX_BYTES 5
+#define CMC_VARLONG_MAX_BYTES 10
+
 cmc_err cmc_buff_pack_varint(cmc_buff *buff, int n);
 int32_t cmc_buff_unpack_varint(cmc_buff *buff);
+cmc_err cmc_buff_pack_varlong(cmc_buff *buff, int64_t n);
+int64_t cmc_buff_unpack_varlong(cmc_buff *buff);
+
+/*
+Bulk versions for arrays of varints, the buffer is only grown or bounds
+checked once for the whole array.
+*/
+cmc_err cmc_buff_pack_varint_array(cmc_buff *buff, const int32_t *values,
+                                   size_t n);
+cmc_err cmc_buff_unpack_varint_array(cmc_buff *buff, int32_t *values, size_t n);
+
+/*
+Encodes n into dst which needs room for CMC_VARINT_MAX_BYTES bytes and
+returns the number of bytes written.
+*/
+size_t cmc_varint_encode(uint8_t *dst, int32_t n);
+size_t cmc_varint_size(int32_t n);
 
 // strings
 cmc_err cmc_buff_pack_string_w_max_len(cmc_buff *buff, const char *str,
@@ -61,6 +203,29 @@ char *cmc_buff_unpack_string_w_max_len(cmc_buff *buff, int max_len);
 char *cmc_buff_unpack_string(cmc_buff *buff);
 void cmc_string_free(char *str);
 
+/*
+A string that borrows its bytes, not null terminated. Views from
+cmc_buff_unpack_string_view point into buff->data and are only valid while
+the buffer lives and is not written to, use the char * functions above to keep
+a string longer.
+*/
+typedef struct {
+  const char *data;
+  size_t length;
+} cmc_string_view;
+
+static inline cmc_string_view cmc_string_view_from(const char *str) {
+  return (cmc_string_view){.data = str, .length = strlen(str)};
+}
+
+cmc_err cmc_buff_pack_string_view_w_max_len(cmc_buff *buff,
+                                            cmc_string_view str,
+                                            size_t max_len);
+cmc_err cmc_buff_pack_string_view(cmc_buff *buff, cmc_string_view str);
+cmc_string_view cmc_buff_unpack_string_view_w_max_len(cmc_buff *buff,
+                                                      int max_len);
+cmc_string_view cmc_buff_unpack_string_view(cmc_buff *buff);
+
 // Block pos
 typedef struct {
   long x;
@@ -90,6 +255,8 @@ typedef struct {
 cmc_err cmc_buff_pack_slot(cmc_buff *buff, cmc_slot *slot);
 cmc_slot *cmc_buff_unpack_slot(cmc_buff *buff);
 cmc_err cmc_slot_free(cmc_slot *slot, cmc_err_extra *err);
+// frees what a slot unpacked into an arena holds outside of it, see cmc/arena.h
+cmc_err cmc_slot_free_in_arena(cmc_slot *slot, cmc_err_extra *err);
 
 // Entity metadata
 typedef enum {
@@ -134,6 +301,8 @@ cmc_entity_metadata cmc_buff_unpack_entity_metadata(cmc_buff *buff);
 
 cmc_err cmc_entity_metadata_free(cmc_entity_metadata metadata,
                                  cmc_err_extra *err);
+cmc_err cmc_entity_metadata_free_in_arena(cmc_entity_metadata metadata,
+                                          cmc_err_extra *err);
 
 // uuids
 typedef struct {
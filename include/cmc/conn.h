@@ -1,10 +1,14 @@
 #pragma once
 
 #include <cmc/buff.h>
+#include <cmc/histogram.h>
+#include <cmc/pool.h>
 #include <cmc/protocol.h>
 
 #include <netinet/in.h>
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -19,27 +23,289 @@ typedef enum {
 
 typedef enum { CMC_DIRECTION_S2C, CMC_DIRECTION_C2S } cmc_packet_direction;
 
+// room for the packet length and the data length varint in front of a packet
+#define CMC_CONN_PACKET_HEADROOM (2 * CMC_VARINT_MAX_BYTES)
+
+#define CMC_CONN_RX_DEFAULT_CAPACITY (64 * 1024)
+// reads into the receive buffer always ask for at least this much
+#define CMC_CONN_RX_MIN_READ (16 * 1024)
+
+/*
+Bytes read from the socket that were not handed out as packets yet, the
+unread part is data[start, end). Packets are framed straight out of it so a
+single recv can serve many packets.
+*/
+typedef struct {
+  uint8_t *data;
+  size_t start;
+  size_t end;
+  size_t capacity;
+  size_t wanted; // size of the incomplete packet at start, if known
+} cmc_conn_rx;
+
+/*
+Default receive limits, anything past them fails with
+CMC_ERR_INVALID_PACKET_LENGTH before it is allocated. The first two are the
+limits vanilla enforces.
+*/
+#define CMC_CONN_DEFAULT_MAX_FRAME_LENGTH ((1 << 21) - 1)
+#define CMC_CONN_DEFAULT_MAX_DECOMPRESSED_LENGTH (8 * 1024 * 1024)
+#define CMC_CONN_DEFAULT_MAX_BUFFERED_BYTES (16 * 1024 * 1024)
+
+#define CMC_CONN_TX_MIN_CAPACITY (4 * 1024)
+
+// framed bytes a non blocking connection could not send yet, data[start, end)
+typedef struct {
+  uint8_t *data;
+  size_t start;
+  size_t end;
+  size_t capacity;
+} cmc_conn_tx;
+
+// play packet ids a connection can filter on, see cmc_conn_want_packet
+#define CMC_CONN_PACKET_FILTER_IDS 256
+
+/*
+What the keep alive responder did, see cmc_conn_set_auto_keep_alive. The
+turnaround is the time from finding the keep alive in the receive buffer to
+its reply being sent or queued, the round trip the server sees adds the
+network both ways on top.
+*/
+typedef struct {
+  uint64_t answered;
+  int64_t last_id;
+  uint64_t last_answered_ns; // CLOCK_MONOTONIC
+  uint64_t last_turnaround_ns;
+  uint64_t max_turnaround_ns;
+} cmc_conn_keep_alive_stats;
+
+/*
+Where the time of a received packet goes, see cmc_conn_enable_latency_stats.
+Every stage starts or ends with the recv that completed the packet.
+*/
+typedef enum {
+  // read from the socket until taken out of the receive buffer
+  CMC_CONN_STAGE_QUEUED,
+  CMC_CONN_STAGE_INFLATE, // inflating a compressed packet
+  // handed to the application until cmc_conn_packet_decoded
+  CMC_CONN_STAGE_DECODE,
+  // read from the socket until the first send after it was handed out
+  CMC_CONN_STAGE_RESPOND,
+  CMC_CONN_STAGES
+} cmc_conn_stage;
+
+// Nanoseconds per stage.
+typedef struct {
+  cmc_histogram stages[CMC_CONN_STAGES];
+  // read from the socket until answered by cmc_conn_set_auto_keep_alive
+  cmc_histogram keep_alive;
+} cmc_conn_latency;
+
+// length of the shared secret of the login encryption response
+#define CMC_CONN_SHARED_SECRET_LENGTH 16
+
+// queued bytes that make a corked connection send, see cmc_conn_cork
+#define CMC_CONN_CORK_DEFAULT_MAX_BYTES (16 * 1024)
+
 typedef struct {
   int sockfd;
   struct sockaddr_in addr;
-  cmc_conn_state state;
+  // atomic because scheduler workers may change it, see cmc/scheduler.h
+  _Atomic cmc_conn_state state;
   ssize_t compression_threshold;
+  int compression_level; // see cmc_conn_set_compression_params
+  int compression_strategy;
+  // reused for every packet, created on first use and freed by close
+  struct cmc_inflater *inflater;
+  struct cmc_deflater *deflater;
+  // null until cmc_conn_enable_encryption, freed by close
+  struct evp_cipher_ctx_st *encrypt_ctx;
+  struct evp_cipher_ctx_st *decrypt_ctx;
   char *name;
   cmc_protocol_version protocol_version;
   cmc_err_extra err;
+  cmc_buff_pool *pool; // buffers for this connection, null means malloc
+  size_t max_frame_length;        // a packet as sent, compressed or not
+  size_t max_decompressed_length; // what a compressed packet may inflate to
+  // receive buffer plus the packet being inflated into
+  size_t max_buffered_bytes;
+  cmc_conn_rx rx;
+  cmc_conn_tx tx;
+  bool filter_packets; // only deliver play packets set in wanted_packets
+  uint64_t wanted_packets[CMC_CONN_PACKET_FILTER_IDS / 64];
+  bool auto_keep_alive; // see cmc_conn_set_auto_keep_alive
+  cmc_conn_keep_alive_stats keep_alive_stats;
+  // null until cmc_conn_enable_latency_stats, freed by close
+  struct cmc_conn_timing *timing;
+  bool nonblocking;
+  bool corked;
+  size_t cork_max_bytes;
+  uint64_t cork_max_delay_ns;
+  uint64_t cork_since_ns; // when the oldest queued packet was queued
+  /*
+  Packets other threads handed over with cmc_conn_queue_packet, null until
+  cmc_conn_enable_send_queue. A loop puts its eventfd into send_wake_fd.
+  */
+  struct cmc_mpsc_queue *send_queue;
+  _Atomic int send_wake_fd;
+  _Atomic bool send_signalled; // packets were queued since the last drain
+  struct cmc_loop *loop;           // the loop the connection is registered with
+  struct cmc_loop_conn *loop_conn; // the loops state for the connection
+  // the pipelines state for the connection
+  struct cmc_pipeline_conn *pipeline_conn;
+  // the schedulers state for the connection
+  struct cmc_scheduler_conn *scheduler_conn;
+  void *user_data;       // free for the application
 } cmc_conn;
 
 cmc_conn cmc_conn_init(cmc_protocol_version protocol_version);
 
+/*
+Returns an empty buffer with room for capacity bytes, taken from conn->pool
+if the connection has one. Used for every packet the connection sends or
+receives. May return null if malloc failed.
+*/
+cmc_buff *cmc_conn_buff_init(cmc_conn *conn, size_t capacity);
+
 cmc_err cmc_conn_connect(cmc_conn *conn, struct sockaddr *addr,
                          socklen_t addr_len);
 
+/*
+Returns the next packet, only calling recv when the receive buffer holds no
+complete packet. May return null on error.
+*/
 cmc_buff *cmc_conn_recive_packet(cmc_conn *conn);
 
+/*
+Non blocking version of cmc_conn_recive_packet. Returns null without setting
+conn->err when no complete packet has arrived yet.
+*/
+cmc_buff *cmc_conn_try_recive_packet(cmc_conn *conn);
+
+/*
+Puts the socket in or out of O_NONBLOCK mode. Sends on a non blocking
+connection are queued and written as far as the socket allows, the rest
+goes out with cmc_conn_flush.
+*/
+cmc_err cmc_conn_set_nonblocking(cmc_conn *conn, bool nonblocking);
+
+/*
+Sends queued bytes until the queue is empty or the socket would block. On a
+connection that belongs to an io_uring loop the send is only submitted on the
+next cmc_loop_run_once.
+*/
+cmc_err cmc_conn_flush(cmc_conn *conn);
+
+/*
+Turns on AES-128-CFB8 in both directions, with the shared secret as key and iv
+like the login encryption response sets it up. Bytes are encrypted in place
+in the send queue and decrypted as they are received, everything received
+before this call is taken as plaintext.
+*/
+cmc_err cmc_conn_enable_encryption(
+    cmc_conn *conn, const uint8_t secret[CMC_CONN_SHARED_SECRET_LENGTH]);
+
+/*
+Makes the connection deliver only the play packets whose ids were passed to
+this. Any other play packet is dropped after inflating just enough of it to
+read its id, so unwanted chunk data never gets decompressed. Packets in the
+other states are always delivered. Ids from CMC_CONN_PACKET_FILTER_IDS up
+can't be filtered and are always delivered as well.
+*/
+void cmc_conn_want_packet(cmc_conn *conn, int packet_id);
+
+// Turns the filter off again, every packet is delivered.
+void cmc_conn_want_all_packets(cmc_conn *conn);
+
+/*
+Makes the connection answer the keep alives of the server itself, in the
+play and the configuration state. They are answered while reading the
+receive buffer, before any packet behind them is handed out, and never
+reach the application. A busy application thread can't get the client
+kicked for not answering in time then. Off by default.
+*/
+void cmc_conn_set_auto_keep_alive(cmc_conn *conn, bool enabled);
+
+/*
+Starts timing every packet through the stages of cmc_conn_stage, recorded
+into the histograms cmc_conn_get_latency returns. Costs a clock read at
+every recv and two for every packet handed out, nothing while it is off.
+Packets handed out as frames (cmc_conn_pop_frame and the pipeline) are
+inflated elsewhere and skip CMC_CONN_STAGE_INFLATE.
+*/
+cmc_err cmc_conn_enable_latency_stats(cmc_conn *conn);
+
+/*
+Tells the connection the application is done decoding the packet it handed
+out last, which ends CMC_CONN_STAGE_DECODE. Only the first call per packet
+counts, on the thread the packet was received on.
+*/
+void cmc_conn_packet_decoded(cmc_conn *conn);
+
+/*
+The live histograms, null if latency stats are off. Any thread can read
+them or take a consistent enough copy with cmc_conn_latency_snapshot while
+the connection keeps recording.
+*/
+const cmc_conn_latency *cmc_conn_get_latency(const cmc_conn *conn);
+
+// Copies the histograms into out. Returns false if latency stats are off.
+bool cmc_conn_latency_snapshot(const cmc_conn *conn, cmc_conn_latency *out);
+
+const char *cmc_conn_stage_string(cmc_conn_stage stage);
+
+/*
+Sets the zlib compression level (0 to 9, -1 is zlibs default) and strategy
+(Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE or Z_FIXED) for
+packets sent from now on. A cmc built with CMC_USE_LIBDEFLATE ignores the
+strategy.
+*/
+void cmc_conn_set_compression_params(cmc_conn *conn, int level, int strategy);
+
+/*
+Queues sends instead of writing every packet on its own, so a burst of small
+packets goes out with a single send. The queue is sent on cmc_conn_flush,
+once max_bytes are queued (0 means CMC_CONN_CORK_DEFAULT_MAX_BYTES) and when a
+send finds the oldest queued packet older than max_delay_ms (0 means no time
+limit). Connections in a loop also send it after every batch of events.
+Whatever is still queued when the connection is closed is dropped.
+*/
+void cmc_conn_cork(cmc_conn *conn, size_t max_bytes, uint32_t max_delay_ms);
+
+// Stops queueing sends and flushes what was queued.
+cmc_err cmc_conn_uncork(cmc_conn *conn);
+
 void cmc_conn_send_buffer(cmc_conn *conn, cmc_buff *buff);
 
 void cmc_conn_send_and_free_buffer(cmc_conn *conn, cmc_buff *buff);
 
+/*
+Sends the bytes from buff->position to buff->length as one packet. If the
+buffer was started with cmc_buff_reserve_headroom(buff,
+CMC_CONN_PACKET_HEADROOM) the length prefixes are written into that room
+instead of copying the packet into a new buffer.
+*/
 void cmc_conn_send_packet(cmc_conn *conn, cmc_buff *buff);
 
+/*
+Creates the queue cmc_conn_queue_packet fills, with room for capacity
+packets. Has to happen before other threads get to see the connection.
+*/
+cmc_err cmc_conn_enable_send_queue(cmc_conn *conn, size_t capacity);
+
+/*
+Hands packet to the thread that owns the connection. Safe to call from any
+number of threads at once, without a lock. The connection takes packet and
+frees it once it is sent. Returns false if the queue is full, packet stays
+with the caller then. A loop the connection is in wakes up and sends it,
+otherwise the owning thread has to call cmc_conn_send_queued_packets.
+*/
+bool cmc_conn_queue_packet(cmc_conn *conn, cmc_buff *packet);
+
+/*
+Sends and frees what cmc_conn_queue_packet queued, on the thread owning the
+connection. Stops at the first packet that fails to send.
+*/
+cmc_err cmc_conn_send_queued_packets(cmc_conn *conn);
+
 cmc_err cmc_conn_close(cmc_conn *conn);
@@ -31,7 +31,10 @@
   X(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION)                                      \
   X(CMC_ERR_UNEXPECTED_PACKET)                                                 \
   X(CMC_ERR_REALLOC_ZERO)                                                      \
-  X(CMC_ERR_NEGATIVE_STRING_LENGTH)
+  X(CMC_ERR_NEGATIVE_STRING_LENGTH)                                            \
+  X(CMC_ERR_INVALID_VARINT)                                                    \
+  X(CMC_ERR_ENCRYPTION)                                                        \
+  X(CMC_ERR_TIMEOUT)
 
 typedef enum {
 #define X(ERR) ERR,
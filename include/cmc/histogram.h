@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+A fixed size latency histogram in the style of HdrHistogram. Every power of
+two is split into CMC_HISTOGRAM_SUB_BUCKETS linear buckets, so a recorded
+value is off by less than 1/CMC_HISTOGRAM_SUB_BUCKETS (6.25 %) at any
+magnitude. Values are meant to be nanoseconds, everything from
+CMC_HISTOGRAM_MAX_VALUE (about 68 s) up lands in the last bucket.
+
+One thread records, any thread may read or copy it at the same time. The
+counters are only ever stored with relaxed atomics, so recording costs a
+few plain loads and stores. A copy taken while values are recorded can be
+a few values behind in some buckets.
+*/
+
+#define CMC_HISTOGRAM_SUB_BUCKET_BITS 4
+#define CMC_HISTOGRAM_SUB_BUCKETS (1 << CMC_HISTOGRAM_SUB_BUCKET_BITS)
+#define CMC_HISTOGRAM_MAX_BITS 36
+#define CMC_HISTOGRAM_MAX_VALUE ((UINT64_C(1) << CMC_HISTOGRAM_MAX_BITS) - 1)
+#define CMC_HISTOGRAM_BUCKETS                                                  \
+  ((CMC_HISTOGRAM_MAX_BITS - CMC_HISTOGRAM_SUB_BUCKET_BITS + 1)                \
+   << CMC_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Zero initialized it is empty.
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t sum;
+  _Atomic uint64_t max;
+  _Atomic uint64_t buckets[CMC_HISTOGRAM_BUCKETS];
+} cmc_histogram;
+
+// Only one thread may record into a histogram.
+void cmc_histogram_record(cmc_histogram *histogram, uint64_t value);
+
+// Copies histogram into out, safe while another thread records into it.
+void cmc_histogram_copy(cmc_histogram *out, const cmc_histogram *histogram);
+
+// Empties the histogram, not while another thread records into it.
+void cmc_histogram_reset(cmc_histogram *histogram);
+
+uint64_t cmc_histogram_count(const cmc_histogram *histogram);
+
+uint64_t cmc_histogram_max(const cmc_histogram *histogram);
+
+// 0 for an empty histogram.
+uint64_t cmc_histogram_mean(const cmc_histogram *histogram);
+
+/*
+The value percentile percent (0 to 100) of the recorded values are at or
+below, rounded up to the end of its bucket but never past the max. 0 for an
+empty histogram.
+*/
+uint64_t cmc_histogram_percentile(const cmc_histogram *histogram,
+                                  double percentile);
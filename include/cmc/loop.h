@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/timer.h>
+
+#include <sys/socket.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+An event loop for many connections on one thread. Connections added to a loop
+are switched to non blocking mode, every complete packet that arrives on one
+of them is decoded and handed to on_packet, and sends made on them are queued
+and flushed whenever the socket becomes writable again.
+
+When a connection fails (the peer closed it, a recv, send, connect or decode
+error) it is removed from the loop and on_close is called, conn->err says
+why. The loop never closes or frees a connection itself.
+
+Callbacks may send on any connection and add or remove connections, but must
+not free a cmc_conn, free removed connections after cmc_loop_run_once
+returned. Timers armed on cmc_loop_get_timers fire on the loop thread, like
+the other callbacks. A loop is not thread safe, other threads can only send with
+cmc_conn_queue_packet and call cmc_loop_wake.
+*/
+typedef struct cmc_loop cmc_loop;
+
+typedef enum {
+  CMC_LOOP_BACKEND_AUTO, // io_uring if the kernel supports it, else epoll
+  CMC_LOOP_BACKEND_EPOLL,
+  /*
+  Multishot receives into a ring of provided buffers and sends that are
+  submitted in one batch per cmc_loop_run_once. Needs linux 6.0 or newer.
+  */
+  CMC_LOOP_BACKEND_IO_URING,
+} cmc_loop_backend;
+
+typedef struct {
+  // the callback owns packet and has to free it
+  void (*on_packet)(cmc_loop *loop, cmc_conn *conn, cmc_buff *packet);
+  // conn was removed from the loop, may be null
+  void (*on_close)(cmc_loop *loop, cmc_conn *conn);
+  // a cmc_loop_connect finished, may be null
+  void (*on_connect)(cmc_loop *loop, cmc_conn *conn);
+  void *user_data;
+} cmc_loop_callbacks;
+
+// events handled per epoll_wait
+#define CMC_LOOP_MAX_EVENTS 256
+
+// size of the io_uring submission queue, the completion queue is 4 times that
+#define CMC_LOOP_URING_ENTRIES 4096
+// receive buffers shared by all connections of an io_uring loop
+#define CMC_LOOP_URING_BUFFERS 1024
+#define CMC_LOOP_URING_BUFFER_SIZE (8 * 1024)
+
+// Same as cmc_loop_init_with_backend(callbacks, CMC_LOOP_BACKEND_AUTO).
+cmc_loop *cmc_loop_init(cmc_loop_callbacks callbacks);
+
+/*
+May return null if malloc failed or the backend is not available on this
+system.
+*/
+cmc_loop *cmc_loop_init_with_backend(cmc_loop_callbacks callbacks,
+                                     cmc_loop_backend backend);
+
+// The registered connections are removed but not closed.
+void cmc_loop_free(cmc_loop *loop);
+
+cmc_loop_backend cmc_loop_get_backend(const cmc_loop *loop);
+
+const char *cmc_loop_backend_string(cmc_loop_backend backend);
+
+cmc_loop_callbacks *cmc_loop_get_callbacks(cmc_loop *loop);
+
+/*
+The timers of the loop, advanced by cmc_loop_run_once with CLOCK_MONOTONIC.
+Use it for keep alive deadlines and periodic sends, cmc_loop_run_once waits
+no longer than until the next timer is due.
+*/
+cmc_timer_wheel *cmc_loop_get_timers(cmc_loop *loop);
+
+/*
+Makes a cmc_loop_run_once that is waiting return, callable from any thread.
+cmc_conn_queue_packet does this on its own.
+*/
+void cmc_loop_wake(cmc_loop *loop);
+
+/*
+Registers a connected conn and makes its socket non blocking. Packets the
+connection already has buffered are delivered on the next
+cmc_loop_run_once.
+*/
+cmc_err cmc_loop_add(cmc_loop *loop, cmc_conn *conn);
+
+/*
+Creates a non blocking socket for conn, starts connecting it to addr and
+registers it. on_connect is called once the connection is established,
+on_close if it failed. Sends made before that are queued.
+*/
+cmc_err cmc_loop_connect(cmc_loop *loop, cmc_conn *conn,
+                         const struct sockaddr *addr, socklen_t addr_len);
+
+// Unregisters conn without calling on_close, it stays non blocking.
+void cmc_loop_remove(cmc_loop *loop, cmc_conn *conn);
+
+size_t cmc_loop_conn_count(const cmc_loop *loop);
+
+/*
+Closes conn with CMC_ERR_TIMEOUT once no packet arrived for timeout_ms,
+counted from now. 0 turns it off. Packets only note the time, a connection
+that is busy costs nothing more than one that is idle.
+*/
+void cmc_loop_set_read_timeout(cmc_loop *loop, cmc_conn *conn,
+                               uint64_t timeout_ms);
+
+/*
+Waits up to timeout_ms (-1 means forever) for socket events and handles them
+and fires the timers that are due. Returns the number of events and timers
+handled or -1 if waiting failed.
+*/
+int cmc_loop_run_once(cmc_loop *loop, int timeout_ms);
+
+/*
+Runs until cmc_loop_stop is called from a callback or no connections are
+left.
+*/
+cmc_err cmc_loop_run(cmc_loop *loop);
+
+void cmc_loop_stop(cmc_loop *loop);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cmc/packets.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+Process wide traffic and cost counters per packet, to find the packets worth
+optimizing. Connections count every packet they receive (as S2C) and send
+(as C2S) under the name cmc_packet_id_to_packet_name_id gives its id, the
+generated unpack_* and cmc_send_* functions add the time they spend
+decoding and encoding it. Ids without a name count as CMC_UNKOWN_NAME_ID.
+
+Off by default, then it costs a relaxed load per packet. While on every
+packet adds to a few shared atomic counters, which threads decoding at the
+same time contend on.
+
+Cycles are TSC ticks on x86 and nanoseconds elsewhere.
+*/
+typedef struct {
+  uint64_t received;
+  uint64_t received_bytes;      // framed as on the wire, compressed or not
+  uint64_t received_data_bytes; // decompressed, packet id included
+  uint64_t decoded;             // successful unpack_* calls
+  uint64_t decode_cycles;
+  uint64_t sent;
+  uint64_t sent_bytes;
+  uint64_t sent_data_bytes;
+  uint64_t encoded; // cmc_send_* calls
+  uint64_t encode_cycles;
+} cmc_packet_stats;
+
+void cmc_packet_stats_enable(bool enabled);
+
+bool cmc_packet_stats_enabled(void);
+
+cmc_packet_stats cmc_packet_stats_get(cmc_packet_name_id id);
+
+// Zeroes every counter.
+void cmc_packet_stats_reset(void);
+
+/*
+Prints a table of every packet that was counted, the ones that took the
+most cycles first and the ones with the most bytes after them.
+*/
+void cmc_packet_stats_dump(FILE *out);
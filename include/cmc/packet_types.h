@@ -13,10 +13,12 @@ typedef struct {
   char *server_addr;
   uint16_t server_port;
   int32_t next_state;
+  bool in_arena;
 } C2S_handshake_handshake_packet;
 
 typedef struct {
   char *response;
+  bool in_arena;
 } S2C_status_response_packet;
 
 typedef struct {
@@ -29,12 +31,14 @@ typedef struct {
 
 typedef struct {
   char *reason;
+  bool in_arena;
 } S2C_login_disconnect_packet;
 
 typedef struct {
   char *server_id;
   cmc_buff *public_key;
   cmc_buff *verify_token;
+  bool in_arena;
 } S2C_login_encryption_request_packet;
 
 typedef struct {
@@ -42,6 +46,7 @@ typedef struct {
   char *name;
   cmc_uuid uuid;
   int32_t properties_count;
+  bool in_arena;
 } S2C_login_success_packet;
 
 typedef struct {
@@ -51,6 +56,7 @@ typedef struct {
 typedef struct {
   char *name;
   cmc_uuid uuid;
+  bool in_arena;
 } C2S_login_start_packet;
 
 typedef struct {
@@ -69,12 +75,12 @@ typedef struct {
   int8_t dimension;
   uint8_t difficulty;
   uint8_t max_players;
-  char *level_type;
+  cmc_string_view level_type;
   bool reduced_debug_info;
 } S2C_play_join_game_packet;
 
 typedef struct {
-  char *message;
+  cmc_string_view message;
   int8_t position;
 } S2C_play_chat_message_packet;
 
@@ -87,6 +93,7 @@ typedef struct {
   int32_t entity_id;
   int16_t slot;
   cmc_slot *item;
+  bool in_arena;
 } S2C_play_entity_equipment_packet;
 
 typedef struct {
@@ -103,7 +110,7 @@ typedef struct {
   int32_t dimesion;
   uint8_t difficulty;
   uint8_t gamemode;
-  char *level_type;
+  cmc_string_view level_type;
 } S2C_play_respawn_packet;
 
 typedef struct {
@@ -139,6 +146,7 @@ typedef struct {
   uint8_t pitch;
   int16_t current_item;
   cmc_entity_metadata meta_data;
+  bool in_arena;
 } S2C_play_spawn_player_packet;
 
 typedef struct {
@@ -159,6 +167,7 @@ typedef struct {
   int16_t y_vel;
   int16_t z_vel;
   cmc_entity_metadata meta_data;
+  bool in_arena;
 } S2C_play_spawn_mob_packet;
 
 typedef struct {
@@ -166,6 +175,7 @@ typedef struct {
   char *title;
   cmc_block_pos location;
   uint8_t direction;
+  bool in_arena;
 } S2C_play_spawn_painting_packet;
 
 typedef struct {
@@ -183,6 +193,16 @@ typedef struct {
   int16_t z_vel;
 } S2C_play_entity_velocity_packet;
 
+typedef struct {
+  int32_t entity_id;
+} S2C_play_destroy_entities_entities;
+
+typedef struct {
+  int32_t count;
+  cmc_array entities;
+  bool in_arena;
+} S2C_play_destroy_entities_packet;
+
 typedef struct {
   int32_t entity_id;
 } S2C_play_entity_packet;
@@ -241,6 +261,7 @@ typedef struct {
 typedef struct {
   int32_t entity_id;
   cmc_entity_metadata meta_data;
+  bool in_arena;
 } S2C_play_entity_metadata_packet;
 
 typedef struct {
@@ -278,6 +299,7 @@ typedef struct {
   int32_t entity_id;
   int32_t properties_count;
   cmc_array properties;
+  bool in_arena;
 } S2C_play_entity_properties_packet;
 
 typedef struct {
@@ -299,6 +321,7 @@ typedef struct {
   int32_t chunk_z;
   int32_t record_count;
   cmc_array records;
+  bool in_arena;
 } S2C_play_multi_block_change_packet;
 
 typedef struct {
@@ -330,6 +353,7 @@ typedef struct {
   int32_t chunk_column_count;
   cmc_array chunk_columns;
   cmc_buff *chunk;
+  bool in_arena;
 } S2C_play_map_chunk_bulk_packet;
 
 typedef struct {
@@ -348,6 +372,7 @@ typedef struct {
   float x_player_vel;
   float y_player_vel;
   float z_player_vel;
+  bool in_arena;
 } S2C_play_explosion_packet;
 
 typedef struct {
@@ -369,7 +394,7 @@ typedef struct {
 } S2C_play_effect_packet;
 
 typedef struct {
-  char *sound_name;
+  cmc_string_view sound_name;
   int32_t x;
   int32_t y;
   int32_t z;
@@ -389,13 +414,14 @@ typedef struct {
 } S2C_play_player_abilities_packet;
 
 typedef struct {
-  char *channel;
+  cmc_string_view channel;
   cmc_buff *data;
 } S2C_play_plugin_message_packet;
 
 typedef struct {
   char *reason;
   cmc_nbt *reason_nbt;
+  bool in_arena;
 } S2C_play_disconnect_packet;
 
 typedef struct {
@@ -408,12 +434,13 @@ typedef struct {
 } C2S_play_keep_alive_packet;
 
 typedef struct {
-  char *channel;
+  cmc_string_view channel;
   cmc_buff *data;
 } S2C_config_plugin_message_packet;
 
 typedef struct {
   char *reason;
+  bool in_arena;
 } S2C_config_disconnect_packet;
 
 typedef struct {
@@ -428,4 +455,8 @@ typedef struct {
   cmc_nbt *registry_codec;
 } S2C_config_registry_data_packet;
 
+typedef struct {
+  int64_t keep_alive_id;
+} C2S_config_keep_alive_packet;
+
 // CGSE: packet_types
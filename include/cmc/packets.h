@@ -38,6 +38,7 @@ typedef enum {
   CMC_S2C_PLAY_SPAWN_PAINTING_NAME_ID,
   CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_NAME_ID,
   CMC_S2C_PLAY_ENTITY_VELOCITY_NAME_ID,
+  CMC_S2C_PLAY_DESTROY_ENTITIES_NAME_ID,
   CMC_S2C_PLAY_ENTITY_NAME_ID,
   CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_NAME_ID,
   CMC_S2C_PLAY_ENTITY_LOOK_NAME_ID,
@@ -75,9 +76,59 @@ typedef enum {
   CMC_S2C_CONFIG_REGISTRY_DATA_NAME_ID,
   CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_NAME_ID,
   CMC_S2C_CONFIG_ADD_RESOURCE_PACK_NAME_ID,
+  CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID,
   // CGSE: packet_name_id_define
+  CMC_PACKET_NAME_IDS
 } cmc_packet_name_id;
 
+// upper bounds for the encoded size (packet id included) of packets that only
+// have fixed size fields
+enum {
+  // CGSS: packet_max_size_define
+  CMC_S2C_STATUS_PONG_MAX_SIZE = 9,
+  CMC_C2S_STATUS_REQUEST_MAX_SIZE = 1,
+  CMC_C2S_STATUS_PING_MAX_SIZE = 9,
+  CMC_S2C_LOGIN_SET_COMPRESSION_MAX_SIZE = 6,
+  CMC_S2C_PLAY_KEEP_ALIVE_MAX_SIZE = 9,
+  CMC_S2C_PLAY_TIME_UPDATE_MAX_SIZE = 17,
+  CMC_S2C_PLAY_SPAWN_POSITION_MAX_SIZE = 9,
+  CMC_S2C_PLAY_UPDATE_HEALTH_MAX_SIZE = 14,
+  CMC_S2C_PLAY_PLAYER_LOOK_AND_POSITION_MAX_SIZE = 34,
+  CMC_S2C_PLAY_HELD_ITEM_CHANGE_MAX_SIZE = 2,
+  CMC_S2C_PLAY_USE_BED_MAX_SIZE = 14,
+  CMC_S2C_PLAY_ANIMATION_MAX_SIZE = 7,
+  CMC_S2C_PLAY_COLLECT_ITEM_MAX_SIZE = 11,
+  CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_MAX_SIZE = 20,
+  CMC_S2C_PLAY_ENTITY_VELOCITY_MAX_SIZE = 12,
+  CMC_S2C_PLAY_ENTITY_MAX_SIZE = 6,
+  CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_MAX_SIZE = 10,
+  CMC_S2C_PLAY_ENTITY_LOOK_MAX_SIZE = 9,
+  CMC_S2C_PLAY_ENTITY_LOOK_AND_RELATIVE_MOVE_MAX_SIZE = 12,
+  CMC_S2C_PLAY_ENTITY_TELEPORT_MAX_SIZE = 21,
+  CMC_S2C_PLAY_ENTITY_HEAD_LOOK_MAX_SIZE = 7,
+  CMC_S2C_PLAY_ENTITY_STATUS_MAX_SIZE = 6,
+  CMC_S2C_PLAY_ATTACH_ENTITY_MAX_SIZE = 10,
+  CMC_S2C_PLAY_ENTITY_EFFECT_MAX_SIZE = 14,
+  CMC_S2C_PLAY_REMOVE_ENTITY_EFFECT_MAX_SIZE = 7,
+  CMC_S2C_PLAY_SET_EXPERIENCE_MAX_SIZE = 15,
+  CMC_S2C_PLAY_BLOCK_CHANGE_MAX_SIZE = 14,
+  CMC_S2C_PLAY_BLOCK_ACTION_MAX_SIZE = 16,
+  CMC_S2C_PLAY_BLOCK_BREAK_ANIMATION_MAX_SIZE = 15,
+  CMC_S2C_PLAY_EFFECT_MAX_SIZE = 59,
+  CMC_S2C_PLAY_CHANGE_GAME_STATE_MAX_SIZE = 6,
+  CMC_S2C_PLAY_PLAYER_ABILITIES_MAX_SIZE = 10,
+  CMC_S2C_PLAY_CHANGE_DIFFICULTY_MAX_SIZE = 2,
+  CMC_C2S_PLAY_KEEP_ALIVE_MAX_SIZE = 9,
+  CMC_C2S_LOGIN_ACKNOWLEDGED_MAX_SIZE = 1,
+  CMC_S2C_CONFIG_FINISH_MAX_SIZE = 1,
+  CMC_S2C_CONFIG_KEEP_ALIVE_MAX_SIZE = 9,
+  CMC_S2C_CONFIG_PING_MAX_SIZE = 5,
+  CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_MAX_SIZE = 1,
+  CMC_S2C_CONFIG_ADD_RESOURCE_PACK_MAX_SIZE = 1,
+  CMC_C2S_CONFIG_KEEP_ALIVE_MAX_SIZE = 9,
+  // CGSE: packet_max_size_define
+};
+
 cmc_packet_name_id
 cmc_packet_id_to_packet_name_id(int packet_id, cmc_conn_state state,
                                 cmc_packet_direction direction,
@@ -152,6 +203,8 @@ cmc_err cmc_send_S2C_play_spawn_experience_orb_packet(
     cmc_conn *conn, S2C_play_spawn_experience_orb_packet *packet);
 cmc_err cmc_send_S2C_play_entity_velocity_packet(
     cmc_conn *conn, S2C_play_entity_velocity_packet *packet);
+cmc_err cmc_send_S2C_play_destroy_entities_packet(
+    cmc_conn *conn, S2C_play_destroy_entities_packet *packet);
 cmc_err cmc_send_S2C_play_entity_packet(cmc_conn *conn,
                                         S2C_play_entity_packet *packet);
 cmc_err cmc_send_S2C_play_entity_relative_move_packet(
@@ -234,6 +287,9 @@ cmc_err cmc_send_S2C_config_registry_data_packet(
     cmc_conn *conn, S2C_config_registry_data_packet *packet);
 cmc_err cmc_send_S2C_config_remove_resource_pack_packet(cmc_conn *conn);
 cmc_err cmc_send_S2C_config_add_resource_pack_packet(cmc_conn *conn);
+cmc_err
+cmc_send_C2S_config_keep_alive_packet(cmc_conn *conn,
+                                      C2S_config_keep_alive_packet *packet);
 // CGSE: send_methods_h
 
 // CGSS: unpack_methods_h
@@ -280,6 +336,8 @@ S2C_play_spawn_experience_orb_packet
 unpack_S2C_play_spawn_experience_orb_packet(cmc_buff *buff);
 S2C_play_entity_velocity_packet
 unpack_S2C_play_entity_velocity_packet(cmc_buff *buff);
+S2C_play_destroy_entities_packet
+unpack_S2C_play_destroy_entities_packet(cmc_buff *buff);
 S2C_play_entity_packet unpack_S2C_play_entity_packet(cmc_buff *buff);
 S2C_play_entity_relative_move_packet
 unpack_S2C_play_entity_relative_move_packet(cmc_buff *buff);
@@ -338,6 +396,8 @@ unpack_S2C_config_keep_alive_packet(cmc_buff *buff);
 S2C_config_ping_packet unpack_S2C_config_ping_packet(cmc_buff *buff);
 S2C_config_registry_data_packet
 unpack_S2C_config_registry_data_packet(cmc_buff *buff);
+C2S_config_keep_alive_packet
+unpack_C2S_config_keep_alive_packet(cmc_buff *buff);
 // CGSE: unpack_methods_h
 
 // CGSS: free_methods_h
@@ -397,6 +457,8 @@ void cmc_free_S2C_play_spawn_experience_orb_packet(
     S2C_play_spawn_experience_orb_packet *packet, cmc_err_extra *err);
 void cmc_free_S2C_play_entity_velocity_packet(
     S2C_play_entity_velocity_packet *packet, cmc_err_extra *err);
+void cmc_free_S2C_play_destroy_entities_packet(
+    S2C_play_destroy_entities_packet *packet, cmc_err_extra *err);
 void cmc_free_S2C_play_entity_packet(S2C_play_entity_packet *packet,
                                      cmc_err_extra *err);
 void cmc_free_S2C_play_entity_relative_move_packet(
@@ -463,4 +525,6 @@ void cmc_free_S2C_config_ping_packet(S2C_config_ping_packet *packet,
                                      cmc_err_extra *err);
 void cmc_free_S2C_config_registry_data_packet(
     S2C_config_registry_data_packet *packet, cmc_err_extra *err);
+void cmc_free_C2S_config_keep_alive_packet(C2S_config_keep_alive_packet *packet,
+                                           cmc_err_extra *err);
 // CGSE: free_methods_h
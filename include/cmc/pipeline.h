@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/loop.h>
+
+#include <sys/socket.h>
+
+#include <stddef.h>
+
+/*
+A cmc_loop that moves decoding off the I/O thread. The thread calling
+cmc_pipeline_run_once only frames packets off the sockets, a pool of worker
+threads inflates them and runs the decode callback (typically the generated
+cmc_packet_unpack_* functions), and the results are handed to on_packet on
+the calling thread again, in the order they arrived on each connection.
+
+Only play packets go to the workers. Everything before that decodes inline,
+set_compression and the state changes of login have to be applied before the
+next packet is looked at.
+
+A connection that fails is closed like in a cmc_loop, but on_close waits
+until the packets it received before are delivered. Except for decode every
+callback runs on the thread calling cmc_pipeline_run_once, the same rules as
+for cmc_loop callbacks apply. A pipeline is not thread safe.
+*/
+typedef struct cmc_pipeline cmc_pipeline;
+
+typedef struct {
+  /*
+  Runs on a worker, may be null. Must not touch anything but packet and what
+  it allocates itself, the result is passed to on_packet as decoded. state is
+  the state of the connection when the packet was received, a play packet
+  received before on_packet handled start_configuration still says play.
+  */
+  void *(*decode)(cmc_buff *packet, cmc_conn_state state, void *user_data);
+  // frees results of decode for packets that are dropped, null means free
+  void (*free_decoded)(void *decoded, void *user_data);
+  // the callback owns packet and decoded, packet is left where decode left it
+  void (*on_packet)(cmc_pipeline *pipeline, cmc_conn *conn, cmc_buff *packet,
+                    void *decoded);
+  // conn was removed from the pipeline, may be null
+  void (*on_close)(cmc_pipeline *pipeline, cmc_conn *conn);
+  // a cmc_pipeline_connect finished, may be null
+  void (*on_connect)(cmc_pipeline *pipeline, cmc_conn *conn);
+  void *user_data;
+} cmc_pipeline_callbacks;
+
+// packets queued per worker before the I/O thread waits for one to finish
+#define CMC_PIPELINE_QUEUE_LENGTH 256
+
+/*
+Starts workers threads, with 0 everything is decoded inline like in a plain
+cmc_loop. Returns null if malloc, the backend or starting a thread failed.
+*/
+cmc_pipeline *cmc_pipeline_init(cmc_pipeline_callbacks callbacks,
+                                size_t workers, cmc_loop_backend backend);
+
+// Stops the workers, the registered connections are removed but not closed.
+void cmc_pipeline_free(cmc_pipeline *pipeline);
+
+cmc_pipeline_callbacks *cmc_pipeline_get_callbacks(cmc_pipeline *pipeline);
+
+size_t cmc_pipeline_worker_count(const cmc_pipeline *pipeline);
+
+// See cmc_loop_add.
+cmc_err cmc_pipeline_add(cmc_pipeline *pipeline, cmc_conn *conn);
+
+// See cmc_loop_connect.
+cmc_err cmc_pipeline_connect(cmc_pipeline *pipeline, cmc_conn *conn,
+                             const struct sockaddr *addr, socklen_t addr_len);
+
+/*
+Unregisters conn without calling on_close. Waits for the packets of conn the
+workers are decoding and drops every packet not delivered yet.
+*/
+void cmc_pipeline_remove(cmc_pipeline *pipeline, cmc_conn *conn);
+
+// Connections added and not yet removed or closed.
+size_t cmc_pipeline_conn_count(const cmc_pipeline *pipeline);
+
+/*
+Delivers decoded packets and handles socket events, waiting up to timeout_ms
+(-1 means forever) if there is nothing to do. While workers are busy it waits
+for them instead of the sockets. Returns the number of events and
+connections with delivered packets or -1 if waiting failed.
+*/
+int cmc_pipeline_run_once(cmc_pipeline *pipeline, int timeout_ms);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/protocol.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+A cache of cmc_buffs and their backing storage, sorted into power of two size
+classes from CMC_BUFF_POOL_MIN_CLASS_SIZE up to CMC_BUFF_POOL_MAX_CLASS_SIZE.
+Buffers taken from a pool remember it and go back into it on cmc_buff_free.
+
+A pool is not thread safe, use one per thread (or per connection) and free
+the buffers on the thread that owns the pool. Every buffer has to be freed
+before the pool itself.
+*/
+#define CMC_BUFF_POOL_MIN_CLASS_SIZE 64
+#define CMC_BUFF_POOL_MAX_CLASS_SIZE (1024 * 1024)
+#define CMC_BUFF_POOL_SIZE_CLASSES 15
+
+typedef struct {
+  uint64_t hits;     // acquires served from the cache
+  uint64_t misses;   // acquires that had to malloc
+  uint64_t releases; // buffers that went back into the cache
+  uint64_t drops;    // buffers that were freed because the class was full
+} cmc_buff_pool_stats;
+
+typedef struct cmc_buff_pool {
+  cmc_buff **free_buffs[CMC_BUFF_POOL_SIZE_CLASSES];
+  size_t free_count[CMC_BUFF_POOL_SIZE_CLASSES];
+  size_t max_per_class;
+  cmc_buff_pool_stats stats;
+} cmc_buff_pool;
+
+/*
+max_per_class is the number of free buffers kept per size class.
+May return null if malloc failed.
+*/
+cmc_buff_pool *cmc_buff_pool_init(size_t max_per_class);
+void cmc_buff_pool_free(cmc_buff_pool *pool);
+
+/*
+Returns an empty buffer with room for at least capacity bytes.
+May return null if malloc failed.
+*/
+cmc_buff *cmc_buff_pool_acquire(cmc_buff_pool *pool,
+                                cmc_protocol_version protocol_version,
+                                size_t capacity);
+
+/*
+Puts the buffer back into the pool, this is what cmc_buff_free does for
+pooled buffers.
+*/
+void cmc_buff_pool_release(cmc_buff_pool *pool, cmc_buff *buff);
+
+void cmc_buff_pool_print_stats(const cmc_buff_pool *pool);
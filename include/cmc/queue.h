@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Bounded lock free queues for handing cmc_buffs (or any other pointer) from
+one thread to another. The capacity is rounded up to a power of two and push
+fails instead of waiting when the queue is full, nothing in here blocks.
+
+The indices the producers and the consumer write live on separate cache
+lines, so the two sides only share a line when one of them catches up with
+the other.
+
+A cmc_buff moved to another thread is freed there, so it must not come from
+a cmc_buff_pool, pools are not thread safe.
+*/
+
+// what the queues pad to, the line size of x86-64 and most arm64 cores
+#define CMC_QUEUE_CACHE_LINE 64
+
+// One thread pushes, one thread pops.
+typedef struct cmc_spsc_queue cmc_spsc_queue;
+
+// Any number of threads push, one thread pops.
+typedef struct cmc_mpsc_queue cmc_mpsc_queue;
+
+// May return null if malloc failed.
+cmc_spsc_queue *cmc_spsc_queue_init(size_t capacity);
+
+// Whatever is still queued is not freed.
+void cmc_spsc_queue_free(cmc_spsc_queue *queue);
+
+size_t cmc_spsc_queue_capacity(const cmc_spsc_queue *queue);
+
+// Returns false if the queue is full, value can't be null.
+bool cmc_spsc_queue_push(cmc_spsc_queue *queue, void *value);
+
+// Returns null if the queue is empty.
+void *cmc_spsc_queue_pop(cmc_spsc_queue *queue);
+
+// Only meaningful on the consumer side.
+bool cmc_spsc_queue_empty(cmc_spsc_queue *queue);
+
+// May return null if malloc failed.
+cmc_mpsc_queue *cmc_mpsc_queue_init(size_t capacity);
+
+// Whatever is still queued is not freed.
+void cmc_mpsc_queue_free(cmc_mpsc_queue *queue);
+
+size_t cmc_mpsc_queue_capacity(const cmc_mpsc_queue *queue);
+
+/*
+Returns false if the queue is full, value can't be null. Producers never
+wait for each other, a push that lost the race for a slot retries the next
+one.
+*/
+bool cmc_mpsc_queue_push(cmc_mpsc_queue *queue, void *value);
+
+/*
+Returns null if the queue is empty. Also returns null while the oldest push
+has claimed its slot but not filled it in yet, the value shows up on a later
+pop.
+*/
+void *cmc_mpsc_queue_pop(cmc_mpsc_queue *queue);
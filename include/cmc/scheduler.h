@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/loop.h>
+
+#include <sys/socket.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Runs the packet handlers of many connections on a pool of worker threads.
+The thread calling cmc_scheduler_run_once receives and decodes packets with a
+cmc_loop. Every play packet is queued on its connection, and the connection
+is handed to the worker that ran it last. Packets of one connection are
+handled one after another, never at the same time and always in the order
+they arrived, while different connections run in parallel. A worker with
+nothing to do steals a waiting connection from another worker, together
+with everything that is queued on it.
+
+Packets in the other states are handled on the calling thread as soon as no
+play packet of the connection is waiting, so set_compression, encryption
+and the login state changes apply before the next packet is decoded. A
+handler running on a worker must not touch the compression or encryption of
+the connection. It must send with cmc_conn_queue_packet, the scheduler gives
+every connection a send queue.
+
+Packets are decoded on the calling thread and freed by a handler on a worker,
+packets a handler queues are freed on the calling thread once they are sent.
+A cmc_buff_pool is not thread safe, so the scheduler clears conn->pool and it
+has to stay null while the connection is registered.
+
+A handler running on a worker may change conn->state (the play to
+configuration switch of 765), which is why the field is atomic. The calling
+thread reads the state for every frame it receives, while the worker is
+still busy with older packets:
+- the packet filter of cmc_conn_want_packet
+- the keep alive responder of cmc_conn_set_auto_keep_alive
+- the packet stats, for the packets received and sent
+- the scheduler itself, to pick between the calling thread and a worker
+Each of them uses the state as it is when the calling thread gets to the
+frame, so frames that follow the packet changing the state but arrive before
+its handler ran still go by the old one.
+
+on_close, on_connect and the calls below belong to the thread calling
+cmc_scheduler_run_once. on_close waits until the packets received before are
+handled. Removed connections are freed after cmc_scheduler_run_once
+returned, like with a cmc_loop.
+*/
+typedef struct cmc_scheduler cmc_scheduler;
+
+typedef struct {
+  // the callback owns packet, may run on any worker or the calling thread
+  void (*on_packet)(cmc_scheduler *scheduler, cmc_conn *conn,
+                    cmc_buff *packet);
+  // conn was removed from the scheduler, may be null
+  void (*on_close)(cmc_scheduler *scheduler, cmc_conn *conn);
+  // a cmc_scheduler_connect finished, may be null
+  void (*on_connect)(cmc_scheduler *scheduler, cmc_conn *conn);
+  void *user_data;
+} cmc_scheduler_callbacks;
+
+typedef struct {
+  uint64_t handled;        // packets handled by workers
+  uint64_t inline_handled; // packets handled on the calling thread
+  uint64_t steals;         // connections a worker took from another one
+} cmc_scheduler_stats;
+
+// packets a connection can have waiting before more are held back
+#define CMC_SCHEDULER_CONN_QUEUE_LENGTH 256
+// connections waiting to be picked up by one worker
+#define CMC_SCHEDULER_WORKER_QUEUE_LENGTH 4096
+// connections one worker holds on to, the rest wait for it
+#define CMC_SCHEDULER_DEQUE_LENGTH 65536
+// packets handled in a row before the worker moves on to the next connection
+#define CMC_SCHEDULER_BATCH 32
+// packets handlers can queue with cmc_conn_queue_packet before it fails
+#define CMC_SCHEDULER_SEND_QUEUE_LENGTH 1024
+
+/*
+Starts workers threads, with 0 every packet is handled on the calling
+thread. Returns null if malloc, the backend or starting a thread failed.
+*/
+cmc_scheduler *cmc_scheduler_init(cmc_scheduler_callbacks callbacks,
+                                  size_t workers, cmc_loop_backend backend);
+
+/*
+Stops the workers, the registered connections are removed but not closed.
+Waits for the handlers that are running.
+*/
+void cmc_scheduler_free(cmc_scheduler *scheduler);
+
+cmc_scheduler_callbacks *cmc_scheduler_get_callbacks(cmc_scheduler *scheduler);
+
+size_t cmc_scheduler_worker_count(const cmc_scheduler *scheduler);
+
+// Sums the counters of all workers, they are updated as they go.
+cmc_scheduler_stats cmc_scheduler_get_stats(const cmc_scheduler *scheduler);
+
+/*
+See cmc_loop_add. Enables the send queue if the connection has none and
+clears conn->pool.
+*/
+cmc_err cmc_scheduler_add(cmc_scheduler *scheduler, cmc_conn *conn);
+
+// See cmc_loop_connect.
+cmc_err cmc_scheduler_connect(cmc_scheduler *scheduler, cmc_conn *conn,
+                              const struct sockaddr *addr,
+                              socklen_t addr_len);
+
+/*
+Unregisters conn without calling on_close. Packets that are still queued are
+dropped, a handler that is running for conn is waited for.
+*/
+void cmc_scheduler_remove(cmc_scheduler *scheduler, cmc_conn *conn);
+
+// Connections added and not yet removed or closed.
+size_t cmc_scheduler_conn_count(const cmc_scheduler *scheduler);
+
+/*
+Receives packets and hands them out, waiting up to timeout_ms (-1 means
+forever) for the sockets. Returns the number of events handled or -1 if
+waiting failed.
+*/
+int cmc_scheduler_run_once(cmc_scheduler *scheduler, int timeout_ms);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmc/list.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+A hierarchical timer wheel with millisecond ticks. Arming and cancelling a
+timer only links or unlinks it from a slot, no matter how many timers are
+armed. The first level has a slot for every millisecond of the next 64, each
+level above covers 64 times the span of the one below, and its timers move
+down a level whenever the level below wrapped around. Every level keeps a
+bitmap of its non empty slots, so finding the next expiry and skipping idle
+time doesn't walk the slots.
+
+The wheel doesn't read a clock, cmc_timer_wheel_advance is told the time.
+Every cmc_loop has one that follows CLOCK_MONOTONIC, see cmc_loop_get_timers.
+Nothing in here is thread safe.
+*/
+typedef struct cmc_timer_wheel cmc_timer_wheel;
+
+typedef struct cmc_timer cmc_timer;
+
+typedef void (*cmc_timer_callback)(cmc_timer_wheel *wheel, cmc_timer *timer);
+
+/*
+Embedded into whatever the timer is for, the wheel never allocates one.
+Set it up with cmc_timer_init and don't move it while it is armed.
+*/
+struct cmc_timer {
+  struct list_head entry; // in a slot, flink is null while not armed
+  uint64_t expires_ms;
+  uint64_t interval_ms; // 0 for a one shot timer
+  uint16_t slot;        // level * CMC_TIMER_WHEEL_SLOTS + slot in the level
+  cmc_timer_callback callback;
+  void *user_data;
+};
+
+#define CMC_TIMER_WHEEL_SLOT_BITS 6
+#define CMC_TIMER_WHEEL_SLOTS (1 << CMC_TIMER_WHEEL_SLOT_BITS)
+#define CMC_TIMER_WHEEL_LEVELS 6
+// about 2 years, longer delays are cut to this
+#define CMC_TIMER_MAX_DELAY_MS                                                 \
+  ((UINT64_C(1) << (CMC_TIMER_WHEEL_SLOT_BITS * CMC_TIMER_WHEEL_LEVELS)) - 1)
+
+// Returns null if malloc failed. now_ms is the time to count from.
+cmc_timer_wheel *cmc_timer_wheel_init(uint64_t now_ms);
+
+// Armed timers are left as they are, they just never fire.
+void cmc_timer_wheel_free(cmc_timer_wheel *wheel);
+
+// The time the wheel was last advanced to.
+uint64_t cmc_timer_wheel_now(const cmc_timer_wheel *wheel);
+
+size_t cmc_timer_wheel_count(const cmc_timer_wheel *wheel);
+
+/*
+When the next timer expires, UINT64_MAX if none is armed. The time may be
+earlier than the expiry while the timer still waits on a higher level, the
+wheel has to be advanced then to move it down.
+*/
+uint64_t cmc_timer_wheel_next_expiry(const cmc_timer_wheel *wheel);
+
+/*
+Fires every timer that expired up to now_ms, in the order they expire.
+Callbacks may arm and cancel any timer, cmc_timer_wheel_now is the time the
+timer was due. Returns the number of callbacks called.
+*/
+size_t cmc_timer_wheel_advance(cmc_timer_wheel *wheel, uint64_t now_ms);
+
+// Milliseconds of CLOCK_MONOTONIC.
+uint64_t cmc_timer_now_ms(void);
+
+void cmc_timer_init(cmc_timer *timer, cmc_timer_callback callback,
+                    void *user_data);
+
+/*
+Fires timer delay_ms after the time the wheel was last advanced to, at least
+1 ms later. With interval_ms it fires again every interval_ms after that
+until cancelled, expiries the wheel was advanced past at once are skipped.
+An armed timer is moved.
+*/
+void cmc_timer_arm(cmc_timer_wheel *wheel, cmc_timer *timer, uint64_t delay_ms,
+                   uint64_t interval_ms);
+
+// Does nothing if the timer isn't armed.
+void cmc_timer_cancel(cmc_timer_wheel *wheel, cmc_timer *timer);
+
+bool cmc_timer_armed(const cmc_timer *timer);
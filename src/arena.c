@@ -0,0 +1,155 @@
+#include <cmc/arena.h>
+
+#include <cmc/err.h>
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "err_macros.h"
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t capacity;
+  size_t used;
+  alignas(ARENA_ALIGN) uint8_t data[];
+} arena_block;
+
+struct cmc_arena {
+  arena_block *blocks; // newest first, allocations only go into the first one
+  size_t block_size;
+  size_t used;
+  void *last;
+};
+
+static size_t align_up(size_t n) {
+  return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static arena_block *block_new(size_t capacity) {
+  arena_block *block = malloc(sizeof(arena_block) + capacity);
+  if (!block)
+    return NULL;
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  return block;
+}
+
+cmc_arena *cmc_arena_init(size_t block_size) {
+  cmc_arena *arena = malloc(sizeof(cmc_arena));
+  if (!arena)
+    return NULL;
+  arena->block_size = block_size ? align_up(block_size)
+                                 : CMC_ARENA_DEFAULT_BLOCK_SIZE;
+  arena->blocks = block_new(arena->block_size);
+  if (!arena->blocks) {
+    free(arena);
+    return NULL;
+  }
+  arena->used = 0;
+  arena->last = NULL;
+  return arena;
+}
+
+static void free_blocks(arena_block *block) {
+  while (block) {
+    arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+void cmc_arena_free(cmc_arena *arena) {
+  assert(arena);
+  free_blocks(arena->blocks);
+  free(arena);
+}
+
+void cmc_arena_reset(cmc_arena *arena) {
+  assert(arena);
+  arena->used = 0;
+  arena->last = NULL;
+  if (!arena->blocks->next) {
+    arena->blocks->used = 0;
+    return;
+  }
+
+  size_t total = 0;
+  for (arena_block *block = arena->blocks; block; block = block->next)
+    total += block->capacity;
+  arena_block *merged = block_new(total);
+  if (merged) {
+    free_blocks(arena->blocks);
+    arena->blocks = merged;
+    arena->block_size = total;
+    return;
+  }
+  // keep the newest block if the merged one could not be allocated
+  free_blocks(arena->blocks->next);
+  arena->blocks->next = NULL;
+  arena->blocks->used = 0;
+}
+
+void *cmc_arena_alloc(cmc_arena *arena, size_t n, cmc_err_extra *err) {
+  assert(arena);
+  if (n == 0)
+    CMC_ERR(CMC_ERR_MALLOC_ZERO, return NULL;);
+  n = align_up(n);
+
+  arena_block *block = arena->blocks;
+  if (block->capacity - block->used < n) {
+    size_t capacity = arena->block_size > n ? arena->block_size : n;
+    block = block_new(capacity);
+    if (!block)
+      CMC_ERR(CMC_ERR_MEM, return NULL;);
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  void *p = block->data + block->used;
+  block->used += n;
+  arena->used += n;
+  arena->last = p;
+  return p;
+}
+
+void *cmc_arena_realloc(cmc_arena *arena, void *p, size_t old_n, size_t n,
+                        cmc_err_extra *err) {
+  assert(arena);
+  if (!p)
+    return cmc_arena_alloc(arena, n, err);
+  if (n == 0)
+    CMC_ERR(CMC_ERR_REALLOC_ZERO, return NULL;);
+
+  arena_block *block = arena->blocks;
+  if (p == arena->last) {
+    size_t start = (uint8_t *)p - block->data;
+    if (block->capacity - start >= align_up(n)) {
+      arena->used += align_up(n) - (block->used - start);
+      block->used = start + align_up(n);
+      return p;
+    }
+  }
+
+  void *new_p = cmc_arena_alloc(arena, n, err);
+  if (!new_p)
+    return NULL;
+  memcpy(new_p, p, old_n < n ? old_n : n);
+  return new_p;
+}
+
+bool cmc_arena_owns(const cmc_arena *arena, const void *p) {
+  for (const arena_block *block = arena->blocks; block; block = block->next) {
+    if ((const uint8_t *)p >= block->data &&
+        (const uint8_t *)p < block->data + block->capacity)
+      return true;
+  }
+  return false;
+}
+
+size_t cmc_arena_used(const cmc_arena *arena) { return arena->used; }
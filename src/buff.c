@@ -1,8 +1,10 @@
 #include <cmc/buff.h>
 
+#include <cmc/arena.h>
 #include <cmc/err.h>
 #include <cmc/heap_utils.h>
 #include <cmc/nbt.h>
+#include <cmc/pool.h>
 
 #include <endian.h>
 
@@ -16,6 +18,7 @@
 #include <string.h>
 
 #include "err_macros.h"
+#include "utf8.h"
 
 #define VARINT_SEGMENT_BITS 0x7F
 #define VARINT_CONTINUE_BIT 0x80
@@ -46,6 +49,17 @@ void cmc_buff_print_info(cmc_buff *buff) {
   printf("'\n");
 }
 
+static cmc_buff_growth_policy growth_policy = CMC_BUFF_DEFAULT_GROWTH_POLICY;
+
+void cmc_buff_set_growth_policy(cmc_buff_growth_policy policy) {
+  assert(policy.growth_factor >= 1);
+  growth_policy = policy;
+}
+
+cmc_buff_growth_policy cmc_buff_get_growth_policy(void) {
+  return growth_policy;
+}
+
 cmc_buff *cmc_buff_init(cmc_protocol_version protocol_version) {
   cmc_buff *buff = malloc(sizeof(cmc_buff));
   if (!buff)
@@ -56,11 +70,33 @@ cmc_buff *cmc_buff_init(cmc_protocol_version protocol_version) {
   buff->length = 0;
   buff->protocol_version = protocol_version;
   buff->err = (cmc_err_extra){};
+  buff->pool = NULL;
+  buff->arena = NULL;
+  return buff;
+}
+
+cmc_buff *cmc_buff_init_with_capacity(cmc_protocol_version protocol_version,
+                                      size_t capacity) {
+  cmc_buff *buff = cmc_buff_init(protocol_version);
+  if (!buff)
+    return NULL;
+  if (capacity == 0)
+    return buff;
+  buff->data = malloc(capacity);
+  if (!buff->data) {
+    free(buff);
+    return NULL;
+  }
+  buff->capacity = capacity;
   return buff;
 }
 
 void cmc_buff_free(cmc_buff *buff) {
   assert(buff);
+  if (buff->pool) {
+    cmc_buff_pool_release(buff->pool, buff);
+    return;
+  }
   if (buff->capacity) {
     free(buff->data);
   }
@@ -76,55 +112,102 @@ cmc_buff *cmc_buff_combine(cmc_buff *buff, cmc_buff *tmp) {
   return buff;
 }
 
+void *cmc_buff_malloc(cmc_buff *buff, size_t n) {
+  if (n == 0)
+    return NULL;
+  if (buff->arena)
+    return cmc_arena_alloc(buff->arena, n, &buff->err);
+  return cmc_malloc(n, &buff->err);
+}
+
+void *cmc_buff_realloc(cmc_buff *buff, void *p, size_t old_n, size_t n) {
+  if (buff->arena)
+    return cmc_arena_realloc(buff->arena, p, old_n, n, &buff->err);
+  return cmc_realloc(p, n, &buff->err);
+}
+
+cmc_err cmc_buff_reserve(cmc_buff *buff, size_t additional) {
+  assert(buff);
+  size_t needed = buff->length + additional;
+  if (needed <= buff->capacity)
+    return CMC_ERR_NO;
+
+  size_t new_capacity = buff->capacity;
+  if (new_capacity < growth_policy.min_capacity)
+    new_capacity = growth_policy.min_capacity;
+  if (growth_policy.growth_factor <= 1 || new_capacity == 0) {
+    new_capacity = needed > new_capacity ? needed : new_capacity;
+  } else {
+    while (needed > new_capacity) {
+      new_capacity *= growth_policy.growth_factor;
+    }
+  }
+
+  unsigned char *new_data =
+      CMC_ERRRB_ABLE(cmc_realloc(buff->data, new_capacity, &buff->err));
+
+  buff->data = new_data;
+  buff->capacity = new_capacity;
+  return CMC_ERR_NO;
+}
+
 cmc_err cmc_buff_pack(cmc_buff *buff, const void *data, size_t data_size) {
   assert(data);
   assert(buff);
   if (data_size == 0)
     return CMC_ERR_NO; // we dont have to do anything...
 
-  if (buff->data == NULL) {
-    buff->data = CMC_ERRRB_ABLE(cmc_malloc(data_size, &buff->err));
-    buff->capacity = data_size;
-    buff->length = 0;
-  } else if (buff->length + data_size > buff->capacity) {
-    size_t new_capacity = buff->capacity * 2;
-    while (buff->length + data_size > new_capacity) {
-      new_capacity *= 2;
-    }
-
-    unsigned char *new_data =
-        CMC_ERRRB_ABLE(cmc_realloc(buff->data, new_capacity, &buff->err));
-
-    buff->data = new_data;
-    buff->capacity = new_capacity;
-  }
+  CMC_ERRRB_ABLE(cmc_buff_reserve(buff, data_size));
   memcpy(buff->data + buff->length, data, data_size);
   buff->length += data_size;
   return CMC_ERR_NO;
 }
 
-void *cmc_buff_unpack(cmc_buff *buff, size_t n) {
-  assert(n > 0);
+cmc_err cmc_buff_reserve_headroom(cmc_buff *buff, size_t n) {
   assert(buff);
-  if (buff->position + n > buff->length)
+  assert(buff->length == 0);
+  if (n == 0)
+    return CMC_ERR_NO;
+  CMC_ERRRB_ABLE(cmc_buff_reserve(buff, n));
+  buff->length = n;
+  buff->position = n;
+  return CMC_ERR_NO;
+}
+
+size_t cmc_buff_remaining(const cmc_buff *buff) {
+  assert(buff);
+  return buff->length - buff->position;
+}
+
+const uint8_t *cmc_buff_peek(cmc_buff *buff, size_t n) {
+  assert(buff);
+  if (n > buff->length - buff->position)
     CMC_ERRB(CMC_ERR_BUFF_OVERFLOW, return NULL;);
+  return buff->data + buff->position;
+}
 
-  void *read_data = CMC_ERRB_ABLE(cmc_malloc(n, &buff->err), return NULL);
-  memcpy(read_data, buff->data + buff->position, n);
+const uint8_t *cmc_buff_view(cmc_buff *buff, size_t n) {
+  const uint8_t *view = CMC_ERRB_ABLE(cmc_buff_peek(buff, n), return NULL;);
   buff->position += n;
+  return view;
+}
+
+void *cmc_buff_unpack(cmc_buff *buff, size_t n) {
+  assert(n > 0);
+  assert(buff);
+  const uint8_t *view = CMC_ERRB_ABLE(cmc_buff_view(buff, n), return NULL;);
+  void *read_data = CMC_ERRB_ABLE(cmc_malloc(n, &buff->err), return NULL);
+  memcpy(read_data, view, n);
   return read_data;
 }
 
 #define NUM_PACK_AND_UNPACK_FUNC_FACTORY(name, type)                           \
   type cmc_buff_unpack_##name(cmc_buff *buff) {                                \
-    void *data = CMC_ERRB_ABLE(cmc_buff_unpack(buff, sizeof(type)), return 0); \
-    char result = *((type *)data);                                             \
-    free(data);                                                                \
-    return result;                                                             \
+    return cmc_buff_read_##name(buff);                                         \
   }                                                                            \
                                                                                \
   cmc_err cmc_buff_pack_##name(cmc_buff *buff, type data) {                    \
-    return cmc_buff_pack(buff, &data, sizeof(type));                           \
+    return cmc_buff_write_##name(buff, data);                                  \
   }
 
 NUM_PACK_AND_UNPACK_FUNC_FACTORY(char, char);
@@ -152,39 +235,200 @@ cmc_err cmc_buff_pack_bool(cmc_buff *buff, bool value) {
 
 bool cmc_buff_unpack_bool(cmc_buff *buff) {
   assert(buff);
-  unsigned char *data = cmc_buff_unpack(buff, 1);
-  unsigned char byte_val = *data;
-  free(data);
-  return byte_val;
+  const uint8_t *data = CMC_ERRB_ABLE(cmc_buff_view(buff, 1), return false;);
+  return *data;
 }
 
-cmc_err cmc_buff_pack_varint(cmc_buff *buff, int n) {
-  assert(buff);
-  unsigned int number = (unsigned int)n;
-  for (int i = 0; i < 5; i++) {
-    uint8_t b = number & 0x7F;
-    number >>= 7;
-    b |= number > 0 ? 0x80 : 0;
-    CMC_ERRRB_ABLE(cmc_buff_pack_byte(buff, b));
-    if (number == 0)
-      break;
+/*
+Varints are decoded branchless from a single 8 byte load when there are
+enough bytes left: the first byte without the continue bit gives the length
+and the 7 bit groups are squeezed together with three mask and shift steps.
+The 1 and 2 byte cases (most ids and lengths) are handled before that, the
+last few bytes of a buffer go through the byte loop.
+*/
+#define VARINT_CONTINUE_BITS 0x8080808080808080ULL
+
+static inline uint64_t varint_squeeze(uint64_t x) {
+  x = (x & 0x007F007F007F007FULL) | ((x & 0x7F007F007F007F00ULL) >> 1);
+  x = (x & 0x00003FFF00003FFFULL) | ((x & 0x3FFF00003FFF0000ULL) >> 2);
+  x = (x & 0x000000000FFFFFFFULL) | ((x & 0x0FFFFFFF00000000ULL) >> 4);
+  return x;
+}
+
+static inline uint64_t varint_spread(uint64_t x) {
+  x = (x & 0x000000000FFFFFFFULL) | ((x & 0x00FFFFFFF0000000ULL) << 4);
+  x = (x & 0x00003FFF00003FFFULL) | ((x & 0x0FFFC0000FFFC000ULL) << 2);
+  x = (x & 0x007F007F007F007FULL) | ((x & 0x3F803F803F803F80ULL) << 1);
+  return x;
+}
+
+// returns the number of bytes consumed or 0 if the varint is too long or
+// doesnt fit into avail
+static size_t varint_decode(const uint8_t *p, size_t avail, size_t max_bytes,
+                            uint64_t *out) {
+  if (avail >= 1 && !(p[0] & VARINT_CONTINUE_BIT)) {
+    *out = p[0];
+    return 1;
+  }
+  if (avail >= 2 && !(p[1] & VARINT_CONTINUE_BIT)) {
+    *out = (p[0] & VARINT_SEGMENT_BITS) | (uint64_t)p[1] << 7;
+    return 2;
+  }
+  if (avail >= 8) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    x = le64toh(x);
+    uint64_t stops = ~x & VARINT_CONTINUE_BITS;
+    if (stops) {
+      size_t len = __builtin_ctzll(stops) / 8 + 1;
+      if (len > max_bytes)
+        return 0;
+      *out = varint_squeeze(x & (UINT64_MAX >> (64 - 8 * len)));
+      return len;
+    }
+    if (max_bytes <= 8)
+      return 0;
+    // only varlongs get here, the last two bytes go through the loop
+    uint64_t number = varint_squeeze(x);
+    for (size_t i = 8; i < max_bytes && i < avail; i++) {
+      number |= (uint64_t)(p[i] & VARINT_SEGMENT_BITS) << (7 * i);
+      if (!(p[i] & VARINT_CONTINUE_BIT)) {
+        *out = number;
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+  uint64_t number = 0;
+  for (size_t i = 0; i < max_bytes && i < avail; i++) {
+    number |= (uint64_t)(p[i] & VARINT_SEGMENT_BITS) << (7 * i);
+    if (!(p[i] & VARINT_CONTINUE_BIT)) {
+      *out = number;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// dst needs room for CMC_VARLONG_MAX_BYTES bytes
+static size_t varint_encode(uint8_t *dst, uint64_t v) {
+  if (v < 0x80) {
+    dst[0] = v;
+    return 1;
+  }
+  if (v < 0x4000) {
+    dst[0] = v | VARINT_CONTINUE_BIT;
+    dst[1] = v >> 7;
+    return 2;
+  }
+  size_t len = (64 - __builtin_clzll(v) + 6) / 7;
+  if (len <= 8) {
+    uint64_t x = varint_spread(v);
+    x |= VARINT_CONTINUE_BITS >> (64 - 8 * (len - 1));
+    x = htole64(x);
+    memcpy(dst, &x, sizeof(x));
+    return len;
   }
+  for (size_t i = 0; i < len; i++) {
+    dst[i] = v & VARINT_SEGMENT_BITS;
+    if (i + 1 < len)
+      dst[i] |= VARINT_CONTINUE_BIT;
+    v >>= 7;
+  }
+  return len;
+}
+
+size_t cmc_varint_size(int32_t n) {
+  uint32_t v = n;
+  return (32 - __builtin_clz(v | 1) + 6) / 7;
+}
+
+size_t cmc_varint_encode(uint8_t *dst, int32_t n) {
+  uint8_t tmp[CMC_VARLONG_MAX_BYTES];
+  size_t len = varint_encode(tmp, (uint32_t)n);
+  memcpy(dst, tmp, len);
+  return len;
+}
+
+static cmc_err buff_pack_varint(cmc_buff *buff, uint64_t v) {
+  CMC_ERRRB_ABLE(cmc_buff_reserve(buff, CMC_VARLONG_MAX_BYTES));
+  buff->length += varint_encode(buff->data + buff->length, v);
   return CMC_ERR_NO;
 }
 
+static uint64_t buff_unpack_varint(cmc_buff *buff, size_t max_bytes) {
+  uint64_t number = 0;
+  size_t len = varint_decode(buff->data + buff->position,
+                             buff->length - buff->position, max_bytes, &number);
+  if (len == 0) {
+    if (buff->length - buff->position < max_bytes)
+      CMC_ERRB(CMC_ERR_BUFF_OVERFLOW, return 0;);
+    CMC_ERRB(CMC_ERR_INVALID_VARINT, return 0;);
+  }
+  buff->position += len;
+  return number;
+}
+
+cmc_err cmc_buff_pack_varint(cmc_buff *buff, int n) {
+  assert(buff);
+  return buff_pack_varint(buff, (uint32_t)n);
+}
+
 int32_t cmc_buff_unpack_varint(cmc_buff *buff) {
   assert(buff);
-  int32_t number = 0;
-  for (int i = 0; i < 5; i++) {
-    uint8_t b = CMC_ERRB_ABLE(cmc_buff_unpack_byte(buff), return 0);
-    number |= (b & VARINT_SEGMENT_BITS) << (7 * i);
-    if (!(b & VARINT_CONTINUE_BIT))
-      break;
+  return (int32_t)(uint32_t)buff_unpack_varint(buff, CMC_VARINT_MAX_BYTES);
+}
+
+cmc_err cmc_buff_pack_varlong(cmc_buff *buff, int64_t n) {
+  assert(buff);
+  return buff_pack_varint(buff, (uint64_t)n);
+}
+
+int64_t cmc_buff_unpack_varlong(cmc_buff *buff) {
+  assert(buff);
+  return (int64_t)buff_unpack_varint(buff, CMC_VARLONG_MAX_BYTES);
+}
+
+cmc_err cmc_buff_pack_varint_array(cmc_buff *buff, const int32_t *values,
+                                   size_t n) {
+  assert(buff);
+  if (n == 0)
+    return CMC_ERR_NO;
+  // varint_encode may store up to 8 bytes for the last value
+  CMC_ERRRB_ABLE(cmc_buff_reserve(buff, (n + 1) * CMC_VARINT_MAX_BYTES));
+  uint8_t *out = buff->data + buff->length;
+  for (size_t i = 0; i < n; i++)
+    out += varint_encode(out, (uint32_t)values[i]);
+  buff->length = out - buff->data;
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_buff_unpack_varint_array(cmc_buff *buff, int32_t *values,
+                                     size_t n) {
+  assert(buff);
+  const uint8_t *p = buff->data + buff->position;
+  const uint8_t *end = buff->data + buff->length;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t number = 0;
+    size_t len = varint_decode(p, end - p, CMC_VARINT_MAX_BYTES, &number);
+    if (len == 0) {
+      if ((size_t)(end - p) < CMC_VARINT_MAX_BYTES)
+        CMC_ERRRB(CMC_ERR_BUFF_OVERFLOW);
+      CMC_ERRRB(CMC_ERR_INVALID_VARINT);
+    }
+    values[i] = (int32_t)(uint32_t)number;
+    p += len;
   }
-  return number;
+  buff->position = p - buff->data;
+  return CMC_ERR_NO;
 }
 
-char *cmc_buff_unpack_string_w_max_len(cmc_buff *buff, int max_len) {
+/*
+Reads the length prefix and returns a view of the string bytes after checking
+them against max_len code points.
+*/
+static const uint8_t *unpack_string_bytes(cmc_buff *buff, int max_len,
+                                          size_t *length) {
   assert(buff);
   assert(max_len > 0);
 
@@ -195,38 +439,58 @@ char *cmc_buff_unpack_string_w_max_len(cmc_buff *buff, int max_len) {
   if (n < 0)
     CMC_ERRB(CMC_ERR_NEGATIVE_STRING_LENGTH, return NULL;);
 
-  char *str = CMC_ERRB_ABLE(cmc_buff_unpack(buff, n), return NULL;);
+  const uint8_t *view = CMC_ERRB_ABLE(cmc_buff_view(buff, n), return NULL;);
+  size_t code_points = 0;
+  CMC_ERRB_IF(!cmc_utf8_count(view, n, &code_points), CMC_ERR_INVALID_STRING,
+              return NULL;);
+  CMC_ERRB_IF(code_points > (size_t)max_len, CMC_ERR_STRING_LENGTH,
+              return NULL;);
+  *length = n;
+  return view;
+}
 
-  str = CMC_ERRB_ABLE(cmc_realloc(str, n + 1, &buff->err), goto err);
+char *cmc_buff_unpack_string_w_max_len(cmc_buff *buff, int max_len) {
+  size_t n = 0;
+  const uint8_t *view = CMC_ERRB_ABLE(unpack_string_bytes(buff, max_len, &n),
+                                      return NULL;);
+  char *str = CMC_ERRB_ABLE(cmc_buff_malloc(buff, n + 1), return NULL;);
+  memcpy(str, view, n);
   str[n] = '\0';
-
-  int utf_str_len = 0;
-  for (int i = 0; i < n; ++i)
-    if ((str[i] & 0xC0) != 0x80)
-      ++utf_str_len;
-  CMC_ERRB_IF(utf_str_len > max_len, CMC_ERR_STRING_LENGTH, goto err;);
   return str;
-err:
-  free(str);
-  return NULL;
 }
 
-cmc_err cmc_buff_pack_string_w_max_len(cmc_buff *buff, const char *str,
-                                       size_t max_len) {
+cmc_string_view cmc_buff_unpack_string_view_w_max_len(cmc_buff *buff,
+                                                      int max_len) {
+  size_t n = 0;
+  const uint8_t *view = CMC_ERRB_ABLE(unpack_string_bytes(buff, max_len, &n),
+                                      return (cmc_string_view){};);
+  return (cmc_string_view){.data = (const char *)view, .length = n};
+}
+
+cmc_err cmc_buff_pack_string_view_w_max_len(cmc_buff *buff,
+                                            cmc_string_view str,
+                                            size_t max_len) {
   assert(buff);
-  assert(str);
-  size_t str_len_bytes = strlen(str);
-  size_t str_len = 0;
-  for (size_t i = 0; i < str_len_bytes; ++i)
-    if ((str[i] & 0xC0) != 0x80)
-      ++str_len;
-  if (str_len > max_len)
+  assert(str.data || str.length == 0);
+  size_t code_points = 0;
+  if (!cmc_utf8_count((const uint8_t *)str.data, str.length, &code_points))
+    CMC_ERRRB(CMC_ERR_INVALID_STRING);
+  if (code_points > max_len)
     CMC_ERRRB(CMC_ERR_STRING_LENGTH);
-  CMC_ERRRB_ABLE(cmc_buff_pack_varint(buff, str_len_bytes));
-  CMC_ERRRB_ABLE(cmc_buff_pack(buff, str, str_len_bytes));
+  CMC_ERRRB_ABLE(cmc_buff_pack_varint(buff, str.length));
+  if (str.length > 0) {
+    CMC_ERRRB_ABLE(cmc_buff_pack(buff, str.data, str.length));
+  }
   return CMC_ERR_NO;
 }
 
+cmc_err cmc_buff_pack_string_w_max_len(cmc_buff *buff, const char *str,
+                                       size_t max_len) {
+  assert(str);
+  return cmc_buff_pack_string_view_w_max_len(buff, cmc_string_view_from(str),
+                                             max_len);
+}
+
 cmc_err cmc_buff_pack_string(cmc_buff *buff, const char *value) {
   return cmc_buff_pack_string_w_max_len(buff, value, DEFAULT_MAX_STRING_LENGTH);
 }
@@ -235,6 +499,16 @@ char *cmc_buff_unpack_string(cmc_buff *buff) {
   return cmc_buff_unpack_string_w_max_len(buff, DEFAULT_MAX_STRING_LENGTH);
 }
 
+cmc_err cmc_buff_pack_string_view(cmc_buff *buff, cmc_string_view str) {
+  return cmc_buff_pack_string_view_w_max_len(buff, str,
+                                             DEFAULT_MAX_STRING_LENGTH);
+}
+
+cmc_string_view cmc_buff_unpack_string_view(cmc_buff *buff) {
+  return cmc_buff_unpack_string_view_w_max_len(buff,
+                                               DEFAULT_MAX_STRING_LENGTH);
+}
+
 cmc_err cmc_buff_pack_position(cmc_buff *buff, cmc_block_pos pos) {
   assert(buff);
   uint64_t encoded_pos = ((pos.x & 0x3FFFFFF) << 38) | ((pos.y & 0xFFF) << 26) |
@@ -278,18 +552,19 @@ cmc_err cmc_buff_pack_buff(cmc_buff *buff, cmc_buff *buff2) {
 cmc_buff *cmc_buff_unpack_buff(cmc_buff *buff) {
   int ret_buff_len = CMC_ERRB_ABLE(cmc_buff_unpack_varint(buff), return NULL);
 
-  cmc_buff *ret =
-      CMC_ERRB_ABLE(cmc_buff_init(buff->protocol_version), return NULL;);
-  void *tmp = CMC_ERRB_ABLE(cmc_buff_unpack(buff, ret_buff_len), goto err;);
-  CMC_ERRB_ABLE(cmc_buff_pack(ret, tmp, ret_buff_len), goto err1;);
-  free(tmp);
+  const uint8_t *view =
+      CMC_ERRB_ABLE(cmc_buff_view(buff, ret_buff_len), return NULL;);
 
+  cmc_buff *ret = cmc_buff_init(buff->protocol_version);
+  if (!ret)
+    CMC_ERRB(CMC_ERR_MEM, return NULL;);
+  if (ret_buff_len > 0 &&
+      cmc_buff_pack(ret, view, ret_buff_len) != CMC_ERR_NO) {
+    buff->err = ret->err;
+    cmc_buff_free(ret);
+    return NULL;
+  }
   return ret;
-err1:
-  free(tmp);
-err:
-  free(ret);
-  return NULL;
 }
 
 cmc_err cmc_buff_pack_slot(cmc_buff *buff, cmc_slot *slot) {
@@ -310,22 +585,22 @@ cmc_slot *cmc_buff_unpack_slot(cmc_buff *buff) {
   if (item_id < 0)
     return NULL;
   cmc_slot *slot =
-      CMC_ERRB_ABLE(cmc_malloc(sizeof(cmc_slot), &buff->err), return NULL;);
+      CMC_ERRB_ABLE(cmc_buff_malloc(buff, sizeof(cmc_slot)), return NULL;);
   slot->item_id = item_id;
   slot->slot_size = CMC_ERRB_ABLE(cmc_buff_unpack_byte(buff), goto err;);
   slot->meta_data = CMC_ERRB_ABLE(cmc_buff_unpack_short(buff), goto err;);
   slot->tag_compound = CMC_ERRB_ABLE(cmc_buff_unpack_nbt(buff), goto err;);
   return slot;
 err:
-  free(slot);
+  if (!buff->arena)
+    free(slot);
   return NULL;
 }
 
 cmc_err cmc_buff_pack_entity_metadata(cmc_buff *buff,
                                       cmc_entity_metadata metadata) {
   for (size_t i = 0; i < metadata.size; i++) {
-    cmc_entity_metadata_entry *entry =
-        metadata.entries + i * sizeof(cmc_entity_metadata_entry);
+    cmc_entity_metadata_entry *entry = metadata.entries + i;
     CMC_ERRRB_ABLE(cmc_buff_pack_char(buff, entry->type << 5 | entry->index));
     switch (entry->type) {
     case ENTITY_METADATA_ENTRY_TYPE_BYTE:
@@ -364,10 +639,11 @@ cmc_err cmc_buff_pack_entity_metadata(cmc_buff *buff,
 
 cmc_entity_metadata cmc_buff_unpack_entity_metadata(cmc_buff *buff) {
   cmc_entity_metadata meta_data = EMPTY_ENTITY_METADATA;
+  size_t capacity = 0;
 
   while (true) {
     int8_t type_and_index =
-        CMC_ERRB_ABLE(cmc_buff_unpack_char(buff), return EMPTY_ENTITY_METADATA);
+        CMC_ERRB_ABLE(cmc_buff_unpack_char(buff), goto on_error;);
 
     if (type_and_index == 127) {
       break;
@@ -380,71 +656,76 @@ cmc_entity_metadata cmc_buff_unpack_entity_metadata(cmc_buff *buff) {
     switch (meta_data_entry.type) {
     case ENTITY_METADATA_ENTRY_TYPE_BYTE:
       meta_data_entry.payload.byte_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_byte(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_byte(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_SHORT:
       meta_data_entry.payload.short_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_short(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_short(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_INT:
       meta_data_entry.payload.int_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_int(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_int(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_FLOAT:
       meta_data_entry.payload.float_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_float(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_float(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_STRING:
       meta_data_entry.payload.string_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_string(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_string(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_SLOT:
       meta_data_entry.payload.slot_data = CMC_ERRB_ABLE(
-          cmc_buff_unpack_slot(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_slot(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_POSITION:
       meta_data_entry.payload.position_data.x = CMC_ERRB_ABLE(
-          cmc_buff_unpack_int(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_int(buff), goto on_error;);
       meta_data_entry.payload.position_data.y = CMC_ERRB_ABLE(
-          cmc_buff_unpack_int(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_int(buff), goto on_error;);
       meta_data_entry.payload.position_data.z = CMC_ERRB_ABLE(
-          cmc_buff_unpack_int(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_int(buff), goto on_error;);
       break;
     case ENTITY_METADATA_ENTRY_TYPE_ROTATION:
       meta_data_entry.payload.rotation_data.x = CMC_ERRB_ABLE(
-          cmc_buff_unpack_float(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_float(buff), goto on_error;);
       meta_data_entry.payload.rotation_data.y = CMC_ERRB_ABLE(
-          cmc_buff_unpack_float(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_float(buff), goto on_error;);
       meta_data_entry.payload.rotation_data.z = CMC_ERRB_ABLE(
-          cmc_buff_unpack_float(buff), return EMPTY_ENTITY_METADATA);
+          cmc_buff_unpack_float(buff), goto on_error;);
       break;
     }
 
-    cmc_entity_metadata_entry *new_entries = CMC_ERRB_ABLE(
-        cmc_realloc(meta_data.entries,
-                    (meta_data.size + 1) * sizeof(cmc_entity_metadata_entry),
-                    &buff->err),
-        return EMPTY_ENTITY_METADATA);
-    if (new_entries == NULL) {
-      CMC_ERRB(CMC_ERR_MEM, goto on_error;);
+    if (meta_data.size == capacity) {
+      size_t new_capacity = capacity ? capacity * 2 : 8;
+      cmc_entity_metadata_entry *new_entries = CMC_ERRB_ABLE(
+          cmc_buff_realloc(buff, meta_data.entries,
+                           capacity * sizeof(cmc_entity_metadata_entry),
+                           new_capacity * sizeof(cmc_entity_metadata_entry)),
+          goto on_error;);
+      meta_data.entries = new_entries;
+      capacity = new_capacity;
     }
 
-    meta_data.entries = new_entries;
     meta_data.entries[meta_data.size] = meta_data_entry;
     meta_data.size++;
   }
   return meta_data;
 
 on_error:
-  CMC_ERRB_ABLE(cmc_entity_metadata_free(meta_data, &buff->err), );
+  // the arena takes the entries back on its own, not the nbt of their slots
+  if (!buff->arena) {
+    CMC_ERRB_ABLE(cmc_entity_metadata_free(meta_data, &buff->err), );
+  } else {
+    CMC_ERRB_ABLE(cmc_entity_metadata_free_in_arena(meta_data, &buff->err), );
+  }
   return EMPTY_ENTITY_METADATA;
 }
 
 cmc_err cmc_entity_metadata_free(cmc_entity_metadata metadata,
                                  cmc_err_extra *err) {
   for (size_t i = 0; i < metadata.size; i++) {
-    cmc_entity_metadata_entry *entry =
-        metadata.entries + i * sizeof(cmc_entity_metadata_entry);
+    cmc_entity_metadata_entry *entry = metadata.entries + i;
     switch (entry->type) {
     case ENTITY_METADATA_ENTRY_TYPE_SLOT:
       cmc_slot_free(entry->payload.slot_data, err);
@@ -473,6 +754,23 @@ cmc_err cmc_slot_free(cmc_slot *slot, cmc_err_extra *err) {
   return err->err;
 }
 
+cmc_err cmc_entity_metadata_free_in_arena(cmc_entity_metadata metadata,
+                                          cmc_err_extra *err) {
+  for (size_t i = 0; i < metadata.size; i++) {
+    cmc_entity_metadata_entry *entry = metadata.entries + i;
+    if (entry->type == ENTITY_METADATA_ENTRY_TYPE_SLOT)
+      cmc_slot_free_in_arena(entry->payload.slot_data, err);
+  }
+  return err->err;
+}
+
+cmc_err cmc_slot_free_in_arena(cmc_slot *slot, cmc_err_extra *err) {
+  // cmc_nbt_parse never allocates from the arena
+  if (slot)
+    cmc_nbt_free(slot->tag_compound, err);
+  return err->err;
+}
+
 cmc_uuid cmc_buff_unpack_uuid(cmc_buff *buff) {
   return (cmc_uuid){.lower = cmc_buff_unpack_long(buff),
                     .upper = cmc_buff_unpack_long(buff)};
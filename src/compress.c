@@ -0,0 +1,176 @@
+#include "compress.h"
+
+#include <cmc/err.h>
+#include <cmc/heap_utils.h>
+
+#include <zlib.h>
+
+#ifdef CMC_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include <stdlib.h>
+
+#include "err_macros.h"
+
+/*
+The zlib streams are only reset between packets, setting one up allocates
+its window and hash tables every time. libdeflate can't stop after a few
+bytes of output, so the inflater keeps a zlib stream for
+cmc_inflate_prefix in both builds.
+*/
+struct cmc_inflater {
+  z_stream strm;
+#ifdef CMC_USE_LIBDEFLATE
+  struct libdeflate_decompressor *decompressor;
+#endif
+};
+
+cmc_inflater *cmc_inflater_init(cmc_err_extra *err) {
+  cmc_inflater *inflater = CMC_ERR_ABLE(
+      cmc_malloc(sizeof(cmc_inflater), err), return NULL;);
+  inflater->strm = (z_stream){.zalloc = Z_NULL, .zfree = Z_NULL};
+  if (inflateInit(&inflater->strm) != Z_OK) {
+    free(inflater);
+    CMC_ERRA_IF(true, *err, CMC_ERR_ZLIB_INIT, return NULL;);
+  }
+#ifdef CMC_USE_LIBDEFLATE
+  inflater->decompressor = libdeflate_alloc_decompressor();
+  if (!inflater->decompressor) {
+    inflateEnd(&inflater->strm);
+    free(inflater);
+    CMC_ERRA_IF(true, *err, CMC_ERR_ZLIB_INIT, return NULL;);
+  }
+#endif
+  return inflater;
+}
+
+void cmc_inflater_free(cmc_inflater *inflater) {
+  inflateEnd(&inflater->strm);
+#ifdef CMC_USE_LIBDEFLATE
+  libdeflate_free_decompressor(inflater->decompressor);
+#endif
+  free(inflater);
+}
+
+static int zlib_inflate(cmc_inflater *inflater, const uint8_t *in,
+                        size_t in_length, uint8_t *out, size_t out_length,
+                        int flush) {
+  z_stream *strm = &inflater->strm;
+  if (inflateReset(strm) != Z_OK)
+    return Z_STREAM_ERROR;
+  strm->next_in = (Bytef *)in;
+  strm->avail_in = in_length;
+  strm->next_out = out;
+  strm->avail_out = out_length;
+  return inflate(strm, flush);
+}
+
+bool cmc_inflate(cmc_inflater *inflater, const uint8_t *in, size_t in_length,
+                 uint8_t *out, size_t out_length, cmc_err_extra *err) {
+#ifdef CMC_USE_LIBDEFLATE
+  // without actual_out_nbytes_ret the output has to fill out exactly
+  enum libdeflate_result res = libdeflate_zlib_decompress(
+      inflater->decompressor, in, in_length, out, out_length, NULL);
+  CMC_ERRA_IF(res == LIBDEFLATE_SHORT_OUTPUT ||
+                  res == LIBDEFLATE_INSUFFICIENT_SPACE,
+              *err, CMC_ERR_SENDER_LYING, return false;);
+  CMC_ERRA_IF(res != LIBDEFLATE_SUCCESS, *err, CMC_ERR_ZLIB_INFLATE,
+              return false;);
+#else
+  int res = zlib_inflate(inflater, in, in_length, out, out_length, Z_FINISH);
+  // out is full but the stream goes on
+  CMC_ERRA_IF(res == Z_BUF_ERROR && inflater->strm.avail_out == 0, *err,
+              CMC_ERR_SENDER_LYING, return false;);
+  CMC_ERRA_IF(res != Z_STREAM_END, *err, CMC_ERR_ZLIB_INFLATE, return false;);
+  CMC_ERRA_IF(inflater->strm.total_out != out_length, *err,
+              CMC_ERR_SENDER_LYING, return false;);
+#endif
+  return true;
+}
+
+bool cmc_inflate_prefix(cmc_inflater *inflater, const uint8_t *in,
+                        size_t in_length, uint8_t *out, size_t out_length,
+                        cmc_err_extra *err) {
+  int res = zlib_inflate(inflater, in, in_length, out, out_length, Z_NO_FLUSH);
+  CMC_ERRA_IF(res != Z_OK && res != Z_STREAM_END, *err, CMC_ERR_ZLIB_INFLATE,
+              return false;);
+  CMC_ERRA_IF(inflater->strm.total_out != out_length, *err,
+              CMC_ERR_SENDER_LYING, return false;);
+  return true;
+}
+
+#ifdef CMC_USE_LIBDEFLATE
+
+// libdeflate goes up to 12, zlibs default level is 6 in both
+#define LIBDEFLATE_DEFAULT_LEVEL 6
+
+cmc_deflater *cmc_deflater_init(int level, int strategy, cmc_err_extra *err) {
+  (void)strategy;
+  struct libdeflate_compressor *c = libdeflate_alloc_compressor(
+      level < 0 ? LIBDEFLATE_DEFAULT_LEVEL : level);
+  CMC_ERRA_IF(!c, *err, CMC_ERR_ZLIB_INIT, return NULL;);
+  return (cmc_deflater *)c;
+}
+
+void cmc_deflater_free(cmc_deflater *deflater) {
+  libdeflate_free_compressor((struct libdeflate_compressor *)deflater);
+}
+
+size_t cmc_deflate_bound(cmc_deflater *deflater, size_t in_length) {
+  return libdeflate_zlib_compress_bound(
+      (struct libdeflate_compressor *)deflater, in_length);
+}
+
+size_t cmc_deflate(cmc_deflater *deflater, const uint8_t *in,
+                   size_t in_length, uint8_t *out, size_t out_capacity,
+                   cmc_err_extra *err) {
+  size_t length =
+      libdeflate_zlib_compress((struct libdeflate_compressor *)deflater, in,
+                               in_length, out, out_capacity);
+  CMC_ERRA_IF(length == 0, *err, CMC_ERR_ZLIB_COMPRESS, return 0;);
+  return length;
+}
+
+#else
+
+struct cmc_deflater {
+  z_stream strm;
+};
+
+cmc_deflater *cmc_deflater_init(int level, int strategy, cmc_err_extra *err) {
+  cmc_deflater *deflater = CMC_ERR_ABLE(
+      cmc_malloc(sizeof(cmc_deflater), err), return NULL;);
+  deflater->strm = (z_stream){.zalloc = Z_NULL, .zfree = Z_NULL};
+  if (deflateInit2(&deflater->strm, level, Z_DEFLATED, MAX_WBITS, 8,
+                   strategy) != Z_OK) {
+    free(deflater);
+    CMC_ERRA_IF(true, *err, CMC_ERR_ZLIB_INIT, return NULL;);
+  }
+  return deflater;
+}
+
+void cmc_deflater_free(cmc_deflater *deflater) {
+  deflateEnd(&deflater->strm);
+  free(deflater);
+}
+
+size_t cmc_deflate_bound(cmc_deflater *deflater, size_t in_length) {
+  return deflateBound(&deflater->strm, in_length);
+}
+
+size_t cmc_deflate(cmc_deflater *deflater, const uint8_t *in,
+                   size_t in_length, uint8_t *out, size_t out_capacity,
+                   cmc_err_extra *err) {
+  z_stream *strm = &deflater->strm;
+  CMC_ERRA_IF(deflateReset(strm) != Z_OK, *err, CMC_ERR_ZLIB_INIT, return 0;);
+  strm->next_in = (Bytef *)in;
+  strm->avail_in = in_length;
+  strm->next_out = out;
+  strm->avail_out = out_capacity;
+  CMC_ERRA_IF(deflate(strm, Z_FINISH) != Z_STREAM_END, *err,
+              CMC_ERR_ZLIB_COMPRESS, return 0;);
+  return strm->total_out;
+}
+
+#endif
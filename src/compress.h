@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cmc/err.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Whole buffer compression in the zlib format packets use. Backed by
+libdeflate when cmc is built with CMC_USE_LIBDEFLATE, by zlib otherwise. Not
+part of the public api.
+
+Both sides are long lived and reused for every packet of a connection.
+*/
+typedef struct cmc_inflater cmc_inflater;
+typedef struct cmc_deflater cmc_deflater;
+
+cmc_inflater *cmc_inflater_init(cmc_err_extra *err);
+
+void cmc_inflater_free(cmc_inflater *inflater);
+
+/*
+Inflates in into out, which has to be exactly what it inflates to.
+CMC_ERR_SENDER_LYING if the size doesn't match, CMC_ERR_ZLIB_INFLATE if in
+is not valid.
+*/
+bool cmc_inflate(cmc_inflater *inflater, const uint8_t *in, size_t in_length,
+                 uint8_t *out, size_t out_length, cmc_err_extra *err);
+
+/*
+Inflates only the first out_length bytes of in, which has to inflate to at
+least that many. Always done by zlib.
+*/
+bool cmc_inflate_prefix(cmc_inflater *inflater, const uint8_t *in,
+                        size_t in_length, uint8_t *out, size_t out_length,
+                        cmc_err_extra *err);
+
+/*
+level is 0 to 9 or -1 for the default, strategy is a zlib strategy and is
+ignored by libdeflate.
+*/
+cmc_deflater *cmc_deflater_init(int level, int strategy, cmc_err_extra *err);
+
+void cmc_deflater_free(cmc_deflater *deflater);
+
+// Upper bound for what in_length bytes can deflate to.
+size_t cmc_deflate_bound(cmc_deflater *deflater, size_t in_length);
+
+// Returns the compressed length, 0 on error.
+size_t cmc_deflate(cmc_deflater *deflater, const uint8_t *in,
+                   size_t in_length, uint8_t *out, size_t out_capacity,
+                   cmc_err_extra *err);
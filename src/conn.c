@@ -3,27 +3,69 @@
 #include <cmc/buff.h>
 #include <cmc/err.h>
 #include <cmc/heap_utils.h>
+#include <cmc/packets.h>
+#include <cmc/pool.h>
+#include <cmc/queue.h>
 
+#include <openssl/evp.h>
 #include <zlib.h>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "compress.h"
 #include "err_macros.h"
+#include "loop_internal.h"
+#include "packet_stats_internal.h"
+
+// the timestamps the stages of cmc_conn_stage are measured between
+struct cmc_conn_timing {
+  cmc_conn_latency latency;
+  uint64_t received_ns; // the last recv
+  // of the packet handed out last, handed_out_ns is 0 before the first
+  uint64_t handed_out_received_ns;
+  uint64_t handed_out_ns;
+  bool decoded;
+  bool responded;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 cmc_conn cmc_conn_init(cmc_protocol_version protocol_version) {
   return (cmc_conn){.state = CMC_CONN_STATE_OFFLINE,
                     .compression_threshold = -1,
+                    .compression_level = Z_DEFAULT_COMPRESSION,
+                    .compression_strategy = Z_DEFAULT_STRATEGY,
+                    .max_frame_length = CMC_CONN_DEFAULT_MAX_FRAME_LENGTH,
+                    .max_decompressed_length =
+                        CMC_CONN_DEFAULT_MAX_DECOMPRESSED_LENGTH,
+                    .max_buffered_bytes = CMC_CONN_DEFAULT_MAX_BUFFERED_BYTES,
                     .sockfd = -1,
+                    .send_wake_fd = -1,
                     .protocol_version = protocol_version};
 }
 
+cmc_buff *cmc_conn_buff_init(cmc_conn *conn, size_t capacity) {
+  if (conn->pool)
+    return cmc_buff_pool_acquire(conn->pool, conn->protocol_version, capacity);
+  return cmc_buff_init_with_capacity(conn->protocol_version, capacity);
+}
+
 cmc_err cmc_conn_connect(cmc_conn *conn, struct sockaddr *addr,
                          socklen_t addr_len) {
   assert(conn->sockfd == -1);
@@ -35,6 +77,29 @@ cmc_err cmc_conn_connect(cmc_conn *conn, struct sockaddr *addr,
 }
 
 cmc_err cmc_conn_close(cmc_conn *conn) {
+  if (conn->inflater)
+    cmc_inflater_free(conn->inflater);
+  conn->inflater = NULL;
+  if (conn->deflater)
+    cmc_deflater_free(conn->deflater);
+  conn->deflater = NULL;
+  EVP_CIPHER_CTX_free(conn->encrypt_ctx);
+  conn->encrypt_ctx = NULL;
+  EVP_CIPHER_CTX_free(conn->decrypt_ctx);
+  conn->decrypt_ctx = NULL;
+  free(conn->rx.data);
+  conn->rx = (cmc_conn_rx){};
+  free(conn->tx.data);
+  conn->tx = (cmc_conn_tx){};
+  free(conn->timing);
+  conn->timing = NULL;
+  if (conn->send_queue) {
+    cmc_buff *packet;
+    while ((packet = cmc_mpsc_queue_pop(conn->send_queue)))
+      cmc_buff_free(packet);
+    cmc_mpsc_queue_free(conn->send_queue);
+    conn->send_queue = NULL;
+  }
   if (conn->state == CMC_CONN_STATE_OFFLINE)
     return CMC_ERR_NO;
   CMC_ERRRC_IF(close(conn->sockfd), CMC_ERR_CLOSING);
@@ -58,123 +123,778 @@ static int send_all(int socket, const void *buff, size_t length) {
   return 0; // Success
 }
 
-static int recv_all(int socket, void *buff, size_t length) {
-  size_t total_received = 0;
+/*
+Looks for a complete packet at the front of the receive buffer. Returns 1 and
+consumes it if there is one, 0 if more bytes are needed and -1 on a malformed
+length.
+*/
+static int rx_next_frame(cmc_conn *conn, const uint8_t **frame,
+                         size_t *frame_length) {
+  const uint8_t *p = conn->rx.data + conn->rx.start;
+  size_t available = conn->rx.end - conn->rx.start;
+
+  uint32_t packet_len = 0;
+  size_t header = 0;
+  for (;; header++) {
+    if (header == CMC_VARINT_MAX_BYTES)
+      return -1;
+    if (header == available)
+      return 0;
+    packet_len |= (uint32_t)(p[header] & 0x7F) << (7 * header);
+    if (!(p[header] & 0x80))
+      break;
+  }
+  header++;
+  // checked before rx_reserve grows the buffer to fit it
+  if (packet_len == 0 || packet_len > conn->max_frame_length)
+    return -1;
+  if (available - header < packet_len) {
+    conn->rx.wanted = header + packet_len;
+    return 0;
+  }
 
-  while (total_received < length) {
-    ssize_t bytes_received = // sorry janfel ): dereferencing ‘void *’ pointer
-        recv(socket, buff + total_received, length - total_received, 0);
+  *frame = p + header;
+  *frame_length = packet_len;
+  conn->rx.start += header + packet_len;
+  conn->rx.wanted = 0;
+  return 1;
+}
 
-    if (bytes_received <= 0)
-      return -1;
-    total_received += bytes_received;
+/*
+Makes room for min_free more bytes, or the rest of the current packet if that
+is more. Returns false if realloc failed or the buffer would grow past
+max_buffered_bytes.
+*/
+static bool rx_reserve(cmc_conn *conn, size_t min_free) {
+  cmc_conn_rx *rx = &conn->rx;
+  size_t needed = rx->end - rx->start + min_free;
+  if (rx->wanted > needed)
+    needed = rx->wanted;
+  CMC_ERRC_IF(needed > conn->max_buffered_bytes, CMC_ERR_INVALID_PACKET_LENGTH,
+              return false;);
+
+  if (rx->start == rx->end) {
+    rx->start = rx->end = 0;
+  } else if (rx->start > 0 && rx->start + needed > rx->capacity) {
+    memmove(rx->data, rx->data + rx->start, rx->end - rx->start);
+    rx->end -= rx->start;
+    rx->start = 0;
   }
 
-  return 0;
+  if (rx->start + needed > rx->capacity) {
+    size_t capacity =
+        rx->capacity ? rx->capacity : CMC_CONN_RX_DEFAULT_CAPACITY;
+    while (capacity < needed)
+      capacity *= 2;
+    if (capacity > conn->max_buffered_bytes)
+      capacity = conn->max_buffered_bytes;
+    uint8_t *data = CMC_ERRC_ABLE(
+        cmc_realloc(rx->data, capacity, &conn->err), return false;);
+    rx->data = data;
+    rx->capacity = capacity;
+  }
+  return true;
 }
 
-cmc_buff *cmc_conn_recive_packet(cmc_conn *conn) {
-  int32_t packet_len = 0;
-  for (int i = 0; i < 5; i++) {
-    uint8_t b;
-    CMC_ERRC_IF(recv(conn->sockfd, &b, 1, 0) != 1, CMC_ERR_RECV, return NULL;);
-    packet_len |= (b & 0x7F) << (7 * i);
-    if (!(b & 0x80))
-      break;
+static EVP_CIPHER_CTX *cipher_init(const uint8_t *key, int encrypt) {
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  if (ctx &&
+      !EVP_CipherInit_ex(ctx, EVP_aes_128_cfb8(), NULL, key, key, encrypt)) {
+    EVP_CIPHER_CTX_free(ctx);
+    return NULL;
   }
+  return ctx;
+}
 
-  CMC_ERRC_IF(packet_len <= 0, CMC_ERR_INVALID_PACKET_LENGTH, return NULL;);
+cmc_err cmc_conn_enable_encryption(
+    cmc_conn *conn, const uint8_t secret[CMC_CONN_SHARED_SECRET_LENGTH]) {
+  EVP_CIPHER_CTX *encrypt_ctx = cipher_init(secret, 1);
+  EVP_CIPHER_CTX *decrypt_ctx = cipher_init(secret, 0);
+  if (!encrypt_ctx || !decrypt_ctx) {
+    EVP_CIPHER_CTX_free(encrypt_ctx);
+    EVP_CIPHER_CTX_free(decrypt_ctx);
+    CMC_ERRRC_IF(true, CMC_ERR_ENCRYPTION);
+  }
+  EVP_CIPHER_CTX_free(conn->encrypt_ctx);
+  EVP_CIPHER_CTX_free(conn->decrypt_ctx);
+  conn->encrypt_ctx = encrypt_ctx;
+  conn->decrypt_ctx = decrypt_ctx;
+  return CMC_ERR_NO;
+}
 
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
-  unsigned char *tmp =
-      CMC_ERRC_ABLE(cmc_malloc(packet_len, &conn->err), goto on_err1);
-  CMC_ERRC_IF(recv_all(conn->sockfd, tmp, packet_len) == -1, CMC_ERR_RECV,
-              goto on_err1;);
-  cmc_buff_pack(buff, tmp, packet_len);
-  free(tmp);
+/*
+Runs the cipher over length bytes, out may be the same as in. CFB8 is a
+stream mode so the output is exactly as long as the input.
+*/
+static bool conn_crypt(cmc_conn *conn, EVP_CIPHER_CTX *ctx, uint8_t *out,
+                       const uint8_t *in, size_t length) {
+  while (length > 0) {
+    int chunk = length > INT_MAX ? INT_MAX : (int)length;
+    int out_length;
+    CMC_ERRC_IF(!EVP_CipherUpdate(ctx, out, &out_length, in, chunk),
+                CMC_ERR_ENCRYPTION, return false;);
+    out += chunk;
+    in += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+/*
+Reads whatever the socket has into the receive buffer. Returns 1 if something
+was read, 0 if a non blocking socket had nothing and -1 if the peer closed
+the connection or recv failed.
+*/
+static int rx_fill(cmc_conn *conn) {
+  cmc_conn_rx *rx = &conn->rx;
+  // reads get smaller close to the limit instead of failing
+  size_t room = conn->max_buffered_bytes - (rx->end - rx->start);
+  size_t min_read = room < CMC_CONN_RX_MIN_READ ? room : CMC_CONN_RX_MIN_READ;
+  if (!rx_reserve(conn, min_read ? min_read : 1))
+    return -1;
+
+  ssize_t received;
+  do {
+    received =
+        recv(conn->sockfd, rx->data + rx->end, rx->capacity - rx->end, 0);
+  } while (received == -1 && errno == EINTR);
+  if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+  CMC_ERRC_IF(received <= 0, CMC_ERR_RECV, return -1;);
+  uint8_t *data = rx->data + rx->end;
+  if (conn->decrypt_ctx &&
+      !conn_crypt(conn, conn->decrypt_ctx, data, data, received))
+    return -1;
+  rx->end += received;
+  if (conn->timing)
+    conn->timing->received_ns = now_ns();
+  return 1;
+}
+
+bool cmc_conn_push_received(cmc_conn *conn, const uint8_t *data,
+                            size_t length) {
+  if (!rx_reserve(conn, length))
+    return false;
+  // decrypting copies the bytes over on the way
+  if (conn->decrypt_ctx) {
+    if (!conn_crypt(conn, conn->decrypt_ctx, conn->rx.data + conn->rx.end,
+                    data, length))
+      return false;
+  } else {
+    memcpy(conn->rx.data + conn->rx.end, data, length);
+  }
+  conn->rx.end += length;
+  if (conn->timing)
+    conn->timing->received_ns = now_ns();
+  return true;
+}
 
+void cmc_conn_set_compression_params(cmc_conn *conn, int level, int strategy) {
+  conn->compression_level = level;
+  conn->compression_strategy = strategy;
+  // both are fixed when the deflater is created, recreate it on the next send
+  if (conn->deflater)
+    cmc_deflater_free(conn->deflater);
+  conn->deflater = NULL;
+}
+
+// Splits off the data length in front of compressed frames.
+static bool frame_header(const cmc_conn *conn, const uint8_t *frame,
+                         size_t frame_length, size_t *body_start,
+                         size_t *decompressed_length, cmc_err_extra *err) {
+  *body_start = 0;
+  *decompressed_length = 0;
   if (conn->compression_threshold == -1)
-    return buff;
+    return true;
+  cmc_buff header = {.data = (uint8_t *)frame,
+                     .length = frame_length,
+                     .protocol_version = conn->protocol_version};
+  int decompressed_length_signed = cmc_buff_unpack_varint(&header);
+  CMC_ERRA_IF(header.err.err != CMC_ERR_NO || decompressed_length_signed < 0,
+              *err, CMC_ERR_INVALID_PACKET_LENGTH, return false;);
+  *body_start = header.position;
+  *decompressed_length = decompressed_length_signed;
+  return true;
+}
 
-  int decompressed_length_signed = cmc_buff_unpack_varint(buff);
-  if (decompressed_length_signed <= 0)
-    return buff;
+void cmc_conn_want_packet(cmc_conn *conn, int packet_id) {
+  assert(packet_id >= 0 && packet_id < CMC_CONN_PACKET_FILTER_IDS);
+  conn->filter_packets = true;
+  conn->wanted_packets[packet_id / 64] |= UINT64_C(1) << (packet_id % 64);
+}
+
+void cmc_conn_want_all_packets(cmc_conn *conn) {
+  conn->filter_packets = false;
+  memset(conn->wanted_packets, 0, sizeof(conn->wanted_packets));
+}
 
-  size_t decompressed_length = decompressed_length_signed;
+void cmc_conn_set_auto_keep_alive(cmc_conn *conn, bool enabled) {
+  conn->auto_keep_alive = enabled;
+}
 
-  unsigned char *decompressed_data =
-      CMC_ERRC_ABLE(cmc_malloc(decompressed_length, &conn->err), goto on_err1);
+/*
+Reads the packet id at the start of the body, inflating only the few bytes
+it takes when the frame is compressed. Sets packet_id to -1 if the body is
+too broken to have one. Returns false on error.
+*/
+static bool frame_packet_id(cmc_conn *conn, const uint8_t *frame,
+                            size_t frame_length, int *packet_id) {
+  size_t body_start, decompressed_length;
+  if (!frame_header(conn, frame, frame_length, &body_start,
+                    &decompressed_length, &conn->err))
+    return false;
+
+  uint8_t prefix[CMC_VARINT_MAX_BYTES];
+  cmc_buff id = {.data = (uint8_t *)frame + body_start,
+                 .length = frame_length - body_start,
+                 .protocol_version = conn->protocol_version};
+  if (decompressed_length > 0) {
+    if (!conn->inflater) {
+      conn->inflater =
+          CMC_ERRC_ABLE(cmc_inflater_init(&conn->err), return false;);
+    }
+    id.data = prefix;
+    id.length = decompressed_length < sizeof(prefix) ? decompressed_length
+                                                     : sizeof(prefix);
+    if (!cmc_inflate_prefix(conn->inflater, frame + body_start,
+                            frame_length - body_start, prefix, id.length,
+                            &conn->err))
+      return false;
+  }
+  *packet_id = cmc_buff_unpack_varint(&id);
+  if (id.err.err != CMC_ERR_NO || *packet_id < 0)
+    *packet_id = -1;
+  return true;
+}
 
-  z_stream strm;
-  strm.zalloc = Z_NULL;
-  strm.zfree = Z_NULL;
-  strm.opaque = Z_NULL;
+static bool is_keep_alive(const cmc_conn *conn, cmc_conn_state state,
+                          int packet_id) {
+  // the name lookup only looks at the low byte of the id
+  if (packet_id > 0xFF)
+    return false;
+  cmc_packet_name_id name = cmc_packet_id_to_packet_name_id(
+      packet_id, state, CMC_DIRECTION_S2C, conn->protocol_version);
+  return name == CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID ||
+         name == CMC_S2C_CONFIG_KEEP_ALIVE_NAME_ID;
+}
 
-  strm.avail_in = buff->length - buff->position;
-  strm.next_in = (Bytef *)buff->data + buff->position;
-  strm.avail_out = decompressed_length;
-  strm.next_out = (Bytef *)decompressed_data;
+// Sends the keep alive in frame back to the server. Returns false on error.
+static bool answer_keep_alive(cmc_conn *conn, cmc_conn_state state,
+                              const uint8_t *frame, size_t frame_length) {
+  uint64_t start = now_ns();
+  cmc_buff *buff = cmc_conn_decode_frame(conn, state, &conn->inflater,
+                                         conn->pool, conn->rx.capacity, frame,
+                                         frame_length, &conn->err);
+  if (!buff)
+    return false;
+  cmc_buff_unpack_varint(buff);
+  int64_t keep_alive_id;
+  // only errors of the reply count, an older one stays for the application
+  cmc_err_extra earlier_err = conn->err;
+  conn->err = (cmc_err_extra){};
+  // the reply isn't the application answering the packet it got last
+  bool responded = conn->timing && conn->timing->responded;
+  if (conn->timing)
+    conn->timing->responded = true;
+  if (state == CMC_CONN_STATE_CONFIG) {
+    S2C_config_keep_alive_packet packet =
+        unpack_S2C_config_keep_alive_packet(buff);
+    keep_alive_id = packet.keep_alive_id;
+    if (buff->err.err == CMC_ERR_NO) {
+      C2S_config_keep_alive_packet reply = {.keep_alive_id = keep_alive_id};
+      cmc_send_C2S_config_keep_alive_packet(conn, &reply);
+    }
+  } else {
+    S2C_play_keep_alive_packet packet = unpack_S2C_play_keep_alive_packet(buff);
+    keep_alive_id = conn->protocol_version == CMC_PROTOCOL_VERSION_47
+                        ? packet.keep_alive_id
+                        : packet.keep_alive_id_long;
+    if (buff->err.err == CMC_ERR_NO) {
+      C2S_play_keep_alive_packet reply = {
+          .keep_alive_id = packet.keep_alive_id,
+          .keep_alive_id_long = packet.keep_alive_id_long};
+      cmc_send_C2S_play_keep_alive_packet(conn, &reply);
+    }
+  }
+  if (conn->timing)
+    conn->timing->responded = responded;
+  if (buff->err.err != CMC_ERR_NO)
+    conn->err = buff->err;
+  cmc_buff_free(buff);
+  if (conn->err.err != CMC_ERR_NO)
+    return false;
+  conn->err = earlier_err;
+
+  cmc_conn_keep_alive_stats *stats = &conn->keep_alive_stats;
+  uint64_t end = now_ns();
+  stats->answered++;
+  stats->last_id = keep_alive_id;
+  stats->last_answered_ns = end;
+  stats->last_turnaround_ns = end - start;
+  if (end - start > stats->max_turnaround_ns)
+    stats->max_turnaround_ns = end - start;
+  if (conn->timing)
+    cmc_histogram_record(&conn->timing->latency.keep_alive,
+                         end - conn->timing->received_ns);
+  return true;
+}
 
-  CMC_ERRC_IF(inflateInit(&strm) != Z_OK, CMC_ERR_ZLIB_INIT, goto on_err2;);
+/*
+Looks at the packet id when the filter or the keep alive responder need it.
+Returns 1 if the packet should be delivered, 0 if it can be dropped or was
+answered and -1 on error.
+*/
+static int frame_wanted(cmc_conn *conn, const uint8_t *frame,
+                        size_t frame_length) {
+  // read once, a scheduler worker may change it in the meantime
+  cmc_conn_state state = conn->state;
+  bool filter = conn->filter_packets && state == CMC_CONN_STATE_PLAY;
+  bool keep_alive =
+      conn->auto_keep_alive &&
+      (state == CMC_CONN_STATE_PLAY || state == CMC_CONN_STATE_CONFIG);
+  if (!filter && !keep_alive)
+    return 1;
+  int packet_id = -1;
+  if (!frame_packet_id(conn, frame, frame_length, &packet_id))
+    return -1;
+  // let the decoder deal with packets too broken to have an id
+  if (packet_id == -1)
+    return 1;
+  if (keep_alive && is_keep_alive(conn, state, packet_id))
+    return answer_keep_alive(conn, state, frame, frame_length) ? 0 : -1;
+  if (!filter || packet_id >= CMC_CONN_PACKET_FILTER_IDS)
+    return 1;
+  return (conn->wanted_packets[packet_id / 64] >> (packet_id % 64)) & 1;
+}
 
-  CMC_ERRC_IF(inflate(&strm, Z_FINISH) != Z_STREAM_END, CMC_ERR_ZLIB_INFLATE,
-              goto on_err3;);
+/*
+Counts the packet for cmc_packet_stats, data starts with the packet id. state
+is the one the packet belongs to, conn->state may have moved on already when
+the packet is decoded on another thread.
+*/
+static void count_packet(const cmc_conn *conn, cmc_conn_state state,
+                         cmc_packet_direction direction, const uint8_t *data,
+                         size_t data_length, size_t wire_length) {
+  if (cmc_packet_stats_active())
+    cmc_packet_stats_add_packet(state, direction, conn->protocol_version, data,
+                                data_length, wire_length);
+}
 
-  size_t real_decompressed_length = strm.total_out;
+static cmc_buff *buff_init(cmc_buff_pool *pool,
+                           cmc_protocol_version protocol_version,
+                           size_t capacity) {
+  if (pool)
+    return cmc_buff_pool_acquire(pool, protocol_version, capacity);
+  return cmc_buff_init_with_capacity(protocol_version, capacity);
+}
 
-  inflateEnd(&strm);
-  CMC_ERRC_IF(real_decompressed_length != decompressed_length,
-              CMC_ERR_SENDER_LYING, goto on_err2;);
+cmc_buff *cmc_conn_decode_frame(const cmc_conn *conn, cmc_conn_state state,
+                                cmc_inflater **inflater, cmc_buff_pool *pool,
+                                size_t buffered, const uint8_t *frame,
+                                size_t frame_length, cmc_err_extra *err) {
+  size_t body_start, decompressed_length;
+  if (!frame_header(conn, frame, frame_length, &body_start,
+                    &decompressed_length, err))
+    return NULL;
+
+  if (decompressed_length == 0) {
+    cmc_buff *buff = buff_init(pool, conn->protocol_version,
+                               frame_length - body_start);
+    CMC_ERRA_IF(!buff, *err, CMC_ERR_MEM, return NULL;);
+    if (frame_length > body_start) {
+      memcpy(buff->data, frame + body_start, frame_length - body_start);
+      buff->length = frame_length - body_start;
+    }
+    count_packet(conn, state, CMC_DIRECTION_S2C, buff->data, buff->length,
+                 cmc_varint_size(frame_length) + frame_length);
+    return buff;
+  }
 
-  cmc_buff_free(buff);
+  // whatever the peer claims, nothing is allocated for it past the limits
+  CMC_ERRA_IF(decompressed_length > conn->max_decompressed_length ||
+                  buffered + decompressed_length > conn->max_buffered_bytes,
+              *err, CMC_ERR_INVALID_PACKET_LENGTH, return NULL;);
+  cmc_buff *decompressed_buff =
+      buff_init(pool, conn->protocol_version, decompressed_length);
+  CMC_ERRA_IF(!decompressed_buff, *err, CMC_ERR_MEM, return NULL;);
 
-  cmc_buff *decompressed_buff = cmc_buff_init(conn->protocol_version);
-  decompressed_buff->data = decompressed_data;
-  decompressed_buff->capacity = decompressed_length;
-  decompressed_buff->length = decompressed_length;
+  if (!*inflater) {
+    *inflater = CMC_ERR_ABLE(cmc_inflater_init(err), goto on_error;);
+  }
+  if (!cmc_inflate(*inflater, frame + body_start, frame_length - body_start,
+                   decompressed_buff->data, decompressed_length, err))
+    goto on_error;
 
+  decompressed_buff->length = decompressed_length;
+  count_packet(conn, state, CMC_DIRECTION_S2C, decompressed_buff->data,
+               decompressed_length,
+               cmc_varint_size(frame_length) + frame_length);
   return decompressed_buff;
 
-  // TODO: Encryption
-on_err3:
-  inflateEnd(&strm);
-on_err2:
-  free(decompressed_data);
-on_err1:
-  cmc_buff_free(buff);
+on_error:
+  cmc_buff_free(decompressed_buff);
   return NULL;
 }
 
+// a frame as it was received, for cmc_conn_decode_frame on another thread
+static cmc_buff *copy_frame(cmc_conn *conn, const uint8_t *frame,
+                            size_t frame_length) {
+  cmc_buff *buff =
+      cmc_buff_init_with_capacity(conn->protocol_version, frame_length);
+  CMC_ERRC_IF(!buff, CMC_ERR_MEM, return NULL;);
+  memcpy(buff->data, frame, frame_length);
+  buff->length = frame_length;
+  return buff;
+}
+
+// next_packet with latency stats on
+static cmc_buff *timed_packet(cmc_conn *conn, const uint8_t *frame,
+                              size_t frame_length, bool raw) {
+  struct cmc_conn_timing *timing = conn->timing;
+  uint64_t start = now_ns();
+  cmc_histogram_record(&timing->latency.stages[CMC_CONN_STAGE_QUEUED],
+                       start - timing->received_ns);
+  cmc_buff *buff;
+  uint64_t end = start;
+  if (raw) {
+    buff = copy_frame(conn, frame, frame_length);
+  } else {
+    buff = cmc_conn_decode_frame(conn, conn->state, &conn->inflater,
+                                 conn->pool, conn->rx.capacity, frame,
+                                 frame_length, &conn->err);
+    // a data length of 0 means the frame isn't compressed
+    if (buff && conn->compression_threshold >= 0 && frame[0] != 0) {
+      end = now_ns();
+      cmc_histogram_record(&timing->latency.stages[CMC_CONN_STAGE_INFLATE],
+                           end - start);
+    }
+  }
+  if (buff) {
+    timing->handed_out_received_ns = timing->received_ns;
+    timing->handed_out_ns = end;
+    timing->decoded = false;
+    timing->responded = false;
+  }
+  return buff;
+}
+
+/*
+Hands out the next wanted packet in the receive buffer, reading the socket
+for more when fill is set. With raw set the frame is copied out as it is
+instead of being decoded.
+*/
+static cmc_buff *next_packet(cmc_conn *conn, bool fill, bool raw) {
+  while (true) {
+    const uint8_t *frame;
+    size_t frame_length;
+    int found = rx_next_frame(conn, &frame, &frame_length);
+    CMC_ERRC_IF(found == -1, CMC_ERR_INVALID_PACKET_LENGTH, return NULL;);
+    if (found) {
+      int wanted = frame_wanted(conn, frame, frame_length);
+      if (wanted == -1)
+        return NULL;
+      if (!wanted)
+        continue;
+      if (conn->timing)
+        return timed_packet(conn, frame, frame_length, raw);
+      if (raw)
+        return copy_frame(conn, frame, frame_length);
+      return cmc_conn_decode_frame(conn, conn->state, &conn->inflater,
+                                   conn->pool, conn->rx.capacity, frame,
+                                   frame_length, &conn->err);
+    }
+    if (!fill || rx_fill(conn) != 1)
+      return NULL;
+  }
+}
+
+cmc_buff *cmc_conn_recive_packet(cmc_conn *conn) {
+  return next_packet(conn, true, false);
+}
+
+cmc_buff *cmc_conn_try_recive_packet(cmc_conn *conn) {
+  assert(conn->nonblocking);
+  return next_packet(conn, true, false);
+}
+
+cmc_buff *cmc_conn_pop_packet(cmc_conn *conn) {
+  return next_packet(conn, false, false);
+}
+
+cmc_buff *cmc_conn_try_recive_frame(cmc_conn *conn) {
+  assert(conn->nonblocking);
+  return next_packet(conn, true, true);
+}
+
+cmc_buff *cmc_conn_pop_frame(cmc_conn *conn) {
+  return next_packet(conn, false, true);
+}
+
+cmc_err cmc_conn_enable_latency_stats(cmc_conn *conn) {
+  if (conn->timing)
+    return CMC_ERR_NO;
+  conn->timing = calloc(1, sizeof(struct cmc_conn_timing));
+  CMC_ERRRC_IF(!conn->timing, CMC_ERR_MEM);
+  return CMC_ERR_NO;
+}
+
+void cmc_conn_packet_decoded(cmc_conn *conn) {
+  struct cmc_conn_timing *timing = conn->timing;
+  if (!timing || timing->decoded || !timing->handed_out_ns)
+    return;
+  timing->decoded = true;
+  cmc_histogram_record(&timing->latency.stages[CMC_CONN_STAGE_DECODE],
+                       now_ns() - timing->handed_out_ns);
+}
+
+const cmc_conn_latency *cmc_conn_get_latency(const cmc_conn *conn) {
+  return conn->timing ? &conn->timing->latency : NULL;
+}
+
+bool cmc_conn_latency_snapshot(const cmc_conn *conn, cmc_conn_latency *out) {
+  if (!conn->timing)
+    return false;
+  for (int i = 0; i < CMC_CONN_STAGES; i++)
+    cmc_histogram_copy(&out->stages[i], &conn->timing->latency.stages[i]);
+  cmc_histogram_copy(&out->keep_alive, &conn->timing->latency.keep_alive);
+  return true;
+}
+
+const char *cmc_conn_stage_string(cmc_conn_stage stage) {
+  switch (stage) {
+  case CMC_CONN_STAGE_QUEUED:
+    return "queued";
+  case CMC_CONN_STAGE_INFLATE:
+    return "inflate";
+  case CMC_CONN_STAGE_DECODE:
+    return "decode";
+  case CMC_CONN_STAGE_RESPOND:
+    return "respond";
+  case CMC_CONN_STAGES:
+    break;
+  }
+  return "unknown";
+}
+
+cmc_err cmc_conn_set_nonblocking(cmc_conn *conn, bool nonblocking) {
+  int flags = fcntl(conn->sockfd, F_GETFL, 0);
+  CMC_ERRRC_IF(flags == -1, CMC_ERR_SOCKET);
+  flags = nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+  CMC_ERRRC_IF(fcntl(conn->sockfd, F_SETFL, flags) == -1, CMC_ERR_SOCKET);
+  conn->nonblocking = nonblocking;
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_conn_flush(cmc_conn *conn) {
+  if (conn->loop)
+    return cmc_loop_flush_conn(conn->loop, conn);
+  return cmc_conn_send_queued(conn);
+}
+
+cmc_err cmc_conn_send_queued(cmc_conn *conn) {
+  cmc_conn_tx *tx = &conn->tx;
+  while (tx->start < tx->end) {
+    ssize_t sent = send(conn->sockfd, tx->data + tx->start,
+                        tx->end - tx->start, MSG_NOSIGNAL);
+    if (sent == -1 && errno == EINTR)
+      continue;
+    if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return CMC_ERR_NO;
+    CMC_ERRRC_IF(sent == -1, CMC_ERR_SENDING);
+    tx->start += sent;
+  }
+  tx->start = tx->end = 0;
+  return CMC_ERR_NO;
+}
+
+// queues bytes behind whatever is still waiting to be sent
+static bool tx_append(cmc_conn *conn, const uint8_t *data, size_t length) {
+  cmc_conn_tx *tx = &conn->tx;
+  if (tx->capacity - tx->end < length && tx->start > 0) {
+    memmove(tx->data, tx->data + tx->start, tx->end - tx->start);
+    tx->end -= tx->start;
+    tx->start = 0;
+  }
+  if (tx->capacity - tx->end < length) {
+    size_t capacity = tx->capacity ? tx->capacity : CMC_CONN_TX_MIN_CAPACITY;
+    while (capacity - tx->end < length)
+      capacity *= 2;
+    uint8_t *new_data = CMC_ERRC_ABLE(
+        cmc_realloc(tx->data, capacity, &conn->err), return false;);
+    tx->data = new_data;
+    tx->capacity = capacity;
+  }
+  memcpy(tx->data + tx->end, data, length);
+  tx->end += length;
+  return true;
+}
+
+// whether a corked queue has to go out after a packet was added to it
+static bool cork_due(cmc_conn *conn, bool was_empty) {
+  if (conn->tx.end - conn->tx.start >= conn->cork_max_bytes)
+    return true;
+  if (conn->cork_max_delay_ns == 0)
+    return false;
+  uint64_t now = now_ns();
+  if (was_empty)
+    conn->cork_since_ns = now;
+  return now - conn->cork_since_ns >= conn->cork_max_delay_ns;
+}
+
+/*
+Blocking connections write straight to the socket, non blocking ones queue
+the frame and send as much as the socket takes right now. Corked ones only
+queue it until a threshold is hit. Encrypted frames always go through the
+queue and are encrypted there, frame belongs to the caller.
+*/
+static void conn_write(cmc_conn *conn, const uint8_t *frame, size_t length) {
+  struct cmc_conn_timing *timing = conn->timing;
+  if (timing && !timing->responded && timing->handed_out_ns) {
+    timing->responded = true;
+    cmc_histogram_record(&timing->latency.stages[CMC_CONN_STAGE_RESPOND],
+                         now_ns() - timing->handed_out_received_ns);
+  }
+  bool was_empty = conn->tx.start == conn->tx.end;
+  if (!conn->nonblocking && !conn->corked && !conn->encrypt_ctx &&
+      was_empty) {
+    CMC_ERRC_IF(send_all(conn->sockfd, frame, length) != 0, CMC_ERR_SENDING,
+                return;);
+    return;
+  }
+  if (!tx_append(conn, frame, length))
+    return;
+  uint8_t *queued = conn->tx.data + conn->tx.end - length;
+  if (conn->encrypt_ctx &&
+      !conn_crypt(conn, conn->encrypt_ctx, queued, queued, length))
+    return;
+  if (conn->corked && !cork_due(conn, was_empty)) {
+    // a loop sends it after the current batch of events
+    if (conn->loop)
+      cmc_loop_flush_later(conn->loop, conn);
+    return;
+  }
+  cmc_conn_flush(conn);
+}
+
+void cmc_conn_cork(cmc_conn *conn, size_t max_bytes, uint32_t max_delay_ms) {
+  conn->corked = true;
+  conn->cork_max_bytes =
+      max_bytes ? max_bytes : CMC_CONN_CORK_DEFAULT_MAX_BYTES;
+  conn->cork_max_delay_ns = (uint64_t)max_delay_ms * 1000000;
+  conn->cork_since_ns = now_ns();
+}
+
+cmc_err cmc_conn_uncork(cmc_conn *conn) {
+  conn->corked = false;
+  return cmc_conn_flush(conn);
+}
+
+/*
+Writes the packet length varint (and with compression the data length
+varint) directly in front of body, which needs CMC_CONN_PACKET_HEADROOM bytes
+of room before it. Returns the start of the framed packet and adds the header
+size to length.
+*/
+static uint8_t *prepend_header(uint8_t *body, size_t *length, bool compression,
+                               size_t data_length) {
+  uint8_t header[CMC_CONN_PACKET_HEADROOM];
+  size_t packet_length = *length;
+  if (compression)
+    packet_length += cmc_varint_size(data_length);
+
+  size_t header_length = cmc_varint_encode(header, packet_length);
+  if (compression)
+    header_length += cmc_varint_encode(header + header_length, data_length);
+
+  memcpy(body - header_length, header, header_length);
+  *length += header_length;
+  return body - header_length;
+}
+
 void cmc_conn_send_packet(cmc_conn *conn, cmc_buff *buff) {
-  cmc_buff *compressed_buff = cmc_buff_init(conn->protocol_version);
-  if (conn->compression_threshold >= 0) {
-    if (buff->length >= (size_t)conn->compression_threshold) {
-      cmc_buff_pack_varint(compressed_buff, buff->length);
-      uLong compressedSize = compressBound(buff->length);
-      Bytef *compressedData =
-          CMC_ERRC_ABLE(cmc_malloc(compressedSize, &buff->err), goto on_error);
-      CMC_ERRC_IF(compress(compressedData, &compressedSize, buff->data,
-                           buff->length) != Z_OK,
-                  CMC_ERR_ZLIB_COMPRESS, goto on_error;);
+  uint8_t *body = buff->data + buff->position;
+  size_t body_length = buff->length - buff->position;
+  bool compression = conn->compression_threshold >= 0;
+
+  if (compression && body_length >= (size_t)conn->compression_threshold) {
+    if (!conn->deflater) {
+      conn->deflater = CMC_ERRC_ABLE(
+          cmc_deflater_init(conn->compression_level,
+                            conn->compression_strategy, &conn->err),
+          return;);
+    }
+    size_t compressed_length = cmc_deflate_bound(conn->deflater, body_length);
+    cmc_buff *compressed = cmc_conn_buff_init(
+        conn, CMC_CONN_PACKET_HEADROOM + compressed_length);
+    CMC_ERRC_IF(!compressed, CMC_ERR_MEM, return;);
+    uint8_t *compressed_body = compressed->data + CMC_CONN_PACKET_HEADROOM;
+    compressed_length =
+        cmc_deflate(conn->deflater, body, body_length, compressed_body,
+                    compressed_length, &conn->err);
+    if (compressed_length == 0)
+      goto on_error;
+
+    size_t frame_length = compressed_length;
+    uint8_t *frame =
+        prepend_header(compressed_body, &frame_length, true, body_length);
+    count_packet(conn, conn->state, CMC_DIRECTION_C2S, body, body_length,
+                 frame_length);
+    conn_write(conn, frame, frame_length);
+  on_error:
+    cmc_buff_free(compressed);
+    return;
+  }
+
+  if (buff->position < CMC_CONN_PACKET_HEADROOM) {
+    // no room for the header in front, frame a copy instead
+    cmc_buff *framed =
+        cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM + body_length);
+    CMC_ERRC_IF(!framed, CMC_ERR_MEM, return;);
+    if (cmc_buff_reserve_headroom(framed, CMC_CONN_PACKET_HEADROOM) ||
+        cmc_buff_pack(framed, body, body_length)) {
+      conn->err = framed->err;
     } else {
-      cmc_buff_pack_varint(compressed_buff, 0);
-      cmc_buff_pack(compressed_buff, buff->data, buff->length);
+      cmc_conn_send_packet(conn, framed);
     }
-  } else {
-    cmc_buff_pack(compressed_buff, buff->data, buff->length);
+    cmc_buff_free(framed);
+    return;
   }
 
-  cmc_buff *packet_size_buff = cmc_buff_init(conn->protocol_version);
-  cmc_buff_pack_varint(packet_size_buff, compressed_buff->length);
+  size_t frame_length = body_length;
+  uint8_t *frame = prepend_header(body, &frame_length, compression, 0);
+  count_packet(conn, conn->state, CMC_DIRECTION_C2S, body, body_length,
+               frame_length);
+  conn_write(conn, frame, frame_length);
+}
+
+cmc_err cmc_conn_enable_send_queue(cmc_conn *conn, size_t capacity) {
+  assert(!conn->send_queue);
+  conn->send_queue = cmc_mpsc_queue_init(capacity);
+  CMC_ERRRC_IF(!conn->send_queue, CMC_ERR_MEM);
+  return CMC_ERR_NO;
+}
 
-  compressed_buff = cmc_buff_combine(packet_size_buff, compressed_buff);
-  CMC_ERRC_IF(send_all(conn->sockfd, compressed_buff->data,
-                       compressed_buff->length) != 0,
-              CMC_ERR_SENDING, );
-  cmc_buff_free(compressed_buff);
-  return;
+bool cmc_conn_queue_packet(cmc_conn *conn, cmc_buff *packet) {
+  if (!cmc_mpsc_queue_push(conn->send_queue, packet))
+    return false;
+  // one wakeup per drain is enough, the rest find the flag set
+  if (!atomic_exchange(&conn->send_signalled, true)) {
+    int wake_fd = atomic_load(&conn->send_wake_fd);
+    if (wake_fd != -1)
+      eventfd_write(wake_fd, 1);
+  }
+  return true;
+}
 
-on_error:
-  cmc_buff_free(compressed_buff);
-  return;
+cmc_err cmc_conn_send_queued_packets(cmc_conn *conn) {
+  // cleared first, a push after this wakes the loop again
+  atomic_store(&conn->send_signalled, false);
+  cmc_buff *packet;
+  while ((packet = cmc_mpsc_queue_pop(conn->send_queue))) {
+    cmc_conn_send_packet(conn, packet);
+    cmc_buff_free(packet);
+    if (conn->err.err != CMC_ERR_NO)
+      return conn->err.err;
+  }
+  return CMC_ERR_NO;
 }
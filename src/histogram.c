@@ -0,0 +1,99 @@
+#include <cmc/histogram.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define SUB_BUCKET_MASK (CMC_HISTOGRAM_SUB_BUCKETS - 1)
+
+// Values below CMC_HISTOGRAM_SUB_BUCKETS get a bucket each.
+static unsigned bucket_index(uint64_t value) {
+  if (value > CMC_HISTOGRAM_MAX_VALUE)
+    value = CMC_HISTOGRAM_MAX_VALUE;
+  if (value < CMC_HISTOGRAM_SUB_BUCKETS)
+    return value;
+  unsigned bits = 63 - __builtin_clzll(value);
+  unsigned shift = bits - CMC_HISTOGRAM_SUB_BUCKET_BITS;
+  return ((shift + 1) << CMC_HISTOGRAM_SUB_BUCKET_BITS) +
+         ((value >> shift) & SUB_BUCKET_MASK);
+}
+
+// the largest value that lands in the bucket
+static uint64_t bucket_end(unsigned index) {
+  if (index < CMC_HISTOGRAM_SUB_BUCKETS)
+    return index;
+  unsigned shift = (index >> CMC_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+  uint64_t start = (uint64_t)(CMC_HISTOGRAM_SUB_BUCKETS +
+                              (index & SUB_BUCKET_MASK))
+                   << shift;
+  return start + (UINT64_C(1) << shift) - 1;
+}
+
+static uint64_t load(const _Atomic uint64_t *value) {
+  return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+static void store(_Atomic uint64_t *value, uint64_t new_value) {
+  atomic_store_explicit(value, new_value, memory_order_relaxed);
+}
+
+void cmc_histogram_record(cmc_histogram *histogram, uint64_t value) {
+  _Atomic uint64_t *bucket = &histogram->buckets[bucket_index(value)];
+  // a single writer, no read-modify-write needed
+  store(bucket, load(bucket) + 1);
+  store(&histogram->count, load(&histogram->count) + 1);
+  store(&histogram->sum, load(&histogram->sum) + value);
+  if (value > load(&histogram->max))
+    store(&histogram->max, value);
+}
+
+void cmc_histogram_copy(cmc_histogram *out, const cmc_histogram *histogram) {
+  store(&out->count, load(&histogram->count));
+  store(&out->sum, load(&histogram->sum));
+  store(&out->max, load(&histogram->max));
+  for (unsigned i = 0; i < CMC_HISTOGRAM_BUCKETS; i++)
+    store(&out->buckets[i], load(&histogram->buckets[i]));
+}
+
+void cmc_histogram_reset(cmc_histogram *histogram) {
+  *histogram = (cmc_histogram){};
+}
+
+uint64_t cmc_histogram_count(const cmc_histogram *histogram) {
+  return load(&histogram->count);
+}
+
+uint64_t cmc_histogram_max(const cmc_histogram *histogram) {
+  return load(&histogram->max);
+}
+
+uint64_t cmc_histogram_mean(const cmc_histogram *histogram) {
+  uint64_t count = load(&histogram->count);
+  return count ? load(&histogram->sum) / count : 0;
+}
+
+uint64_t cmc_histogram_percentile(const cmc_histogram *histogram,
+                                  double percentile) {
+  // the buckets are summed up instead of trusting count, a copy taken while
+  // recording may not add up
+  uint64_t total = 0;
+  for (unsigned i = 0; i < CMC_HISTOGRAM_BUCKETS; i++)
+    total += load(&histogram->buckets[i]);
+  if (total == 0)
+    return 0;
+  if (percentile < 0)
+    percentile = 0;
+  if (percentile > 100)
+    percentile = 100;
+  double exact_rank = percentile / 100 * total;
+  uint64_t rank = exact_rank;
+  if (rank < exact_rank || rank == 0)
+    rank++;
+  uint64_t max = load(&histogram->max);
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < CMC_HISTOGRAM_BUCKETS; i++) {
+    seen += load(&histogram->buckets[i]);
+    if (seen >= rank)
+      return bucket_end(i) < max ? bucket_end(i) : max;
+  }
+  return max;
+}
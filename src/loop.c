@@ -0,0 +1,499 @@
+#include <cmc/loop.h>
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/heap_utils.h>
+#include <cmc/list.h>
+#include <cmc/timer.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "err_macros.h"
+#include "loop_internal.h"
+
+cmc_loop *cmc_loop_init(cmc_loop_callbacks callbacks) {
+  return cmc_loop_init_with_backend(callbacks, CMC_LOOP_BACKEND_AUTO);
+}
+
+cmc_loop *cmc_loop_init_with_backend(cmc_loop_callbacks callbacks,
+                                     cmc_loop_backend backend) {
+  if (backend == CMC_LOOP_BACKEND_AUTO)
+    backend = cmc_loop_uring_available() ? CMC_LOOP_BACKEND_IO_URING
+                                         : CMC_LOOP_BACKEND_EPOLL;
+  cmc_loop *loop = calloc(1, sizeof(cmc_loop));
+  if (!loop)
+    return NULL;
+  loop->backend = backend;
+  loop->callbacks = callbacks;
+  loop->epoll_fd = -1;
+  loop->wake_fd = -1;
+  INIT_LIST_HEAD(&loop->conns);
+  INIT_LIST_HEAD(&loop->removed);
+  loop->now_ms = cmc_timer_now_ms();
+  loop->timers = cmc_timer_wheel_init(loop->now_ms);
+  if (!loop->timers)
+    goto on_error;
+  loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->wake_fd == -1)
+    goto on_error;
+
+  switch (backend) {
+  case CMC_LOOP_BACKEND_AUTO:
+  case CMC_LOOP_BACKEND_EPOLL: {
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1)
+      goto on_error;
+    // the only event without a connection state
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) == -1)
+      goto on_error;
+    break;
+  }
+  case CMC_LOOP_BACKEND_IO_URING:
+    if (!cmc_loop_uring_init(loop))
+      goto on_error;
+    break;
+  }
+  return loop;
+
+on_error:
+  if (loop->epoll_fd != -1)
+    close(loop->epoll_fd);
+  if (loop->wake_fd != -1)
+    close(loop->wake_fd);
+  cmc_timer_wheel_free(loop->timers);
+  free(loop);
+  return NULL;
+}
+
+static void free_conn(cmc_loop_conn *lc) {
+  list_del(&lc->entry);
+  free(lc->sending.data);
+  free(lc);
+}
+
+// frees the states of removed connections the kernel is done with
+static void reap_removed(cmc_loop *loop) {
+  struct list_head *pos, *n;
+  list_for_each_safe(pos, n, &loop->removed) {
+    cmc_loop_conn *lc = list_entry(pos, cmc_loop_conn, entry);
+    if (lc->ops == 0 && !lc->ready)
+      free_conn(lc);
+  }
+}
+
+void cmc_loop_free(cmc_loop *loop) {
+  if (!loop)
+    return;
+  struct list_head *pos, *n;
+  list_for_each(pos, &loop->conns) {
+    cmc_loop_conn *lc = list_entry(pos, cmc_loop_conn, entry);
+    lc->conn->loop = NULL;
+    lc->conn->loop_conn = NULL;
+    atomic_store(&lc->conn->send_wake_fd, -1);
+  }
+  // closing the ring cancels everything that still refers to the states
+  if (loop->uring)
+    cmc_loop_uring_free(loop);
+  if (loop->epoll_fd != -1)
+    close(loop->epoll_fd);
+  close(loop->wake_fd);
+  list_for_each_safe(pos, n, &loop->conns) {
+    free_conn(list_entry(pos, cmc_loop_conn, entry));
+  }
+  list_for_each_safe(pos, n, &loop->removed) {
+    free_conn(list_entry(pos, cmc_loop_conn, entry));
+  }
+  cmc_timer_wheel_free(loop->timers);
+  free(loop->ready);
+  free(loop);
+}
+
+cmc_loop_backend cmc_loop_get_backend(const cmc_loop *loop) {
+  return loop->backend;
+}
+
+const char *cmc_loop_backend_string(cmc_loop_backend backend) {
+  switch (backend) {
+  case CMC_LOOP_BACKEND_AUTO:
+    return "auto";
+  case CMC_LOOP_BACKEND_EPOLL:
+    return "epoll";
+  case CMC_LOOP_BACKEND_IO_URING:
+    return "io_uring";
+  }
+  return "unknown";
+}
+
+cmc_timer_wheel *cmc_loop_get_timers(cmc_loop *loop) { return loop->timers; }
+
+cmc_loop_callbacks *cmc_loop_get_callbacks(cmc_loop *loop) {
+  return &loop->callbacks;
+}
+
+void cmc_loop_wake(cmc_loop *loop) { eventfd_write(loop->wake_fd, 1); }
+
+void cmc_loop_woken(cmc_loop *loop) {
+  eventfd_t count;
+  eventfd_read(loop->wake_fd, &count);
+  struct list_head *pos;
+  list_for_each(pos, &loop->conns) {
+    cmc_loop_conn *lc = list_entry(pos, cmc_loop_conn, entry);
+    if (atomic_load_explicit(&lc->conn->send_signalled,
+                             memory_order_relaxed) &&
+        !cmc_loop_mark_ready(loop, lc))
+      return; // the rest is found on the next wakeup or send
+  }
+}
+
+bool cmc_loop_mark_ready(cmc_loop *loop, cmc_loop_conn *lc) {
+  if (lc->ready)
+    return true;
+  if (loop->ready_count == loop->ready_capacity) {
+    size_t capacity = loop->ready_capacity ? loop->ready_capacity * 2 : 64;
+    cmc_loop_conn **ready =
+        realloc(loop->ready, capacity * sizeof(cmc_loop_conn *));
+    if (!ready)
+      return false;
+    loop->ready = ready;
+    loop->ready_capacity = capacity;
+  }
+  loop->ready[loop->ready_count++] = lc;
+  lc->ready = true;
+  return true;
+}
+
+static void read_timeout(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  cmc_loop_conn *lc = timer->user_data;
+  cmc_conn *conn = lc->conn;
+  uint64_t now = cmc_timer_wheel_now(wheel);
+  // packets only stamp the connection, the timer catches up here
+  if (lc->last_packet_ms + lc->read_timeout_ms > now) {
+    cmc_timer_arm(wheel, timer, lc->last_packet_ms + lc->read_timeout_ms - now,
+                  0);
+    return;
+  }
+  CMC_ERRC_IF(true, CMC_ERR_TIMEOUT, );
+  cmc_loop_close_conn(conn->loop, conn);
+}
+
+static cmc_loop_conn *register_conn(cmc_loop *loop, cmc_conn *conn) {
+  cmc_loop_conn *lc = CMC_ERRC_ABLE(
+      cmc_malloc(sizeof(cmc_loop_conn), &conn->err), return NULL;);
+  *lc = (cmc_loop_conn){.conn = conn};
+  cmc_timer_init(&lc->read_timer, read_timeout, lc);
+  list_add_tail(&lc->entry, &loop->conns);
+  conn->loop = loop;
+  conn->loop_conn = lc;
+  loop->conn_count++;
+  atomic_store(&conn->send_wake_fd, loop->wake_fd);
+  return lc;
+}
+
+static cmc_err epoll_register(cmc_loop *loop, cmc_conn *conn) {
+  // edge triggered, so every wakeup has to be drained until EAGAIN
+  struct epoll_event event = {.events =
+                                  EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+                              .data.ptr = conn->loop_conn};
+  CMC_ERRRC_IF(
+      epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, conn->sockfd, &event) == -1,
+      CMC_ERR_SOCKET);
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_loop_add(cmc_loop *loop, cmc_conn *conn) {
+  assert(conn->loop == NULL);
+  conn->err = (cmc_err_extra){};
+  cmc_err err = cmc_conn_set_nonblocking(conn, true);
+  if (err)
+    return err;
+
+  cmc_loop_conn *lc = register_conn(loop, conn);
+  if (!lc)
+    return conn->err.err;
+  if (loop->backend == CMC_LOOP_BACKEND_IO_URING)
+    err = cmc_loop_uring_add(loop, lc);
+  else
+    err = epoll_register(loop, conn);
+  // neither backend reports bytes that were read before, or packets other
+  // threads queued before
+  if (!err && (conn->rx.end > conn->rx.start || conn->send_signalled) &&
+      !cmc_loop_mark_ready(loop, lc))
+    CMC_ERRC_IF(true, CMC_ERR_MEM, err = CMC_ERR_MEM);
+  if (err)
+    cmc_loop_remove(loop, conn);
+  return err;
+}
+
+cmc_err cmc_loop_connect(cmc_loop *loop, cmc_conn *conn,
+                         const struct sockaddr *addr, socklen_t addr_len) {
+  assert(conn->loop == NULL && conn->sockfd == -1);
+  assert(addr_len <= sizeof(struct sockaddr_storage));
+  conn->err = (cmc_err_extra){};
+  conn->sockfd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  CMC_ERRRC_IF(conn->sockfd == -1, CMC_ERR_SOCKET);
+  conn->nonblocking = true;
+
+  cmc_loop_conn *lc = register_conn(loop, conn);
+  if (!lc)
+    return conn->err.err;
+  lc->connecting = true;
+  memcpy(&lc->addr, addr, addr_len);
+
+  cmc_err err = CMC_ERR_NO;
+  if (loop->backend == CMC_LOOP_BACKEND_IO_URING) {
+    err = cmc_loop_uring_connect(loop, lc, addr_len);
+  } else if (connect(conn->sockfd, addr, addr_len) == -1 &&
+             errno != EINPROGRESS) {
+    CMC_ERRC_IF(true, CMC_ERR_CONNETING, err = CMC_ERR_CONNETING);
+  } else {
+    // the socket turns writable once the connect finished
+    err = epoll_register(loop, conn);
+  }
+  if (err)
+    cmc_loop_remove(loop, conn);
+  return err;
+}
+
+void cmc_loop_remove(cmc_loop *loop, cmc_conn *conn) {
+  if (conn->loop != loop)
+    return;
+  cmc_loop_conn *lc = conn->loop_conn;
+  if (loop->backend == CMC_LOOP_BACKEND_IO_URING)
+    cmc_loop_uring_remove(loop, lc);
+  else
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->sockfd, NULL);
+  conn->loop = NULL;
+  conn->loop_conn = NULL;
+  atomic_store(&conn->send_wake_fd, -1);
+  cmc_timer_cancel(loop->timers, &lc->read_timer);
+  lc->conn = NULL;
+  list_del(&lc->entry);
+  list_add_tail(&lc->entry, &loop->removed);
+  loop->conn_count--;
+}
+
+size_t cmc_loop_conn_count(const cmc_loop *loop) { return loop->conn_count; }
+
+void cmc_loop_set_read_timeout(cmc_loop *loop, cmc_conn *conn,
+                               uint64_t timeout_ms) {
+  assert(conn->loop == loop);
+  cmc_loop_conn *lc = conn->loop_conn;
+  lc->read_timeout_ms = timeout_ms;
+  if (!timeout_ms) {
+    cmc_timer_cancel(loop->timers, &lc->read_timer);
+    return;
+  }
+  lc->last_packet_ms = loop->now_ms;
+  cmc_timer_arm(loop->timers, &lc->read_timer, timeout_ms, 0);
+}
+
+int cmc_loop_tick(cmc_loop *loop) {
+  loop->now_ms = cmc_timer_now_ms();
+  return cmc_timer_wheel_advance(loop->timers, loop->now_ms);
+}
+
+void cmc_loop_close_conn(cmc_loop *loop, cmc_conn *conn) {
+  cmc_loop_remove(loop, conn);
+  if (loop->callbacks.on_close)
+    loop->callbacks.on_close(loop, conn);
+}
+
+void cmc_loop_connected(cmc_loop *loop, cmc_conn *conn) {
+  conn->loop_conn->connecting = false;
+  // packets queued while connecting were left for now
+  if (conn->send_signalled && !cmc_loop_mark_ready(loop, conn->loop_conn)) {
+    CMC_ERRC_IF(true, CMC_ERR_MEM, );
+    cmc_loop_close_conn(loop, conn);
+    return;
+  }
+  if (loop->callbacks.on_connect)
+    loop->callbacks.on_connect(loop, conn);
+}
+
+static void dispatch(cmc_loop *loop, cmc_conn *conn, cmc_buff *packet) {
+  conn->loop_conn->last_packet_ms = loop->now_ms;
+  if (loop->callbacks.on_packet)
+    loop->callbacks.on_packet(loop, conn, packet);
+  else
+    cmc_buff_free(packet);
+}
+
+void cmc_loop_deliver(cmc_loop *loop, cmc_conn *conn) {
+  while (conn->loop == loop) {
+    cmc_buff *packet = loop->raw_frames ? cmc_conn_pop_frame(conn)
+                                        : cmc_conn_pop_packet(conn);
+    if (!packet) {
+      if (conn->err.err != CMC_ERR_NO)
+        cmc_loop_close_conn(loop, conn);
+      return;
+    }
+    dispatch(loop, conn, packet);
+  }
+}
+
+cmc_err cmc_loop_flush_later(cmc_loop *loop, cmc_conn *conn) {
+  CMC_ERRRC_IF(!cmc_loop_mark_ready(loop, conn->loop_conn), CMC_ERR_MEM);
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_loop_flush_conn(cmc_loop *loop, cmc_conn *conn) {
+  if (loop->backend == CMC_LOOP_BACKEND_IO_URING)
+    return cmc_loop_flush_later(loop, conn);
+  // the queue goes out once connected
+  if (conn->loop_conn->connecting)
+    return CMC_ERR_NO;
+  return cmc_conn_send_queued(conn);
+}
+
+// hands out every complete packet until the socket would block
+static void epoll_readable(cmc_loop *loop, cmc_conn *conn) {
+  while (conn->loop == loop) {
+    cmc_buff *packet = loop->raw_frames ? cmc_conn_try_recive_frame(conn)
+                                        : cmc_conn_try_recive_packet(conn);
+    if (!packet) {
+      if (conn->err.err != CMC_ERR_NO)
+        cmc_loop_close_conn(loop, conn);
+      return;
+    }
+    dispatch(loop, conn, packet);
+  }
+}
+
+static void epoll_writable(cmc_loop *loop, cmc_conn *conn) {
+  if (conn->loop_conn->connecting) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(conn->sockfd, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error) {
+      CMC_ERRC_IF(true, CMC_ERR_CONNETING, );
+      cmc_loop_close_conn(loop, conn);
+      return;
+    }
+    cmc_loop_connected(loop, conn);
+    if (conn->loop != loop)
+      return;
+  }
+  if (conn->tx.start == conn->tx.end)
+    return;
+  if (cmc_conn_send_queued(conn) != CMC_ERR_NO)
+    cmc_loop_close_conn(loop, conn);
+}
+
+int cmc_loop_handle_ready(cmc_loop *loop) {
+  // callbacks can mark more connections, those wait for the next call
+  size_t ready_count = loop->ready_count;
+  int handled = 0;
+  for (size_t i = 0; i < ready_count; i++) {
+    cmc_loop_conn *lc = loop->ready[i];
+    lc->ready = false;
+    if (!lc->conn || lc->connecting)
+      continue;
+    cmc_conn *conn = lc->conn;
+    if (conn->rx.end > conn->rx.start) {
+      cmc_loop_deliver(loop, conn);
+      handled++;
+    }
+    if (conn->loop == loop && conn->send_signalled &&
+        cmc_conn_send_queued_packets(conn) != CMC_ERR_NO) {
+      cmc_loop_close_conn(loop, conn);
+      continue;
+    }
+    if (conn->loop != loop || conn->tx.start == conn->tx.end)
+      continue;
+    cmc_err err = loop->backend == CMC_LOOP_BACKEND_IO_URING
+                      ? cmc_loop_uring_send(loop, lc)
+                      : cmc_conn_send_queued(conn);
+    if (err)
+      cmc_loop_close_conn(loop, conn);
+  }
+  loop->ready_count -= ready_count;
+  if (loop->ready_count > 0)
+    memmove(loop->ready, loop->ready + ready_count,
+            loop->ready_count * sizeof(cmc_loop_conn *));
+  return handled;
+}
+
+static int epoll_run_once(cmc_loop *loop, int timeout_ms) {
+  int handled = cmc_loop_handle_ready(loop);
+  if (handled)
+    timeout_ms = 0;
+
+  int count;
+  do {
+    count = epoll_wait(loop->epoll_fd, loop->events, CMC_LOOP_MAX_EVENTS,
+                       timeout_ms);
+  } while (count == -1 && errno == EINTR);
+  if (count == -1)
+    return -1;
+  handled += cmc_loop_tick(loop);
+
+  for (int i = 0; i < count; i++) {
+    cmc_loop_conn *lc = loop->events[i].data.ptr;
+    uint32_t events = loop->events[i].events;
+    if (!lc) {
+      cmc_loop_woken(loop);
+      continue;
+    }
+    // removed by a callback earlier in this batch
+    if (!lc->conn)
+      continue;
+    cmc_conn *conn = lc->conn;
+    if (lc->connecting) {
+      epoll_writable(loop, conn);
+      if (conn->loop != loop)
+        continue;
+    }
+    // hangups and errors show up as a failing recv after the last packets
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      epoll_readable(loop, conn);
+    if ((events & EPOLLOUT) && conn->loop == loop)
+      epoll_writable(loop, conn);
+  }
+  // corked sends from the callbacks and packets queued by other threads
+  cmc_loop_handle_ready(loop);
+  return handled + count;
+}
+
+int cmc_loop_run_once(cmc_loop *loop, int timeout_ms) {
+  // the callbacks of the last call may have taken a while
+  int fired = cmc_loop_tick(loop);
+  // no longer than until the next timer is due
+  uint64_t next = cmc_timer_wheel_next_expiry(loop->timers);
+  if (next != UINT64_MAX) {
+    uint64_t wait = next - loop->now_ms;
+    if (wait > INT_MAX)
+      wait = INT_MAX;
+    if (timeout_ms < 0 || wait < (uint64_t)timeout_ms)
+      timeout_ms = wait;
+  }
+  int handled = loop->backend == CMC_LOOP_BACKEND_IO_URING
+                    ? cmc_loop_uring_run_once(loop, timeout_ms)
+                    : epoll_run_once(loop, timeout_ms);
+  reap_removed(loop);
+  if (handled == -1)
+    return -1;
+  return handled + fired;
+}
+
+cmc_err cmc_loop_run(cmc_loop *loop) {
+  loop->stopping = false;
+  while (!loop->stopping && loop->conn_count > 0) {
+    if (cmc_loop_run_once(loop, -1) == -1)
+      return CMC_ERR_SOCKET;
+  }
+  return CMC_ERR_NO;
+}
+
+void cmc_loop_stop(cmc_loop *loop) { loop->stopping = true; }
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/list.h>
+#include <cmc/loop.h>
+#include <cmc/pool.h>
+#include <cmc/timer.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Shared between conn.c and the event loop backends, not part of the public
+api.
+*/
+
+// Appends bytes a loop received for the connection to its receive buffer.
+bool cmc_conn_push_received(cmc_conn *conn, const uint8_t *data,
+                            size_t length);
+
+/*
+Decodes the next packet that is already in the receive buffer without
+touching the socket. Returns null if there is none or on error (conn->err).
+*/
+cmc_buff *cmc_conn_pop_packet(cmc_conn *conn);
+
+/*
+Like cmc_conn_pop_packet and cmc_conn_try_recive_packet, but the frame is
+handed out as it was received (decrypted, still compressed) so it can be
+decoded with cmc_conn_decode_frame somewhere else.
+*/
+cmc_buff *cmc_conn_pop_frame(cmc_conn *conn);
+cmc_buff *cmc_conn_try_recive_frame(cmc_conn *conn);
+
+/*
+Decodes a frame of conn into a packet buffer. Only reads the compression
+threshold, protocol version and limits of conn, so it can run on another
+thread with its own inflater and a pool (or null) owned by that thread.
+buffered is what the connection holds already, for max_buffered_bytes. state
+is the one the frame was received in, the packet stats count it under that.
+*/
+cmc_buff *cmc_conn_decode_frame(const cmc_conn *conn, cmc_conn_state state,
+                                struct cmc_inflater **inflater,
+                                cmc_buff_pool *pool, size_t buffered,
+                                const uint8_t *frame, size_t frame_length,
+                                cmc_err_extra *err);
+
+// Sends conn->tx directly until it is empty or the socket would block.
+cmc_err cmc_conn_send_queued(cmc_conn *conn);
+
+// Sends or schedules the queued bytes of a registered connection.
+cmc_err cmc_loop_flush_conn(cmc_loop *loop, cmc_conn *conn);
+
+// Sends the queued bytes once the current batch of events is handled.
+cmc_err cmc_loop_flush_later(cmc_loop *loop, cmc_conn *conn);
+
+/*
+The loops state for one connection. With io_uring it outlives the
+registration until the kernel returned every request that refers to it.
+*/
+typedef struct cmc_loop_conn {
+  cmc_conn *conn; // null once the connection was removed
+  struct list_head entry; // in cmc_loop.conns or cmc_loop.removed
+  bool connecting;        // waiting for cmc_loop_connect to finish
+  bool ready;             // in cmc_loop.ready
+  // io_uring only
+  bool recv_armed;     // a multishot recv is in flight
+  bool send_inflight;  // sending is owned by the kernel
+  int ops;             // requests in flight
+  cmc_conn_tx sending; // the part of conn->tx handed to the kernel
+  struct sockaddr_storage addr; // for cmc_loop_connect
+  // see cmc_loop_set_read_timeout, the timer is armed while it is set
+  cmc_timer read_timer;
+  uint64_t read_timeout_ms;
+  uint64_t last_packet_ms;
+} cmc_loop_conn;
+
+struct cmc_loop_uring;
+
+struct cmc_loop {
+  cmc_loop_backend backend;
+  cmc_loop_callbacks callbacks;
+  size_t conn_count;
+  bool stopping;
+  // on_packet gets undecoded frames, a cmc_pipeline decodes them elsewhere
+  bool raw_frames;
+  struct list_head conns;   // registered connections
+  struct list_head removed; // states waiting to be freed
+  // connections to look at without waiting for the kernel, epoll only reports
+  // new data and io_uring sends are submitted in batches
+  cmc_loop_conn **ready;
+  size_t ready_count;
+  size_t ready_capacity;
+
+  int epoll_fd;
+  struct epoll_event events[CMC_LOOP_MAX_EVENTS];
+  // eventfd other threads write to, see cmc_loop_wake
+  int wake_fd;
+
+  cmc_timer_wheel *timers;
+  // CLOCK_MONOTONIC when the loop last woke up
+  uint64_t now_ms;
+
+  struct cmc_loop_uring *uring;
+};
+
+bool cmc_loop_mark_ready(cmc_loop *loop, cmc_loop_conn *lc);
+
+/*
+Delivers packets buffered before the connection joined and sends the queues
+of the connections marked ready. Returns the number of connections that had
+packets.
+*/
+int cmc_loop_handle_ready(cmc_loop *loop);
+
+/*
+Reads wake_fd and marks the connections with packets from
+cmc_conn_queue_packet ready.
+*/
+void cmc_loop_woken(cmc_loop *loop);
+
+// Removes the connection and calls on_close, conn->err has to be set.
+void cmc_loop_close_conn(cmc_loop *loop, cmc_conn *conn);
+
+// Hands every packet buffered in conn->rx to on_packet.
+void cmc_loop_deliver(cmc_loop *loop, cmc_conn *conn);
+
+// Tells the application that a cmc_loop_connect finished.
+void cmc_loop_connected(cmc_loop *loop, cmc_conn *conn);
+
+/*
+Reads the clock and fires the timers that are due. The backends call it
+when they woke up, before they hand out what arrived, so callbacks arm
+timers from the current time. Returns the number of timers fired.
+*/
+int cmc_loop_tick(cmc_loop *loop);
+
+bool cmc_loop_uring_available(void);
+bool cmc_loop_uring_init(cmc_loop *loop);
+void cmc_loop_uring_free(cmc_loop *loop);
+cmc_err cmc_loop_uring_add(cmc_loop *loop, cmc_loop_conn *lc);
+void cmc_loop_uring_remove(cmc_loop *loop, cmc_loop_conn *lc);
+// lc->addr holds the address
+cmc_err cmc_loop_uring_connect(cmc_loop *loop, cmc_loop_conn *lc,
+                               socklen_t addr_len);
+int cmc_loop_uring_run_once(cmc_loop *loop, int timeout_ms);
+// submits a send of conn->tx unless one is in flight
+cmc_err cmc_loop_uring_send(cmc_loop *loop, cmc_loop_conn *lc);
@@ -0,0 +1,548 @@
+#include <cmc/loop.h>
+
+#include <cmc/conn.h>
+#include <cmc/err.h>
+
+#include <stdbool.h>
+
+#include "loop_internal.h"
+
+#ifdef CMC_HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "err_macros.h"
+
+/*
+The rings are driven with the raw syscalls so there is no dependency on
+liburing. Every connection has one multishot recv in flight that picks its
+buffers from a shared ring of provided buffers, so receiving costs no
+syscalls at all while data keeps coming. Sends are collected while
+completions are handled and submitted together in one io_uring_enter.
+*/
+
+// what a completion belongs to, kept in the low bits of the state pointer
+enum { OP_RECV = 1, OP_SEND = 2, OP_CONNECT = 3, OP_WAKE = 4, OP_MASK = 7 };
+
+#define BUFFER_GROUP 0
+
+struct cmc_loop_uring {
+  int fd;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  unsigned sq_entries;
+  unsigned sq_local_tail; // sqes filled in so far
+  unsigned sq_submitted;  // sqes handed to the kernel so far
+  struct io_uring_sqe *sqes;
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *sq_ring;
+  size_t sq_ring_size;
+  size_t sqes_size;
+
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  uint16_t buf_tail;
+  unsigned buf_count;
+  uint8_t *bufs;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags, void *arg, size_t arg_size) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg,
+                 arg_size);
+}
+
+static int uring_register(int fd, unsigned opcode, void *arg,
+                          unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void recycle_buffer(struct cmc_loop_uring *u, uint16_t bid) {
+  unsigned index = u->buf_tail & (u->buf_count - 1);
+  struct io_uring_buf *buf = &u->buf_ring->bufs[index];
+  buf->addr = (uintptr_t)(u->bufs + (size_t)bid * CMC_LOOP_URING_BUFFER_SIZE);
+  buf->len = CMC_LOOP_URING_BUFFER_SIZE;
+  buf->bid = bid;
+  u->buf_tail++;
+  __atomic_store_n(&u->buf_ring->tail, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_free(struct cmc_loop_uring *u) {
+  if (u->fd != -1)
+    close(u->fd);
+  if (u->sq_ring)
+    munmap(u->sq_ring, u->sq_ring_size);
+  if (u->sqes)
+    munmap(u->sqes, u->sqes_size);
+  if (u->buf_ring)
+    munmap(u->buf_ring, u->buf_ring_size);
+  free(u->bufs);
+  free(u);
+}
+
+static struct cmc_loop_uring *uring_init(unsigned entries,
+                                         unsigned buf_count) {
+  struct cmc_loop_uring *u = calloc(1, sizeof(struct cmc_loop_uring));
+  if (!u)
+    return NULL;
+  u->fd = -1;
+
+  struct io_uring_params params = {.flags = IORING_SETUP_CQSIZE,
+                                   .cq_entries = 4 * entries};
+  u->fd = uring_setup(entries, &params);
+  if (u->fd == -1)
+    goto on_error;
+  unsigned needed =
+      IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+  if ((params.features & needed) != needed)
+    goto on_error;
+
+  // the completion ring shares the mapping with the submission ring
+  size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  u->sq_ring_size = sq_size > cq_size ? sq_size : cq_size;
+  u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (u->sq_ring == MAP_FAILED) {
+    u->sq_ring = NULL;
+    goto on_error;
+  }
+  u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) {
+    u->sqes = NULL;
+    goto on_error;
+  }
+
+  uint8_t *ring = u->sq_ring;
+  u->sq_head = (unsigned *)(ring + params.sq_off.head);
+  u->sq_tail = (unsigned *)(ring + params.sq_off.tail);
+  u->sq_mask = *(unsigned *)(ring + params.sq_off.ring_mask);
+  u->sq_entries = params.sq_entries;
+  u->sq_array = (unsigned *)(ring + params.sq_off.array);
+  u->sq_local_tail = u->sq_submitted = *u->sq_tail;
+  u->cq_head = (unsigned *)(ring + params.cq_off.head);
+  u->cq_tail = (unsigned *)(ring + params.cq_off.tail);
+  u->cq_mask = *(unsigned *)(ring + params.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+  // the provided buffer ring has to be page aligned
+  u->buf_count = buf_count;
+  u->buf_ring_size = buf_count * sizeof(struct io_uring_buf);
+  u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (u->buf_ring == MAP_FAILED) {
+    u->buf_ring = NULL;
+    goto on_error;
+  }
+  struct io_uring_buf_reg reg = {.ring_addr = (uintptr_t)u->buf_ring,
+                                 .ring_entries = buf_count,
+                                 .bgid = BUFFER_GROUP};
+  if (uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+    goto on_error;
+  u->bufs = malloc((size_t)buf_count * CMC_LOOP_URING_BUFFER_SIZE);
+  if (!u->bufs)
+    goto on_error;
+  for (unsigned i = 0; i < buf_count; i++)
+    recycle_buffer(u, i);
+  return u;
+
+on_error:
+  uring_free(u);
+  return NULL;
+}
+
+/*
+Hands the filled in sqes to the kernel and waits for min_complete
+completions or timeout_ms, whichever comes first. Returns false if
+io_uring_enter failed for another reason than the timeout or a signal.
+*/
+static bool uring_submit(struct cmc_loop_uring *u, unsigned min_complete,
+                         int timeout_ms) {
+  __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+  unsigned to_submit = u->sq_local_tail - u->sq_submitted;
+  if (to_submit == 0 && min_complete == 0)
+    return true;
+
+  unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+  struct __kernel_timespec ts = {.tv_sec = timeout_ms / 1000,
+                                 .tv_nsec = (timeout_ms % 1000) * 1000000};
+  struct io_uring_getevents_arg arg = {.ts = (uintptr_t)&ts};
+  if (min_complete && timeout_ms > 0)
+    flags |= IORING_ENTER_EXT_ARG;
+
+  int ret = uring_enter(u->fd, to_submit, min_complete, flags,
+                        flags & IORING_ENTER_EXT_ARG ? &arg : NULL,
+                        flags & IORING_ENTER_EXT_ARG ? sizeof(arg) : 0);
+  if (ret >= 0) {
+    u->sq_submitted += ret;
+    return true;
+  }
+  // EBUSY means the completion queue is backed up, draining it fixes that
+  return errno == ETIME || errno == EINTR || errno == EBUSY ||
+         errno == EAGAIN;
+}
+
+static struct io_uring_sqe *get_sqe(struct cmc_loop_uring *u) {
+  unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+  if (u->sq_local_tail - head == u->sq_entries) {
+    if (!uring_submit(u, 0, 0))
+      return NULL;
+    head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head == u->sq_entries)
+      return NULL;
+  }
+  unsigned index = u->sq_local_tail & u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  u->sq_array[index] = index;
+  u->sq_local_tail++;
+  return sqe;
+}
+
+static uint64_t op_data(cmc_loop_conn *lc, int op) {
+  return (uintptr_t)lc | op;
+}
+
+static bool arm_recv(struct cmc_loop_uring *u, cmc_loop_conn *lc) {
+  struct io_uring_sqe *sqe = get_sqe(u);
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = lc->conn->sockfd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  sqe->user_data = op_data(lc, OP_RECV);
+  lc->recv_armed = true;
+  lc->ops++;
+  return true;
+}
+
+// a multishot poll on the wake eventfd, it has no connection state
+static bool arm_wake(cmc_loop *loop) {
+  struct io_uring_sqe *sqe = get_sqe(loop->uring);
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = loop->wake_fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = OP_WAKE;
+  return true;
+}
+
+/*
+Hands conn->tx to the kernel. The queue is swapped with the sending buffer
+so new packets can be queued while the send is in flight.
+*/
+static bool submit_send(struct cmc_loop_uring *u, cmc_loop_conn *lc) {
+  cmc_conn *conn = lc->conn;
+  if (lc->send_inflight || lc->connecting)
+    return true;
+  if (lc->sending.start == lc->sending.end) {
+    if (conn->tx.start == conn->tx.end)
+      return true;
+    cmc_conn_tx empty = {.data = lc->sending.data,
+                         .capacity = lc->sending.capacity};
+    lc->sending = conn->tx;
+    conn->tx = empty;
+  }
+  struct io_uring_sqe *sqe = get_sqe(u);
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = conn->sockfd;
+  sqe->addr = (uintptr_t)(lc->sending.data + lc->sending.start);
+  sqe->len = lc->sending.end - lc->sending.start;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = op_data(lc, OP_SEND);
+  lc->send_inflight = true;
+  lc->ops++;
+  return true;
+}
+
+static void fail(cmc_loop *loop, cmc_conn *conn, cmc_err err) {
+  CMC_ERRC_IF(true, err, );
+  cmc_loop_close_conn(loop, conn);
+}
+
+static void handle_recv(cmc_loop *loop, cmc_loop_conn *lc,
+                        struct io_uring_cqe *cqe) {
+  struct cmc_loop_uring *u = loop->uring;
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    lc->recv_armed = false;
+    lc->ops--;
+  }
+
+  if (cqe->res > 0) {
+    uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    const uint8_t *data =
+        u->bufs + (size_t)bid * CMC_LOOP_URING_BUFFER_SIZE;
+    bool pushed =
+        lc->conn && cmc_conn_push_received(lc->conn, data, cqe->res);
+    recycle_buffer(u, bid);
+    if (!lc->conn)
+      return;
+    if (!pushed) {
+      cmc_loop_close_conn(loop, lc->conn);
+      return;
+    }
+    cmc_loop_deliver(loop, lc->conn);
+  } else if (cqe->res != -ENOBUFS && lc->conn) {
+    // 0 is the peer closing the connection
+    fail(loop, lc->conn, CMC_ERR_RECV);
+    return;
+  }
+
+  // the recv stops when the buffers ran out, start a new one
+  if (lc->conn && !lc->recv_armed && !arm_recv(u, lc))
+    fail(loop, lc->conn, CMC_ERR_RECV);
+}
+
+static void handle_send(cmc_loop *loop, cmc_loop_conn *lc,
+                        struct io_uring_cqe *cqe) {
+  lc->send_inflight = false;
+  lc->ops--;
+  if (!lc->conn)
+    return;
+  if (cqe->res < 0) {
+    fail(loop, lc->conn, CMC_ERR_SENDING);
+    return;
+  }
+  lc->sending.start += cqe->res;
+  if (lc->sending.start == lc->sending.end)
+    lc->sending.start = lc->sending.end = 0;
+  // short sends and packets queued in the meantime go out right away
+  if (!submit_send(loop->uring, lc))
+    fail(loop, lc->conn, CMC_ERR_SENDING);
+}
+
+static void handle_connect(cmc_loop *loop, cmc_loop_conn *lc,
+                           struct io_uring_cqe *cqe) {
+  lc->ops--;
+  if (!lc->conn)
+    return;
+  if (cqe->res < 0) {
+    fail(loop, lc->conn, CMC_ERR_CONNETING);
+    return;
+  }
+  cmc_conn *conn = lc->conn;
+  cmc_loop_connected(loop, conn);
+  if (conn->loop != loop)
+    return;
+  if (!arm_recv(loop->uring, lc) || !submit_send(loop->uring, lc))
+    fail(loop, conn, CMC_ERR_SOCKET);
+}
+
+// returns the number of completions handled
+static int handle_completions(cmc_loop *loop) {
+  struct cmc_loop_uring *u = loop->uring;
+  int handled = 0;
+  unsigned head = *u->cq_head;
+  while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe cqe = u->cqes[head & u->cq_mask];
+    // free the slot before the callbacks can cause more completions
+    __atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+    handled++;
+    if (cqe.user_data == 0)
+      continue; // cancelations
+    cmc_loop_conn *lc = (cmc_loop_conn *)(uintptr_t)(cqe.user_data & ~OP_MASK);
+    switch (cqe.user_data & OP_MASK) {
+    case OP_RECV:
+      handle_recv(loop, lc, &cqe);
+      break;
+    case OP_SEND:
+      handle_send(loop, lc, &cqe);
+      break;
+    case OP_CONNECT:
+      handle_connect(loop, lc, &cqe);
+      break;
+    case OP_WAKE:
+      cmc_loop_woken(loop);
+      // the kernel ended the multishot poll, start a new one
+      if (!(cqe.flags & IORING_CQE_F_MORE) && cqe.res >= 0)
+        arm_wake(loop);
+      break;
+    }
+  }
+  return handled;
+}
+
+cmc_err cmc_loop_uring_send(cmc_loop *loop, cmc_loop_conn *lc) {
+  cmc_conn *conn = lc->conn;
+  CMC_ERRRC_IF(!submit_send(loop->uring, lc), CMC_ERR_SENDING);
+  return CMC_ERR_NO;
+}
+
+int cmc_loop_uring_run_once(cmc_loop *loop, int timeout_ms) {
+  struct cmc_loop_uring *u = loop->uring;
+  int handled = cmc_loop_handle_ready(loop);
+  if (handled || *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    timeout_ms = 0;
+  if (!uring_submit(u, timeout_ms != 0, timeout_ms))
+    return -1;
+  handled += cmc_loop_tick(loop);
+  handled += handle_completions(loop);
+
+  // everything the callbacks sent goes out in one more syscall
+  cmc_loop_handle_ready(loop);
+  if (!uring_submit(u, 0, 0))
+    return -1;
+  return handled;
+}
+
+static _Atomic int available = -1;
+
+bool cmc_loop_uring_available(void) {
+  if (available != -1)
+    return available;
+
+  // multishot recv with provided buffers is the newest feature used
+  bool works = false;
+  struct cmc_loop_uring *u = uring_init(8, 1);
+  int sv[2];
+  if (u && socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0) {
+    struct io_uring_sqe *sqe = get_sqe(u);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sv[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = 1;
+    if (write(sv[1], "x", 1) == 1 && uring_submit(u, 1, 1000)) {
+      unsigned head = *u->cq_head;
+      if (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        works = cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE);
+      }
+    }
+    close(sv[0]);
+    close(sv[1]);
+  }
+  if (u)
+    uring_free(u);
+  available = works;
+  return works;
+}
+
+bool cmc_loop_uring_init(cmc_loop *loop) {
+  if (!cmc_loop_uring_available())
+    return false;
+  loop->uring = uring_init(CMC_LOOP_URING_ENTRIES, CMC_LOOP_URING_BUFFERS);
+  if (!loop->uring)
+    return false;
+  if (!arm_wake(loop)) {
+    cmc_loop_uring_free(loop);
+    return false;
+  }
+  return true;
+}
+
+void cmc_loop_uring_free(cmc_loop *loop) {
+  uring_free(loop->uring);
+  loop->uring = NULL;
+}
+
+cmc_err cmc_loop_uring_add(cmc_loop *loop, cmc_loop_conn *lc) {
+  cmc_conn *conn = lc->conn;
+  CMC_ERRRC_IF(!arm_recv(loop->uring, lc), CMC_ERR_SOCKET);
+  if (conn->tx.start < conn->tx.end)
+    CMC_ERRRC_IF(!cmc_loop_mark_ready(loop, lc), CMC_ERR_MEM);
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_loop_uring_connect(cmc_loop *loop, cmc_loop_conn *lc,
+                               socklen_t addr_len) {
+  cmc_conn *conn = lc->conn;
+  struct io_uring_sqe *sqe = get_sqe(loop->uring);
+  CMC_ERRRC_IF(!sqe, CMC_ERR_SOCKET);
+  sqe->opcode = IORING_OP_CONNECT;
+  sqe->fd = conn->sockfd;
+  sqe->addr = (uintptr_t)&lc->addr;
+  sqe->off = addr_len;
+  sqe->user_data = op_data(lc, OP_CONNECT);
+  lc->ops++;
+  return CMC_ERR_NO;
+}
+
+static void cancel(struct cmc_loop_uring *u, cmc_loop_conn *lc, int op) {
+  struct io_uring_sqe *sqe = get_sqe(u);
+  if (!sqe)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = op_data(lc, op);
+}
+
+void cmc_loop_uring_remove(cmc_loop *loop, cmc_loop_conn *lc) {
+  struct cmc_loop_uring *u = loop->uring;
+  if (lc->recv_armed)
+    cancel(u, lc, OP_RECV);
+  if (lc->connecting)
+    cancel(u, lc, OP_CONNECT);
+  // the socket stays open as long as a request holds it, cancel right away
+  uring_submit(u, 0, 0);
+}
+
+#else
+
+bool cmc_loop_uring_available(void) { return false; }
+
+bool cmc_loop_uring_init(cmc_loop *loop) {
+  (void)loop;
+  return false;
+}
+
+void cmc_loop_uring_free(cmc_loop *loop) { (void)loop; }
+
+cmc_err cmc_loop_uring_add(cmc_loop *loop, cmc_loop_conn *lc) {
+  (void)loop, (void)lc;
+  return CMC_ERR_SOCKET;
+}
+
+void cmc_loop_uring_remove(cmc_loop *loop, cmc_loop_conn *lc) {
+  (void)loop, (void)lc;
+}
+
+cmc_err cmc_loop_uring_connect(cmc_loop *loop, cmc_loop_conn *lc,
+                               socklen_t addr_len) {
+  (void)loop, (void)lc, (void)addr_len;
+  return CMC_ERR_SOCKET;
+}
+
+int cmc_loop_uring_run_once(cmc_loop *loop, int timeout_ms) {
+  (void)loop, (void)timeout_ms;
+  return -1;
+}
+
+cmc_err cmc_loop_uring_send(cmc_loop *loop, cmc_loop_conn *lc) {
+  (void)loop, (void)lc;
+  return CMC_ERR_SENDING;
+}
+
+#endif
@@ -0,0 +1,151 @@
+#include <cmc/packet_stats.h>
+
+#include <cmc/buff.h>
+#include <cmc/packets.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "packet_stats_internal.h"
+
+_Atomic bool cmc_packet_stats_on;
+
+// cmc_packet_stats with every field atomic, in the same order
+typedef struct {
+  _Atomic uint64_t received;
+  _Atomic uint64_t received_bytes;
+  _Atomic uint64_t received_data_bytes;
+  _Atomic uint64_t decoded;
+  _Atomic uint64_t decode_cycles;
+  _Atomic uint64_t sent;
+  _Atomic uint64_t sent_bytes;
+  _Atomic uint64_t sent_data_bytes;
+  _Atomic uint64_t encoded;
+  _Atomic uint64_t encode_cycles;
+} counters;
+
+static counters table[CMC_PACKET_NAME_IDS];
+
+static void add(_Atomic uint64_t *counter, uint64_t value) {
+  atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+static uint64_t load(const _Atomic uint64_t *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void cmc_packet_stats_enable(bool enabled) {
+  atomic_store_explicit(&cmc_packet_stats_on, enabled, memory_order_relaxed);
+}
+
+bool cmc_packet_stats_enabled(void) { return cmc_packet_stats_active(); }
+
+void cmc_packet_stats_add_decoded(cmc_packet_name_id id, uint64_t start) {
+  add(&table[id].decode_cycles, cmc_packet_stats_cycles() - start);
+  add(&table[id].decoded, 1);
+}
+
+void cmc_packet_stats_add_encoded(cmc_packet_name_id id, uint64_t start) {
+  add(&table[id].encode_cycles, cmc_packet_stats_cycles() - start);
+  add(&table[id].encoded, 1);
+}
+
+void cmc_packet_stats_add_packet(cmc_conn_state state,
+                                 cmc_packet_direction direction,
+                                 cmc_protocol_version protocol_version,
+                                 const uint8_t *data, size_t data_length,
+                                 size_t wire_length) {
+  cmc_buff id = {.data = (uint8_t *)data,
+                 .length = data_length,
+                 .protocol_version = protocol_version};
+  int packet_id = cmc_buff_unpack_varint(&id);
+  cmc_packet_name_id name = CMC_UNKOWN_NAME_ID;
+  // the name lookup only looks at the low byte of the id
+  if (id.err.err == CMC_ERR_NO && packet_id >= 0 && packet_id <= 0xFF)
+    name = cmc_packet_id_to_packet_name_id(packet_id, state, direction,
+                                           protocol_version);
+  counters *c = &table[name];
+  if (direction == CMC_DIRECTION_S2C) {
+    add(&c->received, 1);
+    add(&c->received_bytes, wire_length);
+    add(&c->received_data_bytes, data_length);
+  } else {
+    add(&c->sent, 1);
+    add(&c->sent_bytes, wire_length);
+    add(&c->sent_data_bytes, data_length);
+  }
+}
+
+cmc_packet_stats cmc_packet_stats_get(cmc_packet_name_id id) {
+  counters *c = &table[id];
+  return (cmc_packet_stats){
+      .received = load(&c->received),
+      .received_bytes = load(&c->received_bytes),
+      .received_data_bytes = load(&c->received_data_bytes),
+      .decoded = load(&c->decoded),
+      .decode_cycles = load(&c->decode_cycles),
+      .sent = load(&c->sent),
+      .sent_bytes = load(&c->sent_bytes),
+      .sent_data_bytes = load(&c->sent_data_bytes),
+      .encoded = load(&c->encoded),
+      .encode_cycles = load(&c->encode_cycles),
+  };
+}
+
+void cmc_packet_stats_reset(void) {
+  // nothing but counters in there
+  _Atomic uint64_t *counter = &table[0].received;
+  size_t count = CMC_PACKET_NAME_IDS * (sizeof(counters) / sizeof(uint64_t));
+  for (size_t i = 0; i < count; i++)
+    atomic_store_explicit(&counter[i], 0, memory_order_relaxed);
+}
+
+typedef struct {
+  cmc_packet_name_id id;
+  cmc_packet_stats stats;
+} row;
+
+static uint64_t row_cycles(const row *r) {
+  return r->stats.decode_cycles + r->stats.encode_cycles;
+}
+
+static uint64_t row_bytes(const row *r) {
+  return r->stats.received_bytes + r->stats.sent_bytes;
+}
+
+static int compare_rows(const void *a, const void *b) {
+  const row *ra = a, *rb = b;
+  if (row_cycles(ra) != row_cycles(rb))
+    return row_cycles(ra) < row_cycles(rb) ? 1 : -1;
+  if (row_bytes(ra) != row_bytes(rb))
+    return row_bytes(ra) < row_bytes(rb) ? 1 : -1;
+  return (int)ra->id - (int)rb->id;
+}
+
+void cmc_packet_stats_dump(FILE *out) {
+  row rows[CMC_PACKET_NAME_IDS];
+  int count = 0;
+  for (int id = 0; id < CMC_PACKET_NAME_IDS; id++) {
+    cmc_packet_stats stats = cmc_packet_stats_get(id);
+    if (stats.received || stats.sent || stats.decoded || stats.encoded)
+      rows[count++] = (row){.id = id, .stats = stats};
+  }
+  qsort(rows, count, sizeof(row), compare_rows);
+
+  fprintf(out, "%-50s %10s %12s %12s %12s %10s\n", "packet", "packets",
+          "wire bytes", "data bytes", "cycles", "cycles/op");
+  for (int i = 0; i < count; i++) {
+    const cmc_packet_stats *s = &rows[i].stats;
+    uint64_t ops = s->decoded + s->encoded;
+    fprintf(out, "%-50s %10llu %12llu %12llu %12llu %10llu\n",
+            cmc_packet_name_id_string(rows[i].id),
+            (unsigned long long)(s->received + s->sent),
+            (unsigned long long)row_bytes(&rows[i]),
+            (unsigned long long)(s->received_data_bytes + s->sent_data_bytes),
+            (unsigned long long)row_cycles(&rows[i]),
+            (unsigned long long)(ops ? row_cycles(&rows[i]) / ops : 0));
+  }
+}
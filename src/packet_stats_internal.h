@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cmc/conn.h>
+#include <cmc/packets.h>
+#include <cmc/protocol.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+The hooks conn.c and the generated code in packets.c count with, not part
+of the public api. See cmc/packet_stats.h.
+*/
+
+extern _Atomic bool cmc_packet_stats_on;
+
+static inline uint64_t cmc_packet_stats_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline bool cmc_packet_stats_active(void) {
+  return atomic_load_explicit(&cmc_packet_stats_on, memory_order_relaxed);
+}
+
+// Where decoding or encoding a packet starts, 0 while the stats are off.
+static inline uint64_t cmc_packet_stats_start(void) {
+  return cmc_packet_stats_active() ? cmc_packet_stats_cycles() : 0;
+}
+
+void cmc_packet_stats_add_decoded(cmc_packet_name_id id, uint64_t start);
+
+void cmc_packet_stats_add_encoded(cmc_packet_name_id id, uint64_t start);
+
+// start is what cmc_packet_stats_start returned
+static inline void cmc_packet_stats_decoded(cmc_packet_name_id id,
+                                            uint64_t start) {
+  if (start)
+    cmc_packet_stats_add_decoded(id, start);
+}
+
+static inline void cmc_packet_stats_encoded(cmc_packet_name_id id,
+                                            uint64_t start) {
+  if (start)
+    cmc_packet_stats_add_encoded(id, start);
+}
+
+/*
+Counts a packet a connection in state received or sent, only call it while
+the stats are active. data starts with the packet id.
+*/
+void cmc_packet_stats_add_packet(cmc_conn_state state,
+                                 cmc_packet_direction direction,
+                                 cmc_protocol_version protocol_version,
+                                 const uint8_t *data, size_t data_length,
+                                 size_t wire_length);
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "err_macros.h"
+#include "packet_stats_internal.h"
 
 #define UNPACK_ERR_HANDELER                                                    \
   ERR_CHECK(return packet;);                                                   \
@@ -92,6 +93,8 @@ cmc_packet_id_to_packet_name_id(int packet_id, cmc_conn_state state,
     return CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_NAME_ID;
   case (COMBINE_VALUES(0x07, CMC_CONN_STATE_CONFIG, CMC_DIRECTION_S2C, 765)):
     return CMC_S2C_CONFIG_ADD_RESOURCE_PACK_NAME_ID;
+  case (COMBINE_VALUES(0x03, CMC_CONN_STATE_CONFIG, CMC_DIRECTION_C2S, 765)):
+    return CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID;
   case (COMBINE_VALUES(0x15, CMC_CONN_STATE_PLAY, CMC_DIRECTION_C2S, 765)):
     return CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID;
   case (COMBINE_VALUES(0x00, CMC_CONN_STATE_PLAY, CMC_DIRECTION_C2S, 47)):
@@ -138,6 +141,8 @@ cmc_packet_id_to_packet_name_id(int packet_id, cmc_conn_state state,
     return CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_NAME_ID;
   case (COMBINE_VALUES(0x12, CMC_CONN_STATE_PLAY, CMC_DIRECTION_S2C, 47)):
     return CMC_S2C_PLAY_ENTITY_VELOCITY_NAME_ID;
+  case (COMBINE_VALUES(0x13, CMC_CONN_STATE_PLAY, CMC_DIRECTION_S2C, 47)):
+    return CMC_S2C_PLAY_DESTROY_ENTITIES_NAME_ID;
   case (COMBINE_VALUES(0x14, CMC_CONN_STATE_PLAY, CMC_DIRECTION_S2C, 47)):
     return CMC_S2C_PLAY_ENTITY_NAME_ID;
   case (COMBINE_VALUES(0x15, CMC_CONN_STATE_PLAY, CMC_DIRECTION_S2C, 47)):
@@ -233,6 +238,7 @@ const char *cmc_packet_name_id_string(cmc_packet_name_id id) {
     HELPER(CMC_S2C_PLAY_SPAWN_PAINTING_NAME_ID);
     HELPER(CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_NAME_ID);
     HELPER(CMC_S2C_PLAY_ENTITY_VELOCITY_NAME_ID);
+    HELPER(CMC_S2C_PLAY_DESTROY_ENTITIES_NAME_ID);
     HELPER(CMC_S2C_PLAY_ENTITY_NAME_ID);
     HELPER(CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_NAME_ID);
     HELPER(CMC_S2C_PLAY_ENTITY_LOOK_NAME_ID);
@@ -270,7 +276,10 @@ const char *cmc_packet_name_id_string(cmc_packet_name_id id) {
     HELPER(CMC_S2C_CONFIG_REGISTRY_DATA_NAME_ID);
     HELPER(CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_NAME_ID);
     HELPER(CMC_S2C_CONFIG_ADD_RESOURCE_PACK_NAME_ID);
+    HELPER(CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID);
     // CGSE: packet_name_id_string
+  case CMC_PACKET_NAME_IDS:
+    break;
   }
 #undef HELPER
 
@@ -281,13 +290,17 @@ const char *cmc_packet_name_id_string(cmc_packet_name_id id) {
 
 void cmc_free_C2S_handshake_handshake_packet(
     C2S_handshake_handshake_packet *packet, cmc_err_extra *err) {
-  cmc_string_free(packet->server_addr);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->server_addr);
+  }
   (void)err;
 }
 
 void cmc_free_S2C_status_response_packet(S2C_status_response_packet *packet,
                                          cmc_err_extra *err) {
-  cmc_string_free(packet->response);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->response);
+  }
   (void)err;
 }
 
@@ -305,22 +318,28 @@ void cmc_free_C2S_status_ping_packet(C2S_status_ping_packet *packet,
 
 void cmc_free_S2C_login_disconnect_packet(S2C_login_disconnect_packet *packet,
                                           cmc_err_extra *err) {
-  cmc_string_free(packet->reason);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->reason);
+  }
   (void)err;
 }
 
 void cmc_free_S2C_login_encryption_request_packet(
     S2C_login_encryption_request_packet *packet, cmc_err_extra *err) {
-  cmc_string_free(packet->server_id);
   cmc_buff_free(packet->public_key);
   cmc_buff_free(packet->verify_token);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->server_id);
+  }
   (void)err;
 }
 
 void cmc_free_S2C_login_success_packet(S2C_login_success_packet *packet,
                                        cmc_err_extra *err) {
-  cmc_string_free(packet->uuid_str);
-  cmc_string_free(packet->name);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->uuid_str);
+    cmc_string_free(packet->name);
+  }
   (void)err;
 }
 
@@ -332,7 +351,9 @@ void cmc_free_S2C_login_set_compression_packet(
 
 void cmc_free_C2S_login_start_packet(C2S_login_start_packet *packet,
                                      cmc_err_extra *err) {
-  cmc_string_free(packet->name);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->name);
+  }
   (void)err;
 }
 
@@ -351,13 +372,13 @@ void cmc_free_S2C_play_keep_alive_packet(S2C_play_keep_alive_packet *packet,
 
 void cmc_free_S2C_play_join_game_packet(S2C_play_join_game_packet *packet,
                                         cmc_err_extra *err) {
-  cmc_string_free(packet->level_type);
+  (void)packet;
   (void)err;
 }
 
 void cmc_free_S2C_play_chat_message_packet(S2C_play_chat_message_packet *packet,
                                            cmc_err_extra *err) {
-  cmc_string_free(packet->message);
+  (void)packet;
   (void)err;
 }
 
@@ -369,7 +390,11 @@ void cmc_free_S2C_play_time_update_packet(S2C_play_time_update_packet *packet,
 
 void cmc_free_S2C_play_entity_equipment_packet(
     S2C_play_entity_equipment_packet *packet, cmc_err_extra *err) {
-  cmc_slot_free(packet->item, err);
+  if (!packet->in_arena) {
+    cmc_slot_free(packet->item, err);
+  } else {
+    cmc_slot_free_in_arena(packet->item, err);
+  }
   (void)err;
 }
 
@@ -387,7 +412,7 @@ void cmc_free_S2C_play_update_health_packet(
 
 void cmc_free_S2C_play_respawn_packet(S2C_play_respawn_packet *packet,
                                       cmc_err_extra *err) {
-  cmc_string_free(packet->level_type);
+  (void)packet;
   (void)err;
 }
 
@@ -417,7 +442,11 @@ void cmc_free_S2C_play_animation_packet(S2C_play_animation_packet *packet,
 
 void cmc_free_S2C_play_spawn_player_packet(S2C_play_spawn_player_packet *packet,
                                            cmc_err_extra *err) {
-  cmc_entity_metadata_free(packet->meta_data, err);
+  if (!packet->in_arena) {
+    cmc_entity_metadata_free(packet->meta_data, err);
+  } else {
+    cmc_entity_metadata_free_in_arena(packet->meta_data, err);
+  }
   (void)err;
 }
 
@@ -429,13 +458,19 @@ void cmc_free_S2C_play_collect_item_packet(S2C_play_collect_item_packet *packet,
 
 void cmc_free_S2C_play_spawn_mob_packet(S2C_play_spawn_mob_packet *packet,
                                         cmc_err_extra *err) {
-  cmc_entity_metadata_free(packet->meta_data, err);
+  if (!packet->in_arena) {
+    cmc_entity_metadata_free(packet->meta_data, err);
+  } else {
+    cmc_entity_metadata_free_in_arena(packet->meta_data, err);
+  }
   (void)err;
 }
 
 void cmc_free_S2C_play_spawn_painting_packet(
     S2C_play_spawn_painting_packet *packet, cmc_err_extra *err) {
-  cmc_string_free(packet->title);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->title);
+  }
   (void)err;
 }
 
@@ -451,6 +486,15 @@ void cmc_free_S2C_play_entity_velocity_packet(
   (void)err;
 }
 
+void cmc_free_S2C_play_destroy_entities_packet(
+    S2C_play_destroy_entities_packet *packet, cmc_err_extra *err) {
+  if (!packet->in_arena) {
+    free(packet->entities.data);
+    packet->entities.size = 0;
+  }
+  (void)err;
+}
+
 void cmc_free_S2C_play_entity_packet(S2C_play_entity_packet *packet,
                                      cmc_err_extra *err) {
   (void)packet;
@@ -501,7 +545,11 @@ void cmc_free_S2C_play_attach_entity_packet(
 
 void cmc_free_S2C_play_entity_metadata_packet(
     S2C_play_entity_metadata_packet *packet, cmc_err_extra *err) {
-  cmc_entity_metadata_free(packet->meta_data, err);
+  if (!packet->in_arena) {
+    cmc_entity_metadata_free(packet->meta_data, err);
+  } else {
+    cmc_entity_metadata_free_in_arena(packet->meta_data, err);
+  }
   (void)err;
 }
 
@@ -525,19 +573,18 @@ void cmc_free_S2C_play_set_experience_packet(
 
 void cmc_free_S2C_play_entity_properties_packet(
     S2C_play_entity_properties_packet *packet, cmc_err_extra *err) {
-
-  for (size_t i = 0; i < packet->properties.size; ++i) {
-    S2C_play_entity_properties_properties *p_properties =
-        &((S2C_play_entity_properties_properties *)packet->properties.data)[i];
-    cmc_string_free(p_properties->key);
-
-    free(p_properties->modifiers.data);
-    p_properties->modifiers.size = 0;
+  if (!packet->in_arena) {
+    for (size_t i = 0; i < packet->properties.size; ++i) {
+      S2C_play_entity_properties_properties *p_properties =
+          &((S2C_play_entity_properties_properties *)
+                packet->properties.data)[i];
+      cmc_string_free(p_properties->key);
+      free(p_properties->modifiers.data);
+      p_properties->modifiers.size = 0;
+    }
+    free(packet->properties.data);
+    packet->properties.size = 0;
   }
-
-  free(packet->properties.data);
-  packet->properties.size = 0;
-
   (void)err;
 }
 
@@ -549,10 +596,10 @@ void cmc_free_S2C_play_chunk_data_packet(S2C_play_chunk_data_packet *packet,
 
 void cmc_free_S2C_play_multi_block_change_packet(
     S2C_play_multi_block_change_packet *packet, cmc_err_extra *err) {
-
-  free(packet->records.data);
-  packet->records.size = 0;
-
+  if (!packet->in_arena) {
+    free(packet->records.data);
+    packet->records.size = 0;
+  }
   (void)err;
 }
 
@@ -576,19 +623,20 @@ void cmc_free_S2C_play_block_break_animation_packet(
 
 void cmc_free_S2C_play_map_chunk_bulk_packet(
     S2C_play_map_chunk_bulk_packet *packet, cmc_err_extra *err) {
-
-  free(packet->chunk_columns.data);
-  packet->chunk_columns.size = 0;
   cmc_buff_free(packet->chunk);
+  if (!packet->in_arena) {
+    free(packet->chunk_columns.data);
+    packet->chunk_columns.size = 0;
+  }
   (void)err;
 }
 
 void cmc_free_S2C_play_explosion_packet(S2C_play_explosion_packet *packet,
                                         cmc_err_extra *err) {
-
-  free(packet->records.data);
-  packet->records.size = 0;
-
+  if (!packet->in_arena) {
+    free(packet->records.data);
+    packet->records.size = 0;
+  }
   (void)err;
 }
 
@@ -600,7 +648,7 @@ void cmc_free_S2C_play_effect_packet(S2C_play_effect_packet *packet,
 
 void cmc_free_S2C_play_sound_effect_packet(S2C_play_sound_effect_packet *packet,
                                            cmc_err_extra *err) {
-  cmc_string_free(packet->sound_name);
+  (void)packet;
   (void)err;
 }
 
@@ -618,15 +666,16 @@ void cmc_free_S2C_play_player_abilities_packet(
 
 void cmc_free_S2C_play_plugin_message_packet(
     S2C_play_plugin_message_packet *packet, cmc_err_extra *err) {
-  cmc_string_free(packet->channel);
   cmc_buff_free(packet->data);
   (void)err;
 }
 
 void cmc_free_S2C_play_disconnect_packet(S2C_play_disconnect_packet *packet,
                                          cmc_err_extra *err) {
-  cmc_string_free(packet->reason);
   cmc_nbt_free(packet->reason_nbt, err);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->reason);
+  }
   (void)err;
 }
 
@@ -644,14 +693,15 @@ void cmc_free_C2S_play_keep_alive_packet(C2S_play_keep_alive_packet *packet,
 
 void cmc_free_S2C_config_plugin_message_packet(
     S2C_config_plugin_message_packet *packet, cmc_err_extra *err) {
-  cmc_string_free(packet->channel);
   cmc_buff_free(packet->data);
   (void)err;
 }
 
 void cmc_free_S2C_config_disconnect_packet(S2C_config_disconnect_packet *packet,
                                            cmc_err_extra *err) {
-  cmc_string_free(packet->reason);
+  if (!packet->in_arena) {
+    cmc_string_free(packet->reason);
+  }
   (void)err;
 }
 
@@ -673,13 +723,30 @@ void cmc_free_S2C_config_registry_data_packet(
   (void)err;
 }
 
+void cmc_free_C2S_config_keep_alive_packet(C2S_config_keep_alive_packet *packet,
+                                           cmc_err_extra *err) {
+  (void)packet;
+  (void)err;
+}
+
 // CGSE: free_methods_c
 
+// hands the error of buff over to conn, for the cmc_send_* functions
+static cmc_err send_failed(cmc_conn *conn, cmc_buff *buff) {
+  conn->err = buff->err;
+  cmc_buff_free(buff);
+  return conn->err.err;
+}
+
 // CGSS: send_methods_c
 
 cmc_err cmc_send_C2S_handshake_handshake_packet(
     cmc_conn *conn, C2S_handshake_handshake_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -701,9 +768,12 @@ cmc_err cmc_send_C2S_handshake_handshake_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_HANDSHAKE_HANDSHAKE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -712,7 +782,11 @@ cmc_err cmc_send_C2S_handshake_handshake_packet(
 cmc_err
 cmc_send_S2C_status_response_packet(cmc_conn *conn,
                                     S2C_status_response_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -728,9 +802,12 @@ cmc_send_S2C_status_response_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_STATUS_RESPONSE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -738,7 +815,12 @@ cmc_send_S2C_status_response_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_status_pong_packet(cmc_conn *conn,
                                         S2C_status_pong_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_STATUS_PONG_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -754,16 +836,24 @@ cmc_err cmc_send_S2C_status_pong_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_STATUS_PONG_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
 }
 
 cmc_err cmc_send_C2S_status_request_packet(cmc_conn *conn) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_C2S_STATUS_REQUEST_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -779,9 +869,12 @@ cmc_err cmc_send_C2S_status_request_packet(cmc_conn *conn) {
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_STATUS_REQUEST_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -789,7 +882,12 @@ cmc_err cmc_send_C2S_status_request_packet(cmc_conn *conn) {
 
 cmc_err cmc_send_C2S_status_ping_packet(cmc_conn *conn,
                                         C2S_status_ping_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_C2S_STATUS_PING_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -805,9 +903,12 @@ cmc_err cmc_send_C2S_status_ping_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_STATUS_PING_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -816,7 +917,11 @@ cmc_err cmc_send_C2S_status_ping_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_login_disconnect_packet(cmc_conn *conn,
                                      S2C_login_disconnect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -832,9 +937,12 @@ cmc_send_S2C_login_disconnect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_LOGIN_DISCONNECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -842,7 +950,11 @@ cmc_send_S2C_login_disconnect_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_login_encryption_request_packet(
     cmc_conn *conn, S2C_login_encryption_request_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -862,9 +974,13 @@ cmc_err cmc_send_S2C_login_encryption_request_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_LOGIN_ENCRYPTION_REQUEST_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -872,7 +988,11 @@ cmc_err cmc_send_S2C_login_encryption_request_packet(
 
 cmc_err cmc_send_S2C_login_success_packet(cmc_conn *conn,
                                           S2C_login_success_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -891,9 +1011,12 @@ cmc_err cmc_send_S2C_login_success_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_LOGIN_SUCCESS_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -901,7 +1024,12 @@ cmc_err cmc_send_S2C_login_success_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_login_set_compression_packet(
     cmc_conn *conn, S2C_login_set_compression_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_LOGIN_SET_COMPRESSION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -917,9 +1045,12 @@ cmc_err cmc_send_S2C_login_set_compression_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_LOGIN_SET_COMPRESSION_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -927,7 +1058,11 @@ cmc_err cmc_send_S2C_login_set_compression_packet(
 
 cmc_err cmc_send_C2S_login_start_packet(cmc_conn *conn,
                                         C2S_login_start_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -944,9 +1079,12 @@ cmc_err cmc_send_C2S_login_start_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_LOGIN_START_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -954,7 +1092,11 @@ cmc_err cmc_send_C2S_login_start_packet(cmc_conn *conn,
 
 cmc_err cmc_send_C2S_login_encryption_response_packet(
     cmc_conn *conn, C2S_login_encryption_response_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -972,9 +1114,13 @@ cmc_err cmc_send_C2S_login_encryption_response_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_LOGIN_ENCRYPTION_RESPONSE_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -983,7 +1129,12 @@ cmc_err cmc_send_C2S_login_encryption_response_packet(
 cmc_err
 cmc_send_S2C_play_keep_alive_packet(cmc_conn *conn,
                                     S2C_play_keep_alive_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_KEEP_ALIVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -999,9 +1150,12 @@ cmc_send_S2C_play_keep_alive_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1009,7 +1163,11 @@ cmc_send_S2C_play_keep_alive_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_join_game_packet(cmc_conn *conn,
                                            S2C_play_join_game_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1019,15 +1177,18 @@ cmc_err cmc_send_S2C_play_join_game_packet(cmc_conn *conn,
     cmc_buff_pack_char(buff, packet->dimension);
     cmc_buff_pack_byte(buff, packet->difficulty);
     cmc_buff_pack_byte(buff, packet->max_players);
-    cmc_buff_pack_string(buff, packet->level_type);
+    cmc_buff_pack_string_view(buff, packet->level_type);
     cmc_buff_pack_bool(buff, packet->reduced_debug_info);
     break;
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_JOIN_GAME_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1036,20 +1197,27 @@ cmc_err cmc_send_S2C_play_join_game_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_chat_message_packet(cmc_conn *conn,
                                       S2C_play_chat_message_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     cmc_buff_pack_varint(buff, 0x02);
-    cmc_buff_pack_string(buff, packet->message);
+    cmc_buff_pack_string_view(buff, packet->message);
     cmc_buff_pack_char(buff, packet->position);
     break;
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_CHAT_MESSAGE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1058,7 +1226,12 @@ cmc_send_S2C_play_chat_message_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_time_update_packet(cmc_conn *conn,
                                      S2C_play_time_update_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_TIME_UPDATE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1069,9 +1242,12 @@ cmc_send_S2C_play_time_update_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_TIME_UPDATE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1079,7 +1255,11 @@ cmc_send_S2C_play_time_update_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_entity_equipment_packet(
     cmc_conn *conn, S2C_play_entity_equipment_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1091,9 +1271,12 @@ cmc_err cmc_send_S2C_play_entity_equipment_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_EQUIPMENT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1101,7 +1284,12 @@ cmc_err cmc_send_S2C_play_entity_equipment_packet(
 
 cmc_err cmc_send_S2C_play_spawn_position_packet(
     cmc_conn *conn, S2C_play_spawn_position_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_SPAWN_POSITION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1111,9 +1299,12 @@ cmc_err cmc_send_S2C_play_spawn_position_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SPAWN_POSITION_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1122,7 +1313,12 @@ cmc_err cmc_send_S2C_play_spawn_position_packet(
 cmc_err
 cmc_send_S2C_play_update_health_packet(cmc_conn *conn,
                                        S2C_play_update_health_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_UPDATE_HEALTH_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1134,9 +1330,12 @@ cmc_send_S2C_play_update_health_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_UPDATE_HEALTH_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1144,7 +1343,11 @@ cmc_send_S2C_play_update_health_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_respawn_packet(cmc_conn *conn,
                                          S2C_play_respawn_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1152,14 +1355,17 @@ cmc_err cmc_send_S2C_play_respawn_packet(cmc_conn *conn,
     cmc_buff_pack_int(buff, packet->dimesion);
     cmc_buff_pack_byte(buff, packet->difficulty);
     cmc_buff_pack_byte(buff, packet->gamemode);
-    cmc_buff_pack_string(buff, packet->level_type);
+    cmc_buff_pack_string_view(buff, packet->level_type);
     break;
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_RESPAWN_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1167,7 +1373,13 @@ cmc_err cmc_send_S2C_play_respawn_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_player_look_and_position_packet(
     cmc_conn *conn, S2C_play_player_look_and_position_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_PLAYER_LOOK_AND_POSITION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1182,9 +1394,13 @@ cmc_err cmc_send_S2C_play_player_look_and_position_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_PLAYER_LOOK_AND_POSITION_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1192,7 +1408,12 @@ cmc_err cmc_send_S2C_play_player_look_and_position_packet(
 
 cmc_err cmc_send_S2C_play_held_item_change_packet(
     cmc_conn *conn, S2C_play_held_item_change_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_HELD_ITEM_CHANGE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1202,9 +1423,12 @@ cmc_err cmc_send_S2C_play_held_item_change_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_HELD_ITEM_CHANGE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1212,7 +1436,12 @@ cmc_err cmc_send_S2C_play_held_item_change_packet(
 
 cmc_err cmc_send_S2C_play_use_bed_packet(cmc_conn *conn,
                                          S2C_play_use_bed_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_USE_BED_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1223,9 +1452,12 @@ cmc_err cmc_send_S2C_play_use_bed_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_USE_BED_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1233,7 +1465,12 @@ cmc_err cmc_send_S2C_play_use_bed_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_animation_packet(cmc_conn *conn,
                                            S2C_play_animation_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ANIMATION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1244,9 +1481,12 @@ cmc_err cmc_send_S2C_play_animation_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ANIMATION_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1255,7 +1495,11 @@ cmc_err cmc_send_S2C_play_animation_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_spawn_player_packet(cmc_conn *conn,
                                       S2C_play_spawn_player_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1273,9 +1517,12 @@ cmc_send_S2C_play_spawn_player_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SPAWN_PLAYER_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1284,7 +1531,12 @@ cmc_send_S2C_play_spawn_player_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_collect_item_packet(cmc_conn *conn,
                                       S2C_play_collect_item_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_COLLECT_ITEM_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1295,9 +1547,12 @@ cmc_send_S2C_play_collect_item_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_COLLECT_ITEM_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1305,7 +1560,11 @@ cmc_send_S2C_play_collect_item_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_spawn_mob_packet(cmc_conn *conn,
                                            S2C_play_spawn_mob_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1326,9 +1585,12 @@ cmc_err cmc_send_S2C_play_spawn_mob_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SPAWN_MOB_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1336,7 +1598,11 @@ cmc_err cmc_send_S2C_play_spawn_mob_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_spawn_painting_packet(
     cmc_conn *conn, S2C_play_spawn_painting_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1349,9 +1615,12 @@ cmc_err cmc_send_S2C_play_spawn_painting_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SPAWN_PAINTING_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1359,7 +1628,13 @@ cmc_err cmc_send_S2C_play_spawn_painting_packet(
 
 cmc_err cmc_send_S2C_play_spawn_experience_orb_packet(
     cmc_conn *conn, S2C_play_spawn_experience_orb_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1373,9 +1648,13 @@ cmc_err cmc_send_S2C_play_spawn_experience_orb_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1383,7 +1662,12 @@ cmc_err cmc_send_S2C_play_spawn_experience_orb_packet(
 
 cmc_err cmc_send_S2C_play_entity_velocity_packet(
     cmc_conn *conn, S2C_play_entity_velocity_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_VELOCITY_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1396,9 +1680,41 @@ cmc_err cmc_send_S2C_play_entity_velocity_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
+  }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_VELOCITY_NAME_ID, stats_start);
+  cmc_conn_send_packet(conn, buff);
+  cmc_buff_free(buff);
+  return CMC_ERR_NO;
+}
+
+cmc_err cmc_send_S2C_play_destroy_entities_packet(
+    cmc_conn *conn, S2C_play_destroy_entities_packet *packet) {
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
+  switch (conn->protocol_version) {
+
+  case CMC_PROTOCOL_VERSION_47: {
+    cmc_buff_pack_varint(buff, 0x13);
+    cmc_buff_pack_varint(buff, packet->count);
+    cmc_buff_pack_varint_array(buff, packet->entities.data,
+                               packet->entities.size);
+    break;
+  }
+
+  default:
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_DESTROY_ENTITIES_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1406,7 +1722,12 @@ cmc_err cmc_send_S2C_play_entity_velocity_packet(
 
 cmc_err cmc_send_S2C_play_entity_packet(cmc_conn *conn,
                                         S2C_play_entity_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1416,9 +1737,12 @@ cmc_err cmc_send_S2C_play_entity_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1426,7 +1750,13 @@ cmc_err cmc_send_S2C_play_entity_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_entity_relative_move_packet(
     cmc_conn *conn, S2C_play_entity_relative_move_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1440,9 +1770,13 @@ cmc_err cmc_send_S2C_play_entity_relative_move_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1451,7 +1785,12 @@ cmc_err cmc_send_S2C_play_entity_relative_move_packet(
 cmc_err
 cmc_send_S2C_play_entity_look_packet(cmc_conn *conn,
                                      S2C_play_entity_look_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_LOOK_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1464,9 +1803,12 @@ cmc_send_S2C_play_entity_look_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_LOOK_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1474,7 +1816,13 @@ cmc_send_S2C_play_entity_look_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_entity_look_and_relative_move_packet(
     cmc_conn *conn, S2C_play_entity_look_and_relative_move_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_LOOK_AND_RELATIVE_MOVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1490,9 +1838,13 @@ cmc_err cmc_send_S2C_play_entity_look_and_relative_move_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_LOOK_AND_RELATIVE_MOVE_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1500,7 +1852,12 @@ cmc_err cmc_send_S2C_play_entity_look_and_relative_move_packet(
 
 cmc_err cmc_send_S2C_play_entity_teleport_packet(
     cmc_conn *conn, S2C_play_entity_teleport_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_TELEPORT_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1516,9 +1873,12 @@ cmc_err cmc_send_S2C_play_entity_teleport_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_TELEPORT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1526,7 +1886,12 @@ cmc_err cmc_send_S2C_play_entity_teleport_packet(
 
 cmc_err cmc_send_S2C_play_entity_head_look_packet(
     cmc_conn *conn, S2C_play_entity_head_look_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_HEAD_LOOK_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1537,9 +1902,12 @@ cmc_err cmc_send_S2C_play_entity_head_look_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_HEAD_LOOK_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1548,7 +1916,12 @@ cmc_err cmc_send_S2C_play_entity_head_look_packet(
 cmc_err
 cmc_send_S2C_play_entity_status_packet(cmc_conn *conn,
                                        S2C_play_entity_status_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_STATUS_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1559,9 +1932,12 @@ cmc_send_S2C_play_entity_status_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_STATUS_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1570,7 +1946,12 @@ cmc_send_S2C_play_entity_status_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_attach_entity_packet(cmc_conn *conn,
                                        S2C_play_attach_entity_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ATTACH_ENTITY_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1582,9 +1963,12 @@ cmc_send_S2C_play_attach_entity_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ATTACH_ENTITY_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1592,7 +1976,11 @@ cmc_send_S2C_play_attach_entity_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_entity_metadata_packet(
     cmc_conn *conn, S2C_play_entity_metadata_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1603,9 +1991,12 @@ cmc_err cmc_send_S2C_play_entity_metadata_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_METADATA_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1614,7 +2005,12 @@ cmc_err cmc_send_S2C_play_entity_metadata_packet(
 cmc_err
 cmc_send_S2C_play_entity_effect_packet(cmc_conn *conn,
                                        S2C_play_entity_effect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_ENTITY_EFFECT_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1628,9 +2024,12 @@ cmc_send_S2C_play_entity_effect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_EFFECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1638,7 +2037,13 @@ cmc_send_S2C_play_entity_effect_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_remove_entity_effect_packet(
     cmc_conn *conn, S2C_play_remove_entity_effect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_REMOVE_ENTITY_EFFECT_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1649,9 +2054,13 @@ cmc_err cmc_send_S2C_play_remove_entity_effect_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_REMOVE_ENTITY_EFFECT_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1659,7 +2068,12 @@ cmc_err cmc_send_S2C_play_remove_entity_effect_packet(
 
 cmc_err cmc_send_S2C_play_set_experience_packet(
     cmc_conn *conn, S2C_play_set_experience_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_SET_EXPERIENCE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1671,9 +2085,12 @@ cmc_err cmc_send_S2C_play_set_experience_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SET_EXPERIENCE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1681,7 +2098,11 @@ cmc_err cmc_send_S2C_play_set_experience_packet(
 
 cmc_err cmc_send_S2C_play_entity_properties_packet(
     cmc_conn *conn, S2C_play_entity_properties_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1707,9 +2128,12 @@ cmc_err cmc_send_S2C_play_entity_properties_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_ENTITY_PROPERTIES_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1718,7 +2142,11 @@ cmc_err cmc_send_S2C_play_entity_properties_packet(
 cmc_err
 cmc_send_S2C_play_chunk_data_packet(cmc_conn *conn,
                                     S2C_play_chunk_data_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1732,9 +2160,12 @@ cmc_send_S2C_play_chunk_data_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_CHUNK_DATA_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1742,7 +2173,11 @@ cmc_send_S2C_play_chunk_data_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_multi_block_change_packet(
     cmc_conn *conn, S2C_play_multi_block_change_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1762,9 +2197,13 @@ cmc_err cmc_send_S2C_play_multi_block_change_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_MULTI_BLOCK_CHANGE_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1773,7 +2212,12 @@ cmc_err cmc_send_S2C_play_multi_block_change_packet(
 cmc_err
 cmc_send_S2C_play_block_change_packet(cmc_conn *conn,
                                       S2C_play_block_change_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_BLOCK_CHANGE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1784,9 +2228,12 @@ cmc_send_S2C_play_block_change_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_BLOCK_CHANGE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1795,7 +2242,12 @@ cmc_send_S2C_play_block_change_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_block_action_packet(cmc_conn *conn,
                                       S2C_play_block_action_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_BLOCK_ACTION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1808,9 +2260,12 @@ cmc_send_S2C_play_block_action_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_BLOCK_ACTION_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1818,7 +2273,13 @@ cmc_send_S2C_play_block_action_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_block_break_animation_packet(
     cmc_conn *conn, S2C_play_block_break_animation_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_BLOCK_BREAK_ANIMATION_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1830,9 +2291,13 @@ cmc_err cmc_send_S2C_play_block_break_animation_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_BLOCK_BREAK_ANIMATION_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1840,7 +2305,11 @@ cmc_err cmc_send_S2C_play_block_break_animation_packet(
 
 cmc_err cmc_send_S2C_play_map_chunk_bulk_packet(
     cmc_conn *conn, S2C_play_map_chunk_bulk_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1860,9 +2329,12 @@ cmc_err cmc_send_S2C_play_map_chunk_bulk_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_MAP_CHUNK_BULK_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1870,7 +2342,11 @@ cmc_err cmc_send_S2C_play_map_chunk_bulk_packet(
 
 cmc_err cmc_send_S2C_play_explosion_packet(cmc_conn *conn,
                                            S2C_play_explosion_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1894,9 +2370,12 @@ cmc_err cmc_send_S2C_play_explosion_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_EXPLOSION_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1904,7 +2383,12 @@ cmc_err cmc_send_S2C_play_explosion_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_effect_packet(cmc_conn *conn,
                                         S2C_play_effect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_EFFECT_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1928,9 +2412,12 @@ cmc_err cmc_send_S2C_play_effect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_EFFECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1939,12 +2426,16 @@ cmc_err cmc_send_S2C_play_effect_packet(cmc_conn *conn,
 cmc_err
 cmc_send_S2C_play_sound_effect_packet(cmc_conn *conn,
                                       S2C_play_sound_effect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     cmc_buff_pack_varint(buff, 0x29);
-    cmc_buff_pack_string(buff, packet->sound_name);
+    cmc_buff_pack_string_view(buff, packet->sound_name);
     cmc_buff_pack_int(buff, packet->x);
     cmc_buff_pack_int(buff, packet->y);
     cmc_buff_pack_int(buff, packet->z);
@@ -1954,9 +2445,12 @@ cmc_send_S2C_play_sound_effect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_SOUND_EFFECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1964,7 +2458,12 @@ cmc_send_S2C_play_sound_effect_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_change_game_state_packet(
     cmc_conn *conn, S2C_play_change_game_state_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_CHANGE_GAME_STATE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1975,9 +2474,12 @@ cmc_err cmc_send_S2C_play_change_game_state_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_CHANGE_GAME_STATE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -1985,7 +2487,12 @@ cmc_err cmc_send_S2C_play_change_game_state_packet(
 
 cmc_err cmc_send_S2C_play_player_abilities_packet(
     cmc_conn *conn, S2C_play_player_abilities_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_PLAYER_ABILITIES_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -1997,9 +2504,12 @@ cmc_err cmc_send_S2C_play_player_abilities_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_PLAYER_ABILITIES_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2007,20 +2517,27 @@ cmc_err cmc_send_S2C_play_player_abilities_packet(
 
 cmc_err cmc_send_S2C_play_plugin_message_packet(
     cmc_conn *conn, S2C_play_plugin_message_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     cmc_buff_pack_varint(buff, 0x3F);
-    cmc_buff_pack_string(buff, packet->channel);
+    cmc_buff_pack_string_view(buff, packet->channel);
     cmc_buff_pack_buff(buff, packet->data);
     break;
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_PLUGIN_MESSAGE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2029,7 +2546,11 @@ cmc_err cmc_send_S2C_play_plugin_message_packet(
 cmc_err
 cmc_send_S2C_play_disconnect_packet(cmc_conn *conn,
                                     S2C_play_disconnect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2045,9 +2566,12 @@ cmc_send_S2C_play_disconnect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_DISCONNECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2055,7 +2579,12 @@ cmc_send_S2C_play_disconnect_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_play_change_difficulty_packet(
     cmc_conn *conn, S2C_play_change_difficulty_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_PLAY_CHANGE_DIFFICULTY_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2065,9 +2594,12 @@ cmc_err cmc_send_S2C_play_change_difficulty_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_PLAY_CHANGE_DIFFICULTY_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2076,7 +2608,12 @@ cmc_err cmc_send_S2C_play_change_difficulty_packet(
 cmc_err
 cmc_send_C2S_play_keep_alive_packet(cmc_conn *conn,
                                     C2S_play_keep_alive_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_C2S_PLAY_KEEP_ALIVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2092,16 +2629,24 @@ cmc_send_C2S_play_keep_alive_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
 }
 
 cmc_err cmc_send_C2S_login_acknowledged_packet(cmc_conn *conn) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_C2S_LOGIN_ACKNOWLEDGED_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2111,9 +2656,12 @@ cmc_err cmc_send_C2S_login_acknowledged_packet(cmc_conn *conn) {
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_LOGIN_ACKNOWLEDGED_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2121,20 +2669,27 @@ cmc_err cmc_send_C2S_login_acknowledged_packet(cmc_conn *conn) {
 
 cmc_err cmc_send_S2C_config_plugin_message_packet(
     cmc_conn *conn, S2C_config_plugin_message_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
     cmc_buff_pack_varint(buff, 0x00);
-    cmc_buff_pack_string(buff, packet->channel);
+    cmc_buff_pack_string_view(buff, packet->channel);
     cmc_buff_pack_buff(buff, packet->data);
     break;
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_PLUGIN_MESSAGE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2143,7 +2698,11 @@ cmc_err cmc_send_S2C_config_plugin_message_packet(
 cmc_err
 cmc_send_S2C_config_disconnect_packet(cmc_conn *conn,
                                       S2C_config_disconnect_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2153,16 +2712,24 @@ cmc_send_S2C_config_disconnect_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_DISCONNECT_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
 }
 
 cmc_err cmc_send_S2C_config_finish_packet(cmc_conn *conn) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_CONFIG_FINISH_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2172,9 +2739,12 @@ cmc_err cmc_send_S2C_config_finish_packet(cmc_conn *conn) {
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_FINISH_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2183,7 +2753,12 @@ cmc_err cmc_send_S2C_config_finish_packet(cmc_conn *conn) {
 cmc_err
 cmc_send_S2C_config_keep_alive_packet(cmc_conn *conn,
                                       S2C_config_keep_alive_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_CONFIG_KEEP_ALIVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2193,9 +2768,12 @@ cmc_send_S2C_config_keep_alive_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_KEEP_ALIVE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2203,7 +2781,12 @@ cmc_send_S2C_config_keep_alive_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_config_ping_packet(cmc_conn *conn,
                                         S2C_config_ping_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_S2C_CONFIG_PING_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2213,9 +2796,12 @@ cmc_err cmc_send_S2C_config_ping_packet(cmc_conn *conn,
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_PING_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2223,7 +2809,11 @@ cmc_err cmc_send_S2C_config_ping_packet(cmc_conn *conn,
 
 cmc_err cmc_send_S2C_config_registry_data_packet(
     cmc_conn *conn, S2C_config_registry_data_packet *packet) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(conn, CMC_CONN_PACKET_HEADROOM);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2233,16 +2823,25 @@ cmc_err cmc_send_S2C_config_registry_data_packet(
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_REGISTRY_DATA_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
 }
 
 cmc_err cmc_send_S2C_config_remove_resource_pack_packet(cmc_conn *conn) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2252,16 +2851,26 @@ cmc_err cmc_send_S2C_config_remove_resource_pack_packet(cmc_conn *conn) {
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_REMOVE_RESOURCE_PACK_NAME_ID,
+                           stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
 }
 
 cmc_err cmc_send_S2C_config_add_resource_pack_packet(cmc_conn *conn) {
-  cmc_buff *buff = cmc_buff_init(conn->protocol_version);
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn,
+      CMC_CONN_PACKET_HEADROOM + CMC_S2C_CONFIG_ADD_RESOURCE_PACK_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
   switch (conn->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -2271,9 +2880,42 @@ cmc_err cmc_send_S2C_config_add_resource_pack_packet(cmc_conn *conn) {
   }
 
   default:
-    cmc_buff_free(buff);
-    CMC_ERRRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
   }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_S2C_CONFIG_ADD_RESOURCE_PACK_NAME_ID,
+                           stats_start);
+  cmc_conn_send_packet(conn, buff);
+  cmc_buff_free(buff);
+  return CMC_ERR_NO;
+}
+
+cmc_err
+cmc_send_C2S_config_keep_alive_packet(cmc_conn *conn,
+                                      C2S_config_keep_alive_packet *packet) {
+  uint64_t stats_start = cmc_packet_stats_start();
+  cmc_buff *buff = cmc_conn_buff_init(
+      conn, CMC_CONN_PACKET_HEADROOM + CMC_C2S_CONFIG_KEEP_ALIVE_MAX_SIZE);
+  CMC_ERRRC_IF(!buff, CMC_ERR_MEM);
+  if (cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM))
+    return send_failed(conn, buff);
+  switch (conn->protocol_version) {
+
+  case CMC_PROTOCOL_VERSION_765: {
+    cmc_buff_pack_varint(buff, 0x03);
+    cmc_buff_pack_long(buff, packet->keep_alive_id);
+    break;
+  }
+
+  default:
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION,
+             return send_failed(conn, buff););
+  }
+  if (buff->err.err)
+    return send_failed(conn, buff);
+  cmc_packet_stats_encoded(CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID, stats_start);
   cmc_conn_send_packet(conn, buff);
   cmc_buff_free(buff);
   return CMC_ERR_NO;
@@ -2286,6 +2928,8 @@ cmc_err cmc_send_S2C_config_add_resource_pack_packet(cmc_conn *conn) {
 C2S_handshake_handshake_packet
 unpack_C2S_handshake_handshake_packet(cmc_buff *buff) {
   C2S_handshake_handshake_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2310,6 +2954,7 @@ unpack_C2S_handshake_handshake_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_HANDSHAKE_HANDSHAKE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_C2S_handshake_handshake_packet(&packet, &buff->err);
@@ -2318,6 +2963,8 @@ err:
 
 S2C_status_response_packet unpack_S2C_status_response_packet(cmc_buff *buff) {
   S2C_status_response_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2336,6 +2983,7 @@ S2C_status_response_packet unpack_S2C_status_response_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_STATUS_RESPONSE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_status_response_packet(&packet, &buff->err);
@@ -2344,6 +2992,7 @@ err:
 
 S2C_status_pong_packet unpack_S2C_status_pong_packet(cmc_buff *buff) {
   S2C_status_pong_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2362,6 +3011,7 @@ S2C_status_pong_packet unpack_S2C_status_pong_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_STATUS_PONG_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_status_pong_packet(&packet, &buff->err);
@@ -2370,6 +3020,7 @@ err:
 
 C2S_status_ping_packet unpack_C2S_status_ping_packet(cmc_buff *buff) {
   C2S_status_ping_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2388,6 +3039,7 @@ C2S_status_ping_packet unpack_C2S_status_ping_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_STATUS_PING_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_C2S_status_ping_packet(&packet, &buff->err);
@@ -2396,6 +3048,8 @@ err:
 
 S2C_login_disconnect_packet unpack_S2C_login_disconnect_packet(cmc_buff *buff) {
   S2C_login_disconnect_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2414,6 +3068,7 @@ S2C_login_disconnect_packet unpack_S2C_login_disconnect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_LOGIN_DISCONNECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_login_disconnect_packet(&packet, &buff->err);
@@ -2423,6 +3078,8 @@ err:
 S2C_login_encryption_request_packet
 unpack_S2C_login_encryption_request_packet(cmc_buff *buff) {
   S2C_login_encryption_request_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2445,6 +3102,8 @@ unpack_S2C_login_encryption_request_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_LOGIN_ENCRYPTION_REQUEST_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_login_encryption_request_packet(&packet, &buff->err);
@@ -2453,6 +3112,8 @@ err:
 
 S2C_login_success_packet unpack_S2C_login_success_packet(cmc_buff *buff) {
   S2C_login_success_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2474,6 +3135,7 @@ S2C_login_success_packet unpack_S2C_login_success_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_LOGIN_SUCCESS_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_login_success_packet(&packet, &buff->err);
@@ -2483,6 +3145,7 @@ err:
 S2C_login_set_compression_packet
 unpack_S2C_login_set_compression_packet(cmc_buff *buff) {
   S2C_login_set_compression_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2501,6 +3164,7 @@ unpack_S2C_login_set_compression_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_LOGIN_SET_COMPRESSION_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_login_set_compression_packet(&packet, &buff->err);
@@ -2509,6 +3173,8 @@ err:
 
 C2S_login_start_packet unpack_C2S_login_start_packet(cmc_buff *buff) {
   C2S_login_start_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2528,6 +3194,7 @@ C2S_login_start_packet unpack_C2S_login_start_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_LOGIN_START_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_C2S_login_start_packet(&packet, &buff->err);
@@ -2537,6 +3204,7 @@ err:
 C2S_login_encryption_response_packet
 unpack_C2S_login_encryption_response_packet(cmc_buff *buff) {
   C2S_login_encryption_response_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2557,6 +3225,8 @@ unpack_C2S_login_encryption_response_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_LOGIN_ENCRYPTION_RESPONSE_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_C2S_login_encryption_response_packet(&packet, &buff->err);
@@ -2565,6 +3235,7 @@ err:
 
 S2C_play_keep_alive_packet unpack_S2C_play_keep_alive_packet(cmc_buff *buff) {
   S2C_play_keep_alive_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2583,6 +3254,7 @@ S2C_play_keep_alive_packet unpack_S2C_play_keep_alive_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_keep_alive_packet(&packet, &buff->err);
@@ -2591,6 +3263,7 @@ err:
 
 S2C_play_join_game_packet unpack_S2C_play_join_game_packet(cmc_buff *buff) {
   S2C_play_join_game_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2599,7 +3272,7 @@ S2C_play_join_game_packet unpack_S2C_play_join_game_packet(cmc_buff *buff) {
     packet.dimension = cmc_buff_unpack_char(buff);
     packet.difficulty = cmc_buff_unpack_byte(buff);
     packet.max_players = cmc_buff_unpack_byte(buff);
-    packet.level_type = cmc_buff_unpack_string(buff);
+    packet.level_type = cmc_buff_unpack_string_view(buff);
     packet.reduced_debug_info = cmc_buff_unpack_bool(buff);
     break;
   }
@@ -2610,6 +3283,7 @@ S2C_play_join_game_packet unpack_S2C_play_join_game_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_JOIN_GAME_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_join_game_packet(&packet, &buff->err);
@@ -2619,10 +3293,11 @@ err:
 S2C_play_chat_message_packet
 unpack_S2C_play_chat_message_packet(cmc_buff *buff) {
   S2C_play_chat_message_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
-    packet.message = cmc_buff_unpack_string(buff);
+    packet.message = cmc_buff_unpack_string_view(buff);
     packet.position = cmc_buff_unpack_char(buff);
     break;
   }
@@ -2633,6 +3308,7 @@ unpack_S2C_play_chat_message_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_CHAT_MESSAGE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_chat_message_packet(&packet, &buff->err);
@@ -2641,6 +3317,7 @@ err:
 
 S2C_play_time_update_packet unpack_S2C_play_time_update_packet(cmc_buff *buff) {
   S2C_play_time_update_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2655,6 +3332,7 @@ S2C_play_time_update_packet unpack_S2C_play_time_update_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_TIME_UPDATE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_time_update_packet(&packet, &buff->err);
@@ -2664,6 +3342,8 @@ err:
 S2C_play_entity_equipment_packet
 unpack_S2C_play_entity_equipment_packet(cmc_buff *buff) {
   S2C_play_entity_equipment_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2679,6 +3359,7 @@ unpack_S2C_play_entity_equipment_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_EQUIPMENT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_equipment_packet(&packet, &buff->err);
@@ -2688,6 +3369,7 @@ err:
 S2C_play_spawn_position_packet
 unpack_S2C_play_spawn_position_packet(cmc_buff *buff) {
   S2C_play_spawn_position_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2701,6 +3383,7 @@ unpack_S2C_play_spawn_position_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SPAWN_POSITION_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_spawn_position_packet(&packet, &buff->err);
@@ -2710,6 +3393,7 @@ err:
 S2C_play_update_health_packet
 unpack_S2C_play_update_health_packet(cmc_buff *buff) {
   S2C_play_update_health_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2725,6 +3409,7 @@ unpack_S2C_play_update_health_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_UPDATE_HEALTH_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_update_health_packet(&packet, &buff->err);
@@ -2733,13 +3418,14 @@ err:
 
 S2C_play_respawn_packet unpack_S2C_play_respawn_packet(cmc_buff *buff) {
   S2C_play_respawn_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     packet.dimesion = cmc_buff_unpack_int(buff);
     packet.difficulty = cmc_buff_unpack_byte(buff);
     packet.gamemode = cmc_buff_unpack_byte(buff);
-    packet.level_type = cmc_buff_unpack_string(buff);
+    packet.level_type = cmc_buff_unpack_string_view(buff);
     break;
   }
 
@@ -2749,6 +3435,7 @@ S2C_play_respawn_packet unpack_S2C_play_respawn_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_RESPAWN_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_respawn_packet(&packet, &buff->err);
@@ -2758,6 +3445,7 @@ err:
 S2C_play_player_look_and_position_packet
 unpack_S2C_play_player_look_and_position_packet(cmc_buff *buff) {
   S2C_play_player_look_and_position_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2776,6 +3464,8 @@ unpack_S2C_play_player_look_and_position_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_PLAYER_LOOK_AND_POSITION_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_player_look_and_position_packet(&packet, &buff->err);
@@ -2785,6 +3475,7 @@ err:
 S2C_play_held_item_change_packet
 unpack_S2C_play_held_item_change_packet(cmc_buff *buff) {
   S2C_play_held_item_change_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2798,6 +3489,7 @@ unpack_S2C_play_held_item_change_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_HELD_ITEM_CHANGE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_held_item_change_packet(&packet, &buff->err);
@@ -2806,6 +3498,7 @@ err:
 
 S2C_play_use_bed_packet unpack_S2C_play_use_bed_packet(cmc_buff *buff) {
   S2C_play_use_bed_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2820,6 +3513,7 @@ S2C_play_use_bed_packet unpack_S2C_play_use_bed_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_USE_BED_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_use_bed_packet(&packet, &buff->err);
@@ -2828,6 +3522,7 @@ err:
 
 S2C_play_animation_packet unpack_S2C_play_animation_packet(cmc_buff *buff) {
   S2C_play_animation_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2842,6 +3537,7 @@ S2C_play_animation_packet unpack_S2C_play_animation_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ANIMATION_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_animation_packet(&packet, &buff->err);
@@ -2851,6 +3547,8 @@ err:
 S2C_play_spawn_player_packet
 unpack_S2C_play_spawn_player_packet(cmc_buff *buff) {
   S2C_play_spawn_player_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2872,6 +3570,7 @@ unpack_S2C_play_spawn_player_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SPAWN_PLAYER_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_spawn_player_packet(&packet, &buff->err);
@@ -2881,6 +3580,7 @@ err:
 S2C_play_collect_item_packet
 unpack_S2C_play_collect_item_packet(cmc_buff *buff) {
   S2C_play_collect_item_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2895,6 +3595,7 @@ unpack_S2C_play_collect_item_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_COLLECT_ITEM_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_collect_item_packet(&packet, &buff->err);
@@ -2903,6 +3604,8 @@ err:
 
 S2C_play_spawn_mob_packet unpack_S2C_play_spawn_mob_packet(cmc_buff *buff) {
   S2C_play_spawn_mob_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2927,6 +3630,7 @@ S2C_play_spawn_mob_packet unpack_S2C_play_spawn_mob_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SPAWN_MOB_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_spawn_mob_packet(&packet, &buff->err);
@@ -2936,6 +3640,8 @@ err:
 S2C_play_spawn_painting_packet
 unpack_S2C_play_spawn_painting_packet(cmc_buff *buff) {
   S2C_play_spawn_painting_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2952,6 +3658,7 @@ unpack_S2C_play_spawn_painting_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SPAWN_PAINTING_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_spawn_painting_packet(&packet, &buff->err);
@@ -2961,6 +3668,7 @@ err:
 S2C_play_spawn_experience_orb_packet
 unpack_S2C_play_spawn_experience_orb_packet(cmc_buff *buff) {
   S2C_play_spawn_experience_orb_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -2978,6 +3686,8 @@ unpack_S2C_play_spawn_experience_orb_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SPAWN_EXPERIENCE_ORB_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_spawn_experience_orb_packet(&packet, &buff->err);
@@ -2987,6 +3697,7 @@ err:
 S2C_play_entity_velocity_packet
 unpack_S2C_play_entity_velocity_packet(cmc_buff *buff) {
   S2C_play_entity_velocity_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3003,14 +3714,52 @@ unpack_S2C_play_entity_velocity_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_VELOCITY_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_velocity_packet(&packet, &buff->err);
   return (S2C_play_entity_velocity_packet){};
 }
 
+S2C_play_destroy_entities_packet
+unpack_S2C_play_destroy_entities_packet(cmc_buff *buff) {
+  S2C_play_destroy_entities_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
+  switch (buff->protocol_version) {
+
+  case CMC_PROTOCOL_VERSION_47: {
+    packet.count = cmc_buff_unpack_varint(buff);
+    CMC_ERRB_IF(packet.count < 0 ||
+                    (size_t)packet.count > cmc_buff_remaining(buff),
+                CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
+    packet.entities.size = packet.count;
+    packet.entities.data = CMC_ERRB_ABLE(
+        cmc_buff_malloc(buff, packet.entities.size *
+                                  sizeof(S2C_play_destroy_entities_entities)),
+        goto err;);
+    CMC_ERRB_ABLE(cmc_buff_unpack_varint_array(buff, packet.entities.data,
+                                               packet.entities.size),
+                  goto err;);
+    break;
+  }
+
+  default:
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION, return packet;);
+  }
+  CMC_ERRB_ABLE(, goto err);
+  if (buff->position != buff->length)
+    CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_DESTROY_ENTITIES_NAME_ID, stats_start);
+  return packet;
+err:
+  cmc_free_S2C_play_destroy_entities_packet(&packet, &buff->err);
+  return (S2C_play_destroy_entities_packet){};
+}
+
 S2C_play_entity_packet unpack_S2C_play_entity_packet(cmc_buff *buff) {
   S2C_play_entity_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3024,6 +3773,7 @@ S2C_play_entity_packet unpack_S2C_play_entity_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_packet(&packet, &buff->err);
@@ -3033,6 +3783,7 @@ err:
 S2C_play_entity_relative_move_packet
 unpack_S2C_play_entity_relative_move_packet(cmc_buff *buff) {
   S2C_play_entity_relative_move_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3050,6 +3801,8 @@ unpack_S2C_play_entity_relative_move_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_RELATIVE_MOVE_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_relative_move_packet(&packet, &buff->err);
@@ -3058,6 +3811,7 @@ err:
 
 S2C_play_entity_look_packet unpack_S2C_play_entity_look_packet(cmc_buff *buff) {
   S2C_play_entity_look_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3074,6 +3828,7 @@ S2C_play_entity_look_packet unpack_S2C_play_entity_look_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_LOOK_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_look_packet(&packet, &buff->err);
@@ -3083,6 +3838,7 @@ err:
 S2C_play_entity_look_and_relative_move_packet
 unpack_S2C_play_entity_look_and_relative_move_packet(cmc_buff *buff) {
   S2C_play_entity_look_and_relative_move_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3102,6 +3858,8 @@ unpack_S2C_play_entity_look_and_relative_move_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_LOOK_AND_RELATIVE_MOVE_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_look_and_relative_move_packet(&packet, &buff->err);
@@ -3111,6 +3869,7 @@ err:
 S2C_play_entity_teleport_packet
 unpack_S2C_play_entity_teleport_packet(cmc_buff *buff) {
   S2C_play_entity_teleport_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3130,6 +3889,7 @@ unpack_S2C_play_entity_teleport_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_TELEPORT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_teleport_packet(&packet, &buff->err);
@@ -3139,6 +3899,7 @@ err:
 S2C_play_entity_head_look_packet
 unpack_S2C_play_entity_head_look_packet(cmc_buff *buff) {
   S2C_play_entity_head_look_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3153,6 +3914,7 @@ unpack_S2C_play_entity_head_look_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_HEAD_LOOK_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_head_look_packet(&packet, &buff->err);
@@ -3162,6 +3924,7 @@ err:
 S2C_play_entity_status_packet
 unpack_S2C_play_entity_status_packet(cmc_buff *buff) {
   S2C_play_entity_status_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3176,6 +3939,7 @@ unpack_S2C_play_entity_status_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_STATUS_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_status_packet(&packet, &buff->err);
@@ -3185,6 +3949,7 @@ err:
 S2C_play_attach_entity_packet
 unpack_S2C_play_attach_entity_packet(cmc_buff *buff) {
   S2C_play_attach_entity_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3200,6 +3965,7 @@ unpack_S2C_play_attach_entity_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ATTACH_ENTITY_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_attach_entity_packet(&packet, &buff->err);
@@ -3209,6 +3975,8 @@ err:
 S2C_play_entity_metadata_packet
 unpack_S2C_play_entity_metadata_packet(cmc_buff *buff) {
   S2C_play_entity_metadata_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3223,6 +3991,7 @@ unpack_S2C_play_entity_metadata_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_METADATA_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_metadata_packet(&packet, &buff->err);
@@ -3232,6 +4001,7 @@ err:
 S2C_play_entity_effect_packet
 unpack_S2C_play_entity_effect_packet(cmc_buff *buff) {
   S2C_play_entity_effect_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3249,6 +4019,7 @@ unpack_S2C_play_entity_effect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_EFFECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_effect_packet(&packet, &buff->err);
@@ -3258,6 +4029,7 @@ err:
 S2C_play_remove_entity_effect_packet
 unpack_S2C_play_remove_entity_effect_packet(cmc_buff *buff) {
   S2C_play_remove_entity_effect_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3272,6 +4044,8 @@ unpack_S2C_play_remove_entity_effect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_REMOVE_ENTITY_EFFECT_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_remove_entity_effect_packet(&packet, &buff->err);
@@ -3281,6 +4055,7 @@ err:
 S2C_play_set_experience_packet
 unpack_S2C_play_set_experience_packet(cmc_buff *buff) {
   S2C_play_set_experience_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3296,6 +4071,7 @@ unpack_S2C_play_set_experience_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SET_EXPERIENCE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_set_experience_packet(&packet, &buff->err);
@@ -3305,28 +4081,41 @@ err:
 S2C_play_entity_properties_packet
 unpack_S2C_play_entity_properties_packet(cmc_buff *buff) {
   S2C_play_entity_properties_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     packet.entity_id = cmc_buff_unpack_varint(buff);
     packet.properties_count = cmc_buff_unpack_int(buff);
+    CMC_ERRB_IF(packet.properties_count < 0 ||
+                    (size_t)packet.properties_count > cmc_buff_remaining(buff),
+                CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
     packet.properties.size = packet.properties_count;
     packet.properties.data = CMC_ERRB_ABLE(
-        cmc_malloc(packet.properties.size *
-                       sizeof(S2C_play_entity_properties_properties),
-                   &buff->err),
+        cmc_buff_malloc(buff,
+                        packet.properties.size *
+                            sizeof(S2C_play_entity_properties_properties)),
         goto err;);
+    if (packet.properties.data)
+      memset(packet.properties.data, 0,
+             packet.properties.size *
+                 sizeof(S2C_play_entity_properties_properties));
     for (size_t i = 0; i < packet.properties.size; ++i) {
       S2C_play_entity_properties_properties *p_properties =
           &((S2C_play_entity_properties_properties *)packet.properties.data)[i];
       p_properties->key = cmc_buff_unpack_string(buff);
       p_properties->value = cmc_buff_unpack_double(buff);
       p_properties->num_of_modifiers = cmc_buff_unpack_varint(buff);
+      CMC_ERRB_IF(p_properties->num_of_modifiers < 0 ||
+                      (size_t)p_properties->num_of_modifiers >
+                          cmc_buff_remaining(buff),
+                  CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
       p_properties->modifiers.size = p_properties->num_of_modifiers;
       p_properties->modifiers.data = CMC_ERRB_ABLE(
-          cmc_malloc(p_properties->modifiers.size *
-                         sizeof(S2C_play_entity_properties_modifiers),
-                     &buff->err),
+          cmc_buff_malloc(buff,
+                          p_properties->modifiers.size *
+                              sizeof(S2C_play_entity_properties_modifiers)),
           goto err;);
       for (size_t j = 0; j < p_properties->modifiers.size; ++j) {
         S2C_play_entity_properties_modifiers *p_modifiers =
@@ -3346,6 +4135,7 @@ unpack_S2C_play_entity_properties_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_ENTITY_PROPERTIES_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_entity_properties_packet(&packet, &buff->err);
@@ -3354,6 +4144,7 @@ err:
 
 S2C_play_chunk_data_packet unpack_S2C_play_chunk_data_packet(cmc_buff *buff) {
   S2C_play_chunk_data_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3371,6 +4162,7 @@ S2C_play_chunk_data_packet unpack_S2C_play_chunk_data_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_CHUNK_DATA_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_chunk_data_packet(&packet, &buff->err);
@@ -3380,17 +4172,21 @@ err:
 S2C_play_multi_block_change_packet
 unpack_S2C_play_multi_block_change_packet(cmc_buff *buff) {
   S2C_play_multi_block_change_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     packet.chunk_x = cmc_buff_unpack_int(buff);
     packet.chunk_z = cmc_buff_unpack_int(buff);
     packet.record_count = cmc_buff_unpack_varint(buff);
+    CMC_ERRB_IF(packet.record_count < 0 ||
+                    (size_t)packet.record_count > cmc_buff_remaining(buff),
+                CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
     packet.records.size = packet.record_count;
     packet.records.data = CMC_ERRB_ABLE(
-        cmc_malloc(packet.records.size *
-                       sizeof(S2C_play_multi_block_change_records),
-                   &buff->err),
+        cmc_buff_malloc(buff, packet.records.size *
+                                  sizeof(S2C_play_multi_block_change_records)),
         goto err;);
     for (size_t i = 0; i < packet.records.size; ++i) {
       S2C_play_multi_block_change_records *p_records =
@@ -3409,6 +4205,8 @@ unpack_S2C_play_multi_block_change_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_MULTI_BLOCK_CHANGE_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_multi_block_change_packet(&packet, &buff->err);
@@ -3418,6 +4216,7 @@ err:
 S2C_play_block_change_packet
 unpack_S2C_play_block_change_packet(cmc_buff *buff) {
   S2C_play_block_change_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3432,6 +4231,7 @@ unpack_S2C_play_block_change_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_BLOCK_CHANGE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_block_change_packet(&packet, &buff->err);
@@ -3441,6 +4241,7 @@ err:
 S2C_play_block_action_packet
 unpack_S2C_play_block_action_packet(cmc_buff *buff) {
   S2C_play_block_action_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3457,6 +4258,7 @@ unpack_S2C_play_block_action_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_BLOCK_ACTION_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_block_action_packet(&packet, &buff->err);
@@ -3466,6 +4268,7 @@ err:
 S2C_play_block_break_animation_packet
 unpack_S2C_play_block_break_animation_packet(cmc_buff *buff) {
   S2C_play_block_break_animation_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3481,6 +4284,8 @@ unpack_S2C_play_block_break_animation_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_BLOCK_BREAK_ANIMATION_NAME_ID,
+                           stats_start);
   return packet;
 err:
   cmc_free_S2C_play_block_break_animation_packet(&packet, &buff->err);
@@ -3490,16 +4295,22 @@ err:
 S2C_play_map_chunk_bulk_packet
 unpack_S2C_play_map_chunk_bulk_packet(cmc_buff *buff) {
   S2C_play_map_chunk_bulk_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
     packet.sky_light_sent = cmc_buff_unpack_bool(buff);
     packet.chunk_column_count = cmc_buff_unpack_varint(buff);
+    CMC_ERRB_IF(packet.chunk_column_count < 0 ||
+                    (size_t)packet.chunk_column_count >
+                        cmc_buff_remaining(buff),
+                CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
     packet.chunk_columns.size = packet.chunk_column_count;
     packet.chunk_columns.data = CMC_ERRB_ABLE(
-        cmc_malloc(packet.chunk_columns.size *
-                       sizeof(S2C_play_map_chunk_bulk_chunk_columns),
-                   &buff->err),
+        cmc_buff_malloc(buff,
+                        packet.chunk_columns.size *
+                            sizeof(S2C_play_map_chunk_bulk_chunk_columns)),
         goto err;);
     for (size_t i = 0; i < packet.chunk_columns.size; ++i) {
       S2C_play_map_chunk_bulk_chunk_columns *p_chunk_columns =
@@ -3519,6 +4330,7 @@ unpack_S2C_play_map_chunk_bulk_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_MAP_CHUNK_BULK_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_map_chunk_bulk_packet(&packet, &buff->err);
@@ -3527,6 +4339,8 @@ err:
 
 S2C_play_explosion_packet unpack_S2C_play_explosion_packet(cmc_buff *buff) {
   S2C_play_explosion_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3535,10 +4349,13 @@ S2C_play_explosion_packet unpack_S2C_play_explosion_packet(cmc_buff *buff) {
     packet.z = cmc_buff_unpack_float(buff);
     packet.radius = cmc_buff_unpack_float(buff);
     packet.record_count = cmc_buff_unpack_int(buff);
+    CMC_ERRB_IF(packet.record_count < 0 ||
+                    (size_t)packet.record_count > cmc_buff_remaining(buff),
+                CMC_ERR_INVALID_PACKET_LENGTH, goto err;);
     packet.records.size = packet.record_count;
     packet.records.data = CMC_ERRB_ABLE(
-        cmc_malloc(packet.records.size * sizeof(S2C_play_explosion_records),
-                   &buff->err),
+        cmc_buff_malloc(buff, packet.records.size *
+                                  sizeof(S2C_play_explosion_records)),
         goto err;);
     for (size_t i = 0; i < packet.records.size; ++i) {
       S2C_play_explosion_records *p_records =
@@ -3559,6 +4376,7 @@ S2C_play_explosion_packet unpack_S2C_play_explosion_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_EXPLOSION_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_explosion_packet(&packet, &buff->err);
@@ -3567,6 +4385,7 @@ err:
 
 S2C_play_effect_packet unpack_S2C_play_effect_packet(cmc_buff *buff) {
   S2C_play_effect_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3594,6 +4413,7 @@ S2C_play_effect_packet unpack_S2C_play_effect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_EFFECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_effect_packet(&packet, &buff->err);
@@ -3603,10 +4423,11 @@ err:
 S2C_play_sound_effect_packet
 unpack_S2C_play_sound_effect_packet(cmc_buff *buff) {
   S2C_play_sound_effect_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
-    packet.sound_name = cmc_buff_unpack_string(buff);
+    packet.sound_name = cmc_buff_unpack_string_view(buff);
     packet.x = cmc_buff_unpack_int(buff);
     packet.y = cmc_buff_unpack_int(buff);
     packet.z = cmc_buff_unpack_int(buff);
@@ -3621,6 +4442,7 @@ unpack_S2C_play_sound_effect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_SOUND_EFFECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_sound_effect_packet(&packet, &buff->err);
@@ -3630,6 +4452,7 @@ err:
 S2C_play_change_game_state_packet
 unpack_S2C_play_change_game_state_packet(cmc_buff *buff) {
   S2C_play_change_game_state_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3644,6 +4467,7 @@ unpack_S2C_play_change_game_state_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_CHANGE_GAME_STATE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_change_game_state_packet(&packet, &buff->err);
@@ -3653,6 +4477,7 @@ err:
 S2C_play_player_abilities_packet
 unpack_S2C_play_player_abilities_packet(cmc_buff *buff) {
   S2C_play_player_abilities_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3668,6 +4493,7 @@ unpack_S2C_play_player_abilities_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_PLAYER_ABILITIES_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_player_abilities_packet(&packet, &buff->err);
@@ -3677,10 +4503,11 @@ err:
 S2C_play_plugin_message_packet
 unpack_S2C_play_plugin_message_packet(cmc_buff *buff) {
   S2C_play_plugin_message_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
-    packet.channel = cmc_buff_unpack_string(buff);
+    packet.channel = cmc_buff_unpack_string_view(buff);
     packet.data = cmc_buff_unpack_buff(buff);
     break;
   }
@@ -3691,6 +4518,7 @@ unpack_S2C_play_plugin_message_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_PLUGIN_MESSAGE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_plugin_message_packet(&packet, &buff->err);
@@ -3699,6 +4527,8 @@ err:
 
 S2C_play_disconnect_packet unpack_S2C_play_disconnect_packet(cmc_buff *buff) {
   S2C_play_disconnect_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3717,6 +4547,7 @@ S2C_play_disconnect_packet unpack_S2C_play_disconnect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_DISCONNECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_disconnect_packet(&packet, &buff->err);
@@ -3726,6 +4557,7 @@ err:
 S2C_play_change_difficulty_packet
 unpack_S2C_play_change_difficulty_packet(cmc_buff *buff) {
   S2C_play_change_difficulty_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3739,6 +4571,7 @@ unpack_S2C_play_change_difficulty_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_PLAY_CHANGE_DIFFICULTY_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_play_change_difficulty_packet(&packet, &buff->err);
@@ -3747,6 +4580,7 @@ err:
 
 C2S_play_keep_alive_packet unpack_C2S_play_keep_alive_packet(cmc_buff *buff) {
   C2S_play_keep_alive_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_47: {
@@ -3765,6 +4599,7 @@ C2S_play_keep_alive_packet unpack_C2S_play_keep_alive_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_C2S_play_keep_alive_packet(&packet, &buff->err);
@@ -3774,10 +4609,11 @@ err:
 S2C_config_plugin_message_packet
 unpack_S2C_config_plugin_message_packet(cmc_buff *buff) {
   S2C_config_plugin_message_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
-    packet.channel = cmc_buff_unpack_string(buff);
+    packet.channel = cmc_buff_unpack_string_view(buff);
     packet.data = cmc_buff_unpack_buff(buff);
     break;
   }
@@ -3788,6 +4624,7 @@ unpack_S2C_config_plugin_message_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_CONFIG_PLUGIN_MESSAGE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_config_plugin_message_packet(&packet, &buff->err);
@@ -3797,6 +4634,8 @@ err:
 S2C_config_disconnect_packet
 unpack_S2C_config_disconnect_packet(cmc_buff *buff) {
   S2C_config_disconnect_packet packet = {};
+  packet.in_arena = buff->arena != NULL;
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -3810,6 +4649,7 @@ unpack_S2C_config_disconnect_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_CONFIG_DISCONNECT_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_config_disconnect_packet(&packet, &buff->err);
@@ -3819,6 +4659,7 @@ err:
 S2C_config_keep_alive_packet
 unpack_S2C_config_keep_alive_packet(cmc_buff *buff) {
   S2C_config_keep_alive_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -3832,6 +4673,7 @@ unpack_S2C_config_keep_alive_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_CONFIG_KEEP_ALIVE_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_config_keep_alive_packet(&packet, &buff->err);
@@ -3840,6 +4682,7 @@ err:
 
 S2C_config_ping_packet unpack_S2C_config_ping_packet(cmc_buff *buff) {
   S2C_config_ping_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -3853,6 +4696,7 @@ S2C_config_ping_packet unpack_S2C_config_ping_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_CONFIG_PING_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_config_ping_packet(&packet, &buff->err);
@@ -3862,6 +4706,7 @@ err:
 S2C_config_registry_data_packet
 unpack_S2C_config_registry_data_packet(cmc_buff *buff) {
   S2C_config_registry_data_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
   switch (buff->protocol_version) {
 
   case CMC_PROTOCOL_VERSION_765: {
@@ -3875,10 +4720,35 @@ unpack_S2C_config_registry_data_packet(cmc_buff *buff) {
   CMC_ERRB_ABLE(, goto err);
   if (buff->position != buff->length)
     CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_S2C_CONFIG_REGISTRY_DATA_NAME_ID, stats_start);
   return packet;
 err:
   cmc_free_S2C_config_registry_data_packet(&packet, &buff->err);
   return (S2C_config_registry_data_packet){};
 }
 
+C2S_config_keep_alive_packet
+unpack_C2S_config_keep_alive_packet(cmc_buff *buff) {
+  C2S_config_keep_alive_packet packet = {};
+  uint64_t stats_start = cmc_packet_stats_start();
+  switch (buff->protocol_version) {
+
+  case CMC_PROTOCOL_VERSION_765: {
+    packet.keep_alive_id = cmc_buff_unpack_long(buff);
+    break;
+  }
+
+  default:
+    CMC_ERRB(CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION, return packet;);
+  }
+  CMC_ERRB_ABLE(, goto err);
+  if (buff->position != buff->length)
+    CMC_ERRB(CMC_ERR_BUFF_UNDERFLOW, goto err;);
+  cmc_packet_stats_decoded(CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID, stats_start);
+  return packet;
+err:
+  cmc_free_C2S_config_keep_alive_packet(&packet, &buff->err);
+  return (C2S_config_keep_alive_packet){};
+}
+
 // CGSE: unpack_methods_c
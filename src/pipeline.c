@@ -0,0 +1,490 @@
+#include <cmc/pipeline.h>
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/heap_utils.h>
+#include <cmc/list.h>
+#include <cmc/loop.h>
+#include <cmc/queue.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "compress.h"
+#include "err_macros.h"
+#include "loop_internal.h"
+
+typedef struct cmc_pipeline_conn cmc_pipeline_conn;
+
+// one received frame on its way through a worker
+typedef struct {
+  struct list_head entry; // in cmc_pipeline_conn.jobs
+  cmc_pipeline_conn *pc;
+  cmc_conn_state state; // when the frame was received
+  cmc_buff *frame;      // null once decoded
+  cmc_buff *packet;
+  void *decoded;
+  cmc_err_extra err;
+  bool done; // set by the I/O thread once the worker handed it back
+} pipeline_job;
+
+struct cmc_pipeline_conn {
+  cmc_conn *conn;
+  struct list_head entry;       // in cmc_pipeline.conns
+  struct list_head jobs;        // in the order the frames were received
+  struct list_head ready_entry; // in cmc_pipeline.ready
+  bool ready;
+  size_t inflight; // jobs the workers have not handed back
+  // the connection left the loop, on_close is called once jobs is empty
+  bool closing;
+  bool failed; // a packet could not be decoded, the rest is dropped
+};
+
+typedef struct {
+  cmc_spsc_queue *in;  // jobs from the I/O thread
+  cmc_spsc_queue *out; // decoded jobs back to it
+  cmc_pipeline *pipeline;
+  pthread_t thread;
+  bool started;
+  sem_t wake;
+  _Atomic bool sleeping;
+  size_t queued; // I/O thread only, handed out and not collected yet
+  struct cmc_inflater *inflater; // worker only
+} worker;
+
+struct cmc_pipeline {
+  cmc_loop *loop;
+  cmc_pipeline_callbacks callbacks;
+  worker *workers;
+  size_t worker_count;
+  size_t next_worker;
+  _Atomic bool stopping;
+  sem_t results;
+  _Atomic bool io_waiting; // blocked on results
+  size_t inflight;
+  size_t conn_count;
+  struct list_head conns;
+  struct list_head ready; // connections with decoded jobs to look at
+};
+
+static void decode_job(cmc_pipeline *pipeline, pipeline_job *job,
+                       cmc_conn *conn, struct cmc_inflater **inflater,
+                       cmc_buff_pool *pool, size_t buffered) {
+  job->packet =
+      cmc_conn_decode_frame(conn, job->state, inflater, pool, buffered,
+                            job->frame->data, job->frame->length, &job->err);
+  cmc_buff_free(job->frame);
+  job->frame = NULL;
+  if (job->packet && pipeline->callbacks.decode)
+    job->decoded = pipeline->callbacks.decode(job->packet, job->state,
+                                              pipeline->callbacks.user_data);
+}
+
+static void *worker_main(void *arg) {
+  worker *w = arg;
+  cmc_pipeline *pipeline = w->pipeline;
+  while (true) {
+    pipeline_job *job = cmc_spsc_queue_pop(w->in);
+    if (!job) {
+      if (atomic_load(&pipeline->stopping))
+        break;
+      atomic_store(&w->sleeping, true);
+      // a push between the pop and announcing the sleep would not wake us
+      atomic_thread_fence(memory_order_seq_cst);
+      job = cmc_spsc_queue_pop(w->in);
+      if (!job) {
+        sem_wait(&w->wake);
+        atomic_store(&w->sleeping, false);
+        continue;
+      }
+      atomic_store(&w->sleeping, false);
+    }
+    // only reads what a play connection doesn't change
+    decode_job(pipeline, job, job->pc->conn, &w->inflater, NULL, 0);
+    cmc_spsc_queue_push(w->out, job);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&pipeline->io_waiting, false))
+      sem_post(&pipeline->results);
+  }
+  return NULL;
+}
+
+static void wake(worker *w) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_exchange(&w->sleeping, false))
+    sem_post(&w->wake);
+}
+
+static bool results_pending(cmc_pipeline *pipeline) {
+  for (size_t i = 0; i < pipeline->worker_count; i++) {
+    if (!cmc_spsc_queue_empty(pipeline->workers[i].out))
+      return true;
+  }
+  return false;
+}
+
+// waits until a worker hands back a job or timeout_ms passed
+static void wait_results(cmc_pipeline *pipeline, int timeout_ms) {
+  atomic_store(&pipeline->io_waiting, true);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!results_pending(pipeline)) {
+    if (timeout_ms < 0) {
+      sem_wait(&pipeline->results);
+    } else {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += timeout_ms / 1000;
+      deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      sem_timedwait(&pipeline->results, &deadline);
+    }
+  }
+  atomic_store(&pipeline->io_waiting, false);
+}
+
+static void mark_ready(cmc_pipeline *pipeline, cmc_pipeline_conn *pc) {
+  if (pc->ready)
+    return;
+  list_add_tail(&pc->ready_entry, &pipeline->ready);
+  pc->ready = true;
+}
+
+// takes back what the workers decoded, returns the number of jobs
+static size_t collect(cmc_pipeline *pipeline) {
+  size_t count = 0;
+  for (size_t i = 0; i < pipeline->worker_count; i++) {
+    worker *w = &pipeline->workers[i];
+    pipeline_job *job;
+    while ((job = cmc_spsc_queue_pop(w->out))) {
+      job->done = true;
+      job->pc->inflight--;
+      pipeline->inflight--;
+      w->queued--;
+      mark_ready(pipeline, job->pc);
+      count++;
+    }
+  }
+  return count;
+}
+
+// hands job to the next worker with room, waiting for one if there is none
+static void submit(cmc_pipeline *pipeline, pipeline_job *job) {
+  while (true) {
+    for (size_t i = 0; i < pipeline->worker_count; i++) {
+      worker *w = &pipeline->workers[pipeline->next_worker];
+      pipeline->next_worker =
+          (pipeline->next_worker + 1) % pipeline->worker_count;
+      // out has as many slots as in, neither can overflow
+      if (w->queued == CMC_PIPELINE_QUEUE_LENGTH)
+        continue;
+      w->queued++;
+      job->pc->inflight++;
+      pipeline->inflight++;
+      cmc_spsc_queue_push(w->in, job);
+      wake(w);
+      return;
+    }
+    if (collect(pipeline) == 0)
+      wait_results(pipeline, -1);
+  }
+}
+
+static void free_job(cmc_pipeline *pipeline, pipeline_job *job) {
+  if (job->frame)
+    cmc_buff_free(job->frame);
+  if (job->packet)
+    cmc_buff_free(job->packet);
+  if (job->decoded) {
+    if (pipeline->callbacks.free_decoded)
+      pipeline->callbacks.free_decoded(job->decoded,
+                                       pipeline->callbacks.user_data);
+    else
+      free(job->decoded);
+  }
+  free(job);
+}
+
+// unlinks and frees pc, its jobs have to be back from the workers
+static void free_conn(cmc_pipeline *pipeline, cmc_pipeline_conn *pc) {
+  assert(pc->inflight == 0);
+  struct list_head *pos, *n;
+  list_for_each_safe(pos, n, &pc->jobs) {
+    free_job(pipeline, list_entry(pos, pipeline_job, entry));
+  }
+  if (pc->ready)
+    list_del(&pc->ready_entry);
+  list_del(&pc->entry);
+  pc->conn->pipeline_conn = NULL;
+  pipeline->conn_count--;
+  free(pc);
+}
+
+static void finish_close(cmc_pipeline *pipeline, cmc_pipeline_conn *pc) {
+  cmc_conn *conn = pc->conn;
+  free_conn(pipeline, pc);
+  if (pipeline->callbacks.on_close)
+    pipeline->callbacks.on_close(pipeline, conn);
+}
+
+/*
+Hands the decoded jobs at the front of the connection to on_packet. Returns
+whether there were any.
+*/
+static bool deliver_conn(cmc_pipeline *pipeline, cmc_pipeline_conn *pc) {
+  cmc_conn *conn = pc->conn;
+  bool delivered = false;
+  while (!list_empty(&pc->jobs)) {
+    pipeline_job *job = list_entry(pc->jobs.flink, pipeline_job, entry);
+    if (!job->done)
+      break;
+    list_del(&job->entry);
+    if (job->err.err != CMC_ERR_NO && !pc->failed) {
+      conn->err = job->err;
+      cmc_loop_remove(pipeline->loop, conn);
+      pc->closing = true;
+      pc->failed = true;
+    }
+    if (pc->failed) {
+      free_job(pipeline, job);
+      continue;
+    }
+
+    delivered = true;
+    cmc_buff *packet = job->packet;
+    void *decoded = job->decoded;
+    free(job);
+    if (pipeline->callbacks.on_packet) {
+      pipeline->callbacks.on_packet(pipeline, conn, packet, decoded);
+    } else {
+      cmc_buff_free(packet);
+      if (pipeline->callbacks.free_decoded)
+        pipeline->callbacks.free_decoded(decoded,
+                                         pipeline->callbacks.user_data);
+      else
+        free(decoded);
+    }
+    // the callback removed the connection or it was closed meanwhile
+    if (conn->pipeline_conn != pc)
+      return true;
+  }
+  if (pc->closing && list_empty(&pc->jobs))
+    finish_close(pipeline, pc);
+  return delivered;
+}
+
+// Returns the number of connections that had packets.
+static int deliver(cmc_pipeline *pipeline) {
+  collect(pipeline);
+  int count = 0;
+  while (!list_empty(&pipeline->ready)) {
+    cmc_pipeline_conn *pc =
+        list_entry(pipeline->ready.flink, cmc_pipeline_conn, ready_entry);
+    list_del(&pc->ready_entry);
+    pc->ready = false;
+    if (deliver_conn(pipeline, pc))
+      count++;
+  }
+  return count;
+}
+
+static cmc_pipeline *loop_pipeline(cmc_loop *loop) {
+  return cmc_loop_get_callbacks(loop)->user_data;
+}
+
+static void on_frame(cmc_loop *loop, cmc_conn *conn, cmc_buff *frame) {
+  cmc_pipeline *pipeline = loop_pipeline(loop);
+  cmc_pipeline_conn *pc = conn->pipeline_conn;
+  pipeline_job *job = malloc(sizeof(pipeline_job));
+  if (!job) {
+    cmc_buff_free(frame);
+    conn->err.err = CMC_ERR_MEM;
+    cmc_loop_close_conn(loop, conn);
+    return;
+  }
+  *job = (pipeline_job){.pc = pc, .state = conn->state, .frame = frame};
+  list_add_tail(&job->entry, &pc->jobs);
+
+  if (conn->state == CMC_CONN_STATE_PLAY && pipeline->worker_count > 0) {
+    submit(pipeline, job);
+    return;
+  }
+  // login changes compression and state, the next frame depends on this one
+  decode_job(pipeline, job, conn, &conn->inflater, conn->pool,
+             conn->rx.capacity);
+  job->done = true;
+  deliver_conn(pipeline, pc);
+}
+
+static void on_loop_close(cmc_loop *loop, cmc_conn *conn) {
+  cmc_pipeline *pipeline = loop_pipeline(loop);
+  cmc_pipeline_conn *pc = conn->pipeline_conn;
+  pc->closing = true;
+  // delivers what was received before, the connection is gone for new frames
+  mark_ready(pipeline, pc);
+}
+
+static void on_loop_connect(cmc_loop *loop, cmc_conn *conn) {
+  cmc_pipeline *pipeline = loop_pipeline(loop);
+  if (pipeline->callbacks.on_connect)
+    pipeline->callbacks.on_connect(pipeline, conn);
+}
+
+static void stop_workers(cmc_pipeline *pipeline) {
+  atomic_store(&pipeline->stopping, true);
+  for (size_t i = 0; i < pipeline->worker_count; i++) {
+    worker *w = &pipeline->workers[i];
+    if (w->started) {
+      sem_post(&w->wake);
+      pthread_join(w->thread, NULL);
+      if (w->inflater)
+        cmc_inflater_free(w->inflater);
+      sem_destroy(&w->wake);
+    }
+    cmc_spsc_queue_free(w->in);
+    cmc_spsc_queue_free(w->out);
+  }
+  free(pipeline->workers);
+  sem_destroy(&pipeline->results);
+}
+
+cmc_pipeline *cmc_pipeline_init(cmc_pipeline_callbacks callbacks,
+                                size_t workers, cmc_loop_backend backend) {
+  cmc_pipeline *pipeline = calloc(1, sizeof(cmc_pipeline));
+  if (!pipeline)
+    return NULL;
+  pipeline->callbacks = callbacks;
+  INIT_LIST_HEAD(&pipeline->conns);
+  INIT_LIST_HEAD(&pipeline->ready);
+  pipeline->loop = cmc_loop_init_with_backend(
+      (cmc_loop_callbacks){.on_packet = on_frame,
+                           .on_close = on_loop_close,
+                           .on_connect = on_loop_connect,
+                           .user_data = pipeline},
+      backend);
+  if (!pipeline->loop) {
+    free(pipeline);
+    return NULL;
+  }
+  pipeline->loop->raw_frames = true;
+  sem_init(&pipeline->results, 0, 0);
+
+  pipeline->workers = calloc(workers, sizeof(worker));
+  if (workers && !pipeline->workers)
+    goto on_error;
+  pipeline->worker_count = workers;
+  for (size_t i = 0; i < workers; i++) {
+    worker *w = &pipeline->workers[i];
+    w->pipeline = pipeline;
+    w->in = cmc_spsc_queue_init(CMC_PIPELINE_QUEUE_LENGTH);
+    w->out = cmc_spsc_queue_init(CMC_PIPELINE_QUEUE_LENGTH);
+    if (!w->in || !w->out)
+      goto on_error;
+    sem_init(&w->wake, 0, 0);
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+      sem_destroy(&w->wake);
+      goto on_error;
+    }
+    w->started = true;
+  }
+  return pipeline;
+
+on_error:
+  stop_workers(pipeline);
+  cmc_loop_free(pipeline->loop);
+  free(pipeline);
+  return NULL;
+}
+
+void cmc_pipeline_free(cmc_pipeline *pipeline) {
+  if (!pipeline)
+    return;
+  while (!list_empty(&pipeline->conns)) {
+    cmc_pipeline_remove(
+        pipeline,
+        list_entry(pipeline->conns.flink, cmc_pipeline_conn, entry)->conn);
+  }
+  stop_workers(pipeline);
+  cmc_loop_free(pipeline->loop);
+  free(pipeline);
+}
+
+cmc_pipeline_callbacks *cmc_pipeline_get_callbacks(cmc_pipeline *pipeline) {
+  return &pipeline->callbacks;
+}
+
+size_t cmc_pipeline_worker_count(const cmc_pipeline *pipeline) {
+  return pipeline->worker_count;
+}
+
+static cmc_pipeline_conn *register_conn(cmc_pipeline *pipeline,
+                                        cmc_conn *conn) {
+  assert(conn->pipeline_conn == NULL);
+  cmc_pipeline_conn *pc = CMC_ERRC_ABLE(
+      cmc_malloc(sizeof(cmc_pipeline_conn), &conn->err), return NULL;);
+  *pc = (cmc_pipeline_conn){.conn = conn};
+  INIT_LIST_HEAD(&pc->jobs);
+  list_add_tail(&pc->entry, &pipeline->conns);
+  conn->pipeline_conn = pc;
+  pipeline->conn_count++;
+  return pc;
+}
+
+cmc_err cmc_pipeline_add(cmc_pipeline *pipeline, cmc_conn *conn) {
+  cmc_pipeline_conn *pc = register_conn(pipeline, conn);
+  if (!pc)
+    return conn->err.err;
+  cmc_err err = cmc_loop_add(pipeline->loop, conn);
+  if (err)
+    free_conn(pipeline, pc);
+  return err;
+}
+
+cmc_err cmc_pipeline_connect(cmc_pipeline *pipeline, cmc_conn *conn,
+                             const struct sockaddr *addr, socklen_t addr_len) {
+  cmc_pipeline_conn *pc = register_conn(pipeline, conn);
+  if (!pc)
+    return conn->err.err;
+  cmc_err err = cmc_loop_connect(pipeline->loop, conn, addr, addr_len);
+  if (err)
+    free_conn(pipeline, pc);
+  return err;
+}
+
+void cmc_pipeline_remove(cmc_pipeline *pipeline, cmc_conn *conn) {
+  cmc_pipeline_conn *pc = conn->pipeline_conn;
+  if (!pc)
+    return;
+  cmc_loop_remove(pipeline->loop, conn);
+  // the workers still point at the connection
+  while (pc->inflight > 0) {
+    if (collect(pipeline) == 0)
+      wait_results(pipeline, -1);
+  }
+  free_conn(pipeline, pc);
+}
+
+size_t cmc_pipeline_conn_count(const cmc_pipeline *pipeline) {
+  return pipeline->conn_count;
+}
+
+int cmc_pipeline_run_once(cmc_pipeline *pipeline, int timeout_ms) {
+  int handled = deliver(pipeline);
+  int events = cmc_loop_run_once(
+      pipeline->loop, handled > 0 || pipeline->inflight > 0 ? 0 : timeout_ms);
+  if (events == -1)
+    return -1;
+  handled += events;
+  // what the workers finish is the next thing to do
+  if (handled == 0 && pipeline->inflight > 0)
+    wait_results(pipeline, timeout_ms);
+  return handled + deliver(pipeline);
+}
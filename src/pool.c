@@ -0,0 +1,120 @@
+#include <cmc/pool.h>
+
+#include <cmc/buff.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// smallest class that can hold capacity bytes
+static size_t size_class_ceil(size_t capacity) {
+  if (capacity <= CMC_BUFF_POOL_MIN_CLASS_SIZE)
+    return 0;
+  return 64 - __builtin_clzll(capacity - 1) - 6;
+}
+
+// largest class that fits into capacity bytes
+static size_t size_class_floor(size_t capacity) {
+  return 63 - __builtin_clzll(capacity) - 6;
+}
+
+static size_t size_class_size(size_t size_class) {
+  return (size_t)CMC_BUFF_POOL_MIN_CLASS_SIZE << size_class;
+}
+
+cmc_buff_pool *cmc_buff_pool_init(size_t max_per_class) {
+  cmc_buff_pool *pool = calloc(1, sizeof(cmc_buff_pool));
+  if (!pool)
+    return NULL;
+  pool->max_per_class = max_per_class;
+  if (max_per_class == 0)
+    return pool;
+  for (size_t i = 0; i < CMC_BUFF_POOL_SIZE_CLASSES; i++) {
+    pool->free_buffs[i] = malloc(max_per_class * sizeof(cmc_buff *));
+    if (!pool->free_buffs[i]) {
+      cmc_buff_pool_free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void cmc_buff_pool_free(cmc_buff_pool *pool) {
+  assert(pool);
+  for (size_t i = 0; i < CMC_BUFF_POOL_SIZE_CLASSES; i++) {
+    for (size_t j = 0; j < pool->free_count[i]; j++) {
+      pool->free_buffs[i][j]->pool = NULL;
+      cmc_buff_free(pool->free_buffs[i][j]);
+    }
+    free(pool->free_buffs[i]);
+  }
+  free(pool);
+}
+
+cmc_buff *cmc_buff_pool_acquire(cmc_buff_pool *pool,
+                                cmc_protocol_version protocol_version,
+                                size_t capacity) {
+  assert(pool);
+  if (capacity > CMC_BUFF_POOL_MAX_CLASS_SIZE) {
+    // too big to be cached, it gets dropped again on release
+    pool->stats.misses++;
+    cmc_buff *buff = cmc_buff_init_with_capacity(protocol_version, capacity);
+    if (buff)
+      buff->pool = pool;
+    return buff;
+  }
+
+  size_t size_class = size_class_ceil(capacity);
+  if (pool->free_count[size_class] > 0) {
+    pool->stats.hits++;
+    size_t i = --pool->free_count[size_class];
+    cmc_buff *buff = pool->free_buffs[size_class][i];
+    buff->protocol_version = protocol_version;
+    buff->arena = NULL;
+    return buff;
+  }
+
+  pool->stats.misses++;
+  cmc_buff *buff = cmc_buff_init_with_capacity(protocol_version,
+                                               size_class_size(size_class));
+  if (buff)
+    buff->pool = pool;
+  return buff;
+}
+
+void cmc_buff_pool_release(cmc_buff_pool *pool, cmc_buff *buff) {
+  assert(pool);
+  assert(buff);
+  assert(buff->pool == pool);
+  if (buff->capacity < CMC_BUFF_POOL_MIN_CLASS_SIZE ||
+      buff->capacity >= 2 * CMC_BUFF_POOL_MAX_CLASS_SIZE)
+    goto drop;
+
+  size_t size_class = size_class_floor(buff->capacity);
+  if (pool->free_count[size_class] >= pool->max_per_class)
+    goto drop;
+
+  buff->position = 0;
+  buff->length = 0;
+  buff->err = (cmc_err_extra){};
+  // the arena may be gone by the time the buffer is handed out again
+  buff->arena = NULL;
+  pool->free_buffs[size_class][pool->free_count[size_class]++] = buff;
+  pool->stats.releases++;
+  return;
+
+drop:
+  pool->stats.drops++;
+  buff->pool = NULL;
+  cmc_buff_free(buff);
+}
+
+void cmc_buff_pool_print_stats(const cmc_buff_pool *pool) {
+  uint64_t acquires = pool->stats.hits + pool->stats.misses;
+  printf("Hits      %llu\n", (unsigned long long)pool->stats.hits);
+  printf("Misses    %llu\n", (unsigned long long)pool->stats.misses);
+  printf("Hit rate  %.2f%%\n",
+         acquires ? 100.0 * pool->stats.hits / acquires : 0.0);
+  printf("Releases  %llu\n", (unsigned long long)pool->stats.releases);
+  printf("Drops     %llu\n", (unsigned long long)pool->stats.drops);
+}
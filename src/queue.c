@@ -0,0 +1,180 @@
+#include <cmc/queue.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+The indices only grow and are masked into the slots. Each side keeps a copy
+of the other sides index on its own line and only reloads it when the copy
+says the queue is full (or empty).
+*/
+struct cmc_spsc_queue {
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic size_t head; // next slot to pop
+  size_t cached_tail;
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic size_t tail; // next slot to push
+  size_t cached_head;
+  _Alignas(CMC_QUEUE_CACHE_LINE) size_t mask;
+  void **slots;
+};
+
+/*
+Dmitry Vyukov's bounded queue with a single consumer. A slot whose sequence
+equals the tail position is free, one past it holds a value.
+*/
+typedef struct {
+  _Atomic size_t sequence;
+  void *value;
+} mpsc_slot;
+
+struct cmc_mpsc_queue {
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic size_t tail; // claimed by producers
+  _Alignas(CMC_QUEUE_CACHE_LINE) size_t head;         // consumer only
+  _Alignas(CMC_QUEUE_CACHE_LINE) size_t mask;
+  mpsc_slot *slots;
+};
+
+static size_t round_capacity(size_t capacity) {
+  if (capacity < 2)
+    return 2;
+  return (size_t)1 << (64 - __builtin_clzll(capacity - 1));
+}
+
+// the padding only works if the queue itself starts on a line
+static void *alloc_queue(size_t size) {
+  void *queue = aligned_alloc(CMC_QUEUE_CACHE_LINE, size);
+  if (queue)
+    memset(queue, 0, size);
+  return queue;
+}
+
+cmc_spsc_queue *cmc_spsc_queue_init(size_t capacity) {
+  cmc_spsc_queue *queue = alloc_queue(sizeof(cmc_spsc_queue));
+  if (!queue)
+    return NULL;
+  capacity = round_capacity(capacity);
+  queue->slots = malloc(capacity * sizeof(void *));
+  if (!queue->slots) {
+    free(queue);
+    return NULL;
+  }
+  queue->mask = capacity - 1;
+  return queue;
+}
+
+void cmc_spsc_queue_free(cmc_spsc_queue *queue) {
+  if (!queue)
+    return;
+  free(queue->slots);
+  free(queue);
+}
+
+size_t cmc_spsc_queue_capacity(const cmc_spsc_queue *queue) {
+  return queue->mask + 1;
+}
+
+bool cmc_spsc_queue_push(cmc_spsc_queue *queue, void *value) {
+  assert(value);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail - queue->cached_head > queue->mask) {
+    queue->cached_head =
+        atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - queue->cached_head > queue->mask)
+      return false;
+  }
+  queue->slots[tail & queue->mask] = value;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+void *cmc_spsc_queue_pop(cmc_spsc_queue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head == queue->cached_tail) {
+    queue->cached_tail =
+        atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == queue->cached_tail)
+      return NULL;
+  }
+  void *value = queue->slots[head & queue->mask];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return value;
+}
+
+bool cmc_spsc_queue_empty(cmc_spsc_queue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head != queue->cached_tail)
+    return false;
+  queue->cached_tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  return head == queue->cached_tail;
+}
+
+cmc_mpsc_queue *cmc_mpsc_queue_init(size_t capacity) {
+  cmc_mpsc_queue *queue = alloc_queue(sizeof(cmc_mpsc_queue));
+  if (!queue)
+    return NULL;
+  capacity = round_capacity(capacity);
+  queue->slots = malloc(capacity * sizeof(mpsc_slot));
+  if (!queue->slots) {
+    free(queue);
+    return NULL;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&queue->slots[i].sequence, i);
+    queue->slots[i].value = NULL;
+  }
+  queue->mask = capacity - 1;
+  return queue;
+}
+
+void cmc_mpsc_queue_free(cmc_mpsc_queue *queue) {
+  if (!queue)
+    return;
+  free(queue->slots);
+  free(queue);
+}
+
+size_t cmc_mpsc_queue_capacity(const cmc_mpsc_queue *queue) {
+  return queue->mask + 1;
+}
+
+bool cmc_mpsc_queue_push(cmc_mpsc_queue *queue, void *value) {
+  assert(value);
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  mpsc_slot *slot;
+  while (true) {
+    slot = &queue->slots[tail & queue->mask];
+    size_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)tail;
+    if (diff == 0) {
+      // on failure tail is reloaded with what the winner left
+      if (atomic_compare_exchange_weak_explicit(&queue->tail, &tail, tail + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      // the consumer hasn't freed the slot from the last lap
+      return false;
+    } else {
+      tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    }
+  }
+  slot->value = value;
+  atomic_store_explicit(&slot->sequence, tail + 1, memory_order_release);
+  return true;
+}
+
+void *cmc_mpsc_queue_pop(cmc_mpsc_queue *queue) {
+  size_t head = queue->head;
+  mpsc_slot *slot = &queue->slots[head & queue->mask];
+  if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + 1)
+    return NULL;
+  void *value = slot->value;
+  // free for the producers one lap later
+  atomic_store_explicit(&slot->sequence, head + queue->mask + 1,
+                        memory_order_release);
+  queue->head = head + 1;
+  return value;
+}
@@ -0,0 +1,592 @@
+#include <cmc/scheduler.h>
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/heap_utils.h>
+#include <cmc/list.h>
+#include <cmc/loop.h>
+#include <cmc/queue.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "err_macros.h"
+#include "loop_internal.h"
+
+/*
+pending counts the packets in inbox and doubles as the scheduling state: the
+I/O thread that takes it from 0 to 1 hands the connection to a worker, the
+worker that takes it back to 0 lets go of it and doesn't touch it again.
+In between exactly one worker owns the connection.
+*/
+typedef struct cmc_scheduler_conn {
+  cmc_conn *conn;
+  struct list_head entry;  // in cmc_scheduler.conns or cmc_scheduler.closing
+  cmc_spsc_queue *inbox;   // I/O thread to the owning worker
+  _Atomic size_t pending;  // packets in inbox
+  _Atomic size_t worker;   // the worker that ran it last
+  _Atomic bool dropping;   // removed, queued packets are freed unhandled
+  bool closing;            // closed by the loop, in cmc_scheduler.closing
+  // received while inbox was full, I/O thread only
+  cmc_buff **held;
+  size_t held_start;
+  size_t held_count;
+  size_t held_capacity;
+} cmc_scheduler_conn;
+
+/*
+Chase-Lev work stealing deque of connections, in the C11 formulation of Le,
+Pop, Cohen and Zappa Nardelli. The owner pushes and takes at the bottom,
+thieves take from the top.
+*/
+typedef struct {
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic int64_t top;
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic int64_t bottom;
+  _Alignas(CMC_QUEUE_CACHE_LINE) _Atomic(cmc_scheduler_conn *) *slots;
+} deque;
+
+static_assert((CMC_SCHEDULER_DEQUE_LENGTH & (CMC_SCHEDULER_DEQUE_LENGTH - 1)) ==
+                  0,
+              "CMC_SCHEDULER_DEQUE_LENGTH has to be a power of two");
+#define DEQUE_MASK (CMC_SCHEDULER_DEQUE_LENGTH - 1)
+
+static bool deque_push(deque *d, cmc_scheduler_conn *sc) {
+  int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+  if (bottom - top >= CMC_SCHEDULER_DEQUE_LENGTH)
+    return false;
+  atomic_store_explicit(&d->slots[bottom & DEQUE_MASK], sc,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+  return true;
+}
+
+static cmc_scheduler_conn *deque_take(deque *d) {
+  int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t top = atomic_load_explicit(&d->top, memory_order_relaxed);
+  if (top > bottom) {
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+    return NULL;
+  }
+  cmc_scheduler_conn *sc = atomic_load_explicit(
+      &d->slots[bottom & DEQUE_MASK], memory_order_relaxed);
+  if (top == bottom) {
+    // the last one, a thief may be after it as well
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed))
+      sc = NULL;
+    atomic_store_explicit(&d->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return sc;
+}
+
+// null if the deque is empty or another thief won
+static cmc_scheduler_conn *deque_steal(deque *d) {
+  int64_t top = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t bottom = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (top >= bottom)
+    return NULL;
+  cmc_scheduler_conn *sc =
+      atomic_load_explicit(&d->slots[top & DEQUE_MASK], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+                                               memory_order_seq_cst,
+                                               memory_order_relaxed))
+    return NULL;
+  return sc;
+}
+
+static int64_t deque_size(deque *d) {
+  return atomic_load_explicit(&d->bottom, memory_order_relaxed) -
+         atomic_load_explicit(&d->top, memory_order_relaxed);
+}
+
+typedef struct {
+  deque deque;
+  cmc_mpsc_queue *inject; // connections handed to this worker
+  cmc_scheduler *scheduler;
+  size_t index;
+  pthread_t thread;
+  bool started;
+  sem_t wake;
+  _Atomic bool sleeping;
+  uint32_t random; // picks the first victim to steal from
+  _Atomic uint64_t handled;
+  _Atomic uint64_t steals;
+} worker;
+
+struct cmc_scheduler {
+  cmc_loop *loop;
+  cmc_scheduler_callbacks callbacks;
+  worker *workers;
+  size_t worker_count;
+  _Atomic bool stopping;
+  // connections in closing, workers wake the loop when one goes idle
+  _Atomic size_t closing_count;
+  size_t conn_count;
+  size_t held_count; // connections with held packets
+  uint64_t inline_handled;
+  struct list_head conns;
+  struct list_head closing; // closed by the loop, waiting for the workers
+};
+
+static void wake(worker *w) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_exchange(&w->sleeping, false))
+    sem_post(&w->wake);
+}
+
+// wakes one sleeping worker, so it can steal
+static bool wake_idle(cmc_scheduler *scheduler) {
+  for (size_t i = 0; i < scheduler->worker_count; i++) {
+    worker *w = &scheduler->workers[i];
+    if (atomic_load_explicit(&w->sleeping, memory_order_relaxed) &&
+        atomic_exchange(&w->sleeping, false)) {
+      sem_post(&w->wake);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+Hands the connection to the worker that ran it last if that one is waiting
+for work or nobody is, else to a sleeping worker.
+*/
+static void schedule(cmc_scheduler *scheduler, cmc_scheduler_conn *sc) {
+  size_t count = scheduler->worker_count;
+  size_t target = atomic_load_explicit(&sc->worker, memory_order_relaxed);
+  if (!atomic_load(&scheduler->workers[target].sleeping)) {
+    for (size_t i = 1; i < count; i++) {
+      size_t other = (target + i) % count;
+      if (atomic_load(&scheduler->workers[other].sleeping)) {
+        target = other;
+        break;
+      }
+    }
+  }
+  for (size_t i = 0;; i++) {
+    worker *w = &scheduler->workers[(target + i) % count];
+    if (cmc_mpsc_queue_push(w->inject, sc)) {
+      wake(w);
+      return;
+    }
+    // every worker is this far behind, give them time
+    if (i % count == count - 1)
+      sched_yield();
+  }
+}
+
+// Queues packet on its connection, false if the inbox is full.
+static bool enqueue(cmc_scheduler *scheduler, cmc_scheduler_conn *sc,
+                    cmc_buff *packet) {
+  if (!cmc_spsc_queue_push(sc->inbox, packet))
+    return false;
+  if (atomic_fetch_add(&sc->pending, 1) == 0)
+    schedule(scheduler, sc);
+  return true;
+}
+
+static bool hold(cmc_scheduler *scheduler, cmc_scheduler_conn *sc,
+                 cmc_buff *packet) {
+  if (sc->held_start + sc->held_count == sc->held_capacity) {
+    if (sc->held_start > 0) {
+      memmove(sc->held, sc->held + sc->held_start,
+              sc->held_count * sizeof(cmc_buff *));
+      sc->held_start = 0;
+    } else {
+      size_t capacity = sc->held_capacity ? sc->held_capacity * 2 : 64;
+      cmc_buff **held = realloc(sc->held, capacity * sizeof(cmc_buff *));
+      if (!held)
+        return false;
+      sc->held = held;
+      sc->held_capacity = capacity;
+    }
+  }
+  if (sc->held_count == 0)
+    scheduler->held_count++;
+  sc->held[sc->held_start + sc->held_count++] = packet;
+  return true;
+}
+
+// moves held packets into the inbox as far as there is room
+static void release_held(cmc_scheduler *scheduler, cmc_scheduler_conn *sc) {
+  while (sc->held_count > 0 &&
+         enqueue(scheduler, sc, sc->held[sc->held_start])) {
+    sc->held_start++;
+    sc->held_count--;
+  }
+  if (sc->held_count == 0) {
+    sc->held_start = 0;
+    scheduler->held_count--;
+  }
+}
+
+static void free_held(cmc_scheduler *scheduler, cmc_scheduler_conn *sc) {
+  for (size_t i = 0; i < sc->held_count; i++)
+    cmc_buff_free(sc->held[sc->held_start + i]);
+  if (sc->held_count > 0)
+    scheduler->held_count--;
+  free(sc->held);
+  sc->held = NULL;
+  sc->held_count = 0;
+}
+
+// Handles up to CMC_SCHEDULER_BATCH packets, then lets go of the connection.
+static void run_conn(cmc_scheduler *scheduler, worker *w,
+                     cmc_scheduler_conn *sc) {
+  atomic_store_explicit(&sc->worker, w->index, memory_order_relaxed);
+  for (int i = 0; i < CMC_SCHEDULER_BATCH; i++) {
+    cmc_buff *packet = cmc_spsc_queue_pop(sc->inbox);
+    assert(packet); // pending was raised after the push
+    if (atomic_load_explicit(&sc->dropping, memory_order_relaxed))
+      cmc_buff_free(packet);
+    else
+      scheduler->callbacks.on_packet(scheduler, sc->conn, packet);
+    atomic_fetch_add_explicit(&w->handled, 1, memory_order_relaxed);
+    if (atomic_fetch_sub(&sc->pending, 1) == 1) {
+      // sc belongs to the I/O thread again
+      if (atomic_load(&scheduler->closing_count) > 0)
+        cmc_loop_wake(scheduler->loop);
+      return;
+    }
+  }
+  // the rest waits behind what the worker has queued already
+  if (!cmc_mpsc_queue_push(w->inject, sc) && !deque_push(&w->deque, sc))
+    run_conn(scheduler, w, sc);
+}
+
+static uint32_t next_random(worker *w) {
+  // xorshift32
+  w->random ^= w->random << 13;
+  w->random ^= w->random >> 17;
+  w->random ^= w->random << 5;
+  return w->random;
+}
+
+static cmc_scheduler_conn *steal(cmc_scheduler *scheduler, worker *w) {
+  size_t count = scheduler->worker_count;
+  size_t first = next_random(w) % count;
+  for (size_t i = 0; i < count; i++) {
+    worker *victim = &scheduler->workers[(first + i) % count];
+    if (victim == w)
+      continue;
+    cmc_scheduler_conn *sc = deque_steal(&victim->deque);
+    if (sc) {
+      atomic_fetch_add_explicit(&w->steals, 1, memory_order_relaxed);
+      return sc;
+    }
+  }
+  return NULL;
+}
+
+static cmc_scheduler_conn *next_conn(cmc_scheduler *scheduler, worker *w) {
+  cmc_scheduler_conn *sc = deque_take(&w->deque);
+  if (sc)
+    return sc;
+  // newly handed out connections go through the deque, so they can be stolen
+  while (deque_size(&w->deque) < CMC_SCHEDULER_DEQUE_LENGTH &&
+         (sc = cmc_mpsc_queue_pop(w->inject)))
+    deque_push(&w->deque, sc);
+  if (deque_size(&w->deque) > 1)
+    wake_idle(scheduler);
+  sc = deque_take(&w->deque);
+  if (sc)
+    return sc;
+  return steal(scheduler, w);
+}
+
+static void *worker_main(void *arg) {
+  worker *w = arg;
+  cmc_scheduler *scheduler = w->scheduler;
+  while (!atomic_load(&scheduler->stopping)) {
+    cmc_scheduler_conn *sc = next_conn(scheduler, w);
+    if (!sc) {
+      atomic_store(&w->sleeping, true);
+      // work handed out between the look and announcing the sleep
+      atomic_thread_fence(memory_order_seq_cst);
+      sc = cmc_mpsc_queue_pop(w->inject);
+      if (!sc)
+        sc = steal(scheduler, w);
+      if (!sc) {
+        sem_wait(&w->wake);
+        atomic_store(&w->sleeping, false);
+        continue;
+      }
+      atomic_store(&w->sleeping, false);
+    }
+    run_conn(scheduler, w, sc);
+  }
+  return NULL;
+}
+
+static cmc_scheduler *loop_scheduler(cmc_loop *loop) {
+  return cmc_loop_get_callbacks(loop)->user_data;
+}
+
+static void on_loop_packet(cmc_loop *loop, cmc_conn *conn, cmc_buff *packet) {
+  cmc_scheduler *scheduler = loop_scheduler(loop);
+  cmc_scheduler_conn *sc = conn->scheduler_conn;
+  // the state is only read while no worker owns the connection
+  if (scheduler->worker_count == 0 ||
+      (sc->held_count == 0 && atomic_load(&sc->pending) == 0 &&
+       conn->state != CMC_CONN_STATE_PLAY)) {
+    scheduler->inline_handled++;
+    scheduler->callbacks.on_packet(scheduler, conn, packet);
+    return;
+  }
+  if (sc->held_count == 0 && enqueue(scheduler, sc, packet))
+    return;
+  if (!hold(scheduler, sc, packet)) {
+    cmc_buff_free(packet);
+    conn->err.err = CMC_ERR_MEM;
+    cmc_loop_close_conn(loop, conn);
+  }
+}
+
+static void on_loop_close(cmc_loop *loop, cmc_conn *conn) {
+  cmc_scheduler *scheduler = loop_scheduler(loop);
+  cmc_scheduler_conn *sc = conn->scheduler_conn;
+  list_del(&sc->entry);
+  list_add_tail(&sc->entry, &scheduler->closing);
+  sc->closing = true;
+  atomic_fetch_add(&scheduler->closing_count, 1);
+}
+
+static void on_loop_connect(cmc_loop *loop, cmc_conn *conn) {
+  cmc_scheduler *scheduler = loop_scheduler(loop);
+  if (scheduler->callbacks.on_connect)
+    scheduler->callbacks.on_connect(scheduler, conn);
+}
+
+static void free_conn(cmc_scheduler *scheduler, cmc_scheduler_conn *sc) {
+  assert(atomic_load(&sc->pending) == 0);
+  free_held(scheduler, sc);
+  list_del(&sc->entry);
+  cmc_spsc_queue_free(sc->inbox);
+  sc->conn->scheduler_conn = NULL;
+  scheduler->conn_count--;
+  free(sc);
+}
+
+// calls on_close for the closed connections the workers are done with
+static void finish_closing(cmc_scheduler *scheduler) {
+  struct list_head *pos, *n;
+  list_for_each_safe(pos, n, &scheduler->closing) {
+    cmc_scheduler_conn *sc = list_entry(pos, cmc_scheduler_conn, entry);
+    if (sc->held_count > 0)
+      release_held(scheduler, sc);
+    if (sc->held_count > 0 || atomic_load(&sc->pending) > 0)
+      continue;
+    cmc_conn *conn = sc->conn;
+    atomic_fetch_sub(&scheduler->closing_count, 1);
+    free_conn(scheduler, sc);
+    if (scheduler->callbacks.on_close)
+      scheduler->callbacks.on_close(scheduler, conn);
+  }
+}
+
+static void release_all_held(cmc_scheduler *scheduler) {
+  if (scheduler->held_count == 0)
+    return;
+  struct list_head *pos;
+  list_for_each(pos, &scheduler->conns) {
+    cmc_scheduler_conn *sc = list_entry(pos, cmc_scheduler_conn, entry);
+    if (sc->held_count > 0)
+      release_held(scheduler, sc);
+  }
+}
+
+static void stop_workers(cmc_scheduler *scheduler) {
+  atomic_store(&scheduler->stopping, true);
+  for (size_t i = 0; i < scheduler->worker_count; i++) {
+    worker *w = &scheduler->workers[i];
+    if (w->started) {
+      sem_post(&w->wake);
+      pthread_join(w->thread, NULL);
+      sem_destroy(&w->wake);
+    }
+    cmc_mpsc_queue_free(w->inject);
+    free(w->deque.slots);
+  }
+  free(scheduler->workers);
+}
+
+cmc_scheduler *cmc_scheduler_init(cmc_scheduler_callbacks callbacks,
+                                  size_t workers, cmc_loop_backend backend) {
+  cmc_scheduler *scheduler = calloc(1, sizeof(cmc_scheduler));
+  if (!scheduler)
+    return NULL;
+  scheduler->callbacks = callbacks;
+  INIT_LIST_HEAD(&scheduler->conns);
+  INIT_LIST_HEAD(&scheduler->closing);
+  scheduler->loop = cmc_loop_init_with_backend(
+      (cmc_loop_callbacks){.on_packet = on_loop_packet,
+                           .on_close = on_loop_close,
+                           .on_connect = on_loop_connect,
+                           .user_data = scheduler},
+      backend);
+  if (!scheduler->loop) {
+    free(scheduler);
+    return NULL;
+  }
+
+  // the deques are cache line aligned, calloc doesn't promise that
+  if (workers > 0) {
+    scheduler->workers =
+        aligned_alloc(_Alignof(worker), workers * sizeof(worker));
+    if (!scheduler->workers)
+      goto on_error;
+    memset(scheduler->workers, 0, workers * sizeof(worker));
+  }
+  scheduler->worker_count = workers;
+  for (size_t i = 0; i < workers; i++) {
+    worker *w = &scheduler->workers[i];
+    w->scheduler = scheduler;
+    w->index = i;
+    w->random = 2654435761u * (i + 1);
+    w->inject = cmc_mpsc_queue_init(CMC_SCHEDULER_WORKER_QUEUE_LENGTH);
+    w->deque.slots = calloc(CMC_SCHEDULER_DEQUE_LENGTH,
+                            sizeof(_Atomic(cmc_scheduler_conn *)));
+    if (!w->inject || !w->deque.slots)
+      goto on_error;
+    sem_init(&w->wake, 0, 0);
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+      sem_destroy(&w->wake);
+      goto on_error;
+    }
+    w->started = true;
+  }
+  return scheduler;
+
+on_error:
+  stop_workers(scheduler);
+  cmc_loop_free(scheduler->loop);
+  free(scheduler);
+  return NULL;
+}
+
+void cmc_scheduler_free(cmc_scheduler *scheduler) {
+  if (!scheduler)
+    return;
+  while (!list_empty(&scheduler->conns)) {
+    cmc_scheduler_remove(
+        scheduler,
+        list_entry(scheduler->conns.flink, cmc_scheduler_conn, entry)->conn);
+  }
+  while (!list_empty(&scheduler->closing)) {
+    cmc_scheduler_remove(
+        scheduler,
+        list_entry(scheduler->closing.flink, cmc_scheduler_conn, entry)->conn);
+  }
+  stop_workers(scheduler);
+  cmc_loop_free(scheduler->loop);
+  free(scheduler);
+}
+
+cmc_scheduler_callbacks *cmc_scheduler_get_callbacks(cmc_scheduler *scheduler) {
+  return &scheduler->callbacks;
+}
+
+size_t cmc_scheduler_worker_count(const cmc_scheduler *scheduler) {
+  return scheduler->worker_count;
+}
+
+cmc_scheduler_stats cmc_scheduler_get_stats(const cmc_scheduler *scheduler) {
+  cmc_scheduler_stats stats = {.inline_handled = scheduler->inline_handled};
+  for (size_t i = 0; i < scheduler->worker_count; i++) {
+    worker *w = &scheduler->workers[i];
+    stats.handled += atomic_load_explicit(&w->handled, memory_order_relaxed);
+    stats.steals += atomic_load_explicit(&w->steals, memory_order_relaxed);
+  }
+  return stats;
+}
+
+static cmc_scheduler_conn *register_conn(cmc_scheduler *scheduler,
+                                         cmc_conn *conn) {
+  assert(conn->scheduler_conn == NULL);
+  if (!conn->send_queue &&
+      cmc_conn_enable_send_queue(conn, CMC_SCHEDULER_SEND_QUEUE_LENGTH))
+    return NULL;
+  cmc_scheduler_conn *sc = CMC_ERRC_ABLE(
+      cmc_malloc(sizeof(cmc_scheduler_conn), &conn->err), return NULL;);
+  *sc = (cmc_scheduler_conn){.conn = conn};
+  sc->inbox = cmc_spsc_queue_init(CMC_SCHEDULER_CONN_QUEUE_LENGTH);
+  if (!sc->inbox) {
+    free(sc);
+    CMC_ERRC_IF(true, CMC_ERR_MEM, return NULL;);
+  }
+  // packets are freed on another thread than the one that made them
+  conn->pool = NULL;
+  // spreads the connections over the workers until they move around
+  if (scheduler->worker_count > 0)
+    atomic_init(&sc->worker, scheduler->conn_count % scheduler->worker_count);
+  list_add_tail(&sc->entry, &scheduler->conns);
+  conn->scheduler_conn = sc;
+  scheduler->conn_count++;
+  return sc;
+}
+
+cmc_err cmc_scheduler_add(cmc_scheduler *scheduler, cmc_conn *conn) {
+  cmc_scheduler_conn *sc = register_conn(scheduler, conn);
+  if (!sc)
+    return conn->err.err;
+  cmc_err err = cmc_loop_add(scheduler->loop, conn);
+  if (err)
+    free_conn(scheduler, sc);
+  return err;
+}
+
+cmc_err cmc_scheduler_connect(cmc_scheduler *scheduler, cmc_conn *conn,
+                              const struct sockaddr *addr,
+                              socklen_t addr_len) {
+  cmc_scheduler_conn *sc = register_conn(scheduler, conn);
+  if (!sc)
+    return conn->err.err;
+  cmc_err err = cmc_loop_connect(scheduler->loop, conn, addr, addr_len);
+  if (err)
+    free_conn(scheduler, sc);
+  return err;
+}
+
+void cmc_scheduler_remove(cmc_scheduler *scheduler, cmc_conn *conn) {
+  cmc_scheduler_conn *sc = conn->scheduler_conn;
+  if (!sc)
+    return;
+  cmc_loop_remove(scheduler->loop, conn);
+  atomic_store(&sc->dropping, true);
+  // the owning worker frees the rest of the inbox
+  while (atomic_load(&sc->pending) > 0)
+    sched_yield();
+  if (sc->closing)
+    atomic_fetch_sub(&scheduler->closing_count, 1);
+  free_conn(scheduler, sc);
+}
+
+size_t cmc_scheduler_conn_count(const cmc_scheduler *scheduler) {
+  return scheduler->conn_count;
+}
+
+int cmc_scheduler_run_once(cmc_scheduler *scheduler, int timeout_ms) {
+  release_all_held(scheduler);
+  finish_closing(scheduler);
+  // held packets are retried soon, workers don't say when there is room
+  if (scheduler->held_count > 0 && (timeout_ms < 0 || timeout_ms > 1))
+    timeout_ms = 1;
+  int events = cmc_loop_run_once(scheduler->loop, timeout_ms);
+  release_all_held(scheduler);
+  finish_closing(scheduler);
+  return events;
+}
@@ -0,0 +1,185 @@
+#include <cmc/timer.h>
+
+#include <cmc/list.h>
+
+#include <time.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SLOT_MASK (CMC_TIMER_WHEEL_SLOTS - 1)
+
+static_assert(CMC_TIMER_WHEEL_SLOTS == 64,
+              "the bitmaps of the levels are one uint64_t each");
+
+struct cmc_timer_wheel {
+  uint64_t now;    // every timer due at or before now has fired
+  uint64_t target; // what cmc_timer_wheel_advance is advancing to
+  size_t count;
+  uint64_t occupied[CMC_TIMER_WHEEL_LEVELS]; // bit n set if slot n isn't empty
+  struct list_head slots[CMC_TIMER_WHEEL_LEVELS * CMC_TIMER_WHEEL_SLOTS];
+};
+
+static unsigned level_shift(int level) {
+  return level * CMC_TIMER_WHEEL_SLOT_BITS;
+}
+
+cmc_timer_wheel *cmc_timer_wheel_init(uint64_t now_ms) {
+  cmc_timer_wheel *wheel = malloc(sizeof(cmc_timer_wheel));
+  if (!wheel)
+    return NULL;
+  *wheel = (cmc_timer_wheel){.now = now_ms, .target = now_ms};
+  for (size_t i = 0; i < CMC_TIMER_WHEEL_LEVELS * CMC_TIMER_WHEEL_SLOTS; i++)
+    INIT_LIST_HEAD(&wheel->slots[i]);
+  return wheel;
+}
+
+void cmc_timer_wheel_free(cmc_timer_wheel *wheel) { free(wheel); }
+
+uint64_t cmc_timer_wheel_now(const cmc_timer_wheel *wheel) {
+  return wheel->now;
+}
+
+size_t cmc_timer_wheel_count(const cmc_timer_wheel *wheel) {
+  return wheel->count;
+}
+
+/*
+A timer on level n is due in at least 64^n ms and at most 64^(n+1) ms, its
+slot is the one that is moved down when the level below wraps around just
+before it is due.
+*/
+static void place(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  uint64_t delta = timer->expires_ms - wheel->now;
+  // only a periodic timer the wheel was advanced years past gets here
+  if (delta > CMC_TIMER_MAX_DELAY_MS) {
+    delta = CMC_TIMER_MAX_DELAY_MS;
+    timer->expires_ms = wheel->now + delta;
+  }
+  int level = delta < CMC_TIMER_WHEEL_SLOTS
+                  ? 0
+                  : (63 - __builtin_clzll(delta)) / CMC_TIMER_WHEEL_SLOT_BITS;
+  assert(level < CMC_TIMER_WHEEL_LEVELS);
+  int slot = (timer->expires_ms >> level_shift(level)) & SLOT_MASK;
+  timer->slot = level * CMC_TIMER_WHEEL_SLOTS + slot;
+  list_add_tail(&timer->entry, &wheel->slots[timer->slot]);
+  wheel->occupied[level] |= UINT64_C(1) << slot;
+}
+
+static void unlink_timer(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  list_del(&timer->entry);
+  if (list_empty(&wheel->slots[timer->slot]))
+    wheel->occupied[timer->slot / CMC_TIMER_WHEEL_SLOTS] &=
+        ~(UINT64_C(1) << (timer->slot & SLOT_MASK));
+}
+
+static uint64_t rotate_right(uint64_t bits, unsigned n) {
+  n &= 63;
+  return n ? bits >> n | bits << (64 - n) : bits;
+}
+
+uint64_t cmc_timer_wheel_next_expiry(const cmc_timer_wheel *wheel) {
+  uint64_t next = UINT64_MAX;
+  for (int level = 0; level < CMC_TIMER_WHEEL_LEVELS; level++) {
+    if (!wheel->occupied[level])
+      continue;
+    // the slots in the order the wheel gets to them, starting after now
+    uint64_t index = wheel->now >> level_shift(level);
+    uint64_t ahead = rotate_right(wheel->occupied[level], index + 1);
+    uint64_t when = (index + __builtin_ctzll(ahead) + 1) << level_shift(level);
+    if (when < next)
+      next = when;
+  }
+  return next;
+}
+
+// moves the timers of a higher level slot down to where they belong now
+static void cascade(cmc_timer_wheel *wheel, int level) {
+  int slot = (wheel->now >> level_shift(level)) & SLOT_MASK;
+  struct list_head *head =
+      &wheel->slots[level * CMC_TIMER_WHEEL_SLOTS + slot];
+  wheel->occupied[level] &= ~(UINT64_C(1) << slot);
+  while (!list_empty(head)) {
+    cmc_timer *timer = list_entry(head->flink, cmc_timer, entry);
+    list_del(&timer->entry);
+    place(wheel, timer);
+  }
+}
+
+static void fire(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  unlink_timer(wheel, timer);
+  if (timer->interval_ms) {
+    uint64_t missed = 0;
+    if (wheel->target > timer->expires_ms)
+      missed = (wheel->target - timer->expires_ms) / timer->interval_ms;
+    timer->expires_ms += (missed + 1) * timer->interval_ms;
+    place(wheel, timer);
+  } else {
+    wheel->count--;
+  }
+  timer->callback(wheel, timer);
+}
+
+size_t cmc_timer_wheel_advance(cmc_timer_wheel *wheel, uint64_t now_ms) {
+  if (now_ms <= wheel->now)
+    return 0;
+  wheel->target = now_ms;
+  size_t fired = 0;
+  while (true) {
+    uint64_t next = cmc_timer_wheel_next_expiry(wheel);
+    if (next > now_ms)
+      break;
+    wheel->now = next;
+    for (int level = CMC_TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+      if ((next & ((UINT64_C(1) << level_shift(level)) - 1)) == 0)
+        cascade(wheel, level);
+    // callbacks arm timers at least 1 ms ahead, never into this slot
+    struct list_head *head = &wheel->slots[next & SLOT_MASK];
+    while (!list_empty(head)) {
+      fire(wheel, list_entry(head->flink, cmc_timer, entry));
+      fired++;
+    }
+  }
+  wheel->now = now_ms;
+  return fired;
+}
+
+uint64_t cmc_timer_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void cmc_timer_init(cmc_timer *timer, cmc_timer_callback callback,
+                    void *user_data) {
+  *timer = (cmc_timer){.callback = callback, .user_data = user_data};
+}
+
+void cmc_timer_arm(cmc_timer_wheel *wheel, cmc_timer *timer, uint64_t delay_ms,
+                   uint64_t interval_ms) {
+  if (cmc_timer_armed(timer))
+    unlink_timer(wheel, timer);
+  else
+    wheel->count++;
+  if (delay_ms == 0)
+    delay_ms = 1;
+  if (delay_ms > CMC_TIMER_MAX_DELAY_MS)
+    delay_ms = CMC_TIMER_MAX_DELAY_MS;
+  timer->expires_ms = wheel->now + delay_ms;
+  timer->interval_ms = interval_ms < CMC_TIMER_MAX_DELAY_MS
+                           ? interval_ms
+                           : CMC_TIMER_MAX_DELAY_MS;
+  place(wheel, timer);
+}
+
+void cmc_timer_cancel(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  if (!cmc_timer_armed(timer))
+    return;
+  unlink_timer(wheel, timer);
+  wheel->count--;
+}
+
+bool cmc_timer_armed(const cmc_timer *timer) {
+  return timer->entry.flink != NULL;
+}
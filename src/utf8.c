@@ -0,0 +1,254 @@
+#include "utf8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_X86
+#include <immintrin.h>
+#endif
+
+/*
+Decodes the sequence starting at str[i], returns its length or 0 if it is
+malformed or cut off by the end of the string.
+*/
+static size_t scalar_sequence(const uint8_t *str, size_t i, size_t n) {
+  uint8_t b = str[i];
+  if (b < 0x80)
+    return 1;
+
+  size_t len;
+  uint8_t min = 0x80, max = 0xBF; // allowed range of the second byte
+  if (b < 0xC2) {
+    return 0; // continuation byte or overlong two byte form
+  } else if (b < 0xE0) {
+    len = 2;
+  } else if (b < 0xF0) {
+    len = 3;
+    if (b == 0xE0)
+      min = 0xA0; // overlong
+    else if (b == 0xED)
+      max = 0x9F; // surrogates
+  } else if (b < 0xF5) {
+    len = 4;
+    if (b == 0xF0)
+      min = 0x90; // overlong
+    else if (b == 0xF4)
+      max = 0x8F; // above U+10FFFF
+  } else {
+    return 0;
+  }
+
+  if (n - i < len)
+    return 0;
+  if (str[i + 1] < min || str[i + 1] > max)
+    return 0;
+  for (size_t j = 2; j < len; j++)
+    if ((str[i + j] & 0xC0) != 0x80)
+      return 0;
+  return len;
+}
+
+static bool scalar_count(const uint8_t *str, size_t n, size_t *code_points) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; count++) {
+    size_t len = scalar_sequence(str, i, n);
+    if (len == 0)
+      return false;
+    i += len;
+  }
+  *code_points = count;
+  return true;
+}
+
+#ifdef UTF8_X86
+
+/*
+Skips 16 byte ascii blocks with SSE2 and decodes everything else one sequence
+at a time.
+*/
+__attribute__((target("sse2"))) static bool
+sse2_count(const uint8_t *str, size_t n, size_t *code_points) {
+  size_t count = 0;
+  size_t i = 0;
+  while (i < n) {
+    if (n - i >= 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+      if (_mm_movemask_epi8(block) == 0) {
+        count += 16;
+        i += 16;
+        continue;
+      }
+    }
+    // decode sequences until the next block boundary is passed
+    size_t end = n - i >= 16 ? i + 16 : n;
+    while (i < end) {
+      size_t len = scalar_sequence(str, i, n);
+      if (len == 0)
+        return false;
+      i += len;
+      count++;
+    }
+  }
+  *code_points = count;
+  return true;
+}
+
+/*
+The lookup table validator from Keiser and Lemire, "Validating UTF-8 In Less
+Than One Instruction Per Byte". Every byte pair is classified by three table
+lookups whose results only overlap for invalid pairs, and 3 and 4 byte
+sequences are checked by where continuation bytes have to be.
+*/
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTS (-128) // 1 << 7 as int8_t
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// the bytes of input shifted back by n, with the end of prev in front
+__attribute__((target("avx2"))) static inline __m256i
+avx2_prev(__m256i input, __m256i prev, int n) {
+  __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+  switch (n) {
+  case 1:
+    return _mm256_alignr_epi8(input, shifted, 15);
+  case 2:
+    return _mm256_alignr_epi8(input, shifted, 14);
+  default:
+    return _mm256_alignr_epi8(input, shifted, 13);
+  }
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_high_nibbles(__m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+avx2_check_block(__m256i input, __m256i prev_input) {
+  const __m256i byte_1_high_table = TABLE(
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m256i byte_1_low_table =
+      TABLE(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2,
+            CARRY, CARRY, CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m256i byte_2_high_table = TABLE(
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+          OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+  __m256i prev1 = avx2_prev(input, prev_input, 1);
+  __m256i byte_1_high =
+      _mm256_shuffle_epi8(byte_1_high_table, avx2_high_nibbles(prev1));
+  __m256i byte_1_low = _mm256_shuffle_epi8(
+      byte_1_low_table, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+  __m256i byte_2_high =
+      _mm256_shuffle_epi8(byte_2_high_table, avx2_high_nibbles(input));
+  __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low),
+                                     byte_2_high);
+
+  // only leads of 3 and 4 byte sequences survive the saturating subtraction
+  __m256i is_third_byte = _mm256_subs_epu8(avx2_prev(input, prev_input, 2),
+                                           _mm256_set1_epi8(0xE0 - 0x80));
+  __m256i is_fourth_byte = _mm256_subs_epu8(avx2_prev(input, prev_input, 3),
+                                            _mm256_set1_epi8(0xF0 - 0x80));
+  __m256i must_be_cont =
+      _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte),
+                       _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must_be_cont, special);
+}
+
+// nonzero if the block ends in the middle of a sequence
+__attribute__((target("avx2"))) static inline __m256i
+avx2_incomplete(__m256i input) {
+  const __m256i max = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1),
+      (char)(0xE0 - 1), (char)(0xC0 - 1));
+  return _mm256_subs_epu8(input, max);
+}
+
+// continuation bytes are the only ones below -64 as int8_t
+__attribute__((target("avx2,popcnt"))) static inline size_t
+avx2_leads(__m256i input, uint32_t lanes) {
+  __m256i leads = _mm256_cmpgt_epi8(input, _mm256_set1_epi8(-65));
+  return __builtin_popcount((uint32_t)_mm256_movemask_epi8(leads) & lanes);
+}
+
+__attribute__((target("avx2,popcnt"))) static bool
+avx2_count(const uint8_t *str, size_t n, size_t *code_points) {
+  __m256i error = _mm256_setzero_si256();
+  __m256i prev_input = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  size_t count = 0;
+
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i input = _mm256_loadu_si256((const __m256i *)(str + i));
+    if (_mm256_movemask_epi8(input) == 0) {
+      error = _mm256_or_si256(error, prev_incomplete);
+      prev_incomplete = _mm256_setzero_si256();
+      count += 32;
+    } else {
+      error = _mm256_or_si256(error, avx2_check_block(input, prev_input));
+      prev_incomplete = avx2_incomplete(input);
+      count += avx2_leads(input, UINT32_MAX);
+    }
+    prev_input = input;
+  }
+
+  if (i < n) {
+    // zero padding is ascii, so a sequence cut off by the end is too short
+    uint8_t tail[32] = {0};
+    memcpy(tail, str + i, n - i);
+    __m256i input = _mm256_loadu_si256((const __m256i *)tail);
+    error = _mm256_or_si256(error, avx2_check_block(input, prev_input));
+    count += avx2_leads(input, (1u << (n - i)) - 1);
+    prev_incomplete = _mm256_setzero_si256();
+  }
+  error = _mm256_or_si256(error, prev_incomplete);
+
+  if (!_mm256_testz_si256(error, error))
+    return false;
+  *code_points = count;
+  return true;
+}
+
+#endif
+
+bool cmc_utf8_count(const uint8_t *str, size_t n, size_t *code_points) {
+#ifdef UTF8_X86
+  if (n >= 32 && __builtin_cpu_supports("avx2"))
+    return avx2_count(str, n, code_points);
+  if (__builtin_cpu_supports("sse2"))
+    return sse2_count(str, n, code_points);
+#endif
+  return scalar_count(str, n, code_points);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Validates str as UTF-8 and counts its code points in the same pass. Returns
+false for malformed input (overlong forms, surrogates, code points above
+U+10FFFF, stray or missing continuation bytes), code_points is only set on
+success. Picks an AVX2 or SSE2 implementation at runtime when the cpu has one.
+*/
+bool cmc_utf8_count(const uint8_t *str, size_t n, size_t *code_points);
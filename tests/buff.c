@@ -0,0 +1,578 @@
+#include <cmc/buff.h>
+#include <cmc/arena.h>
+#include <cmc/err.h>
+#include <cmc/heap_utils.h>
+#include <cmc/packets.h>
+#include <cmc/pool.h>
+
+#include <float.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+static cmc_buff *buff_from(const void *data, size_t n) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack(buff, data, n);
+  return buff;
+}
+
+// reads the big endian bytes with the inline reader and then the exported
+// function, each on its own, and writes value back with both
+#define CHECK_NUMBER(name, type, value, ...)                                   \
+  do {                                                                         \
+    const uint8_t bytes[] = {__VA_ARGS__};                                     \
+    CHECK(sizeof(bytes) == sizeof(type));                                      \
+    cmc_buff *buff = buff_from(bytes, sizeof(bytes));                          \
+    CHECK(cmc_buff_read_##name(buff) == (type)(value));                        \
+    CHECK(buff->position == sizeof(bytes) && buff->err.err == CMC_ERR_NO);     \
+    buff->position = 0;                                                        \
+    CHECK(cmc_buff_unpack_##name(buff) == (type)(value));                      \
+    CHECK(buff->position == sizeof(bytes) && buff->err.err == CMC_ERR_NO);     \
+    cmc_buff_free(buff);                                                       \
+    buff = cmc_buff_init(47);                                                  \
+    CHECK(cmc_buff_write_##name(buff, value) == CMC_ERR_NO);                   \
+    CHECK(buff->length == sizeof(bytes));                                      \
+    CHECK(memcmp(buff->data, bytes, sizeof(bytes)) == 0);                      \
+    cmc_buff_free(buff);                                                       \
+    buff = cmc_buff_init(47);                                                  \
+    CHECK(cmc_buff_pack_##name(buff, value) == CMC_ERR_NO);                    \
+    CHECK(buff->length == sizeof(bytes));                                      \
+    CHECK(memcmp(buff->data, bytes, sizeof(bytes)) == 0);                      \
+    cmc_buff_free(buff);                                                       \
+  } while (0)
+
+static void test_numbers(void) {
+  CHECK_NUMBER(char, char, -2, 0xFE);
+  CHECK_NUMBER(char, char, -128, 0x80);
+  CHECK_NUMBER(char, char, 127, 0x7F);
+
+  CHECK_NUMBER(byte, uint8_t, 0, 0x00);
+  CHECK_NUMBER(byte, uint8_t, 0xFE, 0xFE);
+  CHECK_NUMBER(byte, uint8_t, UINT8_MAX, 0xFF);
+
+  CHECK_NUMBER(short, int16_t, -2, 0xFF, 0xFE);
+  CHECK_NUMBER(short, int16_t, 0x1234, 0x12, 0x34);
+  CHECK_NUMBER(short, int16_t, INT16_MIN, 0x80, 0x00);
+  CHECK_NUMBER(short, int16_t, INT16_MAX, 0x7F, 0xFF);
+
+  CHECK_NUMBER(ushort, uint16_t, 25565, 0x63, 0xDD);
+  CHECK_NUMBER(ushort, uint16_t, UINT16_MAX, 0xFF, 0xFF);
+
+  CHECK_NUMBER(int, int32_t, 0x12345678, 0x12, 0x34, 0x56, 0x78);
+  CHECK_NUMBER(int, int32_t, -1, 0xFF, 0xFF, 0xFF, 0xFF);
+  CHECK_NUMBER(int, int32_t, -0x12345678, 0xED, 0xCB, 0xA9, 0x88);
+  CHECK_NUMBER(int, int32_t, INT32_MIN, 0x80, 0x00, 0x00, 0x00);
+  CHECK_NUMBER(int, int32_t, INT32_MAX, 0x7F, 0xFF, 0xFF, 0xFF);
+
+  CHECK_NUMBER(uint, uint32_t, 0xDEADBEEF, 0xDE, 0xAD, 0xBE, 0xEF);
+  CHECK_NUMBER(uint, uint32_t, UINT32_MAX, 0xFF, 0xFF, 0xFF, 0xFF);
+
+  CHECK_NUMBER(long, int64_t, -2, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+               0xFE);
+  CHECK_NUMBER(long, int64_t, 0x0102030405060708, 0x01, 0x02, 0x03, 0x04,
+               0x05, 0x06, 0x07, 0x08);
+  CHECK_NUMBER(long, int64_t, INT64_MIN, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00,
+               0x00, 0x00);
+  CHECK_NUMBER(long, int64_t, INT64_MAX, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+               0xFF, 0xFF);
+
+  CHECK_NUMBER(ulong, uint64_t, 0x0102030405060708, 0x01, 0x02, 0x03, 0x04,
+               0x05, 0x06, 0x07, 0x08);
+  CHECK_NUMBER(ulong, uint64_t, UINT64_MAX, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+               0xFF, 0xFF);
+
+  CHECK_NUMBER(float, float, 1.5f, 0x3F, 0xC0, 0x00, 0x00);
+  CHECK_NUMBER(float, float, -2.5f, 0xC0, 0x20, 0x00, 0x00);
+  CHECK_NUMBER(float, float, -0.0f, 0x80, 0x00, 0x00, 0x00);
+  CHECK_NUMBER(float, float, FLT_MAX, 0x7F, 0x7F, 0xFF, 0xFF);
+
+  CHECK_NUMBER(double, double, -2.0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+               0x00);
+  CHECK_NUMBER(double, double, 0.1, 0x3F, 0xB9, 0x99, 0x99, 0x99, 0x99, 0x99,
+               0x9A);
+  CHECK_NUMBER(double, double, -DBL_MAX, 0xFF, 0xEF, 0xFF, 0xFF, 0xFF, 0xFF,
+               0xFF, 0xFF);
+}
+
+static void test_overflow(void) {
+  const uint8_t bytes[] = {0x01, 0x02, 0x03};
+  cmc_buff *buff = buff_from(bytes, sizeof(bytes));
+  CHECK(cmc_buff_read_int(buff) == 0);
+  CHECK(buff->err.err == CMC_ERR_BUFF_OVERFLOW);
+  CHECK(buff->position == 0);
+  cmc_buff_free(buff);
+}
+
+static void test_views(void) {
+  const uint8_t bytes[] = {0x01, 0x02, 0x03};
+  cmc_buff *buff = buff_from(bytes, sizeof(bytes));
+  const uint8_t *peek = cmc_buff_peek(buff, 2);
+  CHECK(peek == buff->data && buff->position == 0);
+  const uint8_t *view = cmc_buff_view(buff, 2);
+  CHECK(view == buff->data && buff->position == 2);
+  CHECK(cmc_buff_remaining(buff) == 1);
+  CHECK(cmc_buff_view(buff, 2) == NULL);
+  CHECK(buff->err.err == CMC_ERR_BUFF_OVERFLOW);
+  cmc_buff_free(buff);
+}
+
+// the straightforward loop the fast varint codec has to agree with
+static size_t reference_varint_encode(uint8_t *dst, uint64_t v) {
+  size_t i = 0;
+  do {
+    dst[i] = v & 0x7F;
+    v >>= 7;
+    if (v)
+      dst[i] |= 0x80;
+    i++;
+  } while (v);
+  return i;
+}
+
+static void test_varints(void) {
+  const int64_t values[] = {0,          1,         127,        128,
+                            255,        300,       16383,      16384,
+                            2097151,    2097152,   268435455,  268435456,
+                            INT32_MAX,  -1,        INT32_MIN,  -300,
+                            INT64_MAX,  INT64_MIN, 1LL << 56,  (1LL << 56) - 1,
+                            1LL << 49,  1LL << 62, -(1LL << 40)};
+  for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    int32_t v32 = (int32_t)values[i];
+    uint8_t expected[CMC_VARLONG_MAX_BYTES];
+
+    // varint, once with trailing bytes so the 8 byte load path is taken
+    size_t expected_len = reference_varint_encode(expected, (uint32_t)v32);
+    for (int padding = 0; padding <= 8; padding += 8) {
+      cmc_buff *buff = cmc_buff_init(47);
+      CHECK(cmc_buff_pack_varint(buff, v32) == CMC_ERR_NO);
+      CHECK(buff->length == expected_len);
+      CHECK(memcmp(buff->data, expected, expected_len) == 0);
+      CHECK(cmc_varint_size(v32) == expected_len);
+      for (int j = 0; j < padding; j++)
+        cmc_buff_pack_byte(buff, 0xFF);
+      CHECK(cmc_buff_unpack_varint(buff) == v32);
+      CHECK(buff->err.err == CMC_ERR_NO);
+      CHECK(buff->position == expected_len);
+      cmc_buff_free(buff);
+    }
+
+    // varlong
+    expected_len = reference_varint_encode(expected, (uint64_t)values[i]);
+    for (int padding = 0; padding <= 8; padding += 8) {
+      cmc_buff *buff = cmc_buff_init(47);
+      CHECK(cmc_buff_pack_varlong(buff, values[i]) == CMC_ERR_NO);
+      CHECK(buff->length == expected_len);
+      CHECK(memcmp(buff->data, expected, expected_len) == 0);
+      for (int j = 0; j < padding; j++)
+        cmc_buff_pack_byte(buff, 0xFF);
+      CHECK(cmc_buff_unpack_varlong(buff) == values[i]);
+      CHECK(buff->err.err == CMC_ERR_NO);
+      CHECK(buff->position == expected_len);
+      cmc_buff_free(buff);
+    }
+  }
+
+  // bulk
+  int32_t ids[257];
+  int32_t decoded[257];
+  for (size_t i = 0; i < 257; i++)
+    ids[i] = (int32_t)(i * 2654435761u) >> (i % 32);
+  cmc_buff *buff = cmc_buff_init(47);
+  CHECK(cmc_buff_pack_varint_array(buff, ids, 257) == CMC_ERR_NO);
+  cmc_buff *single = cmc_buff_init(47);
+  for (size_t i = 0; i < 257; i++)
+    cmc_buff_pack_varint(single, ids[i]);
+  CHECK(buff->length == single->length);
+  CHECK(memcmp(buff->data, single->data, buff->length) == 0);
+  CHECK(cmc_buff_unpack_varint_array(buff, decoded, 257) == CMC_ERR_NO);
+  CHECK(memcmp(ids, decoded, sizeof(ids)) == 0);
+  CHECK(cmc_buff_remaining(buff) == 0);
+  CHECK(cmc_buff_unpack_varint_array(buff, decoded, 1) ==
+        CMC_ERR_BUFF_OVERFLOW);
+  cmc_buff_free(single);
+  cmc_buff_free(buff);
+
+  // too long
+  const uint8_t too_long[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01,
+                              0x00, 0x00, 0x00};
+  buff = buff_from(too_long, sizeof(too_long));
+  cmc_buff_unpack_varint(buff);
+  CHECK(buff->err.err == CMC_ERR_INVALID_VARINT);
+  cmc_buff_free(buff);
+  buff = buff_from(too_long, 4);
+  cmc_buff_unpack_varint(buff);
+  CHECK(buff->err.err == CMC_ERR_BUFF_OVERFLOW);
+  cmc_buff_free(buff);
+}
+
+static void test_capacity(void) {
+  cmc_buff *buff = cmc_buff_init_with_capacity(47, 19);
+  CHECK(buff->capacity == 19);
+  uint8_t *data = buff->data;
+  CHECK(cmc_buff_reserve_headroom(buff, 10) == CMC_ERR_NO);
+  cmc_buff_write_byte(buff, 0x00);
+  cmc_buff_write_long(buff, 1);
+  CHECK(buff->data == data && buff->capacity == 19 && buff->length == 19);
+  cmc_buff_free(buff);
+
+  buff = cmc_buff_init(47);
+  cmc_buff_write_byte(buff, 1);
+  CHECK(buff->capacity == cmc_buff_get_growth_policy().min_capacity);
+  CHECK(cmc_buff_reserve(buff, 1000) == CMC_ERR_NO);
+  CHECK(buff->capacity >= 1001);
+  cmc_buff_free(buff);
+
+  cmc_buff_growth_policy old = cmc_buff_get_growth_policy();
+  cmc_buff_set_growth_policy(
+      (cmc_buff_growth_policy){.min_capacity = 0, .growth_factor = 1});
+  buff = cmc_buff_init(47);
+  cmc_buff_write_int(buff, 1);
+  CHECK(buff->capacity == 4);
+  cmc_buff_write_short(buff, 1);
+  CHECK(buff->capacity == 6);
+  cmc_buff_free(buff);
+  cmc_buff_set_growth_policy(old);
+}
+
+static void test_pool(void) {
+  cmc_buff_pool *pool = cmc_buff_pool_init(1);
+  CHECK(pool != NULL);
+
+  cmc_buff *a = cmc_buff_pool_acquire(pool, 47, 100);
+  CHECK(a->capacity == 128 && a->length == 0 && a->pool == pool);
+  cmc_buff_write_int(a, 7);
+  cmc_buff_free(a);
+  CHECK(pool->stats.misses == 1 && pool->stats.releases == 1);
+
+  // comes back empty from the cache
+  cmc_buff *b = cmc_buff_pool_acquire(pool, 765, 65);
+  CHECK(b == a && b->length == 0 && b->position == 0);
+  CHECK(b->protocol_version == 765 && pool->stats.hits == 1);
+
+  // class already holds one buffer, the second one gets dropped
+  cmc_buff *c = cmc_buff_pool_acquire(pool, 47, 128);
+  CHECK(c != b && pool->stats.misses == 2);
+  cmc_buff_free(b);
+  cmc_buff_free(c);
+  CHECK(pool->stats.drops == 1);
+
+  // a buffer that grew goes into the class of its new capacity
+  cmc_buff *d = cmc_buff_pool_acquire(pool, 47, 0);
+  CHECK(d->capacity == 64);
+  uint8_t big[300] = {0};
+  cmc_buff_pack(d, big, sizeof(big));
+  cmc_buff_free(d);
+  CHECK(d->capacity == 512);
+  cmc_buff *e = cmc_buff_pool_acquire(pool, 47, 512);
+  CHECK(e == d && pool->stats.hits == 2);
+  cmc_buff_free(e);
+
+  cmc_buff *huge =
+      cmc_buff_pool_acquire(pool, 47, CMC_BUFF_POOL_MAX_CLASS_SIZE * 2);
+  CHECK(huge->capacity == CMC_BUFF_POOL_MAX_CLASS_SIZE * 2);
+  cmc_buff_free(huge);
+  CHECK(pool->stats.drops == 2);
+
+  cmc_buff_pool_free(pool);
+}
+
+static void test_string_views(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_string_view(buff, cmc_string_view_from("minecraft:brand"));
+  cmc_buff_pack_string(buff, "h\xc3\xa9");
+  cmc_buff_pack_string_view(buff, (cmc_string_view){.data = NULL, .length = 0});
+
+  cmc_string_view channel = cmc_buff_unpack_string_view(buff);
+  CHECK(channel.length == 15 && (uint8_t *)channel.data == buff->data + 1);
+  CHECK(memcmp(channel.data, "minecraft:brand", 15) == 0);
+  // two code points, three bytes
+  cmc_string_view accented = cmc_buff_unpack_string_view_w_max_len(buff, 2);
+  CHECK(accented.length == 3 && buff->err.err == CMC_ERR_NO);
+  cmc_string_view empty = cmc_buff_unpack_string_view(buff);
+  CHECK(empty.length == 0 && buff->position == buff->length);
+
+  buff->position = 0;
+  cmc_string_view too_long = cmc_buff_unpack_string_view_w_max_len(buff, 14);
+  CHECK(too_long.data == NULL && buff->err.err == CMC_ERR_STRING_LENGTH);
+  buff->err = (cmc_err_extra){};
+
+  // the owned api still hands out a copy
+  buff->position = 0;
+  char *owned = cmc_buff_unpack_string(buff);
+  CHECK(strcmp(owned, "minecraft:brand") == 0);
+  CHECK((uint8_t *)owned != buff->data + 1);
+  cmc_string_free(owned);
+  cmc_buff_free(buff);
+
+  buff = cmc_buff_init(47);
+  cmc_buff_pack_string(buff, "hello");
+  cmc_buff_pack_char(buff, 1);
+  S2C_play_chat_message_packet chat = unpack_S2C_play_chat_message_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_NO && chat.position == 1);
+  CHECK(chat.message.length == 5 && memcmp(chat.message.data, "hello", 5) == 0);
+  cmc_free_S2C_play_chat_message_packet(&chat, &buff->err);
+  cmc_buff_free(buff);
+}
+
+// unpacks bytes as a length prefixed string and returns the error
+static cmc_err unpack_utf8(const uint8_t *bytes, size_t n, int max_len) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, n);
+  cmc_buff_pack(buff, bytes, n);
+  cmc_buff_unpack_string_view_w_max_len(buff, max_len);
+  cmc_err err = buff->err.err;
+  cmc_buff_free(buff);
+  return err;
+}
+
+static void test_utf8(void) {
+  static const struct {
+    const char *bytes;
+    int code_points; // -1 for malformed input
+  } cases[] = {
+      {"plain ascii", 11},
+      {"\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", 3},
+      {"\xef\xbf\xbf\xf4\x8f\xbf\xbf", 2}, // U+FFFF and U+10FFFF
+      {"\x80", -1},                           // lone continuation
+      {"\xc3", -1},                           // cut off
+      {"\xe2\x82", -1},                       // cut off
+      {"\xc3\xa9\xa9", -1},                   // one continuation too many
+      {"\xc0\xaf", -1},                       // overlong 2 bytes
+      {"\xe0\x80\xaf", -1},                   // overlong 3 bytes
+      {"\xf0\x80\x80\xaf", -1},               // overlong 4 bytes
+      {"\xed\xa0\x80", -1},                   // surrogate
+      {"\xf4\x90\x80\x80", -1},               // above U+10FFFF
+      {"\xf8\x88\x80\x80\x80", -1},           // 5 byte form
+  };
+
+  // every case at every offset around the 16 and 32 byte block boundaries,
+  // padded with ascii on both sides
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    size_t len = strlen(cases[i].bytes);
+    for (size_t offset = 0; offset < 40; offset++) {
+      uint8_t bytes[96];
+      memset(bytes, 'a', sizeof(bytes));
+      memcpy(bytes + offset, cases[i].bytes, len);
+      for (size_t n = offset + len; n <= offset + len + 24; n += 24) {
+        if (cases[i].code_points < 0) {
+          CHECK(unpack_utf8(bytes, n, n) == CMC_ERR_INVALID_STRING);
+          continue;
+        }
+        int code_points = cases[i].code_points + n - len;
+        CHECK(unpack_utf8(bytes, n, code_points) == CMC_ERR_NO);
+        CHECK(unpack_utf8(bytes, n, code_points - 1) == CMC_ERR_STRING_LENGTH);
+      }
+    }
+  }
+
+  // counting, checked through the max_len limit
+  uint8_t text[1000];
+  size_t n = 0, code_points = 0;
+  while (n + 4 <= sizeof(text)) {
+    static const char *samples[] = {"a", "\xc3\xa9", "\xe2\x82\xac",
+                                    "\xf0\x9f\x98\x80"};
+    const char *sample = samples[code_points * 7 % 4];
+    memcpy(text + n, sample, strlen(sample));
+    n += strlen(sample);
+    code_points++;
+  }
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, n);
+  cmc_buff_pack(buff, text, n);
+  cmc_buff_unpack_string_view_w_max_len(buff, code_points);
+  CHECK(buff->err.err == CMC_ERR_NO);
+  buff->position = 0;
+  cmc_buff_unpack_string_view_w_max_len(buff, code_points - 1);
+  CHECK(buff->err.err == CMC_ERR_STRING_LENGTH);
+  cmc_buff_free(buff);
+
+  // packing validates too
+  buff = cmc_buff_init(47);
+  CHECK(cmc_buff_pack_string(buff, "\xed\xa0\x80") == CMC_ERR_INVALID_STRING);
+  cmc_buff_free(buff);
+}
+
+static cmc_buff *entity_properties_payload(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 12);
+  cmc_buff_pack_int(buff, 3);
+  for (int i = 0; i < 3; i++) {
+    cmc_buff_pack_string(buff, "generic.movementSpeed");
+    cmc_buff_pack_double(buff, 0.1 * i);
+    cmc_buff_pack_varint(buff, i);
+    for (int j = 0; j < i; j++) {
+      cmc_buff_pack_double(buff, j);
+      cmc_buff_pack_byte(buff, j);
+    }
+  }
+  return buff;
+}
+
+static void test_arena(void) {
+  cmc_err_extra err = {};
+  cmc_arena *arena = cmc_arena_init(256);
+  CHECK(arena != NULL);
+
+  uint8_t *a = cmc_arena_alloc(arena, 10, &err);
+  CHECK(a && ((uintptr_t)a % alignof(max_align_t)) == 0);
+  memset(a, 7, 10);
+  // the last allocation grows in place
+  CHECK(cmc_arena_realloc(arena, a, 10, 100, &err) == a);
+  uint8_t *b = cmc_arena_alloc(arena, 1, &err);
+  uint8_t *c = cmc_arena_realloc(arena, a, 100, 200, &err);
+  CHECK(c != a && c[9] == 7 && cmc_arena_owns(arena, b));
+  // bigger than a block, gets its own
+  uint8_t *big = cmc_arena_alloc(arena, 4096, &err);
+  CHECK(big && cmc_arena_owns(arena, big));
+  CHECK(err.err == CMC_ERR_NO);
+
+  cmc_arena_reset(arena);
+  CHECK(cmc_arena_used(arena) == 0);
+  cmc_arena_alloc(arena, 4096, &err);
+  cmc_arena_alloc(arena, 200, &err);
+  CHECK(cmc_arena_used(arena) >= 4296);
+
+  // a whole packet decoded into the arena, the free function must not touch it
+  cmc_arena_reset(arena);
+  cmc_buff *buff = entity_properties_payload();
+  buff->arena = arena;
+  S2C_play_entity_properties_packet packet =
+      unpack_S2C_play_entity_properties_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_NO && packet.in_arena);
+  CHECK(packet.properties.size == 3);
+  S2C_play_entity_properties_properties *props = packet.properties.data;
+  CHECK(cmc_arena_owns(arena, props) && cmc_arena_owns(arena, props[2].key));
+  CHECK(strcmp(props[1].key, "generic.movementSpeed") == 0);
+  CHECK(props[0].modifiers.size == 0 && props[2].modifiers.size == 2);
+  S2C_play_entity_properties_modifiers *mods = props[2].modifiers.data;
+  CHECK(mods[1].amount == 1.0 && mods[1].operation == 1);
+  cmc_free_S2C_play_entity_properties_packet(&packet, &buff->err);
+  cmc_buff_free(buff);
+
+  // without an arena the same packet is malloced and freed as before
+  buff = entity_properties_payload();
+  packet = unpack_S2C_play_entity_properties_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_NO && packet.properties.size == 3);
+  CHECK(!packet.in_arena && !cmc_arena_owns(arena, packet.properties.data));
+  cmc_free_S2C_play_entity_properties_packet(&packet, &buff->err);
+  cmc_buff_free(buff);
+
+  // metadata entries and their strings
+  buff = cmc_buff_init(47);
+  for (int i = 0; i < 20; i++) {
+    cmc_buff_pack_char(buff, ENTITY_METADATA_ENTRY_TYPE_STRING << 5 | i);
+    cmc_buff_pack_string(buff, "name");
+  }
+  cmc_buff_pack_byte(buff, 127);
+  buff->arena = arena;
+  cmc_entity_metadata meta_data = cmc_buff_unpack_entity_metadata(buff);
+  CHECK(meta_data.size == 20 && cmc_arena_owns(arena, meta_data.entries));
+  CHECK(meta_data.entries[19].index == 19);
+  CHECK(strcmp(meta_data.entries[19].payload.string_data, "name") == 0);
+  // nothing of strings is outside the arena
+  CHECK(cmc_entity_metadata_free_in_arena(meta_data, &buff->err) ==
+        CMC_ERR_NO);
+  cmc_buff_free(buff);
+
+  // an empty slot, the arena free only looks at the nbt of real ones
+  buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 5);
+  cmc_buff_pack_short(buff, 0);
+  cmc_buff_pack_short(buff, -1);
+  buff->arena = arena;
+  S2C_play_entity_equipment_packet equipment =
+      unpack_S2C_play_entity_equipment_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_NO && equipment.in_arena && !equipment.item);
+  cmc_free_S2C_play_entity_equipment_packet(&equipment, &buff->err);
+  CHECK(buff->err.err == CMC_ERR_NO);
+  cmc_buff_free(buff);
+
+  // a packet cut short, the error path leaves the arena to the arena
+  cmc_arena_reset(arena);
+  buff = entity_properties_payload();
+  buff->length -= 4;
+  buff->arena = arena;
+  packet = unpack_S2C_play_entity_properties_packet(buff);
+  CHECK(buff->err.err != CMC_ERR_NO && packet.properties.data == NULL);
+  CHECK(cmc_arena_used(arena) > 0);
+  cmc_buff_free(buff);
+
+  cmc_arena_free(arena);
+}
+
+// array counts from the peer are checked against the bytes left first
+static void test_array_counts(void) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 1 << 30);
+  cmc_buff_pack_varint(buff, 1);
+  cmc_buff_pack_varint(buff, 2);
+  S2C_play_destroy_entities_packet destroy =
+      unpack_S2C_play_destroy_entities_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  CHECK(destroy.entities.data == NULL && destroy.entities.size == 0);
+  cmc_buff_free(buff);
+
+  buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 12);
+  cmc_buff_pack_int(buff, -1);
+  S2C_play_entity_properties_packet properties =
+      unpack_S2C_play_entity_properties_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  CHECK(properties.properties.size == 0);
+  cmc_buff_free(buff);
+
+  // the nested count of the modifiers
+  buff = cmc_buff_init(47);
+  cmc_buff_pack_varint(buff, 12);
+  cmc_buff_pack_int(buff, 1);
+  cmc_buff_pack_string(buff, "generic.movementSpeed");
+  cmc_buff_pack_double(buff, 0.1);
+  cmc_buff_pack_varint(buff, 100);
+  properties = unpack_S2C_play_entity_properties_packet(buff);
+  CHECK(buff->err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  cmc_buff_free(buff);
+}
+
+static void test_pool_arena(void) {
+  cmc_buff_pool *pool = cmc_buff_pool_init(1);
+  cmc_arena *arena = cmc_arena_init(256);
+
+  cmc_buff *a = cmc_buff_pool_acquire(pool, 47, 100);
+  a->arena = arena;
+  CHECK(cmc_arena_owns(arena, cmc_buff_malloc(a, 16)));
+  cmc_buff_free(a);
+  cmc_arena_free(arena);
+
+  // the recycled buffer must not allocate from the freed arena
+  cmc_buff *b = cmc_buff_pool_acquire(pool, 47, 100);
+  CHECK(b == a && b->arena == NULL);
+  cmc_buff_pack_string(b, "pooled");
+  char *string = cmc_buff_unpack_string(b);
+  CHECK(b->err.err == CMC_ERR_NO && strcmp(string, "pooled") == 0);
+  free(string);
+  cmc_buff_free(b);
+
+  cmc_buff_pool_free(pool);
+}
+
+int main() {
+  test_numbers();
+  test_overflow();
+  test_views();
+  test_varints();
+  test_capacity();
+  test_pool();
+  test_arena();
+  test_pool_arena();
+  test_array_counts();
+  test_string_views();
+  test_utf8();
+  if (!failed)
+    printf("all buff tests passed\n");
+  return failed;
+}
@@ -0,0 +1,639 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/packets.h>
+
+#include <zlib.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+/*
+Forks a writer that sends the given packets over its end of a socketpair.
+With dribble set they go through a relay that forwards them a few bytes at a
+time. Returns the reading connection.
+*/
+static cmc_conn start_writer(const int *sizes, size_t count,
+                             ssize_t compression_threshold, bool dribble,
+                             pid_t *pid) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  *pid = fork();
+  if (*pid == 0) {
+    close(sv[0]);
+    cmc_conn writer = cmc_conn_init(47);
+    writer.compression_threshold = compression_threshold;
+    int relay[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, relay);
+    pid_t dribbler = dribble ? fork() : -1;
+    if (dribbler == 0) {
+      // forwards the framed packets a few bytes at a time
+      close(relay[1]);
+      uint8_t bytes[3];
+      ssize_t n;
+      for (int i = 0; (n = read(relay[0], bytes, sizeof(bytes))) > 0; i++) {
+        write(sv[1], bytes, n);
+        if (i % 64 == 0)
+          usleep(50);
+      }
+      _exit(0);
+    }
+    close(relay[0]);
+    writer.sockfd = dribble ? relay[1] : sv[1];
+    for (size_t i = 0; i < count; i++) {
+      cmc_buff *buff = make_packet(sizes[i]);
+      cmc_conn_send_packet(&writer, buff);
+      cmc_buff_free(buff);
+    }
+    close(relay[1]);
+    if (dribble)
+      waitpid(dribbler, NULL, 0);
+    _exit(0);
+  }
+  close(sv[1]);
+  cmc_conn reader = cmc_conn_init(47);
+  reader.compression_threshold = compression_threshold;
+  reader.sockfd = sv[0];
+  reader.state = CMC_CONN_STATE_PLAY;
+  return reader;
+}
+
+static void finish(cmc_conn *conn, pid_t pid) {
+  cmc_conn_close(conn);
+  waitpid(pid, NULL, 0);
+}
+
+static void test_batched(void) {
+  int sizes[100];
+  for (int i = 0; i < 100; i++)
+    sizes[i] = i % 10;
+  pid_t pid;
+  cmc_conn conn = start_writer(sizes, 100, -1, false, &pid);
+  waitpid(pid, NULL, 0); // everything is in the socket now
+
+  cmc_buff *buff = cmc_conn_recive_packet(&conn);
+  CHECK(check_packet(buff, sizes[0]));
+  cmc_buff_free(buff);
+  // the first recv already pulled in every other packet
+  size_t rest = 0;
+  for (int i = 1; i < 100; i++)
+    rest += 1 + 1 + 4 * sizes[i];
+  CHECK(conn.rx.end - conn.rx.start == rest);
+
+  for (int i = 1; i < 100; i++) {
+    buff = cmc_conn_recive_packet(&conn);
+    CHECK(check_packet(buff, sizes[i]));
+    cmc_buff_free(buff);
+  }
+  CHECK(conn.rx.start == conn.rx.end);
+
+  // the writer is gone, so the next read fails
+  CHECK(cmc_conn_recive_packet(&conn) == NULL);
+  CHECK(conn.err.err == CMC_ERR_RECV);
+  finish(&conn, pid);
+}
+
+static void test_split(void) {
+  // lengths that need one, two and three varint bytes
+  int sizes[] = {3, 40, 100, 20000, 0, 7};
+  size_t count = sizeof(sizes) / sizeof(sizes[0]);
+  for (ssize_t threshold = -1; threshold <= 64; threshold += 65) {
+    pid_t pid;
+    cmc_conn conn = start_writer(sizes, count, threshold, true, &pid);
+    for (size_t i = 0; i < count; i++) {
+      cmc_buff *buff = cmc_conn_recive_packet(&conn);
+      CHECK(check_packet(buff, sizes[i]));
+      if (buff)
+        cmc_buff_free(buff);
+    }
+    finish(&conn, pid);
+  }
+}
+
+static void test_large(void) {
+  // bigger than the default receive buffer
+  int sizes[] = {5, 100000, 5};
+  for (ssize_t threshold = -1; threshold <= 256; threshold += 257) {
+    pid_t pid;
+    cmc_conn conn = start_writer(sizes, 3, threshold, false, &pid);
+    for (size_t i = 0; i < 3; i++) {
+      cmc_buff *buff = cmc_conn_recive_packet(&conn);
+      CHECK(check_packet(buff, sizes[i]));
+      if (buff)
+        cmc_buff_free(buff);
+    }
+    CHECK(conn.rx.capacity > CMC_CONN_RX_DEFAULT_CAPACITY);
+    finish(&conn, pid);
+  }
+}
+
+static void test_invalid_length(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  const uint8_t bytes[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  write(sv[1], bytes, sizeof(bytes));
+  cmc_conn conn = cmc_conn_init(47);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  CHECK(cmc_conn_recive_packet(&conn) == NULL);
+  CHECK(conn.err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+}
+
+// a bad peer is cut off before its lengths turn into allocations
+static void test_limits(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(47);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  // a frame of 2 MiB, one byte over the default
+  const uint8_t too_long[] = {0x80, 0x80, 0x80, 0x01};
+  write(sv[1], too_long, sizeof(too_long));
+  CHECK(cmc_conn_recive_packet(&conn) == NULL);
+  CHECK(conn.err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  CHECK(conn.rx.capacity <= CMC_CONN_RX_DEFAULT_CAPACITY);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+
+  // a tiny compressed frame that claims to inflate to 1 GiB
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  conn = cmc_conn_init(47);
+  conn.sockfd = sv[0];
+  conn.state = CMC_CONN_STATE_PLAY;
+  conn.compression_threshold = 0;
+  const uint8_t too_big[] = {0x06, 0x80, 0x80, 0x80, 0x80, 0x04, 0x78};
+  write(sv[1], too_big, sizeof(too_big));
+  CHECK(cmc_conn_recive_packet(&conn) == NULL);
+  CHECK(conn.err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  cmc_conn_close(&conn);
+  close(sv[1]);
+
+  // lowered limits, a frame that fits the frame limit but not the buffer
+  int sizes[] = {10, 2000};
+  pid_t pid;
+  conn = start_writer(sizes, 2, -1, false, &pid);
+  conn.max_buffered_bytes = 4096;
+  cmc_buff *buff = cmc_conn_recive_packet(&conn);
+  CHECK(check_packet(buff, 10));
+  if (buff)
+    cmc_buff_free(buff);
+  CHECK(cmc_conn_recive_packet(&conn) == NULL);
+  CHECK(conn.err.err == CMC_ERR_INVALID_PACKET_LENGTH);
+  CHECK(conn.rx.capacity <= 4096);
+  finish(&conn, pid);
+}
+
+// the streams are reused across packets and recreated when the params change
+static void test_compression_params(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn writer = cmc_conn_init(47);
+  writer.sockfd = sv[1];
+  writer.state = CMC_CONN_STATE_PLAY;
+  writer.compression_threshold = 0;
+  cmc_conn reader = cmc_conn_init(47);
+  reader.sockfd = sv[0];
+  reader.state = CMC_CONN_STATE_PLAY;
+  reader.compression_threshold = 0;
+
+  int params[][2] = {{Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY},
+                     {Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY},
+                     {Z_BEST_SPEED, Z_RLE},
+                     {Z_BEST_COMPRESSION, Z_FILTERED},
+                     {Z_NO_COMPRESSION, Z_HUFFMAN_ONLY}};
+  for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+    if (i > 1)
+      cmc_conn_set_compression_params(&writer, params[i][0], params[i][1]);
+    cmc_buff *buff = make_packet(500 + i);
+    cmc_conn_send_packet(&writer, buff);
+    cmc_buff_free(buff);
+    CHECK(writer.err.err == CMC_ERR_NO);
+    buff = cmc_conn_recive_packet(&reader);
+    CHECK(check_packet(buff, 500 + i));
+    if (buff)
+      cmc_buff_free(buff);
+  }
+  CHECK(writer.deflater && reader.inflater);
+  cmc_conn_close(&writer);
+  cmc_conn_close(&reader);
+  CHECK(!writer.deflater && !reader.inflater);
+}
+
+static void test_want_packet(void) {
+  for (ssize_t threshold = -1; threshold <= 0; threshold++) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    cmc_conn writer = cmc_conn_init(47);
+    writer.sockfd = sv[1];
+    writer.state = CMC_CONN_STATE_PLAY;
+    writer.compression_threshold = threshold;
+    cmc_conn reader = cmc_conn_init(47);
+    reader.sockfd = sv[0];
+    reader.state = CMC_CONN_STATE_PLAY;
+    reader.compression_threshold = threshold;
+    cmc_conn_want_packet(&reader, 0x42);
+    cmc_conn_want_packet(&reader, 0xC8);
+
+    // 0xC8 takes two bytes as a varint, 0x1000 is past the filter
+    int ids[] = {0x10, 0x42, 0x11, 0x11, 0xC8, 0x43, 0x1000, 0x42};
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+      cmc_buff *buff = cmc_buff_init(47);
+      cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+      cmc_buff_pack_varint(buff, ids[i]);
+      for (int j = 0; j < 100; j++)
+        cmc_buff_pack_int(buff, j);
+      cmc_conn_send_packet(&writer, buff);
+      cmc_buff_free(buff);
+    }
+
+    int wanted[] = {0x42, 0xC8, 0x1000, 0x42};
+    for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+      cmc_buff *buff = cmc_conn_recive_packet(&reader);
+      CHECK(buff && cmc_buff_unpack_varint(buff) == wanted[i]);
+      if (buff)
+        cmc_buff_free(buff);
+    }
+    CHECK(reader.err.err == CMC_ERR_NO);
+
+    // outside of play nothing is filtered
+    reader.state = CMC_CONN_STATE_LOGIN;
+    cmc_buff *buff = make_packet(1);
+    buff->data[buff->position] = 0x01;
+    cmc_conn_send_packet(&writer, buff);
+    cmc_buff_free(buff);
+    buff = cmc_conn_recive_packet(&reader);
+    CHECK(buff && cmc_buff_unpack_varint(buff) == 0x01);
+    if (buff)
+      cmc_buff_free(buff);
+
+    cmc_conn_want_all_packets(&reader);
+    CHECK(!reader.filter_packets);
+    cmc_conn_close(&writer);
+    cmc_conn_close(&reader);
+  }
+}
+
+static void send_keep_alive(cmc_conn *server, int64_t id) {
+  if (server->state == CMC_CONN_STATE_CONFIG) {
+    S2C_config_keep_alive_packet packet = {.keep_alive_id = id};
+    cmc_send_S2C_config_keep_alive_packet(server, &packet);
+  } else {
+    S2C_play_keep_alive_packet packet = {.keep_alive_id = (int32_t)id,
+                                         .keep_alive_id_long = id};
+    cmc_send_S2C_play_keep_alive_packet(server, &packet);
+  }
+}
+
+// the id of the keep alive the client answered with, -1 if it wasn't one
+static int64_t recive_keep_alive_reply(cmc_conn *server) {
+  cmc_buff *buff = cmc_conn_recive_packet(server);
+  if (!buff)
+    return -1;
+  int packet_id = cmc_buff_unpack_varint(buff);
+  int64_t id = -1;
+  if (cmc_packet_id_to_packet_name_id(packet_id, server->state,
+                                      CMC_DIRECTION_C2S,
+                                      server->protocol_version) ==
+      CMC_C2S_CONFIG_KEEP_ALIVE_NAME_ID) {
+    id = unpack_C2S_config_keep_alive_packet(buff).keep_alive_id;
+  } else if (packet_id == (server->protocol_version == 47 ? 0x00 : 0x15)) {
+    C2S_play_keep_alive_packet packet = unpack_C2S_play_keep_alive_packet(buff);
+    id = server->protocol_version == 47 ? packet.keep_alive_id
+                                        : packet.keep_alive_id_long;
+  }
+  if (buff->err.err != CMC_ERR_NO)
+    id = -1;
+  cmc_buff_free(buff);
+  return id;
+}
+
+static void test_auto_keep_alive(void) {
+  struct {
+    cmc_protocol_version version;
+    cmc_conn_state state;
+    ssize_t threshold;
+  } cases[] = {{47, CMC_CONN_STATE_PLAY, -1},
+               {765, CMC_CONN_STATE_PLAY, 0},
+               {765, CMC_CONN_STATE_CONFIG, -1}};
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    cmc_conn server = cmc_conn_init(cases[i].version);
+    server.sockfd = sv[0];
+    server.state = cases[i].state;
+    server.compression_threshold = cases[i].threshold;
+    cmc_conn client = cmc_conn_init(cases[i].version);
+    client.sockfd = sv[1];
+    client.state = cases[i].state;
+    client.compression_threshold = cases[i].threshold;
+
+    // off by default, the application gets it
+    send_keep_alive(&server, 7);
+    cmc_buff *buff = cmc_conn_recive_packet(&client);
+    cmc_packet_name_id keep_alive = client.state == CMC_CONN_STATE_CONFIG
+                                        ? CMC_S2C_CONFIG_KEEP_ALIVE_NAME_ID
+                                        : CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID;
+    CHECK(buff && cmc_packet_id_to_packet_name_id(
+                      cmc_buff_unpack_varint(buff), client.state,
+                      CMC_DIRECTION_S2C,
+                      client.protocol_version) == keep_alive);
+    if (buff)
+      cmc_buff_free(buff);
+    CHECK(client.keep_alive_stats.answered == 0);
+
+    // answered in between other packets, which are all that is delivered
+    cmc_conn_set_auto_keep_alive(&client, true);
+    // an older error the application didn't clear doesn't fail the replies
+    client.err = (cmc_err_extra){.err = CMC_ERR_STRING_LENGTH};
+    for (int64_t id = 100000000000; id < 100000000003; id++) {
+      send_keep_alive(&server, id);
+      buff = make_packet(3);
+      cmc_conn_send_packet(&server, buff);
+      cmc_buff_free(buff);
+    }
+    for (int j = 0; j < 3; j++) {
+      buff = cmc_conn_recive_packet(&client);
+      CHECK(check_packet(buff, 3));
+      if (buff)
+        cmc_buff_free(buff);
+    }
+    CHECK(client.err.err == CMC_ERR_STRING_LENGTH);
+    client.err = (cmc_err_extra){};
+    // 47 has int ids
+    int64_t first =
+        cases[i].version == 47 ? (int32_t)100000000000 : 100000000000;
+    for (int64_t j = 0; j < 3; j++)
+      CHECK(recive_keep_alive_reply(&server) == first + j);
+    CHECK(client.keep_alive_stats.answered == 3);
+    CHECK(client.keep_alive_stats.last_id == first + 2);
+    CHECK(client.keep_alive_stats.last_answered_ns > 0);
+    CHECK(client.keep_alive_stats.max_turnaround_ns >=
+          client.keep_alive_stats.last_turnaround_ns);
+
+    // nothing is answered during login
+    client.state = CMC_CONN_STATE_LOGIN;
+    send_keep_alive(&server, 8);
+    buff = cmc_conn_recive_packet(&client);
+    CHECK(buff != NULL);
+    if (buff)
+      cmc_buff_free(buff);
+    CHECK(client.keep_alive_stats.answered == 3);
+
+    cmc_conn_close(&server);
+    cmc_conn_close(&client);
+  }
+}
+
+static void test_latency_stats(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn server = cmc_conn_init(47);
+  server.sockfd = sv[0];
+  server.state = CMC_CONN_STATE_PLAY;
+  server.compression_threshold = 64;
+  cmc_conn client = cmc_conn_init(47);
+  client.sockfd = sv[1];
+  client.state = CMC_CONN_STATE_PLAY;
+  client.compression_threshold = 64;
+  CHECK(cmc_conn_get_latency(&client) == NULL);
+  cmc_conn_latency *snapshot = malloc(sizeof(cmc_conn_latency));
+  CHECK(!cmc_conn_latency_snapshot(&client, snapshot));
+  CHECK(cmc_conn_enable_latency_stats(&client) == CMC_ERR_NO);
+  cmc_conn_set_auto_keep_alive(&client, true);
+
+  // one compressed, one not and a keep alive in between
+  int sizes[] = {100, 1, 100};
+  for (int i = 0; i < 3; i++) {
+    if (i == 1)
+      send_keep_alive(&server, 5);
+    cmc_buff *buff = make_packet(sizes[i]);
+    cmc_conn_send_packet(&server, buff);
+    cmc_buff_free(buff);
+  }
+  for (int i = 0; i < 3; i++) {
+    cmc_buff *buff = cmc_conn_recive_packet(&client);
+    CHECK(check_packet(buff, sizes[i]));
+    cmc_conn_packet_decoded(&client);
+    cmc_conn_packet_decoded(&client);
+    // only the first send after a packet is its response
+    cmc_conn_send_packet(&client, buff);
+    cmc_conn_send_packet(&client, buff);
+    if (buff)
+      cmc_buff_free(buff);
+  }
+  // the keep alive reply went out between the echoed packets
+  int replies = 0;
+  for (int i = 0; i < 7; i++)
+    replies += recive_keep_alive_reply(&server) == 5;
+  CHECK(replies == 1);
+
+  const cmc_conn_latency *latency = cmc_conn_get_latency(&client);
+  CHECK(cmc_histogram_count(&latency->stages[CMC_CONN_STAGE_QUEUED]) == 3);
+  CHECK(cmc_histogram_count(&latency->stages[CMC_CONN_STAGE_INFLATE]) == 2);
+  CHECK(cmc_histogram_count(&latency->stages[CMC_CONN_STAGE_DECODE]) == 3);
+  CHECK(cmc_histogram_count(&latency->stages[CMC_CONN_STAGE_RESPOND]) == 3);
+  CHECK(cmc_histogram_count(&latency->keep_alive) == 1);
+  CHECK(cmc_conn_latency_snapshot(&client, snapshot));
+  for (int i = 0; i < CMC_CONN_STAGES; i++) {
+    CHECK(cmc_histogram_count(&snapshot->stages[i]) ==
+          cmc_histogram_count(&latency->stages[i]));
+    CHECK(cmc_histogram_max(&snapshot->stages[i]) ==
+          cmc_histogram_max(&latency->stages[i]));
+  }
+  // the response comes after everything before it
+  CHECK(cmc_histogram_max(&latency->stages[CMC_CONN_STAGE_RESPOND]) >=
+        cmc_histogram_max(&latency->stages[CMC_CONN_STAGE_DECODE]));
+  CHECK(client.err.err == CMC_ERR_NO);
+
+  free(snapshot);
+  cmc_conn_close(&server);
+  cmc_conn_close(&client);
+  CHECK(client.timing == NULL);
+}
+
+static bool contains(const uint8_t *haystack, size_t length,
+                     const uint8_t *needle, size_t needle_length) {
+  for (size_t i = 0; i + needle_length <= length; i++)
+    if (memcmp(haystack + i, needle, needle_length) == 0)
+      return true;
+  return false;
+}
+
+/*
+A stand-in server asks for encryption in the clear, the client answers in
+the clear and from then on both sides only see ciphertext on the socket.
+*/
+static void test_encryption(void) {
+  const uint8_t secret[CMC_CONN_SHARED_SECRET_LENGTH] = {
+      0x13, 0x37, 0x42, 0x00, 0xFF, 0x10, 0x20, 0x30,
+      0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xA0, 0xB0};
+  for (ssize_t threshold = -1; threshold <= 64; threshold += 65) {
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    cmc_conn server = cmc_conn_init(47);
+    server.sockfd = sv[0];
+    server.state = CMC_CONN_STATE_LOGIN;
+    server.compression_threshold = threshold;
+    cmc_conn client = cmc_conn_init(47);
+    client.sockfd = sv[1];
+    client.state = CMC_CONN_STATE_LOGIN;
+    client.compression_threshold = threshold;
+
+    cmc_buff *buff = make_packet(3);
+    cmc_conn_send_packet(&server, buff);
+    cmc_buff_free(buff);
+    buff = cmc_conn_recive_packet(&client);
+    CHECK(check_packet(buff, 3));
+    if (buff)
+      cmc_buff_free(buff);
+    buff = make_packet(4);
+    cmc_conn_send_packet(&client, buff);
+    cmc_buff_free(buff);
+    CHECK(cmc_conn_enable_encryption(&client, secret) == CMC_ERR_NO);
+    buff = cmc_conn_recive_packet(&server);
+    CHECK(check_packet(buff, 4));
+    if (buff)
+      cmc_buff_free(buff);
+    CHECK(cmc_conn_enable_encryption(&server, secret) == CMC_ERR_NO);
+
+    // a few in a row so the cipher state has to carry over between them
+    int sizes[] = {0, 1, 50, 1000, 2};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      cmc_buff *sent = make_packet(sizes[i]);
+      cmc_conn_send_packet(&server, sent);
+      cmc_conn_send_packet(&client, sent);
+      // the packet itself is left alone and never shows up on the wire
+      size_t body = sent->position;
+      CHECK(check_packet(sent, sizes[i]));
+      uint8_t wire[8192];
+      ssize_t n = recv(client.sockfd, wire, sizeof(wire), MSG_PEEK);
+      // a body of a byte or two could turn up in the ciphertext by chance
+      CHECK(n > 0 && (sizes[i] < 2 || !contains(wire, n, sent->data + body,
+                                                sent->length - body)));
+      cmc_buff_free(sent);
+
+      buff = cmc_conn_recive_packet(&client);
+      CHECK(check_packet(buff, sizes[i]));
+      if (buff)
+        cmc_buff_free(buff);
+      buff = cmc_conn_recive_packet(&server);
+      CHECK(check_packet(buff, sizes[i]));
+      if (buff)
+        cmc_buff_free(buff);
+    }
+    CHECK(client.err.err == CMC_ERR_NO && server.err.err == CMC_ERR_NO);
+    cmc_conn_close(&server);
+    cmc_conn_close(&client);
+    CHECK(!client.encrypt_ctx && !client.decrypt_ctx);
+  }
+}
+
+// bytes waiting in the socket without reading them
+static size_t pending_bytes(int fd) {
+  uint8_t bytes[4096];
+  ssize_t n = recv(fd, bytes, sizeof(bytes), MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 ? n : 0;
+}
+
+static void test_cork(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn writer = cmc_conn_init(47);
+  writer.sockfd = sv[1];
+  writer.state = CMC_CONN_STATE_PLAY;
+  cmc_conn reader = cmc_conn_init(47);
+  reader.sockfd = sv[0];
+  reader.state = CMC_CONN_STATE_PLAY;
+
+  // 10 byte frames, held back until 100 bytes are queued
+  cmc_conn_cork(&writer, 100, 0);
+  cmc_buff *buff = make_packet(2);
+  for (int i = 0; i < 9; i++)
+    cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 0);
+  CHECK(writer.tx.end - writer.tx.start == 90);
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 100);
+  CHECK(writer.tx.start == writer.tx.end);
+
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 100);
+  CHECK(cmc_conn_flush(&writer) == CMC_ERR_NO);
+  CHECK(pending_bytes(sv[0]) == 110);
+
+  // a send after the delay takes the older packets with it
+  cmc_conn_cork(&writer, 0, 1);
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 110);
+  usleep(2000);
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 130);
+
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(cmc_conn_uncork(&writer) == CMC_ERR_NO);
+  cmc_conn_send_packet(&writer, buff);
+  CHECK(pending_bytes(sv[0]) == 150);
+  cmc_buff_free(buff);
+
+  for (int i = 0; i < 15; i++) {
+    cmc_buff *packet = cmc_conn_recive_packet(&reader);
+    CHECK(check_packet(packet, 2));
+    if (packet)
+      cmc_buff_free(packet);
+  }
+  cmc_conn_close(&writer);
+  cmc_conn_close(&reader);
+}
+
+// a packet that can't be encoded fails the send and nothing goes out
+static void test_send_errors(void) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  cmc_conn conn = cmc_conn_init(765);
+  conn.sockfd = sv[1];
+
+  C2S_login_start_packet login_start = {.name = "\xff"};
+  CHECK(cmc_send_C2S_login_start_packet(&conn, &login_start) ==
+        CMC_ERR_INVALID_STRING);
+  CHECK(conn.err.err == CMC_ERR_INVALID_STRING);
+
+  conn.err = (cmc_err_extra){};
+  conn.protocol_version = 1;
+  C2S_play_keep_alive_packet keep_alive = {.keep_alive_id_long = 1};
+  CHECK(cmc_send_C2S_play_keep_alive_packet(&conn, &keep_alive) ==
+        CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+  CHECK(conn.err.err == CMC_ERR_UNSUPPORTED_PROTOCOL_VERSION);
+  CHECK(pending_bytes(sv[0]) == 0);
+
+  conn.protocol_version = 765;
+  close(sv[0]);
+  cmc_conn_close(&conn);
+}
+
+int main() {
+  test_batched();
+  test_split();
+  test_large();
+  test_invalid_length();
+  test_limits();
+  test_compression_params();
+  test_want_packet();
+  test_auto_keep_alive();
+  test_latency_stats();
+  test_encryption();
+  test_cork();
+  test_send_errors();
+  if (!failed)
+    printf("all conn tests passed\n");
+  return failed;
+}
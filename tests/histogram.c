@@ -0,0 +1,96 @@
+#include <cmc/histogram.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+// whether value is within the precision of the histogram of expected
+static bool close_to(uint64_t value, uint64_t expected) {
+  uint64_t diff = value > expected ? value - expected : expected - value;
+  return diff <= expected / CMC_HISTOGRAM_SUB_BUCKETS;
+}
+
+static void test_empty() {
+  cmc_histogram histogram = {};
+  CHECK(cmc_histogram_count(&histogram) == 0);
+  CHECK(cmc_histogram_mean(&histogram) == 0);
+  CHECK(cmc_histogram_max(&histogram) == 0);
+  CHECK(cmc_histogram_percentile(&histogram, 50) == 0);
+}
+
+static void test_small_values() {
+  // below CMC_HISTOGRAM_SUB_BUCKETS * 2 every value has its own bucket
+  cmc_histogram histogram = {};
+  for (uint64_t i = 1; i <= 2 * CMC_HISTOGRAM_SUB_BUCKETS; i++)
+    cmc_histogram_record(&histogram, i);
+  CHECK(cmc_histogram_count(&histogram) == 2 * CMC_HISTOGRAM_SUB_BUCKETS);
+  CHECK(cmc_histogram_percentile(&histogram, 0) == 1);
+  CHECK(cmc_histogram_percentile(&histogram, 50) == CMC_HISTOGRAM_SUB_BUCKETS);
+  CHECK(cmc_histogram_percentile(&histogram, 100) ==
+        2 * CMC_HISTOGRAM_SUB_BUCKETS);
+  CHECK(cmc_histogram_max(&histogram) == 2 * CMC_HISTOGRAM_SUB_BUCKETS);
+}
+
+static void test_percentiles() {
+  // 1 to 1000000 once each, percentiles are known exactly
+  enum { VALUES = 1000000 };
+  cmc_histogram *histogram = calloc(1, sizeof(cmc_histogram));
+  for (uint64_t i = VALUES; i >= 1; i--)
+    cmc_histogram_record(histogram, i);
+  CHECK(cmc_histogram_count(histogram) == VALUES);
+  CHECK(cmc_histogram_mean(histogram) == (VALUES + 1) / 2);
+  CHECK(cmc_histogram_max(histogram) == VALUES);
+  double percentiles[] = {1, 10, 50, 90, 99, 99.9, 99.99};
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+    uint64_t expected = percentiles[i] / 100 * VALUES;
+    uint64_t value = cmc_histogram_percentile(histogram, percentiles[i]);
+    CHECK(close_to(value, expected));
+    // rounded up, never down
+    CHECK(value >= expected);
+  }
+  CHECK(cmc_histogram_percentile(histogram, 100) == VALUES);
+
+  cmc_histogram *copy = malloc(sizeof(cmc_histogram));
+  cmc_histogram_copy(copy, histogram);
+  CHECK(cmc_histogram_count(copy) == VALUES);
+  CHECK(cmc_histogram_percentile(copy, 99) ==
+        cmc_histogram_percentile(histogram, 99));
+  cmc_histogram_reset(histogram);
+  CHECK(cmc_histogram_count(histogram) == 0);
+  CHECK(cmc_histogram_percentile(histogram, 99) == 0);
+  free(copy);
+  free(histogram);
+}
+
+static void test_range() {
+  cmc_histogram histogram = {};
+  // every power of two and its neighbours, up to past the max
+  for (int bits = 0; bits < 64; bits++) {
+    uint64_t value = UINT64_C(1) << bits;
+    cmc_histogram_reset(&histogram);
+    cmc_histogram_record(&histogram, value - 1);
+    cmc_histogram_record(&histogram, value);
+    cmc_histogram_record(&histogram, value + 1);
+    if (value < CMC_HISTOGRAM_MAX_VALUE) {
+      CHECK(close_to(cmc_histogram_percentile(&histogram, 50), value));
+    } else {
+      // cut to the last bucket, the max is still exact
+      CHECK(cmc_histogram_percentile(&histogram, 50) >=
+            CMC_HISTOGRAM_MAX_VALUE - CMC_HISTOGRAM_MAX_VALUE / 16);
+    }
+    CHECK(cmc_histogram_max(&histogram) == value + 1);
+  }
+}
+
+int main() {
+  test_empty();
+  test_small_values();
+  test_percentiles();
+  test_range();
+  if (!failed)
+    printf("all histogram tests passed\n");
+  return failed;
+}
@@ -0,0 +1,431 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/loop.h>
+#include <cmc/timer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+// the uncompressed frame of make_packet(n)
+static cmc_buff *make_frame(int n) {
+  cmc_buff *frame = cmc_buff_init(47);
+  cmc_buff_pack_varint(frame, 1 + 4 * n);
+  cmc_buff_pack_varint(frame, 0x42);
+  for (int i = 0; i < n; i++)
+    cmc_buff_pack_int(frame, i);
+  return frame;
+}
+
+typedef struct {
+  int connects; // on_connect calls
+  int packets;  // packets received on the connection
+  int size;     // ints every packet is expected to have
+  bool bad;     // a packet did not match
+  bool closed;  // on_close was called
+  bool echo;    // send every packet back
+} conn_state;
+
+static void on_packet(cmc_loop *loop, cmc_conn *conn, cmc_buff *packet) {
+  (void)loop;
+  conn_state *state = conn->user_data;
+  size_t start = packet->position;
+  if (!check_packet(packet, state->size))
+    state->bad = true;
+  state->packets++;
+  if (state->echo) {
+    packet->position = start;
+    cmc_conn_send_packet(conn, packet);
+  }
+  cmc_buff_free(packet);
+}
+
+static void on_close(cmc_loop *loop, cmc_conn *conn) {
+  (void)loop;
+  conn_state *state = conn->user_data;
+  state->closed = true;
+}
+
+static void on_connect(cmc_loop *loop, cmc_conn *conn) {
+  (void)loop;
+  conn_state *state = conn->user_data;
+  state->connects++;
+}
+
+static const cmc_loop_callbacks callbacks = {
+    .on_packet = on_packet, .on_close = on_close, .on_connect = on_connect};
+
+static void test_many(cmc_loop_backend backend) {
+  enum { CONNS = 16, PACKETS = 50 };
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conns[CONNS];
+  conn_state states[CONNS] = {};
+  cmc_conn peers[CONNS];
+  for (int i = 0; i < CONNS; i++) {
+    connected(&conns[i], &peers[i], 47, -1);
+    states[i].size = i;
+    conns[i].user_data = &states[i];
+    CHECK(cmc_loop_add(loop, &conns[i]) == CMC_ERR_NO);
+  }
+  CHECK(cmc_loop_conn_count(loop) == CONNS);
+
+  // every connection gets its packets one byte at a time, interleaved
+  cmc_buff *frames[CONNS];
+  for (int i = 0; i < CONNS; i++) {
+    frames[i] = cmc_buff_init(47);
+    for (int j = 0; j < PACKETS; j++) {
+      cmc_buff *frame = make_frame(i);
+      cmc_buff_pack(frames[i], frame->data, frame->length);
+      cmc_buff_free(frame);
+    }
+  }
+  for (size_t offset = 0; offset < frames[CONNS - 1]->length; offset++) {
+    for (int i = 0; i < CONNS; i++)
+      if (offset < frames[i]->length)
+        write(peers[i].sockfd, frames[i]->data + offset, 1);
+    if (offset % 7 == 0)
+      cmc_loop_run_once(loop, 0);
+  }
+  while (cmc_loop_run_once(loop, 0) > 0)
+    ;
+
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].packets == PACKETS);
+    CHECK(!states[i].bad);
+    CHECK(!states[i].closed);
+    CHECK(conns[i].rx.start == conns[i].rx.end);
+    cmc_buff_free(frames[i]);
+  }
+
+  // closing the peers closes the connections
+  for (int i = 0; i < CONNS; i++)
+    cmc_conn_close(&peers[i]);
+  while (cmc_loop_conn_count(loop) > 0)
+    cmc_loop_run_once(loop, 1000);
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].closed);
+    CHECK(conns[i].err.err == CMC_ERR_RECV);
+    CHECK(conns[i].loop == NULL);
+    cmc_conn_close(&conns[i]);
+  }
+  cmc_loop_free(loop);
+}
+
+static void test_echo(cmc_loop_backend backend, bool encrypted) {
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {.size = 10, .echo = true};
+  conn.user_data = &state;
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+
+  if (encrypted) {
+    const uint8_t secret[CMC_CONN_SHARED_SECRET_LENGTH] = {1, 2, 3, 4, 5};
+    CHECK(cmc_conn_enable_encryption(&conn, secret) == CMC_ERR_NO);
+    CHECK(cmc_conn_enable_encryption(&peer, secret) == CMC_ERR_NO);
+  }
+  for (int i = 0; i < 5; i++) {
+    cmc_buff *buff = make_packet(10);
+    cmc_conn_send_packet(&peer, buff);
+    cmc_buff_free(buff);
+    cmc_loop_run_once(loop, 1000);
+    buff = cmc_conn_recive_packet(&peer);
+    CHECK(check_packet(buff, 10));
+    if (buff)
+      cmc_buff_free(buff);
+  }
+  CHECK(state.packets == 5);
+  CHECK(!state.bad);
+
+  cmc_loop_remove(loop, &conn);
+  CHECK(cmc_loop_conn_count(loop) == 0);
+  CHECK(!state.closed);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+static void test_partial_write(cmc_loop_backend backend) {
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {};
+  conn.user_data = &state;
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+
+  // far more than the socket buffer takes, the rest is queued
+  const int n = 256 * 1024;
+  cmc_buff *buff = make_packet(n);
+  cmc_conn_send_packet(&conn, buff);
+  cmc_buff_free(buff);
+  CHECK(conn.err.err == CMC_ERR_NO);
+  CHECK(conn.tx.end - conn.tx.start > 0);
+
+  CHECK(cmc_conn_set_nonblocking(&peer, true) == CMC_ERR_NO);
+  buff = NULL;
+  for (int i = 0; i < 100000 && !buff && !peer.err.err; i++) {
+    buff = cmc_conn_try_recive_packet(&peer);
+    cmc_loop_run_once(loop, 0);
+  }
+  CHECK(check_packet(buff, n));
+  if (buff)
+    cmc_buff_free(buff);
+  CHECK(conn.tx.start == conn.tx.end);
+
+  cmc_loop_remove(loop, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+static void test_buffered(cmc_loop_backend backend) {
+  // packets read before the connection joined the loop are still delivered
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  for (int i = 0; i < 3; i++) {
+    cmc_buff *frame = make_frame(4);
+    write(peer.sockfd, frame->data, frame->length);
+    cmc_buff_free(frame);
+  }
+  cmc_buff *buff = cmc_conn_recive_packet(&conn);
+  CHECK(check_packet(buff, 4));
+  cmc_buff_free(buff);
+
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  conn_state state = {.size = 4};
+  conn.user_data = &state;
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+  CHECK(cmc_loop_run_once(loop, 0) > 0);
+  CHECK(state.packets == 2);
+  CHECK(!state.bad);
+
+  cmc_loop_remove(loop, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+static void test_connect(cmc_loop_backend backend) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t addr_len = sizeof(addr);
+  bind(listener, (struct sockaddr *)&addr, addr_len);
+  listen(listener, 8);
+  getsockname(listener, (struct sockaddr *)&addr, &addr_len);
+
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn = cmc_conn_init(47);
+  conn_state state = {.size = 3};
+  conn.user_data = &state;
+  CHECK(cmc_loop_connect(loop, &conn, (struct sockaddr *)&addr, addr_len) ==
+        CMC_ERR_NO);
+  conn.state = CMC_CONN_STATE_PLAY;
+  // queued until the connection is up
+  cmc_buff *buff = make_packet(3);
+  cmc_conn_send_packet(&conn, buff);
+  cmc_buff_free(buff);
+  for (int i = 0; i < 100 && !state.connects; i++)
+    cmc_loop_run_once(loop, 100);
+  CHECK(state.connects == 1);
+
+  cmc_conn peer = cmc_conn_init(47);
+  peer.sockfd = accept(listener, NULL, NULL);
+  peer.state = CMC_CONN_STATE_PLAY;
+  for (int i = 0; i < 10; i++)
+    cmc_loop_run_once(loop, 0);
+  buff = cmc_conn_recive_packet(&peer);
+  CHECK(check_packet(buff, 3));
+  buff->position = 0;
+  cmc_conn_send_packet(&peer, buff);
+  cmc_buff_free(buff);
+  for (int i = 0; i < 100 && !state.packets; i++)
+    cmc_loop_run_once(loop, 100);
+  CHECK(state.packets == 1);
+  CHECK(!state.bad);
+  cmc_loop_remove(loop, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+
+  // nothing listens there anymore
+  close(listener);
+  cmc_conn refused = cmc_conn_init(47);
+  conn_state refused_state = {};
+  refused.user_data = &refused_state;
+  CHECK(cmc_loop_connect(loop, &refused, (struct sockaddr *)&addr,
+                         addr_len) == CMC_ERR_NO);
+  for (int i = 0; i < 100 && !refused_state.closed; i++)
+    cmc_loop_run_once(loop, 100);
+  CHECK(refused_state.closed);
+  CHECK(refused_state.connects == 0);
+  CHECK(refused.err.err == CMC_ERR_CONNETING);
+  close(refused.sockfd);
+  cmc_loop_free(loop);
+}
+
+static void test_corked(cmc_loop_backend backend) {
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {.size = 1, .echo = true};
+  conn.user_data = &state;
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+  cmc_conn_cork(&conn, 0, 0);
+
+  // every echo of the batch goes out together after it was handled
+  for (int i = 0; i < 20; i++) {
+    cmc_buff *frame = make_frame(1);
+    write(peer.sockfd, frame->data, frame->length);
+    cmc_buff_free(frame);
+  }
+  for (int i = 0; i < 10 && state.packets < 20; i++)
+    cmc_loop_run_once(loop, 100);
+  CHECK(state.packets == 20);
+  cmc_loop_run_once(loop, 0);
+
+  uint8_t bytes[1024];
+  ssize_t n = recv(peer.sockfd, bytes, sizeof(bytes), MSG_DONTWAIT);
+  CHECK(n == 20 * 6);
+  CHECK(conn.tx.start == conn.tx.end);
+
+  cmc_loop_remove(loop, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+enum { QUEUED_PACKETS = 500 };
+
+static void *queue_packets(void *arg) {
+  cmc_conn *conn = arg;
+  for (int i = 0; i < QUEUED_PACKETS; i++) {
+    cmc_buff *buff = make_packet(3);
+    while (!cmc_conn_queue_packet(conn, buff))
+      sched_yield();
+  }
+  return NULL;
+}
+
+static void test_queued(cmc_loop_backend backend) {
+  enum { THREADS = 2 };
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {};
+  conn.user_data = &state;
+  CHECK(cmc_conn_enable_send_queue(&conn, 16) == CMC_ERR_NO);
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+  cmc_conn_set_nonblocking(&peer, true);
+
+  pthread_t threads[THREADS];
+  for (int i = 0; i < THREADS; i++)
+    pthread_create(&threads[i], NULL, queue_packets, &conn);
+  // nothing but the queued packets wakes the loop up
+  int received = 0;
+  while (received < THREADS * QUEUED_PACKETS && !state.closed) {
+    cmc_loop_run_once(loop, -1);
+    cmc_buff *buff;
+    while ((buff = cmc_conn_try_recive_packet(&peer))) {
+      CHECK(check_packet(buff, 3));
+      cmc_buff_free(buff);
+      received++;
+    }
+  }
+  for (int i = 0; i < THREADS; i++)
+    pthread_join(threads[i], NULL);
+  CHECK(received == THREADS * QUEUED_PACKETS);
+  CHECK(!state.closed);
+
+  cmc_loop_remove(loop, &conn);
+  CHECK(conn.send_wake_fd == -1);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+typedef struct {
+  int peer_fd;
+  int sent;
+} feeder;
+
+// writes a packet from the peer every time it fires, 5 times
+static void feed(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  feeder *f = timer->user_data;
+  cmc_buff *frame = make_frame(1);
+  write(f->peer_fd, frame->data, frame->length);
+  cmc_buff_free(frame);
+  if (++f->sent == 5)
+    cmc_timer_cancel(wheel, timer);
+}
+
+static void test_timers(cmc_loop_backend backend) {
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {.size = 1};
+  conn.user_data = &state;
+  CHECK(cmc_loop_add(loop, &conn) == CMC_ERR_NO);
+  cmc_loop_set_read_timeout(loop, &conn, 60);
+
+  // a packet every 20 ms keeps the connection open past its timeout
+  feeder f = {.peer_fd = peer.sockfd};
+  cmc_timer timer;
+  cmc_timer_init(&timer, feed, &f);
+  cmc_timer_arm(cmc_loop_get_timers(loop), &timer, 20, 20);
+  uint64_t start = cmc_timer_now_ms();
+  // nothing but the timers wakes the loop up
+  while (!state.closed && cmc_timer_now_ms() - start < 2000)
+    cmc_loop_run_once(loop, -1);
+  uint64_t elapsed = cmc_timer_now_ms() - start;
+  CHECK(state.closed);
+  CHECK(state.packets == 5);
+  CHECK(!state.bad);
+  CHECK(conn.err.err == CMC_ERR_TIMEOUT);
+  // the last packet came after 100 ms, the clocks are read a bit apart
+  CHECK(elapsed >= 150 && elapsed < 1000);
+  CHECK(!cmc_timer_armed(&timer));
+  CHECK(cmc_timer_wheel_count(cmc_loop_get_timers(loop)) == 0);
+
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_loop_free(loop);
+}
+
+static void test_backend(cmc_loop_backend backend) {
+  cmc_loop *loop = cmc_loop_init_with_backend(callbacks, backend);
+  if (!loop) {
+    printf("skipping the %s backend, not available\n",
+           cmc_loop_backend_string(backend));
+    return;
+  }
+  CHECK(cmc_loop_get_backend(loop) == backend);
+  cmc_loop_free(loop);
+  test_many(backend);
+  test_echo(backend, false);
+  test_echo(backend, true);
+  test_partial_write(backend);
+  test_buffered(backend);
+  test_connect(backend);
+  test_corked(backend);
+  test_queued(backend);
+  test_timers(backend);
+}
+
+int main() {
+  test_backend(CMC_LOOP_BACKEND_EPOLL);
+  test_backend(CMC_LOOP_BACKEND_IO_URING);
+  if (!failed)
+    printf("all loop tests passed\n");
+  return failed;
+}
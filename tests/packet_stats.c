@@ -0,0 +1,137 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/packet_stats.h>
+#include <cmc/packets.h>
+
+#include <sys/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+// the client answers keep alives by hand, decoding and encoding every one
+static void answer_keep_alives(cmc_conn *client, cmc_conn *server, int count) {
+  for (int i = 0; i < count; i++) {
+    S2C_play_keep_alive_packet keep_alive = {.keep_alive_id_long = i};
+    cmc_send_S2C_play_keep_alive_packet(server, &keep_alive);
+  }
+  for (int i = 0; i < count; i++) {
+    cmc_buff *buff = cmc_conn_recive_packet(client);
+    CHECK(buff && cmc_buff_unpack_varint(buff) == 0x24);
+    if (!buff)
+      continue;
+    S2C_play_keep_alive_packet keep_alive =
+        unpack_S2C_play_keep_alive_packet(buff);
+    CHECK(buff->err.err == CMC_ERR_NO);
+    C2S_play_keep_alive_packet reply = {.keep_alive_id_long =
+                                            keep_alive.keep_alive_id_long};
+    cmc_send_C2S_play_keep_alive_packet(client, &reply);
+    cmc_buff_free(buff);
+  }
+}
+
+static void test_counts() {
+  cmc_conn client, server;
+  connected(&client, &server, 765, -1);
+
+  // nothing is counted while off
+  CHECK(!cmc_packet_stats_enabled());
+  answer_keep_alives(&client, &server, 2);
+  cmc_packet_stats received =
+      cmc_packet_stats_get(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID);
+  CHECK(received.received == 0 && received.decoded == 0);
+
+  cmc_packet_stats_enable(true);
+  CHECK(cmc_packet_stats_enabled());
+  answer_keep_alives(&client, &server, 3);
+  received = cmc_packet_stats_get(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID);
+  CHECK(received.received == 3);
+  // the packet id and a long, behind a one byte length
+  CHECK(received.received_data_bytes == 3 * 9);
+  CHECK(received.received_bytes == 3 * 10);
+  CHECK(received.decoded == 3);
+  CHECK(received.decode_cycles > 0);
+  cmc_packet_stats sent =
+      cmc_packet_stats_get(CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID);
+  CHECK(sent.sent == 3);
+  CHECK(sent.sent_data_bytes == 3 * 9);
+  CHECK(sent.sent_bytes == 3 * 10);
+  CHECK(sent.encoded == 3);
+  CHECK(sent.encode_cycles > 0);
+  CHECK(sent.received == 0 && sent.decoded == 0);
+
+  // ids without a name, like the ones the stand-in server sent as a client
+  cmc_packet_stats_reset();
+  CHECK(cmc_packet_stats_get(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID).received == 0);
+  cmc_buff *buff = cmc_buff_init(765);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x7F);
+  cmc_conn_send_packet(&client, buff);
+  cmc_buff_free(buff);
+  CHECK(cmc_packet_stats_get(CMC_UNKOWN_NAME_ID).sent == 1);
+
+  cmc_packet_stats_reset();
+  CHECK(cmc_packet_stats_get(CMC_UNKOWN_NAME_ID).sent == 0);
+  cmc_packet_stats_enable(false);
+  cmc_conn_close(&client);
+  cmc_conn_close(&server);
+}
+
+static void test_compressed() {
+  cmc_conn client, server;
+  connected(&client, &server, 765, 0);
+  cmc_packet_stats_enable(true);
+  answer_keep_alives(&client, &server, 4);
+  cmc_packet_stats received =
+      cmc_packet_stats_get(CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID);
+  CHECK(received.received == 4);
+  CHECK(received.received_data_bytes == 4 * 9);
+  // the deflate stream and the data length on top
+  CHECK(received.received_bytes > received.received_data_bytes);
+  CHECK(cmc_packet_stats_get(CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID).sent == 4);
+  cmc_packet_stats_reset();
+  cmc_packet_stats_enable(false);
+  cmc_conn_close(&client);
+  cmc_conn_close(&server);
+}
+
+static void test_dump() {
+  cmc_conn client, server;
+  connected(&client, &server, 765, -1);
+  cmc_packet_stats_enable(true);
+  answer_keep_alives(&client, &server, 5);
+  cmc_packet_stats_enable(false);
+
+  char *text = NULL;
+  size_t length = 0;
+  FILE *out = open_memstream(&text, &length);
+  cmc_packet_stats_dump(out);
+  fclose(out);
+  CHECK(strncmp(text, "packet", 6) == 0);
+  char *decoded = strstr(text, "CMC_S2C_PLAY_KEEP_ALIVE_NAME_ID");
+  char *encoded = strstr(text, "CMC_C2S_PLAY_KEEP_ALIVE_NAME_ID");
+  CHECK(decoded && encoded);
+  // a row per packet that was counted and nothing else
+  int rows = 0;
+  for (char *c = text; *c; c++)
+    rows += *c == '\n';
+  CHECK(rows >= 3);
+  CHECK(!strstr(text, "CMC_S2C_STATUS_PONG_NAME_ID"));
+  free(text);
+  cmc_packet_stats_reset();
+  cmc_conn_close(&client);
+  cmc_conn_close(&server);
+}
+
+int main() {
+  test_counts();
+  test_compressed();
+  test_dump();
+  if (!failed)
+    printf("all packet_stats tests passed\n");
+  return failed;
+}
@@ -0,0 +1,240 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/loop.h>
+#include <cmc/pipeline.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+static pthread_t main_thread;
+
+typedef struct {
+  int seq;
+  bool bad; // not a make_seq_packet packet
+  bool on_worker;
+  cmc_conn_state state;
+} decoded_packet;
+
+static void *decode(cmc_buff *packet, cmc_conn_state state, void *user_data) {
+  (void)user_data;
+  decoded_packet *decoded = malloc(sizeof(decoded_packet));
+  *decoded = (decoded_packet){
+      .on_worker = !pthread_equal(pthread_self(), main_thread),
+      .state = state};
+  decoded->seq = check_seq_packet(packet);
+  decoded->bad = decoded->seq == -1;
+  return decoded;
+}
+
+typedef struct {
+  int packets;     // in order, seq counts up from 0
+  int on_worker;   // packets decoded by a worker
+  bool bad;        // a packet did not match or came out of order
+  int closes;      // on_close calls
+  int after_close; // packets delivered after on_close
+  bool login;      // the first packet switches to play, like login_success
+} conn_state;
+
+static void on_packet(cmc_pipeline *pipeline, cmc_conn *conn, cmc_buff *packet,
+                      void *decoded) {
+  (void)pipeline;
+  conn_state *state = conn->user_data;
+  decoded_packet *d = decoded;
+  if (!d || d->bad || d->seq != state->packets)
+    state->bad = true;
+  if (d && d->on_worker) {
+    state->on_worker++;
+    // only play packets leave the I/O thread
+    if (d->state != CMC_CONN_STATE_PLAY)
+      state->bad = true;
+  }
+  if (state->closes)
+    state->after_close++;
+  state->packets++;
+  if (state->login)
+    conn->state = CMC_CONN_STATE_PLAY;
+  free(decoded);
+  cmc_buff_free(packet);
+}
+
+static void on_close(cmc_pipeline *pipeline, cmc_conn *conn) {
+  (void)pipeline;
+  conn_state *state = conn->user_data;
+  state->closes++;
+}
+
+static const cmc_pipeline_callbacks callbacks = {
+    .decode = decode, .on_packet = on_packet, .on_close = on_close};
+
+static void send_packets(cmc_conn *peer, int first, int count) {
+  for (int seq = first; seq < first + count; seq++) {
+    // every other packet is big enough to be compressed
+    cmc_buff *buff = make_seq_packet(seq, seq % 2 ? 100 : 2);
+    cmc_conn_send_packet(peer, buff);
+    cmc_buff_free(buff);
+  }
+}
+
+static void run_until(cmc_pipeline *pipeline, const conn_state *states,
+                      int conns, int packets) {
+  RUN_UNTIL(cmc_pipeline_run_once, pipeline, states, conns, packets);
+}
+
+static void test_order(cmc_loop_backend backend, size_t workers) {
+  enum { CONNS = 8, PACKETS = 100 };
+  cmc_pipeline *pipeline = cmc_pipeline_init(callbacks, workers, backend);
+  CHECK(cmc_pipeline_worker_count(pipeline) == workers);
+  cmc_conn conns[CONNS], peers[CONNS];
+  conn_state states[CONNS] = {};
+  for (int i = 0; i < CONNS; i++) {
+    connected(&conns[i], &peers[i], 47, 64);
+    conns[i].user_data = &states[i];
+    CHECK(cmc_pipeline_add(pipeline, &conns[i]) == CMC_ERR_NO);
+  }
+  CHECK(cmc_pipeline_conn_count(pipeline) == CONNS);
+
+  // interleaved so the workers get packets of every connection
+  for (int seq = 0; seq < PACKETS; seq += 10) {
+    for (int i = 0; i < CONNS; i++)
+      send_packets(&peers[i], seq, 10);
+    cmc_pipeline_run_once(pipeline, 0);
+  }
+  run_until(pipeline, states, CONNS, PACKETS);
+
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].packets == PACKETS);
+    CHECK(!states[i].bad);
+    CHECK(states[i].on_worker == (workers ? PACKETS : 0));
+    CHECK(states[i].closes == 0);
+  }
+
+  // packets that arrived before the peer closed are delivered first
+  for (int i = 0; i < CONNS; i++) {
+    send_packets(&peers[i], PACKETS, 20);
+    cmc_conn_close(&peers[i]);
+  }
+  for (int round = 0; round < 1000 && cmc_pipeline_conn_count(pipeline) > 0;
+       round++)
+    cmc_pipeline_run_once(pipeline, 10);
+  CHECK(cmc_pipeline_conn_count(pipeline) == 0);
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].packets == PACKETS + 20);
+    CHECK(!states[i].bad);
+    CHECK(states[i].closes == 1);
+    CHECK(states[i].after_close == 0);
+    CHECK(conns[i].err.err == CMC_ERR_RECV);
+    CHECK(conns[i].pipeline_conn == NULL);
+    cmc_conn_close(&conns[i]);
+  }
+  cmc_pipeline_free(pipeline);
+}
+
+static void test_login(cmc_loop_backend backend) {
+  cmc_pipeline *pipeline = cmc_pipeline_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, 0);
+  conn.state = CMC_CONN_STATE_LOGIN;
+  conn_state state = {.login = true};
+  conn.user_data = &state;
+  CHECK(cmc_pipeline_add(pipeline, &conn) == CMC_ERR_NO);
+
+  // all in one read, the first one still has to be handled inline
+  send_packets(&peer, 0, 10);
+  run_until(pipeline, &state, 1, 10);
+  CHECK(state.packets == 10);
+  CHECK(!state.bad);
+  CHECK(state.on_worker == 9);
+
+  cmc_pipeline_remove(pipeline, &conn);
+  CHECK(cmc_pipeline_conn_count(pipeline) == 0);
+  CHECK(state.closes == 0);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_pipeline_free(pipeline);
+}
+
+static void test_bad_frame(cmc_loop_backend backend) {
+  cmc_pipeline *pipeline = cmc_pipeline_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, 0);
+  conn_state state = {};
+  conn.user_data = &state;
+  CHECK(cmc_pipeline_add(pipeline, &conn) == CMC_ERR_NO);
+
+  // claims 16 bytes compressed, but isn't zlib, what follows is dropped
+  send_packets(&peer, 0, 5);
+  const uint8_t bad[] = {5, 16, 1, 2, 3, 4};
+  write(peer.sockfd, bad, sizeof(bad));
+  send_packets(&peer, 5, 5);
+  for (int round = 0; round < 1000 && cmc_pipeline_conn_count(pipeline) > 0;
+       round++)
+    cmc_pipeline_run_once(pipeline, 10);
+  CHECK(state.packets == 5);
+  CHECK(!state.bad);
+  CHECK(state.closes == 1);
+  CHECK(conn.err.err == CMC_ERR_ZLIB_INFLATE);
+  CHECK(conn.loop == NULL);
+
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_pipeline_free(pipeline);
+}
+
+static void test_remove(cmc_loop_backend backend) {
+  cmc_pipeline *pipeline = cmc_pipeline_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, 0);
+  conn_state state = {};
+  conn.user_data = &state;
+  CHECK(cmc_pipeline_add(pipeline, &conn) == CMC_ERR_NO);
+
+  // removed while the workers may still have some of them
+  send_packets(&peer, 0, 50);
+  cmc_pipeline_run_once(pipeline, 10);
+  cmc_pipeline_remove(pipeline, &conn);
+  CHECK(cmc_pipeline_conn_count(pipeline) == 0);
+  CHECK(conn.pipeline_conn == NULL);
+  CHECK(!state.bad);
+  CHECK(state.closes == 0);
+  int packets = state.packets;
+  cmc_pipeline_run_once(pipeline, 0);
+  CHECK(state.packets == packets);
+
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_pipeline_free(pipeline);
+}
+
+static void test_backend(cmc_loop_backend backend) {
+  cmc_pipeline *pipeline = cmc_pipeline_init(callbacks, 1, backend);
+  if (!pipeline) {
+    printf("skipping the %s backend, not available\n",
+           cmc_loop_backend_string(backend));
+    return;
+  }
+  cmc_pipeline_free(pipeline);
+  test_order(backend, 0);
+  test_order(backend, 1);
+  test_order(backend, 4);
+  test_login(backend);
+  test_bad_frame(backend);
+  test_remove(backend);
+}
+
+int main() {
+  main_thread = pthread_self();
+  test_backend(CMC_LOOP_BACKEND_EPOLL);
+  test_backend(CMC_LOOP_BACKEND_IO_URING);
+  if (!failed)
+    printf("all pipeline tests passed\n");
+  return failed;
+}
@@ -0,0 +1,117 @@
+#include <cmc/queue.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+// values are 1 based, the queues can't carry null
+#define VALUE(i) ((void *)(uintptr_t)((i) + 1))
+
+static void test_spsc() {
+  cmc_spsc_queue *queue = cmc_spsc_queue_init(5);
+  CHECK(cmc_spsc_queue_capacity(queue) == 8);
+  CHECK(cmc_spsc_queue_empty(queue));
+  CHECK(cmc_spsc_queue_pop(queue) == NULL);
+
+  // a few laps, so the indices wrap around the slots
+  for (int lap = 0; lap < 5; lap++) {
+    for (int i = 0; i < 8; i++)
+      CHECK(cmc_spsc_queue_push(queue, VALUE(i)));
+    CHECK(!cmc_spsc_queue_push(queue, VALUE(8)));
+    CHECK(!cmc_spsc_queue_empty(queue));
+    for (int i = 0; i < 8; i++)
+      CHECK(cmc_spsc_queue_pop(queue) == VALUE(i));
+    CHECK(cmc_spsc_queue_pop(queue) == NULL);
+    CHECK(cmc_spsc_queue_empty(queue));
+  }
+  cmc_spsc_queue_free(queue);
+}
+
+static void test_mpsc() {
+  cmc_mpsc_queue *queue = cmc_mpsc_queue_init(4);
+  CHECK(cmc_mpsc_queue_capacity(queue) == 4);
+  CHECK(cmc_mpsc_queue_pop(queue) == NULL);
+  for (int lap = 0; lap < 5; lap++) {
+    for (int i = 0; i < 4; i++)
+      CHECK(cmc_mpsc_queue_push(queue, VALUE(i)));
+    CHECK(!cmc_mpsc_queue_push(queue, VALUE(4)));
+    for (int i = 0; i < 4; i++)
+      CHECK(cmc_mpsc_queue_pop(queue) == VALUE(i));
+    CHECK(cmc_mpsc_queue_pop(queue) == NULL);
+  }
+  cmc_mpsc_queue_free(queue);
+}
+
+enum { PRODUCERS = 4, PER_PRODUCER = 100000 };
+
+typedef struct {
+  cmc_spsc_queue *spsc;
+  cmc_mpsc_queue *mpsc;
+  int id;
+} producer;
+
+// the producer goes into the high bits, the sequence number into the low ones
+static void *produce(void *arg) {
+  producer *p = arg;
+  for (int i = 0; i < PER_PRODUCER; i++) {
+    void *value = VALUE((uintptr_t)p->id << 32 | i);
+    // yields so a single core gets to the consumer
+    while (p->spsc ? !cmc_spsc_queue_push(p->spsc, value)
+                   : !cmc_mpsc_queue_push(p->mpsc, value))
+      sched_yield();
+  }
+  return NULL;
+}
+
+// every value arrives once and each producers values in order
+static void consume(cmc_spsc_queue *spsc, cmc_mpsc_queue *mpsc,
+                    int producers) {
+  int next[PRODUCERS] = {};
+  for (int received = 0; received < producers * PER_PRODUCER;) {
+    void *value = spsc ? cmc_spsc_queue_pop(spsc) : cmc_mpsc_queue_pop(mpsc);
+    if (!value) {
+      sched_yield();
+      continue;
+    }
+    uintptr_t raw = (uintptr_t)value - 1;
+    int id = raw >> 32;
+    CHECK(id < producers && (int)(raw & 0xFFFFFFFF) == next[id]);
+    if (id < producers)
+      next[id]++;
+    received++;
+  }
+}
+
+static void test_threads(bool multi) {
+  cmc_spsc_queue *spsc = multi ? NULL : cmc_spsc_queue_init(64);
+  cmc_mpsc_queue *mpsc = multi ? cmc_mpsc_queue_init(64) : NULL;
+  int producers = multi ? PRODUCERS : 1;
+  pthread_t threads[PRODUCERS];
+  producer args[PRODUCERS];
+  for (int i = 0; i < producers; i++) {
+    args[i] = (producer){.spsc = spsc, .mpsc = mpsc, .id = i};
+    pthread_create(&threads[i], NULL, produce, &args[i]);
+  }
+  consume(spsc, mpsc, producers);
+  for (int i = 0; i < producers; i++)
+    pthread_join(threads[i], NULL);
+  CHECK(spsc ? cmc_spsc_queue_pop(spsc) == NULL
+             : cmc_mpsc_queue_pop(mpsc) == NULL);
+  cmc_spsc_queue_free(spsc);
+  cmc_mpsc_queue_free(mpsc);
+}
+
+int main() {
+  test_spsc();
+  test_mpsc();
+  test_threads(false);
+  test_threads(true);
+  if (!failed)
+    printf("all queue tests passed\n");
+  return failed;
+}
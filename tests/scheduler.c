@@ -0,0 +1,340 @@
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/loop.h>
+#include <cmc/pool.h>
+#include <cmc/scheduler.h>
+
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+static pthread_t main_thread;
+
+// the make_seq_packet(seq, 1) a handler answers with, from cmc_conn_buff_init
+static cmc_buff *echo_packet(cmc_conn *conn, int seq) {
+  cmc_buff *buff = cmc_conn_buff_init(conn, 64);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x42);
+  cmc_buff_pack_int(buff, seq);
+  cmc_buff_pack_int(buff, 0);
+  return buff;
+}
+
+// written by whichever thread runs the handler
+typedef struct {
+  _Atomic int packets;   // in order, seq counts up from 0
+  _Atomic int on_worker; // packets handled by a worker
+  _Atomic bool bad;      // a packet did not match or came out of order
+  _Atomic bool running;  // a handler is running for the connection
+  bool login;            // the first packet switches to play, like login
+  bool echo;             // sends every packet back with cmc_conn_queue_packet
+  int configure_after;   // switches to configuration after so many, 0 never
+  int closes;            // on_close calls
+  int closed_after;      // packets handled before on_close
+} conn_state;
+
+static void on_packet(cmc_scheduler *scheduler, cmc_conn *conn,
+                      cmc_buff *packet) {
+  (void)scheduler;
+  conn_state *state = conn->user_data;
+  // never two handlers for one connection at the same time
+  if (atomic_exchange(&state->running, true))
+    state->bad = true;
+  int seq = check_seq_packet(packet);
+  if (seq != state->packets)
+    state->bad = true;
+  if (!pthread_equal(pthread_self(), main_thread)) {
+    state->on_worker++;
+    // only play packets leave the I/O thread
+    if (conn->state != CMC_CONN_STATE_PLAY)
+      state->bad = true;
+  }
+  if (state->echo && !cmc_conn_queue_packet(conn, echo_packet(conn, seq)))
+    state->bad = true;
+  if (state->login)
+    conn->state = CMC_CONN_STATE_PLAY;
+  if (state->configure_after == seq + 1)
+    conn->state = CMC_CONN_STATE_CONFIG;
+  cmc_buff_free(packet);
+  state->packets++;
+  atomic_store(&state->running, false);
+}
+
+static void on_close(cmc_scheduler *scheduler, cmc_conn *conn) {
+  (void)scheduler;
+  conn_state *state = conn->user_data;
+  state->closes++;
+  state->closed_after = state->packets;
+}
+
+static const cmc_scheduler_callbacks callbacks = {.on_packet = on_packet,
+                                                  .on_close = on_close};
+
+static void send_packets(cmc_conn *peer, int first, int count) {
+  for (int seq = first; seq < first + count; seq++) {
+    cmc_buff *buff = make_seq_packet(seq, seq % 4);
+    cmc_conn_send_packet(peer, buff);
+    cmc_buff_free(buff);
+  }
+}
+
+static void run_until(cmc_scheduler *scheduler, conn_state *states, int conns,
+                      int packets) {
+  RUN_UNTIL(cmc_scheduler_run_once, scheduler, states, conns, packets);
+}
+
+static void test_order(cmc_loop_backend backend, size_t workers) {
+  // more packets per connection than its queue holds
+  enum { CONNS = 16, PACKETS = 600 };
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, workers, backend);
+  CHECK(cmc_scheduler_worker_count(scheduler) == workers);
+  cmc_conn conns[CONNS], peers[CONNS];
+  conn_state states[CONNS] = {};
+  for (int i = 0; i < CONNS; i++) {
+    connected(&conns[i], &peers[i], 47, -1);
+    conns[i].user_data = &states[i];
+    CHECK(cmc_scheduler_add(scheduler, &conns[i]) == CMC_ERR_NO);
+    CHECK(conns[i].send_queue != NULL);
+  }
+  CHECK(cmc_scheduler_conn_count(scheduler) == CONNS);
+
+  // interleaved so the workers get packets of every connection
+  for (int seq = 0; seq < PACKETS; seq += 100) {
+    for (int i = 0; i < CONNS; i++)
+      send_packets(&peers[i], seq, 100);
+    cmc_scheduler_run_once(scheduler, 0);
+  }
+  run_until(scheduler, states, CONNS, PACKETS);
+
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].packets == PACKETS);
+    CHECK(!states[i].bad);
+    CHECK(states[i].on_worker == (workers ? PACKETS : 0));
+    CHECK(states[i].closes == 0);
+  }
+  cmc_scheduler_stats stats = cmc_scheduler_get_stats(scheduler);
+  CHECK(stats.handled == (workers ? CONNS * PACKETS : 0));
+  CHECK(stats.inline_handled == (workers ? 0 : CONNS * PACKETS));
+  CHECK(workers > 1 || stats.steals == 0);
+
+  // packets that arrived before the peer closed are handled first
+  for (int i = 0; i < CONNS; i++) {
+    send_packets(&peers[i], PACKETS, 20);
+    cmc_conn_close(&peers[i]);
+  }
+  for (int round = 0; round < 1000 && cmc_scheduler_conn_count(scheduler) > 0;
+       round++)
+    cmc_scheduler_run_once(scheduler, 10);
+  CHECK(cmc_scheduler_conn_count(scheduler) == 0);
+  for (int i = 0; i < CONNS; i++) {
+    CHECK(states[i].packets == PACKETS + 20);
+    CHECK(!states[i].bad);
+    CHECK(states[i].closes == 1);
+    CHECK(states[i].closed_after == PACKETS + 20);
+    CHECK(conns[i].err.err == CMC_ERR_RECV);
+    CHECK(conns[i].scheduler_conn == NULL);
+    cmc_conn_close(&conns[i]);
+  }
+  cmc_scheduler_free(scheduler);
+}
+
+static void test_login(cmc_loop_backend backend) {
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn.state = CMC_CONN_STATE_LOGIN;
+  conn_state state = {.login = true};
+  conn.user_data = &state;
+  CHECK(cmc_scheduler_add(scheduler, &conn) == CMC_ERR_NO);
+
+  // all in one read, the first one still has to be handled inline
+  send_packets(&peer, 0, 10);
+  run_until(scheduler, &state, 1, 10);
+  CHECK(state.packets == 10);
+  CHECK(!state.bad);
+  CHECK(state.on_worker == 9);
+  CHECK(cmc_scheduler_get_stats(scheduler).inline_handled == 1);
+
+  cmc_scheduler_remove(scheduler, &conn);
+  CHECK(cmc_scheduler_conn_count(scheduler) == 0);
+  CHECK(state.closes == 0);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_scheduler_free(scheduler);
+}
+
+// a handler on a worker leaves play, what comes after stays on the I/O thread
+static void test_configuration(cmc_loop_backend backend) {
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {.configure_after = 5};
+  conn.user_data = &state;
+  CHECK(cmc_scheduler_add(scheduler, &conn) == CMC_ERR_NO);
+
+  send_packets(&peer, 0, 5);
+  run_until(scheduler, &state, 1, 5);
+  CHECK(state.on_worker == 5);
+  send_packets(&peer, 5, 5);
+  run_until(scheduler, &state, 1, 10);
+  CHECK(state.packets == 10);
+  CHECK(!state.bad);
+  CHECK(state.on_worker == 5);
+  CHECK(cmc_scheduler_get_stats(scheduler).inline_handled == 5);
+
+  cmc_scheduler_remove(scheduler, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_scheduler_free(scheduler);
+}
+
+// handlers on the workers answer through the send queue
+static void test_echo(cmc_loop_backend backend, size_t workers) {
+  enum { PACKETS = 500 };
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, workers, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {.echo = true};
+  conn.user_data = &state;
+  CHECK(cmc_scheduler_add(scheduler, &conn) == CMC_ERR_NO);
+
+  // small writes, in chunks so they fit into the socket buffers
+  cmc_conn_set_nonblocking(&peer, true);
+  int received = 0;
+  for (int round = 0; round < 1000 && received < PACKETS; round++) {
+    if (round * 50 < PACKETS)
+      send_packets(&peer, round * 50, 50);
+    cmc_scheduler_run_once(scheduler, 10);
+    cmc_buff *buff;
+    while ((buff = cmc_conn_try_recive_packet(&peer))) {
+      CHECK(check_seq_packet(buff) == received);
+      cmc_buff_free(buff);
+      received++;
+    }
+  }
+  CHECK(received == PACKETS);
+  CHECK(!state.bad);
+  CHECK(state.closes == 0);
+
+  cmc_scheduler_remove(scheduler, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_scheduler_free(scheduler);
+}
+
+// received packets are freed on workers and echoes on the I/O thread, so a
+// connection with a pool loses it
+static void test_pool(cmc_loop_backend backend) {
+  enum { PACKETS = 500 };
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, 3, backend);
+  cmc_buff_pool *pool = cmc_buff_pool_init(16);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn.pool = pool;
+  conn_state state = {.echo = true};
+  conn.user_data = &state;
+  CHECK(cmc_scheduler_add(scheduler, &conn) == CMC_ERR_NO);
+  CHECK(conn.pool == NULL);
+
+  cmc_conn_set_nonblocking(&peer, true);
+  int received = 0;
+  for (int round = 0; round < 1000 && received < PACKETS; round++) {
+    if (round * 50 < PACKETS)
+      send_packets(&peer, round * 50, 50);
+    cmc_scheduler_run_once(scheduler, 10);
+    cmc_buff *buff;
+    while ((buff = cmc_conn_try_recive_packet(&peer))) {
+      CHECK(check_seq_packet(buff) == received);
+      cmc_buff_free(buff);
+      received++;
+    }
+  }
+  CHECK(received == PACKETS);
+  CHECK(!state.bad);
+  CHECK(state.on_worker == PACKETS);
+  CHECK(pool->stats.hits + pool->stats.misses == 0);
+
+  cmc_scheduler_remove(scheduler, &conn);
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_scheduler_free(scheduler);
+  cmc_buff_pool_free(pool);
+}
+
+static void test_remove(cmc_loop_backend backend) {
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, 2, backend);
+  cmc_conn conn, peer;
+  connected(&conn, &peer, 47, -1);
+  conn_state state = {};
+  conn.user_data = &state;
+  CHECK(cmc_scheduler_add(scheduler, &conn) == CMC_ERR_NO);
+
+  // removed while the workers may still have some of them
+  for (int seq = 0; seq < 500; seq += 100) {
+    send_packets(&peer, seq, 100);
+    cmc_scheduler_run_once(scheduler, 0);
+  }
+  cmc_scheduler_remove(scheduler, &conn);
+  CHECK(cmc_scheduler_conn_count(scheduler) == 0);
+  CHECK(conn.scheduler_conn == NULL);
+  CHECK(!state.bad);
+  CHECK(state.closes == 0);
+  int packets = state.packets;
+  cmc_scheduler_run_once(scheduler, 0);
+  CHECK(state.packets == packets);
+
+  // freeing removes the rest the same way
+  cmc_conn other, other_peer;
+  connected(&other, &other_peer, 47, -1);
+  conn_state other_state = {};
+  other.user_data = &other_state;
+  CHECK(cmc_scheduler_add(scheduler, &other) == CMC_ERR_NO);
+  for (int seq = 0; seq < 500; seq += 100) {
+    send_packets(&other_peer, seq, 100);
+    cmc_scheduler_run_once(scheduler, 0);
+  }
+  cmc_scheduler_free(scheduler);
+  CHECK(other.scheduler_conn == NULL);
+  CHECK(!other_state.bad);
+  CHECK(other_state.closes == 0);
+
+  cmc_conn_close(&conn);
+  cmc_conn_close(&peer);
+  cmc_conn_close(&other);
+  cmc_conn_close(&other_peer);
+}
+
+static void test_backend(cmc_loop_backend backend) {
+  cmc_scheduler *scheduler = cmc_scheduler_init(callbacks, 1, backend);
+  if (!scheduler) {
+    printf("skipping the %s backend, not available\n",
+           cmc_loop_backend_string(backend));
+    return;
+  }
+  cmc_scheduler_free(scheduler);
+  test_order(backend, 0);
+  test_order(backend, 1);
+  test_order(backend, 4);
+  test_login(backend);
+  test_configuration(backend);
+  test_echo(backend, 0);
+  test_echo(backend, 3);
+  test_pool(backend);
+  test_remove(backend);
+}
+
+int main() {
+  main_thread = pthread_self();
+  test_backend(CMC_LOOP_BACKEND_EPOLL);
+  test_backend(CMC_LOOP_BACKEND_IO_URING);
+  if (!failed)
+    printf("all scheduler tests passed\n");
+  return failed;
+}
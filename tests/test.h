@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cmc/buff.h>
+#include <cmc/conn.h>
+#include <cmc/err.h>
+#include <cmc/protocol.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+What the tests have in common. Every test is a program of its own that
+includes this once, main returns failed.
+*/
+
+static int failed = 0;
+
+#define CHECK(cond)                                                            \
+  if (!(cond)) {                                                               \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);            \
+    failed = 1;                                                                \
+  }
+
+// a packet with id 0x42 and n ints counting up from 0
+static inline cmc_buff *make_packet(int n) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x42);
+  for (int i = 0; i < n; i++)
+    cmc_buff_pack_int(buff, i);
+  return buff;
+}
+
+static inline bool check_packet(cmc_buff *buff, int n) {
+  if (!buff || cmc_buff_unpack_varint(buff) != 0x42)
+    return false;
+  for (int i = 0; i < n; i++)
+    if (cmc_buff_unpack_int(buff) != i)
+      return false;
+  return buff->position == buff->length && buff->err.err == CMC_ERR_NO;
+}
+
+// id 0x42, a sequence number and n ints counting up from 0
+static inline cmc_buff *make_seq_packet(int seq, int n) {
+  cmc_buff *buff = cmc_buff_init(47);
+  cmc_buff_reserve_headroom(buff, CMC_CONN_PACKET_HEADROOM);
+  cmc_buff_pack_varint(buff, 0x42);
+  cmc_buff_pack_int(buff, seq);
+  for (int i = 0; i < n; i++)
+    cmc_buff_pack_int(buff, i);
+  return buff;
+}
+
+// the sequence number or -1 if it isn't a make_seq_packet packet
+static inline int check_seq_packet(cmc_buff *packet) {
+  if (cmc_buff_unpack_varint(packet) != 0x42)
+    return -1;
+  int seq = cmc_buff_unpack_int(packet);
+  for (int i = 0; packet->position < packet->length; i++)
+    if (cmc_buff_unpack_int(packet) != i)
+      return -1;
+  return packet->err.err == CMC_ERR_NO ? seq : -1;
+}
+
+// a connection in play on one end of a socketpair and the peer on the other
+static inline void connected(cmc_conn *conn, cmc_conn *peer,
+                             cmc_protocol_version protocol_version,
+                             ssize_t compression_threshold) {
+  int sv[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+  *conn = cmc_conn_init(protocol_version);
+  conn->sockfd = sv[0];
+  conn->state = CMC_CONN_STATE_PLAY;
+  conn->compression_threshold = compression_threshold;
+  *peer = cmc_conn_init(protocol_version);
+  peer->sockfd = sv[1];
+  peer->state = CMC_CONN_STATE_PLAY;
+  peer->compression_threshold = compression_threshold;
+}
+
+/*
+Calls run_once(runner, 10) until the first conns entries of states, structs
+with a packets field, all counted packets. Gives up after 1000 rounds.
+*/
+#define RUN_UNTIL(run_once, runner, states, conns, count)                      \
+  for (int round = 0; round < 1000; round++) {                                 \
+    bool done = true;                                                          \
+    for (int i = 0; i < (conns); i++)                                          \
+      done &= (states)[i].packets == (count);                                  \
+    if (done)                                                                  \
+      break;                                                                   \
+    run_once(runner, 10);                                                      \
+  }
@@ -0,0 +1,183 @@
+#include <cmc/timer.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+typedef struct {
+  cmc_timer timer;
+  uint64_t due;     // when it should fire next
+  uint64_t fired;   // when it fired last, cmc_timer_wheel_now in the callback
+  int fire_count;
+  cmc_timer *cancel; // cancelled by the callback
+  uint64_t rearm;    // delay the callback arms the timer again with
+} test_timer;
+
+static uint64_t last_fired;
+static bool out_of_order;
+
+static void on_timer(cmc_timer_wheel *wheel, cmc_timer *timer) {
+  test_timer *t = timer->user_data;
+  t->fired = cmc_timer_wheel_now(wheel);
+  t->fire_count++;
+  if (t->fired < last_fired)
+    out_of_order = true;
+  last_fired = t->fired;
+  if (t->cancel)
+    cmc_timer_cancel(wheel, t->cancel);
+  if (t->rearm) {
+    t->due = t->fired + t->rearm;
+    cmc_timer_arm(wheel, timer, t->rearm, 0);
+  }
+}
+
+static void arm(cmc_timer_wheel *wheel, test_timer *t, uint64_t delay,
+                uint64_t interval) {
+  cmc_timer_init(&t->timer, on_timer, t);
+  t->due = cmc_timer_wheel_now(wheel) + delay;
+  cmc_timer_arm(wheel, &t->timer, delay, interval);
+}
+
+// delays on every level, each fires exactly when it is due
+static void test_levels() {
+  enum { TIMERS = 5000 };
+  // not 0, so the first levels start out of line
+  uint64_t start = 1000003;
+  cmc_timer_wheel *wheel = cmc_timer_wheel_init(start);
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == UINT64_MAX);
+  test_timer *timers = calloc(TIMERS, sizeof(test_timer));
+  srand(7);
+  uint64_t last_due = 0;
+  for (int i = 0; i < TIMERS; i++) {
+    // a random number of bits, so every level gets some
+    int bits = 1 + rand() % 28;
+    uint64_t delay = 1 + ((uint64_t)rand() * RAND_MAX + rand()) % (1 << bits);
+    arm(wheel, &timers[i], delay, 0);
+    if (timers[i].due > last_due)
+      last_due = timers[i].due;
+  }
+  CHECK(cmc_timer_wheel_count(wheel) == TIMERS);
+
+  // uneven steps, some of them far
+  last_fired = 0;
+  out_of_order = false;
+  uint64_t now = start;
+  size_t fired = 0;
+  while (now < last_due) {
+    now += 1 + rand() % (rand() % 2 ? 100 : 100000);
+    fired += cmc_timer_wheel_advance(wheel, now);
+    CHECK(cmc_timer_wheel_now(wheel) == now);
+    uint64_t next = cmc_timer_wheel_next_expiry(wheel);
+    CHECK(next > now);
+  }
+  CHECK(fired == TIMERS);
+  CHECK(cmc_timer_wheel_count(wheel) == 0);
+  CHECK(!out_of_order);
+  for (int i = 0; i < TIMERS; i++) {
+    CHECK(timers[i].fire_count == 1);
+    CHECK(timers[i].fired == timers[i].due);
+  }
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == UINT64_MAX);
+  free(timers);
+  cmc_timer_wheel_free(wheel);
+}
+
+static void test_next_expiry() {
+  cmc_timer_wheel *wheel = cmc_timer_wheel_init(0);
+  test_timer near = {}, far = {};
+  arm(wheel, &near, 10, 0);
+  arm(wheel, &far, 100000, 0);
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == 10);
+  CHECK(cmc_timer_wheel_advance(wheel, 10) == 1);
+  // waiting on a higher level, never later than it is due
+  for (int steps = 0; cmc_timer_wheel_count(wheel) > 0; steps++) {
+    uint64_t next = cmc_timer_wheel_next_expiry(wheel);
+    CHECK(next <= far.due);
+    cmc_timer_wheel_advance(wheel, next);
+    CHECK(steps < 10);
+    if (steps >= 10)
+      break;
+  }
+  CHECK(far.fired == 100000);
+
+  // 0 is rounded up to the next tick
+  arm(wheel, &near, 0, 0);
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == 100001);
+  CHECK(cmc_timer_wheel_advance(wheel, 100000) == 0);
+  CHECK(cmc_timer_wheel_advance(wheel, 100001) == 1);
+  cmc_timer_wheel_free(wheel);
+}
+
+static void test_cancel() {
+  enum { TIMERS = 1000 };
+  cmc_timer_wheel *wheel = cmc_timer_wheel_init(0);
+  test_timer timers[TIMERS] = {};
+  for (int i = 0; i < TIMERS; i++)
+    arm(wheel, &timers[i], 1 + i * 37, 0);
+  for (int i = 0; i < TIMERS; i += 2)
+    cmc_timer_cancel(wheel, &timers[i].timer);
+  CHECK(cmc_timer_wheel_count(wheel) == TIMERS / 2);
+  // again does nothing
+  cmc_timer_cancel(wheel, &timers[0].timer);
+  CHECK(cmc_timer_wheel_count(wheel) == TIMERS / 2);
+
+  // moving an armed timer
+  cmc_timer_arm(wheel, &timers[1].timer, 5, 0);
+  timers[1].due = 5;
+  CHECK(cmc_timer_wheel_count(wheel) == TIMERS / 2);
+
+  // one callback cancels a timer due at the same time
+  test_timer a = {}, b = {};
+  arm(wheel, &a, 200, 0);
+  arm(wheel, &b, 200, 0);
+  a.cancel = &b.timer;
+
+  CHECK(cmc_timer_wheel_advance(wheel, 100 * TIMERS) == TIMERS / 2 + 1);
+  for (int i = 0; i < TIMERS; i++) {
+    CHECK(timers[i].fire_count == i % 2);
+    CHECK(!cmc_timer_armed(&timers[i].timer));
+  }
+  CHECK(timers[1].fired == 5);
+  CHECK(a.fire_count == 1 && b.fire_count == 0);
+  CHECK(cmc_timer_wheel_count(wheel) == 0);
+  cmc_timer_wheel_free(wheel);
+}
+
+static void test_periodic() {
+  cmc_timer_wheel *wheel = cmc_timer_wheel_init(0);
+  test_timer t = {};
+  arm(wheel, &t, 50, 50);
+  for (uint64_t now = 1; now <= 1000; now++)
+    cmc_timer_wheel_advance(wheel, now);
+  CHECK(t.fire_count == 20);
+  CHECK(t.fired == 1000);
+  CHECK(cmc_timer_armed(&t.timer));
+
+  // missed expiries are skipped, the phase stays
+  CHECK(cmc_timer_wheel_advance(wheel, 1234) == 1);
+  CHECK(t.fire_count == 21);
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == 1250);
+  cmc_timer_cancel(wheel, &t.timer);
+  CHECK(cmc_timer_wheel_count(wheel) == 0);
+
+  // rearming from the callback counts from when the timer was due
+  test_timer chain = {.rearm = 30};
+  arm(wheel, &chain, 30, 0);
+  CHECK(cmc_timer_wheel_advance(wheel, 1234 + 300) == 10);
+  CHECK(chain.fired == 1234 + 300);
+  CHECK(cmc_timer_wheel_next_expiry(wheel) == 1234 + 330);
+  cmc_timer_cancel(wheel, &chain.timer);
+  cmc_timer_wheel_free(wheel);
+}
+
+int main() {
+  test_levels();
+  test_next_expiry();
+  test_cancel();
+  test_periodic();
+  if (!failed)
+    printf("all timer tests passed\n");
+  return failed;
+}